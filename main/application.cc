@@ -268,14 +268,13 @@ void Application::ToggleChatState() {
 
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            if (!protocol_->IsAudioChannelOpened()) {
-                SetDeviceState(kDeviceStateConnecting);
-                if (!protocol_->OpenAudioChannel()) {
-                    return;
-                }
-            }
-
-            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            OpenAudioChannel([this]() {
+                SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            });
+        });
+    } else if (device_state_ == kDeviceStateConnecting) {
+        Schedule([this]() {
+            CancelOpenAudioChannel();
         });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
@@ -305,14 +304,9 @@ void Application::StartListening() {
     
     if (device_state_ == kDeviceStateIdle) {
         Schedule([this]() {
-            if (!protocol_->IsAudioChannelOpened()) {
-                SetDeviceState(kDeviceStateConnecting);
-                if (!protocol_->OpenAudioChannel()) {
-                    return;
-                }
-            }
-
-            SetListeningMode(kListeningModeManualStop);
+            OpenAudioChannel([this]() {
+                SetListeningMode(kListeningModeManualStop);
+            });
         });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
@@ -329,7 +323,8 @@ void Application::StopListening() {
         return;
     }
 
-    const std::array<int, 3> valid_states = {
+    const std::array<int, 4> valid_states = {
+        kDeviceStateConnecting,
         kDeviceStateListening,
         kDeviceStateSpeaking,
         kDeviceStateIdle,
@@ -340,7 +335,9 @@ void Application::StopListening() {
     }
 
     Schedule([this]() {
-        if (device_state_ == kDeviceStateListening) {
+        if (device_state_ == kDeviceStateConnecting) {
+            CancelOpenAudioChannel();
+        } else if (device_state_ == kDeviceStateListening) {
             protocol_->SendStopListening();
             SetDeviceState(kDeviceStateIdle);
         }
@@ -369,6 +366,20 @@ void Application::Start() {
     callbacks.on_vad_change = [this](bool speaking) {
         xEventGroupSetBits(event_group_, MAIN_EVENT_VAD_CHANGE);
     };
+    callbacks.on_end_of_speech = [this](int64_t speech_end_time_us) {
+        if (listening_mode_ == kListeningModeRealtime) {
+            return;
+        }
+        speech_end_time_us_ = speech_end_time_us;
+        Schedule([this]() {
+            // If the device misses the end, the server still ends the turn
+            if (device_state_ == kDeviceStateListening && listening_mode_ == kListeningModeAutoStop) {
+                ESP_LOGI(TAG, "End of speech detected on device, stop listening");
+                protocol_->SendStopListening();
+                SetDeviceState(kDeviceStateIdle);
+            }
+        });
+    };
     audio_service_.SetCallbacks(callbacks);
 
     /* Start the clock timer to update the status bar */
@@ -410,17 +421,29 @@ void Application::Start() {
         last_error_message_ = message;
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
-    protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+    protocol_->OnAudioSent([this](bool sent, int64_t send_us) {
+        audio_service_.OnAudioSent(sent, send_us);
+    });
+    protocol_->OnIncomingAudio([this](AudioStreamPacketPtr packet) {
         if (device_state_ == kDeviceStateSpeaking) {
+            int64_t speech_end_time_us = speech_end_time_us_.exchange(0);
+            if (speech_end_time_us != 0) {
+                ESP_LOGI(TAG, "First response audio %lld ms after the end of speech", (esp_timer_get_time() - speech_end_time_us) / 1000);
+            }
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
         }
     });
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
-        board.SetPowerSaveMode(false);
-        if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
-            ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
-                protocol_->server_sample_rate(), codec->output_sample_rate());
-        }
+        // Called by the task opening the channel, runs before OnAudioChannelOpenDone
+        Schedule([this, codec, &board]() {
+            board.SetPowerSaveMode(false);
+            audio_service_.SetFrameDuration(protocol_->frame_duration());
+            audio_service_.EnableUplinkDtx(protocol_->uplink_dtx());
+            if (protocol_->server_sample_rate() != codec->output_sample_rate()) {
+                ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
+                    protocol_->server_sample_rate(), codec->output_sample_rate());
+            }
+        });
     });
     protocol_->OnAudioChannelClosed([this, &board]() {
         board.SetPowerSaveMode(true);
@@ -587,9 +610,15 @@ void Application::MainEventLoop() {
             Alert(Lang::Strings::ERROR, last_error_message_.c_str(), "circle_xmark", Lang::Sounds::OGG_EXCLAMATION);
         }
 
-        if (bits & MAIN_EVENT_SEND_AUDIO) {
+        if (bits & MAIN_EVENT_SEND_AUDIO && audio_channel_opening_) {
+            HoldAudioBacklog();
+        } else if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (!protocol_->SendAudio(std::move(packet))) {
+                // How long the send takes tells how congested the link is
+                int64_t start_time = esp_timer_get_time();
+                bool sent = protocol_->SendAudio(std::move(packet));
+                audio_service_.OnAudioSent(sent, esp_timer_get_time() - start_time);
+                if (!sent) {
                     break;
                 }
             }
@@ -625,29 +654,25 @@ void Application::OnWakeWordDetected() {
     if (device_state_ == kDeviceStateIdle) {
         audio_service_.EncodeWakeWord();
 
-        if (!protocol_->IsAudioChannelOpened()) {
-            SetDeviceState(kDeviceStateConnecting);
-            if (!protocol_->OpenAudioChannel()) {
-                audio_service_.EnableWakeWordDetection(true);
-                return;
-            }
-        }
-
-        auto wake_word = audio_service_.GetLastWakeWord();
-        ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
+        OpenAudioChannel([this]() {
+            auto wake_word = audio_service_.GetLastWakeWord();
+            ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
-        while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
-        }
-        // Set the chat state to wake word detected
-        protocol_->SendWakeWordDetected(wake_word);
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            // Encode and send the wake word data to the server
+            while (auto packet = audio_service_.PopWakeWordPacket()) {
+                protocol_->SendAudio(std::move(packet));
+            }
+            // Set the chat state to wake word detected
+            protocol_->SendWakeWordDetected(wake_word);
+            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
 #else
-        SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
-        // Play the pop up sound to indicate the wake word is detected
-        audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
+            SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+            // Play the pop up sound to indicate the wake word is detected
+            audio_service_.PlaySound(Lang::Sounds::OGG_POPUP);
 #endif
+        }, [this]() {
+            audio_service_.EnableWakeWordDetection(true);
+        });
     } else if (device_state_ == kDeviceStateSpeaking) {
         AbortSpeaking(kAbortReasonWakeWordDetected);
     } else if (device_state_ == kDeviceStateActivating) {
@@ -655,6 +680,149 @@ void Application::OnWakeWordDetected() {
     }
 }
 
+void Application::OpenAudioChannel(std::function<void()> on_ready, std::function<void()> on_failed) {
+    if (!audio_channel_opening_ && protocol_->IsAudioChannelOpened()) {
+        on_ready();
+        return;
+    }
+
+    // The latest request decides what happens once the channel is open
+    on_audio_channel_ready_ = std::move(on_ready);
+    on_audio_channel_failed_ = std::move(on_failed);
+    // An attempt is only shared while the device is still connecting for it. After a cancel or a
+    // network error the device is idle and the running attempt belongs to an older request.
+    bool shared = audio_channel_opening_ && device_state_ == kDeviceStateConnecting;
+    SetDeviceState(kDeviceStateConnecting);
+    if (shared) {
+        return;
+    }
+    audio_channel_generation_++;
+    if (audio_channel_opening_) {
+        // The stale attempt starts a new one for this request if it fails
+        return;
+    }
+    StartOpenAudioChannelTask();
+}
+
+void Application::StartOpenAudioChannelTask() {
+    audio_channel_opening_ = true;
+    audio_channel_attempt_ = audio_channel_generation_;
+    audio_channel_open_time_us_ = esp_timer_get_time();
+    protocol_->PrepareOpenAudioChannel();
+    auto ret = xTaskCreate([](void* arg) {
+        auto app = (Application*)arg;
+        uint32_t generation = app->audio_channel_attempt_;
+        bool opened = app->protocol_->OpenAudioChannel();
+        app->Schedule([app, generation, opened]() {
+            app->OnAudioChannelOpenDone(generation, opened);
+        });
+        vTaskDelete(NULL);
+    }, "audio_channel", AUDIO_CHANNEL_TASK_STACK_SIZE, this, 2, nullptr);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the audio channel task");
+        OnAudioChannelOpenDone(audio_channel_attempt_, false);
+    }
+}
+
+void Application::CancelOpenAudioChannel() {
+    if (!audio_channel_opening_) {
+        return;
+    }
+    ESP_LOGI(TAG, "Cancel opening the audio channel");
+    audio_channel_generation_++;
+    on_audio_channel_ready_ = nullptr;
+    on_audio_channel_failed_ = nullptr;
+    protocol_->CancelOpenAudioChannel();
+    SetDeviceState(kDeviceStateIdle);
+}
+
+void Application::OnAudioChannelOpenDone(uint32_t generation, bool opened) {
+    audio_channel_opening_ = false;
+    if (generation != audio_channel_generation_) {
+        // The attempt was cancelled or has failed before a newer request came in
+        if (device_state_ != kDeviceStateConnecting) {
+            if (opened) {
+                protocol_->CloseAudioChannel();
+            }
+            return;
+        }
+        if (!opened) {
+            StartOpenAudioChannelTask();
+            return;
+        }
+    }
+
+    auto on_ready = std::move(on_audio_channel_ready_);
+    auto on_failed = std::move(on_audio_channel_failed_);
+    on_audio_channel_ready_ = nullptr;
+    on_audio_channel_failed_ = nullptr;
+    if (!opened) {
+        if (on_failed) {
+            on_failed();
+        }
+        // The network error usually set the device idle already, but not every failure reports one
+        if (device_state_ == kDeviceStateConnecting) {
+            SetDeviceState(kDeviceStateIdle);
+        }
+        return;
+    }
+    ESP_LOGI(TAG, "Audio channel opened in %lld ms", (esp_timer_get_time() - audio_channel_open_time_us_) / 1000);
+    if (on_ready && device_state_ == kDeviceStateConnecting) {
+        on_ready();
+    }
+    if (device_state_ == kDeviceStateListening) {
+        SendAudioBacklog();
+    } else {
+        DiscardAudioBacklog();
+    }
+}
+
+void Application::HoldAudioBacklog() {
+    while (auto packet = audio_service_.PopPacketFromSendQueue()) {
+        // Left over from a cancelled attempt
+        if (device_state_ != kDeviceStateConnecting) {
+            continue;
+        }
+        audio_backlog_duration_ms_ += packet->frame_duration;
+        audio_backlog_.push_back(std::move(packet));
+        // The oldest goes first, so what is held stays contiguous with the live audio that follows
+        while (audio_backlog_duration_ms_ > AUDIO_BACKLOG_MAX_DURATION_MS) {
+            int duration = audio_backlog_.front()->frame_duration;
+            audio_backlog_duration_ms_ -= duration;
+            audio_backlog_dropped_ms_ += duration;
+            audio_backlog_.pop_front();
+        }
+    }
+}
+
+void Application::SendAudioBacklog() {
+    // Packets encoded after the last hold come after the backlog
+    HoldAudioBacklog();
+    if (audio_backlog_.empty()) {
+        return;
+    }
+
+    // Not reported to the rate controller, the burst would look like congestion
+    size_t frames = audio_backlog_.size();
+    int64_t start_time = esp_timer_get_time();
+    while (!audio_backlog_.empty()) {
+        if (!protocol_->SendAudio(std::move(audio_backlog_.front()))) {
+            break;
+        }
+        audio_backlog_.pop_front();
+    }
+    int drain_ms = (esp_timer_get_time() - start_time) / 1000;
+    ESP_LOGI(TAG, "Audio backlog: %u frames (%d ms) captured while connecting, sent in %d ms, %d ms dropped",
+        frames - audio_backlog_.size(), audio_backlog_duration_ms_, drain_ms, audio_backlog_dropped_ms_);
+    DiscardAudioBacklog();
+}
+
+void Application::DiscardAudioBacklog() {
+    audio_backlog_.clear();
+    audio_backlog_duration_ms_ = 0;
+    audio_backlog_dropped_ms_ = 0;
+}
+
 void Application::AbortSpeaking(AbortReason reason) {
     ESP_LOGI(TAG, "Abort speaking");
     aborted_ = true;
@@ -690,20 +858,29 @@ void Application::SetDeviceState(DeviceState state) {
             display->SetEmotion("neutral");
             audio_service_.EnableVoiceProcessing(false);
             audio_service_.EnableWakeWordDetection(true);
+            DiscardAudioBacklog();
             break;
         case kDeviceStateConnecting:
             display->SetStatus(Lang::Strings::CONNECTING);
             display->SetEmotion("neutral");
             display->SetChatMessage("system", "");
+
+            // Capture and encode while the channel opens, the main loop holds the packets meanwhile
+            if (!audio_service_.IsAudioProcessorRunning()) {
+                audio_service_.EnableVoiceProcessing(true);
+                audio_service_.EnableWakeWordDetection(false);
+            }
             break;
         case kDeviceStateListening:
             display->SetStatus(Lang::Strings::LISTENING);
             display->SetEmotion("neutral");
 
-            // Make sure the audio processor is running
-            if (!audio_service_.IsAudioProcessorRunning()) {
+            // Make sure the audio processor is running, it was started already if the channel just opened
+            if (previous_state == kDeviceStateConnecting || !audio_service_.IsAudioProcessorRunning()) {
                 // Send the start listening command
                 protocol_->SendStartListening(listening_mode_);
+            }
+            if (!audio_service_.IsAudioProcessorRunning()) {
                 audio_service_.EnableVoiceProcessing(true);
                 audio_service_.EnableWakeWordDetection(false);
             }
@@ -735,12 +912,15 @@ void Application::Reboot() {
 
 void Application::WakeWordInvoke(const std::string& wake_word) {
     if (device_state_ == kDeviceStateIdle) {
-        ToggleChatState();
         Schedule([this, wake_word]() {
-            if (protocol_) {
-                protocol_->SendWakeWordDetected(wake_word); 
+            if (!protocol_) {
+                return;
             }
-        }); 
+            OpenAudioChannel([this, wake_word]() {
+                SetListeningMode(aec_mode_ == kAecOff ? kListeningModeAutoStop : kListeningModeRealtime);
+                protocol_->SendWakeWordDetected(wake_word);
+            });
+        });
     } else if (device_state_ == kDeviceStateSpeaking) {
         Schedule([this]() {
             AbortSpeaking(kAbortReasonNone);
@@ -755,7 +935,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
 }
 
 bool Application::CanEnterSleepMode() {
-    if (device_state_ != kDeviceStateIdle) {
+    if (device_state_ != kDeviceStateIdle || audio_channel_opening_) {
         return false;
     }
 
@@ -811,7 +991,9 @@ void Application::SetAecMode(AecMode mode) {
         }
 
         // If the AEC mode is changed, close the audio channel
-        if (protocol_ && protocol_->IsAudioChannelOpened()) {
+        if (audio_channel_opening_) {
+            CancelOpenAudioChannel();
+        } else if (protocol_ && protocol_->IsAudioChannelOpened()) {
             protocol_->CloseAudioChannel();
         }
     });
@@ -829,6 +1011,10 @@ WebsocketProtocol* Application::GetWebsocketProtocol() {
     return nullptr;
 }
 
+bool Application::GetAudioLinkStats(AudioLinkStats& stats) {
+    return protocol_ && protocol_->GetAudioLinkStats(stats);
+}
+
 void Application::InitializeCameraConnection() {
     ESP_LOGI(TAG, "Initializing camera connection manager");
     
@@ -10,6 +10,7 @@
 #include <mutex>
 #include <deque>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
 #include "ota.h"
@@ -25,6 +26,11 @@
 #define MAIN_EVENT_ERROR (1 << 4)
 #define MAIN_EVENT_CHECK_NEW_VERSION_DONE (1 << 5)
 
+// Opening the audio channel runs the TLS handshake, so its task gets the stack of the main task
+#define AUDIO_CHANNEL_TASK_STACK_SIZE 8192
+// Speech captured while the audio channel opens is held up to this duration, the oldest is dropped beyond
+#define AUDIO_BACKLOG_MAX_DURATION_MS 3000
+
 enum AecMode {
     kAecOff,
     kAecOnDeviceSide,
@@ -44,6 +50,8 @@ public:
     void Start();
     void MainEventLoop();
     DeviceState GetDeviceState() const { return device_state_; }
+    // Set on the main task before the task opening the audio channel is created
+    bool IsAudioChannelOpening() const { return audio_channel_opening_; }
     bool IsVoiceDetected() const { return audio_service_.IsVoiceDetected(); }
     void Schedule(std::function<void()> callback);
     void SetDeviceState(DeviceState state);
@@ -64,6 +72,7 @@ public:
     
     // 获取websocket协议实例
     WebsocketProtocol* GetWebsocketProtocol();
+    bool GetAudioLinkStats(AudioLinkStats& stats);
 
 private:
     Application();
@@ -83,8 +92,23 @@ private:
 
     bool has_server_time_ = false;
     bool aborted_ = false;
+    // Capture time of the end of the last utterance, to log the time to the first response audio
+    std::atomic<int64_t> speech_end_time_us_ = 0;
     int clock_ticks_ = 0;
     TaskHandle_t check_new_version_task_handle_ = nullptr;
+
+    // The audio channel is opened on its own task, the main loop only sees the result
+    bool audio_channel_opening_ = false;
+    // Bumped by every cancel and every request that cannot share the running attempt, which is then stale
+    uint32_t audio_channel_generation_ = 0;
+    uint32_t audio_channel_attempt_ = 0;    // the generation the running attempt was started for
+    int64_t audio_channel_open_time_us_ = 0;
+    std::function<void()> on_audio_channel_ready_;
+    std::function<void()> on_audio_channel_failed_;
+    // Encoded while the channel opens, sent as fast as the link allows once it is open
+    std::deque<AudioStreamPacketPtr> audio_backlog_;
+    int audio_backlog_duration_ms_ = 0;
+    int audio_backlog_dropped_ms_ = 0;
     
     // 摄像头连接管理器
     std::unique_ptr<CameraConnection> camera_connection_;
@@ -96,6 +120,14 @@ private:
     void OnCameraKeepaliveTimer();
     void SetListeningMode(ListeningMode mode);
     void InitializeCameraConnection();
+    // Runs on_ready on the main loop once the audio channel is open, without blocking it meanwhile
+    void OpenAudioChannel(std::function<void()> on_ready, std::function<void()> on_failed = nullptr);
+    void CancelOpenAudioChannel();
+    void StartOpenAudioChannelTask();
+    void OnAudioChannelOpenDone(uint32_t generation, bool opened);
+    void HoldAudioBacklog();
+    void SendAudioBacklog();
+    void DiscardAudioBacklog();
 };
 
 #endif // _APPLICATION_H_
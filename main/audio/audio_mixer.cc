@@ -0,0 +1,113 @@
+#include "audio_mixer.h"
+#include "pcm_kernels.h"
+
+#include <algorithm>
+
+AudioMixer::AudioMixer() {
+}
+
+void AudioMixer::Configure(AudioMixerSource source, const AudioMixerSourceConfig& config) {
+    sources_[source].config = config;
+    sources_[source].applied_gain_q16 = config.gain_q16;
+    sources_[source].target_gain_q16 = config.gain_q16;
+}
+
+void AudioMixer::SetPull(AudioMixerSource source, PullFunc pull) {
+    sources_[source].pull = pull;
+}
+
+void AudioMixer::Clear(AudioMixerSource source) {
+    sources_[source].pending.clear();
+    sources_[source].offset = 0;
+}
+
+bool AudioMixer::Prepare(Source& source) {
+    while (source.offset >= source.pending.size()) {
+        if (!source.pull || !source.pull(source.pending)) {
+            source.pending.clear();
+            source.offset = 0;
+            return false;
+        }
+        source.offset = 0;
+    }
+    return true;
+}
+
+void AudioMixer::UpdateGains(bool speech_active) {
+    sources_[kAudioMixerSourceSpeech].active = speech_active;
+    for (auto& source : sources_) {
+        int64_t gain = source.config.gain_q16;
+        for (auto& other : sources_) {
+            if (other.active && other.config.priority > source.config.priority) {
+                gain = (gain * other.config.duck_q16) >> 16;
+            }
+        }
+        source.target_gain_q16 = gain;
+    }
+}
+
+size_t AudioMixer::Accumulate(Source& source, size_t samples) {
+    size_t done = 0;
+    while (done < samples && Prepare(source)) {
+        size_t count = std::min(samples - done, source.pending.size() - source.offset);
+        PcmAccumulateInt16(source.pending.data() + source.offset, accumulator_.data() + done, count,
+            source.applied_gain_q16, source.target_gain_q16);
+        source.applied_gain_q16 = source.target_gain_q16;
+        source.offset += count;
+        done += count;
+    }
+    return done;
+}
+
+void AudioMixer::Output(int16_t* output, size_t samples) {
+    PcmInt32ToInt16(accumulator_.data(), output, samples, 0);
+}
+
+void AudioMixer::Mix(std::vector<int16_t>& speech) {
+    bool mixing = false;
+    for (int i = kAudioMixerSourceSpeech + 1; i < kAudioMixerSourceCount; i++) {
+        sources_[i].active = Prepare(sources_[i]);
+        mixing |= sources_[i].active;
+    }
+    UpdateGains(true);
+
+    auto& source = sources_[kAudioMixerSourceSpeech];
+    if (!mixing && source.applied_gain_q16 == 65536 && source.target_gain_q16 == 65536) {
+        // Nothing to mix, the frame goes out untouched
+        return;
+    }
+
+    accumulator_.assign(speech.size(), 0);
+    PcmAccumulateInt16(speech.data(), accumulator_.data(), speech.size(), source.applied_gain_q16, source.target_gain_q16);
+    source.applied_gain_q16 = source.target_gain_q16;
+    for (int i = kAudioMixerSourceSpeech + 1; i < kAudioMixerSourceCount; i++) {
+        if (sources_[i].active) {
+            Accumulate(sources_[i], speech.size());
+        }
+    }
+    Output(speech.data(), speech.size());
+}
+
+bool AudioMixer::Render(std::vector<int16_t>& output, size_t max_samples) {
+    bool rendering = false;
+    for (int i = kAudioMixerSourceSpeech + 1; i < kAudioMixerSourceCount; i++) {
+        sources_[i].active = Prepare(sources_[i]);
+        rendering |= sources_[i].active;
+    }
+    if (!rendering) {
+        return false;
+    }
+    UpdateGains(false);
+
+    // The block ends with the longest source, the shorter ones are padded with silence
+    accumulator_.assign(max_samples, 0);
+    size_t samples = 0;
+    for (int i = kAudioMixerSourceSpeech + 1; i < kAudioMixerSourceCount; i++) {
+        if (sources_[i].active) {
+            samples = std::max(samples, Accumulate(sources_[i], max_samples));
+        }
+    }
+    output.resize(samples);
+    Output(output.data(), samples);
+    return samples > 0;
+}
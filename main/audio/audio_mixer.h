@@ -0,0 +1,68 @@
+#ifndef AUDIO_MIXER_H
+#define AUDIO_MIXER_H
+
+#include <vector>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+enum AudioMixerSource {
+    kAudioMixerSourceSpeech,    // the server TTS stream, passed to Mix() frame by frame
+    kAudioMixerSourceEffect,    // UI sounds from PlaySound()
+    kAudioMixerSourceLocal,     // other locally generated audio
+    kAudioMixerSourceCount,
+};
+
+struct AudioMixerSourceConfig {
+    int priority = 0;
+    int32_t gain_q16 = 65536;   // 0-65536
+    int32_t duck_q16 = 65536;   // gain of the lower priority sources while this one has audio
+};
+
+/*
+ * Output mixing stage in front of AudioCodec::OutputData.
+ *
+ * The speech stream sets the pace: Mix() adds the other sources to a speech frame in place, so
+ * the frame keeps its length and goes out as soon as it would without the mixer. When there is
+ * no speech, Render() plays the other sources on their own in short blocks. Every source must
+ * already be at the codec output rate, its producer does the resampling.
+ *
+ * Sources are summed in 32 bits and saturated once. Gain changes, including ducking, ramp over
+ * one block to avoid clicks. Only the audio output task may call Mix() and Render().
+ */
+class AudioMixer {
+public:
+    // Pulls the next frame of a source without blocking, returns false if none is ready
+    using PullFunc = std::function<bool(std::vector<int16_t>& pcm)>;
+
+    AudioMixer();
+
+    void Configure(AudioMixerSource source, const AudioMixerSourceConfig& config);
+    void SetPull(AudioMixerSource source, PullFunc pull);
+
+    void Mix(std::vector<int16_t>& speech);
+    // Renders up to max_samples of the sources other than speech, returns false if none has audio
+    bool Render(std::vector<int16_t>& output, size_t max_samples);
+    // Drops the buffered audio of a source
+    void Clear(AudioMixerSource source);
+
+private:
+    struct Source {
+        AudioMixerSourceConfig config;
+        PullFunc pull;
+        std::vector<int16_t> pending;
+        size_t offset = 0;
+        int32_t applied_gain_q16 = 65536;
+        int32_t target_gain_q16 = 65536;
+        bool active = false;
+    };
+    Source sources_[kAudioMixerSourceCount];
+    std::vector<int32_t> accumulator_;
+
+    bool Prepare(Source& source);
+    void UpdateGains(bool speech_active);
+    size_t Accumulate(Source& source, size_t samples);
+    void Output(int16_t* output, size_t samples);
+};
+
+#endif // AUDIO_MIXER_H
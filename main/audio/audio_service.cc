@@ -1,4 +1,5 @@
 #include "audio_service.h"
+#include "pcm_kernels.h"
 #include <esp_log.h>
 #include <cstring>
 
@@ -18,15 +19,46 @@
 
 #define TAG "AudioService"
 
+static_assert(MAX_DECODE_PACKETS_IN_QUEUE(OPUS_MIN_FRAME_DURATION_MS) <= AUDIO_DECODE_QUEUE_CAPACITY, "Decode queue is too small");
+static_assert(MAX_SEND_PACKETS_IN_QUEUE(OPUS_MIN_FRAME_DURATION_MS) <= AUDIO_SEND_QUEUE_CAPACITY, "Send queue is too small");
+static_assert(AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS <= AUDIO_TESTING_QUEUE_CAPACITY, "Testing queue is too small");
 
-AudioService::AudioService() {
+
+AudioService::AudioService()
+    : audio_task_pool_(AUDIO_TASK_POOL_SIZE, nullptr, [](AudioTask& task) {
+        task.pcm.clear();
+        task.timestamp = 0;
+        task.origin_time_us = 0;
+        task.silence = false;
+        task.split_samples = 0;
+    }) {
     event_group_ = xEventGroupCreate();
+    queue_event_group_ = xEventGroupCreate();
+
+    audio_encode_queue_.Bind(queue_event_group_, AS_QUEUE_ENCODE_READABLE, AS_QUEUE_ENCODE_WRITABLE);
+    audio_encode_queue_.SetLimit(MAX_ENCODE_TASKS_IN_QUEUE);
+    audio_send_queue_.Bind(queue_event_group_, 0, AS_QUEUE_SEND_WRITABLE);
+    audio_send_queue_.SetLimit(MAX_SEND_PACKETS_IN_QUEUE(OPUS_FRAME_DURATION_MS));
+    audio_decode_queue_.Bind(queue_event_group_, AS_QUEUE_DECODE_READABLE, AS_QUEUE_DECODE_WRITABLE);
+    audio_decode_queue_.SetLimit(MAX_DECODE_PACKETS_IN_QUEUE(OPUS_FRAME_DURATION_MS));
+    audio_playback_queue_.Bind(queue_event_group_, AS_QUEUE_PLAYBACK_READABLE, AS_QUEUE_PLAYBACK_WRITABLE);
+    audio_playback_queue_.SetLimit(MAX_PLAYBACK_TASKS_IN_QUEUE);
+    // Sound packets wake the opus decoder task like the downlink
+    audio_effect_queue_.Bind(queue_event_group_, AS_QUEUE_DECODE_READABLE, AS_QUEUE_EFFECT_WRITABLE);
+    audio_effect_playback_queue_.Bind(queue_event_group_, AS_QUEUE_EFFECT_PLAYBACK_READABLE, AS_QUEUE_EFFECT_PLAYBACK_WRITABLE);
+    audio_effect_playback_queue_.SetLimit(MAX_EFFECT_TASKS_IN_QUEUE);
+    // The testing queue is drained by the opus decoder task when the recording is played back
+    audio_testing_queue_.Bind(queue_event_group_, AS_QUEUE_DECODE_READABLE, 0);
+    audio_testing_queue_.SetLimit(AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS);
 }
 
 AudioService::~AudioService() {
     if (event_group_ != nullptr) {
         vEventGroupDelete(event_group_);
     }
+    if (queue_event_group_ != nullptr) {
+        vEventGroupDelete(queue_event_group_);
+    }
 }
 
 
@@ -35,13 +67,16 @@ void AudioService::Initialize(AudioCodec* codec) {
     codec_->Start();
 
     /* Setup the audio codec */
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(codec->output_sample_rate(), 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_ = std::make_unique<OpusEncoderWrapper>(16000, 1, OPUS_FRAME_DURATION_MS);
-    opus_encoder_->SetComplexity(0);
+    opus_decoders_.SetOutputSampleRate(codec->output_sample_rate());
+    opus_decoders_.Select(codec->output_sample_rate(), OPUS_FRAME_DURATION_MS);
+    effect_decoders_.SetOutputSampleRate(codec->output_sample_rate());
+    playback_timeline_.SetSampleRate(codec->output_sample_rate());
+    opus_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, OPUS_FRAME_DURATION_MS);
+    ApplyUplinkRateSettings();
+    encoder_stats_.frame_duration_ms = OPUS_FRAME_DURATION_MS;
 
     if (codec->input_sample_rate() != 16000) {
-        input_resampler_.Configure(codec->input_sample_rate(), 16000);
-        reference_resampler_.Configure(codec->input_sample_rate(), 16000);
+        input_resampler_.Configure(codec->input_sample_rate(), 16000, codec->input_channels());
     }
 
 #if CONFIG_USE_AUDIO_PROCESSOR
@@ -60,8 +95,42 @@ void AudioService::Initialize(AudioCodec* codec) {
     wake_word_ = nullptr;
 #endif
 
+    /* Sounds duck the speech while they play */
+    mixer_.Configure(kAudioMixerSourceSpeech, {.priority = 0});
+    mixer_.Configure(kAudioMixerSourceEffect, {.priority = 2, .duck_q16 = AUDIO_MIXER_SPEECH_DUCK_Q16});
+    mixer_.SetPull(kAudioMixerSourceEffect, [this](std::vector<int16_t>& pcm) {
+        AudioTaskPtr task;
+        if (!audio_effect_playback_queue_.Pop(task)) {
+            return false;
+        }
+        int64_t sound_requested_time_us = sound_requested_time_us_.exchange(0);
+        if (sound_requested_time_us != 0) {
+            ESP_LOGI(TAG, "Sound started playing %lld us after it was requested", esp_timer_get_time() - sound_requested_time_us);
+        }
+        // The released task keeps the previous buffer for the next sound frame
+        pcm.swap(task->pcm);
+        return true;
+    });
+
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
-        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
+        if (pre_roll_ready_.load(std::memory_order_acquire)) {
+            PushPreRollToEncodeQueue();
+        }
+        int64_t first_sample_time_us = 0;
+        int64_t capture_time_us = TraceProcessedSamples(data.size(), first_sample_time_us);
+        uint32_t timestamp = 0;
+#if CONFIG_USE_SERVER_AEC
+        /* Tag the frame with the downlink audio that was playing when its first sample was captured */
+        if (first_sample_time_us != 0) {
+            timestamp = playback_timeline_.GetTimestamp(first_sample_time_us);
+        }
+#endif
+#if CONFIG_USE_LOCAL_ENDPOINTER
+        if (endpointer_.Process(voice_detected_, data.data(), data.size(), capture_time_us) && callbacks_.on_end_of_speech) {
+            callbacks_.on_end_of_speech(endpointer_.speech_end_time_us());
+        }
+#endif
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data), capture_time_us, timestamp, !voice_detected_);
     });
 
     audio_processor_->OnVadStateChange([this](bool speaking) {
@@ -73,6 +142,8 @@ void AudioService::Initialize(AudioCodec* codec) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            wake_word_detected_time_us_ = esp_timer_get_time();
+            wake_word_packets_ = 0;
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
@@ -128,12 +199,20 @@ void AudioService::Start() {
     }, "audio_output", 2048, this, 3, &audio_output_task_handle_);
 #endif
 
-    /* Start the opus codec task */
-    xTaskCreate([](void* arg) {
+    /* Start the opus encoder and decoder tasks */
+    xTaskCreatePinnedToCore([](void* arg) {
         AudioService* audio_service = (AudioService*)arg;
-        audio_service->OpusCodecTask();
+        audio_service->OpusEncoderTask();
         vTaskDelete(NULL);
-    }, "opus_codec", 2048 * 13, this, 2, &opus_codec_task_handle_);
+    }, "opus_encoder", OPUS_ENCODER_TASK_STACK_SIZE, this, CONFIG_OPUS_ENCODER_TASK_PRIORITY,
+        &opus_encoder_task_handle_, OPUS_ENCODER_TASK_CORE);
+
+    xTaskCreatePinnedToCore([](void* arg) {
+        AudioService* audio_service = (AudioService*)arg;
+        audio_service->OpusDecoderTask();
+        vTaskDelete(NULL);
+    }, "opus_decoder", OPUS_DECODER_TASK_STACK_SIZE, this, CONFIG_OPUS_DECODER_TASK_PRIORITY,
+        &opus_decoder_task_handle_, OPUS_DECODER_TASK_CORE);
 }
 
 void AudioService::Stop() {
@@ -143,12 +222,14 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    audio_effect_queue_.Clear();
+    audio_effect_playback_queue_.Clear();
+    /* Wake up every task blocked on a queue so that it can see the service is stopped */
+    xEventGroupSetBits(queue_event_group_, AS_QUEUE_ALL_BITS);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -159,31 +240,13 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
     }
 
     if (codec_->input_sample_rate() != sample_rate) {
-        data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
-        if (!codec_->InputData(data)) {
+        /* Read at the codec rate into a persistent buffer, then resample all channels in one pass */
+        int frames = samples * codec_->input_sample_rate() / sample_rate;
+        input_buffer_.resize(frames * codec_->input_channels());
+        if (!codec_->InputData(input_buffer_)) {
             return false;
         }
-        if (codec_->input_channels() == 2) {
-            auto mic_channel = std::vector<int16_t>(data.size() / 2);
-            auto reference_channel = std::vector<int16_t>(data.size() / 2);
-            for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
-                mic_channel[i] = data[j];
-                reference_channel[i] = data[j + 1];
-            }
-            auto resampled_mic = std::vector<int16_t>(input_resampler_.GetOutputSamples(mic_channel.size()));
-            auto resampled_reference = std::vector<int16_t>(reference_resampler_.GetOutputSamples(reference_channel.size()));
-            input_resampler_.Process(mic_channel.data(), mic_channel.size(), resampled_mic.data());
-            reference_resampler_.Process(reference_channel.data(), reference_channel.size(), resampled_reference.data());
-            data.resize(resampled_mic.size() + resampled_reference.size());
-            for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
-                data[j] = resampled_mic[i];
-                data[j + 1] = resampled_reference[i];
-            }
-        } else {
-            auto resampled = std::vector<int16_t>(input_resampler_.GetOutputSamples(data.size()));
-            input_resampler_.Process(data.data(), data.size(), resampled.data());
-            data = std::move(resampled);
-        }
+        input_resampler_.Process(input_buffer_.data(), frames, data);
     } else {
         data.resize(samples * codec_->input_channels());
         if (!codec_->InputData(data)) {
@@ -207,6 +270,8 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 }
 
 void AudioService::AudioInputTask() {
+    /* Keep the buffer across frames, the encode queue hands a recycled one back on every push */
+    std::vector<int16_t> data;
     while (true) {
         EventBits_t bits = xEventGroupWaitBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING |
             AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING,
@@ -215,29 +280,23 @@ void AudioService::AudioInputTask() {
         if (service_stopped_) {
             break;
         }
-        if (audio_input_need_warmup_) {
-            audio_input_need_warmup_ = false;
-            vTaskDelay(pdMS_TO_TICKS(120));
-            continue;
+        if (pre_roll_mark_pending_.exchange(false)) {
+            pre_roll_mark_ = pre_roll_ring_.written();
         }
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            if (audio_testing_queue_.full()) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
-            std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ms_ * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    PcmExtractChannel(data.data(), data.data(), data.size() / 2, 2, 0);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -246,10 +305,10 @@ void AudioService::AudioInputTask() {
 
         /* Feed the wake word */
         if (bits & AS_EVENT_WAKE_WORD_RUNNING) {
-            std::vector<int16_t> data;
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    FeedPreRoll(data);
                     wake_word_->Feed(data);
                     continue;
                 }
@@ -258,10 +317,16 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
-            std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    /* Everything before this chunk is pre-roll, the processor gets the rest */
+                    if (pre_roll_pending_.exchange(false)) {
+                        TakePreRoll();
+                    }
+                    FeedPreRoll(data);
+                    captured_samples_ += samples;
+                    capture_marks_.Push(CaptureMark{captured_samples_, esp_timer_get_time()});
                     audio_processor_->Feed(std::move(data));
                     continue;
                 }
@@ -277,185 +342,453 @@ void AudioService::AudioInputTask() {
 
 void AudioService::AudioOutputTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
+        AudioTaskPtr task;
+        if (!audio_playback_queue_.Pop(task)) {
+            /* No speech, the sounds play on their own in short blocks */
+            int samples = codec_->output_sample_rate() * AUDIO_MIXER_RENDER_MS / 1000;
+            if (!mixer_.Render(mixer_buffer_, samples)) {
+                xEventGroupWaitBits(queue_event_group_, AS_QUEUE_PLAYBACK_READABLE | AS_QUEUE_EFFECT_PLAYBACK_READABLE,
+                    pdTRUE, pdFALSE, portMAX_DELAY);
+                continue;
+            }
+            if (!codec_->output_enabled()) {
+                esp_timer_stop(audio_power_timer_);
+                esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
+                codec_->EnableOutput(true);
+            }
+            codec_->OutputData(mixer_buffer_);
+#if CONFIG_USE_SERVER_AEC
+            playback_timeline_.Record(0, mixer_buffer_.size(), esp_timer_get_time());
+#endif
+            last_output_time_ = std::chrono::steady_clock::now();
+            continue;
+        }
 
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+        /* The sounds are added to the speech frame, which keeps its length and timing */
+        mixer_.Mix(task->pcm);
+        if (task->origin_time_us != 0) {
+            int64_t now = esp_timer_get_time();
+            latency_tracer_.Record(kLatencyStagePlayback, now - task->queued_time_us);
+            latency_tracer_.Record(kLatencyStageDownlink, now - task->origin_time_us);
+        }
         codec_->OutputData(task->pcm);
+#if CONFIG_USE_SERVER_AEC
+        /* Record where the frame went in the output, for server AEC */
+        playback_timeline_.Record(task->timestamp, task->pcm.size(), esp_timer_get_time());
+#endif
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
-
-#if CONFIG_USE_SERVER_AEC
-        /* Record the timestamp for server AEC */
-        if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
-        }
-#endif
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
-void AudioService::OpusCodecTask() {
+static void LogEncoderStats(const CodecWorkerStats& stats) {
+    if (stats.frames == 0 || stats.frame_duration_ms == 0) {
+        return;
+    }
+    // CPU share of one core at this frame duration, to compare the 20 / 40 / 60 ms modes
+    int64_t busy_avg_us = stats.busy_us / stats.frames;
+    ESP_LOGI(TAG, "Opus encoder %d ms: %lu frames, busy avg %lld us max %lld us (%lld.%lld%% CPU), queue wait avg %lld us max %lld us",
+        stats.frame_duration_ms, stats.frames, busy_avg_us, stats.max_busy_us,
+        busy_avg_us / (stats.frame_duration_ms * 10), busy_avg_us / stats.frame_duration_ms % 10,
+        stats.queue_wait_us / stats.frames, stats.max_queue_wait_us);
+}
+
+static void UpdateWorkerStats(CodecWorkerStats& stats, int64_t busy_us, int64_t queue_wait_us) {
+    stats.frames++;
+    stats.busy_us += busy_us;
+    if (busy_us > stats.max_busy_us) {
+        stats.max_busy_us = busy_us;
+    }
+    stats.queue_wait_us += queue_wait_us;
+    if (queue_wait_us > stats.max_queue_wait_us) {
+        stats.max_queue_wait_us = queue_wait_us;
+    }
+}
+
+void AudioService::OpusEncoderTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
         if (service_stopped_) {
             break;
         }
+        /* Release the slots of cleared tasks even if the send queue is full */
+        audio_encode_queue_.DiscardCleared();
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_->Decode(std::move(packet->payload), task->pcm)) {
-                // Resample if the sample rate is different
-                if (opus_decoder_->sample_rate() != codec_->output_sample_rate()) {
-                    int target_size = output_resampler_.GetOutputSamples(task->pcm.size());
-                    std::vector<int16_t> resampled(target_size);
-                    output_resampler_.Process(task->pcm.data(), task->pcm.size(), resampled.data());
-                    task->pcm = std::move(resampled);
-                }
+        AudioTaskPtr task;
+        if (audio_send_queue_.full() || !audio_encode_queue_.Pop(task)) {
+            xEventGroupWaitBits(queue_event_group_, AS_QUEUE_ENCODE_READABLE | AS_QUEUE_SEND_WRITABLE,
+                pdTRUE, pdFALSE, portMAX_DELAY);
+            continue;
+        }
+
+        if (task->split_samples > 0) {
+            EncodePreRoll(*task);
+            continue;
+        }
+        EncodeFrame(*task, task->pcm);
+    }
 
-                lock.lock();
-                audio_playback_queue_.push_back(std::move(task));
-                audio_queue_cv_.notify_all();
-            } else {
-                ESP_LOGE(TAG, "Failed to decode audio");
-                lock.lock();
+    ESP_LOGW(TAG, "Opus encoder task stopped");
+}
+
+void AudioService::EncodeFrame(const AudioTask& task, const std::vector<int16_t>& pcm) {
+    /* The encoder follows the frame duration of the PCM it receives */
+    int frame_duration = pcm.size() * 1000 / 16000;
+    if (frame_duration != opus_encoder_->duration_ms() && IS_VALID_OPUS_FRAME_DURATION(frame_duration)) {
+        LogEncoderStats(encoder_stats_);
+        opus_encoder_ = std::make_unique<OpusStreamEncoder>(16000, 1, frame_duration);
+        ApplyUplinkRateSettings();
+        encoder_stats_ = CodecWorkerStats();
+        encoder_stats_.frame_duration_ms = frame_duration;
+    }
+
+    int64_t start_time = esp_timer_get_time();
+    auto packet = CreateAudioStreamPacket();
+    packet->frame_duration = opus_encoder_->duration_ms();
+    packet->sample_rate = 16000;
+    packet->timestamp = task.timestamp;
+    /* Encoded straight into the pooled packet, behind the headroom for the transport header */
+    int size = opus_encoder_->Encode(pcm, packet->ResizePayload(AUDIO_STREAM_PACKET_PAYLOAD_CAPACITY),
+        AUDIO_STREAM_PACKET_PAYLOAD_CAPACITY);
+    if (size < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio");
+        return;
+    }
+    packet->ResizePayload(size);
+    int64_t encode_time = esp_timer_get_time();
+    UpdateWorkerStats(encoder_stats_, encode_time - start_time, start_time - task.queued_time_us);
+    if (task.origin_time_us != 0) {
+        latency_tracer_.Record(kLatencyStageEncode, encode_time - task.queued_time_us);
+        packet->origin_time_us = task.origin_time_us;
+        packet->encode_time_us = encode_time;
+    }
+
+    if (task.type == kAudioTaskTypeEncodeToSendQueue) {
+        if (rate_controller_.OnFrame(encode_time, packet->frame_duration, encode_time - start_time,
+            audio_send_queue_.size(), audio_send_queue_.limit())) {
+            ApplyUplinkRateSettings();
+        }
+        /* Suppressed silence is encoded all the same, so the encoder state stays continuous */
+        if (!uplink_dtx_enabled_ || uplink_dtx_.OnFrame(task.silence, packet->frame_duration, packet->payload_size())) {
+            audio_send_queue_.Push(std::move(packet));
+            if (callbacks_.on_send_queue_available) {
+                callbacks_.on_send_queue_available();
             }
-            debug_statistics_.decode_count++;
-        }
-        
-        /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-            if (!opus_encoder_->Encode(std::move(task->pcm), packet->payload)) {
-                ESP_LOGE(TAG, "Failed to encode audio");
-                continue;
+        }
+    } else if (task.type == kAudioTaskTypeEncodeToTestingQueue) {
+        audio_testing_queue_.Push(std::move(packet));
+    }
+    debug_statistics_.encode_count++;
+}
+
+void AudioService::EncodePreRoll(AudioTask& task) {
+    /* The frames captured meanwhile are parked here and encoded after the pre-roll, so the processor
+       output keeps finding room in the encode queue however long the pre-roll takes to encode */
+    auto park = [this]() {
+        AudioTaskPtr live;
+        while (audio_encode_queue_.Pop(live)) {
+            parked_tasks_.push_back(std::move(live));
+        }
+    };
+    auto wait_for_send_room = [&]() {
+        park();
+        while (audio_send_queue_.full()) {
+            if (service_stopped_) {
+                return false;
             }
+            xEventGroupWaitBits(queue_event_group_, AS_QUEUE_SEND_WRITABLE | AS_QUEUE_ENCODE_READABLE,
+                pdTRUE, pdFALSE, portMAX_DELAY);
+            park();
+        }
+        return true;
+    };
 
-            if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                {
-                    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                    audio_send_queue_.push_back(std::move(packet));
-                }
-                if (callbacks_.on_send_queue_available) {
-                    callbacks_.on_send_queue_available();
-                }
-            } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-                audio_testing_queue_.push_back(std::move(packet));
+    for (size_t offset = 0; offset + task.split_samples <= task.pcm.size(); offset += task.split_samples) {
+        if (!wait_for_send_room()) {
+            break;
+        }
+        pre_roll_frame_.assign(task.pcm.begin() + offset, task.pcm.begin() + offset + task.split_samples);
+        EncodeFrame(task, pre_roll_frame_);
+    }
+    /* Free the pre-roll, the recycled task would keep the whole buffer otherwise */
+    std::vector<int16_t>().swap(task.pcm);
+
+    while (!parked_tasks_.empty()) {
+        if (!wait_for_send_room()) {
+            parked_tasks_.clear();
+            break;
+        }
+        EncodeFrame(*parked_tasks_.front(), parked_tasks_.front()->pcm);
+        parked_tasks_.pop_front();
+    }
+}
+
+void AudioService::ApplyUplinkRateSettings() {
+    auto& settings = rate_controller_.settings();
+    opus_encoder_->SetBitrate(settings.bitrate);
+    opus_encoder_->SetComplexity(settings.complexity);
+    opus_encoder_->SetDtx(settings.dtx);
+}
+
+void AudioService::OpusDecoderTask() {
+    while (true) {
+        if (service_stopped_) {
+            break;
+        }
+        /* Release the slots of cleared packets even if the playback queue is full */
+        audio_decode_queue_.DiscardCleared();
+        audio_effect_queue_.DiscardCleared();
+
+        if (decoder_reset_pending_.exchange(false)) {
+            auto stats = jitter_buffer_.GetStats();
+            if (stats.received > 0) {
+                ESP_LOGI(TAG, "Jitter buffer: received %lu, late %lu, lost %lu (fec %lu, plc %lu), stretched %lu, underruns %lu, jitter %lu ms, depth %lu",
+                    stats.received, stats.late, stats.lost, stats.fec_recovered, stats.concealed, stats.stretched,
+                    stats.underruns, stats.jitter_ms, stats.target_depth);
+            }
+            jitter_buffer_.Reset();
+            opus_decoders_.ResetState();
+        }
+
+        AudioStreamPacketPtr packet;
+        /* Sounds are short and do not go through the jitter buffer */
+        if (!audio_effect_playback_queue_.full() && audio_effect_queue_.Pop(packet)) {
+            DecodeEffect(packet);
+            continue;
+        }
+
+        /* Move the arrived packets into the jitter buffer */
+        while (!jitter_buffer_.full() && PopPacketToDecode(packet)) {
+            jitter_buffer_.Put(std::move(packet), esp_timer_get_time());
+        }
+
+        /* Decode the next frame, the jitter buffer decides whether to wait, decode or conceal */
+        TickType_t idle_wait = portMAX_DELAY;
+        if (!audio_playback_queue_.full()) {
+            int64_t start_time = esp_timer_get_time();
+            auto frame = jitter_buffer_.Pull(start_time, audio_playback_queue_.empty());
+            if (frame.action != kJitterBufferWait) {
+                DecodeFrame(frame);
+                // Downlink frames wait in the jitter buffer on purpose, so only the decode time is counted
+                UpdateWorkerStats(decoder_stats_, esp_timer_get_time() - start_time, 0);
+                continue;
+            }
+            if (frame.wait_ms >= 0) {
+                idle_wait = pdMS_TO_TICKS(frame.wait_ms);
             }
-            debug_statistics_.encode_count++;
-            lock.lock();
         }
+
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_DECODE_READABLE | AS_QUEUE_PLAYBACK_WRITABLE |
+            AS_QUEUE_EFFECT_PLAYBACK_WRITABLE, pdTRUE, pdFALSE, idle_wait);
     }
 
-    ESP_LOGW(TAG, "Opus codec task stopped");
+    ESP_LOGW(TAG, "Opus decoder task stopped");
 }
 
-void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
-    if (opus_decoder_->sample_rate() == sample_rate && opus_decoder_->duration_ms() == frame_duration) {
+void AudioService::DecodeFrame(JitterBufferFrame& frame) {
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+
+    bool decoded;
+    if (frame.action == kJitterBufferDecode) {
+        task->timestamp = frame.packet->timestamp;
+        task->origin_time_us = frame.packet->origin_time_us;
+        decoded = opus_decoders_.Select(frame.packet->sample_rate, frame.packet->frame_duration)->Decode(frame.packet->payload_data(), frame.packet->payload_size(), task->pcm);
+    } else if (frame.action == kJitterBufferDecodeFec) {
+        decoded = opus_decoders_.decoder()->DecodeFec(frame.next_packet->payload_data(), frame.next_packet->payload_size(), task->pcm);
+    } else {
+        decoded = opus_decoders_.decoder()->Conceal(task->pcm);
+    }
+    debug_statistics_.decode_count++;
+    if (!decoded) {
+        ESP_LOGE(TAG, "Failed to decode audio");
         return;
     }
 
-    opus_decoder_.reset();
-    opus_decoder_ = std::make_unique<OpusDecoderWrapper>(sample_rate, 1, frame_duration);
-
-    auto codec = Board::GetInstance().GetAudioCodec();
-    if (opus_decoder_->sample_rate() != codec->output_sample_rate()) {
-        ESP_LOGI(TAG, "Resampling audio from %d to %d", opus_decoder_->sample_rate(), codec->output_sample_rate());
-        output_resampler_.Configure(opus_decoder_->sample_rate(), codec->output_sample_rate());
+    // Resample if the sample rate is different
+    opus_decoders_.Resample(task->pcm, output_resample_buffer_);
+    task->queued_time_us = esp_timer_get_time();
+    if (task->origin_time_us != 0) {
+        latency_tracer_.Record(kLatencyStageDecode, task->queued_time_us - task->origin_time_us);
     }
+    audio_playback_queue_.Push(std::move(task));
 }
 
-void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
-    task->type = type;
-    task->pcm = std::move(pcm);
-    
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+void AudioService::DecodeEffect(AudioStreamPacketPtr& packet) {
+    auto task = audio_task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToEffectQueue;
+
+    /* Sounds that were decoded before are copied from the cache, already at the output rate */
+    const uint8_t* sound_packet = packet->payload_view;
+    if (sound_packet != nullptr && sound_bank_.LoadPcm(sound_packet, task->pcm)) {
+        audio_effect_playback_queue_.Push(std::move(task));
+        return;
+    }
+
+    auto decoder = effect_decoders_.Select(packet->sample_rate, packet->frame_duration);
+    if (!decoder->Decode(packet->payload_data(), packet->payload_size(), task->pcm)) {
+        ESP_LOGE(TAG, "Failed to decode sound");
+        return;
+    }
 
-    /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    // The mixer takes every source at the output rate
+    effect_decoders_.Resample(task->pcm, output_resample_buffer_);
+    if (sound_packet != nullptr) {
+        sound_bank_.StorePcm(sound_packet, task->pcm, codec_->output_sample_rate());
+    }
+    audio_effect_playback_queue_.Push(std::move(task));
+}
+
+bool AudioService::PopPacketToDecode(AudioStreamPacketPtr& packet) {
+    /* The recorded testing audio is played back before anything else */
+    if (audio_testing_playback_) {
+        if (audio_testing_queue_.Pop(packet)) {
+            return true;
         }
-        timestamp_queue_.pop_front();
+        audio_testing_playback_ = false;
+    }
+    return audio_decode_queue_.Pop(packet);
+}
+
+int64_t AudioService::TraceProcessedSamples(size_t samples, int64_t& first_sample_time_us) {
+    /* The first sample of the output was read with the first chunk that ends after it */
+    while (capture_mark_.end_sample <= processed_samples_ && capture_marks_.Pop(capture_mark_)) {
+    }
+    int64_t capture_time_us = 0;
+    if (capture_mark_.end_sample > processed_samples_) {
+        capture_time_us = capture_mark_.time_us;
+        latency_tracer_.Record(kLatencyStageProcess, esp_timer_get_time() - capture_time_us);
+        /* The read returned with the last sample of the chunk, count back to the first sample of the output */
+        first_sample_time_us = capture_time_us - (int64_t)(capture_mark_.end_sample - processed_samples_) * 1000000 / 16000;
+    }
+    processed_samples_ += samples;
+    return capture_time_us;
+}
+
+void AudioService::FeedPreRoll(const std::vector<int16_t>& data) {
+    if (pre_roll_ring_.capacity() == 0) {
+        return;
     }
+    int64_t now = esp_timer_get_time();
+    auto output_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - last_output_time_).count();
+    if (now - pre_roll_write_time_us_ > AUDIO_PRE_ROLL_MAX_GAP_MS * 1000 || output_elapsed < AUDIO_PRE_ROLL_PLAYBACK_GUARD_MS) {
+        pre_roll_ring_.Reset();
+        pre_roll_mark_ = 0;
+    }
+    pre_roll_write_time_us_ = now;
+    if (output_elapsed >= AUDIO_PRE_ROLL_PLAYBACK_GUARD_MS) {
+        int channels = codec_->input_channels();
+        pre_roll_ring_.Write(data.data(), data.size() / channels, channels);
+    }
+}
+
+void AudioService::TakePreRoll() {
+    /* The previous pre-roll was never sent if the processor produced no output */
+    pre_roll_pcm_.clear();
+    uint64_t end = pre_roll_ring_.written();
+    uint64_t start = pre_roll_ring_.oldest();
+    if (pre_roll_mark_ > start) {
+        start = pre_roll_mark_;
+    } else if (pre_roll_mark_ > 0) {
+        ESP_LOGW(TAG, "Pre-roll: %llu ms after the wake word were overwritten", (start - pre_roll_mark_) / 16);
+    }
+    pre_roll_mark_ = 0;
+    if (esp_timer_get_time() - pre_roll_write_time_us_ > AUDIO_PRE_ROLL_MAX_GAP_MS * 1000) {
+        return;
+    }
+
+    /* Whole frames only, the oldest partial frame is dropped */
+    size_t frame_samples = frame_duration_ms_ * 16000 / 1000;
+    size_t count = (end - start) / frame_samples * frame_samples;
+    if (count == 0) {
+        return;
+    }
+    pre_roll_pcm_.resize(count);
+    pre_roll_ring_.Read(end - count, count, pre_roll_pcm_.data());
+    pre_roll_ready_.store(true, std::memory_order_release);
+}
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+void AudioService::PushPreRollToEncodeQueue() {
+    /* Runs on the processor output. The pre-roll goes out as a single task that the encoder task splits
+       into frames, so the processor output waits for one slot of the encode queue rather than one per frame */
+    size_t samples = pre_roll_pcm_.size();
+    PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(pre_roll_pcm_), 0, 0, false, frame_duration_ms_ * 16000 / 1000);
+    ESP_LOGI(TAG, "Pre-roll: recovered %u ms captured before listening started", samples / 16);
+    pre_roll_ready_.store(false, std::memory_order_release);
 }
 
-bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, int64_t origin_time_us, uint32_t timestamp, bool silence, size_t split_samples) {
+    auto task = audio_task_pool_.Acquire();
+    task->type = type;
+    /* Swap instead of move, so the caller gets the recycled buffer back and does not reallocate */
+    task->pcm.swap(pcm);
+    task->queued_time_us = esp_timer_get_time();
+    task->origin_time_us = origin_time_us;
+    task->timestamp = timestamp;
+    task->silence = silence;
+    task->split_samples = split_samples;
+
+    /* Push the task to the encode queue, wait for the opus encoder task if it is full */
+    while (!audio_encode_queue_.Push(std::move(task))) {
+        if (service_stopped_) {
+            return;
+        }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_ENCODE_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+}
+
+bool AudioService::PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait) {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(audio_decode_producer_mutex_);
+            if (audio_decode_queue_.Push(std::move(packet))) {
+                return true;
+            }
+        }
+        if (!wait || service_stopped_) {
             return false;
         }
+        xEventGroupWaitBits(queue_event_group_, AS_QUEUE_DECODE_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
-    return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+AudioStreamPacketPtr AudioService::PopPacketFromSendQueue() {
+    AudioStreamPacketPtr packet;
+    if (audio_send_queue_.Pop(packet) && packet->origin_time_us != 0) {
+        int64_t now = esp_timer_get_time();
+        latency_tracer_.Record(kLatencyStageSend, now - packet->encode_time_us);
+        latency_tracer_.Record(kLatencyStageUplink, now - packet->origin_time_us);
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
     return packet;
 }
 
+void AudioService::OnAudioSent(bool sent, int64_t send_us) {
+    rate_controller_.OnSend(sent, send_us);
+}
+
+void AudioService::EnableUplinkDtx(bool enable) {
+    ESP_LOGI(TAG, "Uplink DTX %s", enable ? "enabled" : "disabled");
+    uplink_dtx_enabled_ = enable;
+}
+
 void AudioService::EncodeWakeWord() {
     if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+        wake_word_->EncodeWakeWordData(frame_duration_ms_);
+        /* The wake word audio goes to the server, so the pre-roll starts after it */
+        pre_roll_mark_pending_ = true;
     }
 }
 
@@ -463,11 +796,18 @@ const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
+AudioStreamPacketPtr AudioService::PopWakeWordPacket() {
+    auto packet = CreateAudioStreamPacket();
+    if (wake_word_->GetWakeWordOpus(wake_word_opus_)) {
+        packet->AssignPayload(wake_word_opus_.data(), wake_word_opus_.size());
+        if (wake_word_packets_++ == 0) {
+            ESP_LOGI(TAG, "Wake word audio: first packet ready %lld ms after detection",
+                (esp_timer_get_time() - wake_word_detected_time_us_) / 1000);
+        }
         return packet;
     }
+    ESP_LOGI(TAG, "Wake word audio: %d packets handed out %lld ms after detection", wake_word_packets_.load(),
+        (esp_timer_get_time() - wake_word_detected_time_us_) / 1000);
     return nullptr;
 }
 
@@ -497,44 +837,109 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+            audio_processor_->Initialize(codec_, frame_duration_ms_);
             audio_processor_initialized_ = true;
         }
+        audio_processor_->SetFrameDuration(frame_duration_ms_);
+        /* The processor starts empty, so its output lines up with the next samples read */
+        capture_marks_.Clear();
+        capture_mark_ = CaptureMark();
+        captured_samples_ = 0;
+        processed_samples_ = 0;
 
         /* We should make sure no audio is playing */
         ResetDecoder();
-        audio_input_need_warmup_ = true;
+        pre_roll_ready_ = false;
+        pre_roll_pending_ = true;
+        uplink_dtx_.Reset();
+#if CONFIG_USE_LOCAL_ENDPOINTER
+        endpointer_.Reset();
+#endif
         audio_processor_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
     } else {
         audio_processor_->Stop();
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+
+        auto packet_stats = GetAudioStreamPacketPoolStats();
+        auto task_stats = audio_task_pool_.GetStats();
+        ESP_LOGI(TAG, "Frame pools: packets %u (high water %u, misses %u), tasks %u (high water %u, misses %u)",
+            packet_stats.allocated, packet_stats.high_water, packet_stats.misses,
+            task_stats.allocated, task_stats.high_water, task_stats.misses);
+        auto queues = GetQueueStats();
+        ESP_LOGI(TAG, "Queue high water: encode %u/%u, send %u/%u, decode %u/%u, playback %u/%u, effect %u/%u",
+            queues.encode.high_water, queues.encode.limit, queues.send.high_water, queues.send.limit,
+            queues.decode.high_water, queues.decode.limit, queues.playback.high_water, queues.playback.limit,
+            queues.effect.high_water, queues.effect.limit);
+
+        LogEncoderStats(encoder_stats_);
+        auto dtx_stats = uplink_dtx_.GetStats();
+        if (dtx_stats.suppressed_frames > 0) {
+            ESP_LOGI(TAG, "Uplink DTX: sent %lu frames (%lu bytes), suppressed %lu frames, saved %lu bytes",
+                dtx_stats.sent_frames, dtx_stats.sent_bytes, dtx_stats.suppressed_frames, dtx_stats.saved_bytes);
+        }
+        auto& decoder = decoder_stats_;
+        if (decoder.frames > 0) {
+            ESP_LOGI(TAG, "Opus decoder: %lu frames, busy avg %lld us max %lld us",
+                decoder.frames, decoder.busy_us / decoder.frames, decoder.max_busy_us);
+        }
+        auto& speech_cache = opus_decoders_.stats();
+        auto& sound_cache = effect_decoders_.stats();
+        ESP_LOGI(TAG, "Opus decoder format switches: speech %lu (created %lu, evicted %lu), sounds %lu (created %lu, evicted %lu)",
+            speech_cache.switches, speech_cache.created, speech_cache.evicted,
+            sound_cache.switches, sound_cache.created, sound_cache.evicted);
+        latency_tracer_.Print();
     }
 }
 
 void AudioService::EnableAudioTesting(bool enable) {
     ESP_LOGI(TAG, "%s audio testing", enable ? "Enabling" : "Disabling");
     if (enable) {
+        audio_testing_playback_ = false;
+        audio_testing_queue_.Clear();
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* Let the opus decoder task play back audio_testing_queue_ */
+        audio_testing_playback_ = true;
+        xEventGroupSetBits(queue_event_group_, AS_QUEUE_DECODE_READABLE);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS);
+        audio_processor_->Initialize(codec_, frame_duration_ms_);
         audio_processor_initialized_ = true;
     }
 
     audio_processor_->EnableDeviceAec(enable);
 }
 
+void AudioService::SetFrameDuration(int frame_duration_ms) {
+    if (!IS_VALID_OPUS_FRAME_DURATION(frame_duration_ms)) {
+        ESP_LOGW(TAG, "Invalid frame duration: %d ms", frame_duration_ms);
+        return;
+    }
+    if (frame_duration_ms_ == frame_duration_ms) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Frame duration: %d ms", frame_duration_ms);
+    frame_duration_ms_ = frame_duration_ms;
+    /* The queue limits are counted in frames, keep them at the same duration */
+    audio_send_queue_.SetLimit(MAX_SEND_PACKETS_IN_QUEUE(frame_duration_ms));
+    audio_decode_queue_.SetLimit(MAX_DECODE_PACKETS_IN_QUEUE(frame_duration_ms));
+    audio_testing_queue_.SetLimit(AUDIO_TESTING_MAX_DURATION_MS / frame_duration_ms);
+    /*
+     * Voice processing may already run, capturing while the audio channel opens. The processor then
+     * cuts its next frames at the new size, and the encoder follows the frames it gets.
+     */
+    if (xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
+        audio_processor_->SetFrameDuration(frame_duration_ms);
+    }
+}
+
 void AudioService::SetCallbacks(AudioServiceCallbacks& callbacks) {
     callbacks_ = callbacks;
 }
@@ -546,111 +951,59 @@ void AudioService::PlaySound(const std::string_view& ogg) {
         codec_->EnableOutput(true);
     }
 
-    const uint8_t* buf = reinterpret_cast<const uint8_t*>(ogg.data());
-    size_t size = ogg.size();
-    size_t offset = 0;
-
-    auto find_page = [&](size_t start)->size_t {
-        for (size_t i = start; i + 4 <= size; ++i) {
-            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
-        }
-        return static_cast<size_t>(-1);
-    };
-
-    bool seen_head = false;
-    bool seen_tags = false;
-    int sample_rate = 16000; // 默认值
-
-    while (true) {
-        size_t pos = find_page(offset);
-        if (pos == static_cast<size_t>(-1)) break;
-        offset = pos;
-        if (offset + 27 > size) break;
-
-        const uint8_t* page = buf + offset;
-        uint8_t page_segments = page[26];
-        size_t seg_table_off = offset + 27;
-        if (seg_table_off + page_segments > size) break;
-
-        size_t body_size = 0;
-        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
-
-        size_t body_off = seg_table_off + page_segments;
-        if (body_off + body_size > size) break;
-
-        // Parse packets using lacing
-        size_t cur = body_off;
-        size_t seg_idx = 0;
-        while (seg_idx < page_segments) {
-            size_t pkt_len = 0;
-            size_t pkt_start = cur;
-            bool continued = false;
-            do {
-                uint8_t l = page[27 + seg_idx++];
-                pkt_len += l;
-                cur += l;
-                continued = (l == 255);
-            } while (continued && seg_idx < page_segments);
-
-            if (pkt_len == 0) continue;
-            const uint8_t* pkt_ptr = buf + pkt_start;
-
-            if (!seen_head) {
-                // 解析OpusHead包
-                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
-                    seen_head = true;
-                    
-                    // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
-                    // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
-                    if (pkt_len >= 12) {
-                        uint8_t version = pkt_ptr[8];
-                        uint8_t channel_count = pkt_ptr[9];
-                        
-                        if (pkt_len >= 16) {
-                            // 读取输入采样率 (little-endian)
-                            sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | 
-                                        (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
-                            ESP_LOGI(TAG, "OpusHead: version=%d, channels=%d, sample_rate=%d", 
-                                   version, channel_count, sample_rate);
-                        }
-                    }
+    auto sound = sound_bank_.Get(ogg);
+    if (sound == nullptr) {
+        return;
+    }
+    int64_t expected = 0;
+    sound_requested_time_us_.compare_exchange_strong(expected, esp_timer_get_time());
+
+    /* The packets point into the embedded sound, nothing is copied */
+    for (auto& sound_packet : sound->packets) {
+        auto packet = CreateAudioStreamPacket();
+        packet->sample_rate = sound->sample_rate;
+        packet->frame_duration = sound_packet.frame_duration;
+        packet->payload_view = sound->data + sound_packet.offset;
+        packet->payload_view_size = sound_packet.size;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(audio_effect_producer_mutex_);
+                if (audio_effect_queue_.Push(std::move(packet))) {
+                    break;
                 }
-                continue;
             }
-            if (!seen_tags) {
-                // Expect OpusTags in second packet
-                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
-                    seen_tags = true;
-                }
-                continue;
+            if (service_stopped_) {
+                return;
             }
-
-            // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->sample_rate = sample_rate;
-            packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
-            PushPacketToDecodeQueue(std::move(packet), true);
+            xEventGroupWaitBits(queue_event_group_, AS_QUEUE_EFFECT_WRITABLE, pdTRUE, pdFALSE, portMAX_DELAY);
         }
-
-        offset = body_off + body_size;
     }
 }
 
+AudioQueueStats AudioService::GetQueueStats() const {
+    AudioQueueStats stats;
+    stats.encode = {audio_encode_queue_.high_water(), audio_encode_queue_.limit()};
+    stats.send = {audio_send_queue_.high_water(), audio_send_queue_.limit()};
+    stats.decode = {audio_decode_queue_.high_water(), audio_decode_queue_.limit()};
+    stats.playback = {audio_playback_queue_.high_water(), audio_playback_queue_.limit()};
+    stats.effect = {audio_effect_queue_.high_water(), audio_effect_queue_.limit()};
+    return stats;
+}
+
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && jitter_buffer_.empty() &&
+        audio_playback_queue_.empty() && audio_testing_queue_.empty() && audio_effect_queue_.empty() &&
+        audio_effect_playback_queue_.empty();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    opus_decoder_->ResetState();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_testing_playback_ = false;
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    /* The decoder and the jitter buffer belong to the opus decoder task, let it reset them */
+    decoder_reset_pending_ = true;
+    xEventGroupSetBits(queue_event_group_, AS_QUEUE_DECODE_READABLE);
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -2,9 +2,9 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
+#include <atomic>
 #include <chrono>
+#include <deque>
 #include <mutex>
 
 #include <freertos/FreeRTOS.h>
@@ -12,35 +12,113 @@
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
 
-#include <opus_encoder.h>
-#include <opus_decoder.h>
-#include <opus_resampler.h>
 
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
 #include "wake_word.h"
+#include "spsc_queue.h"
+#include "jitter_buffer.h"
+#include "opus_stream_decoder.h"
+#include "opus_decoder_cache.h"
+#include "opus_stream_encoder.h"
+#include "uplink_rate_controller.h"
+#include "uplink_dtx.h"
+#include "endpointer.h"
+#include "frame_pool.h"
+#include "interleaved_resampler.h"
+#include "sound_bank.h"
+#include "latency_tracer.h"
+#include "pcm_ring.h"
+#include "playback_timeline.h"
+#include "audio_mixer.h"
 #include "protocol.h"
 
 
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> [Mixer] -> (Speaker)
+ *    (PlaySound) -> {Effect Queue} -> [Opus Decoder] -> {Effect Playback Queue} -> [Mixer]
  *
- * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
+ * We use one task for MIC / Speaker / Processors, and one task each for the Opus Encoder and the Opus Decoder,
+ * so that a long decode never delays the uplink and the other way round.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ *
+ * Every queue is a lock-free SPSC ring with its own readable / writable event bits, so each stage
+ * only wakes the task on the other side of its own hop.
  */
 
+/* Default frame duration, the one in use is negotiated in the hello exchange, see SetFrameDuration() */
+#if CONFIG_OPUS_FRAME_DURATION_20
+#define OPUS_FRAME_DURATION_MS 20
+#elif CONFIG_OPUS_FRAME_DURATION_40
+#define OPUS_FRAME_DURATION_MS 40
+#else
 #define OPUS_FRAME_DURATION_MS 60
+#endif
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define OPUS_MAX_FRAME_DURATION_MS 60
+#define IS_VALID_OPUS_FRAME_DURATION(ms) ((ms) == 20 || (ms) == 40 || (ms) == 60)
+
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_EFFECT_TASKS_IN_QUEUE 2
+#define MAX_QUEUED_AUDIO_DURATION_MS 2400
+#define MAX_DECODE_PACKETS_IN_QUEUE(frame_duration) (MAX_QUEUED_AUDIO_DURATION_MS / (frame_duration))
+#define MAX_SEND_PACKETS_IN_QUEUE(frame_duration) (MAX_QUEUED_AUDIO_DURATION_MS / (frame_duration))
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
-#define MAX_TIMESTAMPS_IN_QUEUE 3
+
+/* Physical ring sizes, the limits above are the backpressure thresholds at the shortest frame duration */
+#define AUDIO_ENCODE_QUEUE_CAPACITY 4
+#define AUDIO_PLAYBACK_QUEUE_CAPACITY 4
+#define AUDIO_EFFECT_QUEUE_CAPACITY 32
+#define AUDIO_EFFECT_PLAYBACK_QUEUE_CAPACITY 4
+#define AUDIO_DECODE_QUEUE_CAPACITY 128
+#define AUDIO_SEND_QUEUE_CAPACITY 128
+#define AUDIO_TESTING_QUEUE_CAPACITY 512
+#define AUDIO_CAPTURE_MARK_QUEUE_CAPACITY 16
+
+/* Frame pools, sized for full queues plus the frames in flight between tasks */
+#define AUDIO_MAX_OPUS_BITRATE 64000
+#define AUDIO_STREAM_PACKET_PAYLOAD_CAPACITY (AUDIO_MAX_OPUS_BITRATE / 8 * OPUS_MAX_FRAME_DURATION_MS / 1000)
+#define AUDIO_STREAM_PACKET_POOL_SIZE (MAX_DECODE_PACKETS_IN_QUEUE(OPUS_MIN_FRAME_DURATION_MS) + \
+    MAX_SEND_PACKETS_IN_QUEUE(OPUS_MIN_FRAME_DURATION_MS) + AUDIO_EFFECT_QUEUE_CAPACITY + 8)
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + MAX_EFFECT_TASKS_IN_QUEUE + 4)
+
+/* Opus worker tasks, core and priority are set in Kconfig */
+#define OPUS_ENCODER_TASK_STACK_SIZE (2048 * 13)
+#define OPUS_DECODER_TASK_STACK_SIZE (2048 * 8)
+#if CONFIG_OPUS_ENCODER_TASK_CORE >= 0
+#define OPUS_ENCODER_TASK_CORE CONFIG_OPUS_ENCODER_TASK_CORE
+#else
+#define OPUS_ENCODER_TASK_CORE tskNO_AFFINITY
+#endif
+#if CONFIG_OPUS_DECODER_TASK_CORE >= 0
+#define OPUS_DECODER_TASK_CORE CONFIG_OPUS_DECODER_TASK_CORE
+#else
+#define OPUS_DECODER_TASK_CORE tskNO_AFFINITY
+#endif
+
+#define SOUND_PCM_CACHE_SIZE (CONFIG_SOUND_PCM_CACHE_SIZE * 1024)
+/* Decoders kept per playback path for the formats seen last, created on first use */
+#if CONFIG_SPIRAM
+#define OPUS_DECODER_CACHE_SIZE 3
+#else
+#define OPUS_DECODER_CACHE_SIZE 2
+#endif
+
+/* Output mixer, sounds are played over the speech, which is lowered while they play */
+#define AUDIO_MIXER_RENDER_MS 20
+#define AUDIO_MIXER_SPEECH_DUCK_Q16 (65536 / 2)
+
+/* Microphone history sent ahead of the processed audio when listening starts, at 16kHz */
+#define AUDIO_PRE_ROLL_SAMPLES (CONFIG_AUDIO_PRE_ROLL_DURATION * 16)
+// A longer pause between two reads means the history no longer leads up to the present
+#define AUDIO_PRE_ROLL_MAX_GAP_MS 200
+// The microphone hears the speaker, so the history restarts after playback plus its echo tail
+#define AUDIO_PRE_ROLL_PLAYBACK_GUARD_MS 300
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
@@ -51,10 +129,24 @@
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
 
+#define AS_QUEUE_ENCODE_READABLE            (1 << 0)
+#define AS_QUEUE_ENCODE_WRITABLE            (1 << 1)
+#define AS_QUEUE_SEND_WRITABLE              (1 << 2)
+#define AS_QUEUE_DECODE_READABLE            (1 << 3)
+#define AS_QUEUE_DECODE_WRITABLE            (1 << 4)
+#define AS_QUEUE_PLAYBACK_READABLE          (1 << 5)
+#define AS_QUEUE_PLAYBACK_WRITABLE          (1 << 6)
+#define AS_QUEUE_EFFECT_PLAYBACK_READABLE   (1 << 7)
+#define AS_QUEUE_EFFECT_WRITABLE            (1 << 8)
+#define AS_QUEUE_EFFECT_PLAYBACK_WRITABLE   (1 << 9)
+#define AS_QUEUE_ALL_BITS                   (0x3FF)
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
     std::function<void(bool)> on_vad_change;
+    // The utterance ended, with the capture time of its last speech
+    std::function<void(int64_t)> on_end_of_speech;
     std::function<void(void)> on_audio_testing_queue_full;
 };
 
@@ -63,14 +155,27 @@ enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
     kAudioTaskTypeDecodeToPlaybackQueue,
+    kAudioTaskTypeDecodeToEffectQueue,
 };
 
 struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
-    uint32_t timestamp;
+    uint32_t timestamp = 0;
+    int64_t queued_time_us = 0;
+    int64_t origin_time_us = 0;     // see AudioStreamPacket::origin_time_us
+    bool silence = false;           // the VAD reported silence, the frame may be suppressed
+    size_t split_samples = 0;       // pcm holds several frames of this size (the pre-roll), encoded one by one
+};
+
+// End of a chunk read from the microphone, matches processor output back to its capture time
+struct CaptureMark {
+    uint64_t end_sample = 0;
+    int64_t time_us = 0;
 };
 
+using AudioTaskPtr = FramePool<AudioTask>::Handle;
+
 struct DebugStatistics {
     uint32_t input_count = 0;
     uint32_t decode_count = 0;
@@ -78,6 +183,28 @@ struct DebugStatistics {
     uint32_t playback_count = 0;
 };
 
+struct AudioQueueDepth {
+    size_t high_water = 0;          // most frames queued at once
+    size_t limit = 0;
+};
+
+struct AudioQueueStats {
+    AudioQueueDepth encode;
+    AudioQueueDepth send;
+    AudioQueueDepth decode;
+    AudioQueueDepth playback;
+    AudioQueueDepth effect;
+};
+
+struct CodecWorkerStats {
+    int frame_duration_ms = 0;
+    uint32_t frames = 0;
+    int64_t busy_us = 0;            // time spent coding, including resampling
+    int64_t max_busy_us = 0;
+    int64_t queue_wait_us = 0;      // time the frames waited in the input queue
+    int64_t max_queue_wait_us = 0;
+};
+
 class AudioService {
 public:
     AudioService();
@@ -87,9 +214,10 @@ public:
     void Start();
     void Stop();
     void EncodeWakeWord();
-    std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
+    AudioStreamPacketPtr PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
+    int frame_duration() const { return frame_duration_ms_; }
     bool IsIdle();
     bool IsWakeWordRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_WAKE_WORD_RUNNING; }
     bool IsAudioProcessorRunning() const { return xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_PROCESSOR_RUNNING; }
@@ -98,14 +226,23 @@ public:
     void EnableVoiceProcessing(bool enable);
     void EnableAudioTesting(bool enable);
     void EnableDeviceAec(bool enable);
+    void SetFrameDuration(int frame_duration_ms);
+    // Suppress the uplink frames the VAD marked as silence, only if the server accepted it
+    void EnableUplinkDtx(bool enable);
 
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
-    bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
-    std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    bool PushPacketToDecodeQueue(AudioStreamPacketPtr packet, bool wait = false);
+    AudioStreamPacketPtr PopPacketFromSendQueue();
+    // Called after each SendAudio() of a packet from PopPacketFromSendQueue(), feeds the uplink rate controller
+    void OnAudioSent(bool sent, int64_t send_us);
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
+    CodecWorkerStats GetEncoderStats() const { return encoder_stats_; }
+    CodecWorkerStats GetDecoderStats() const { return decoder_stats_; }
+    AudioQueueStats GetQueueStats() const;
+    LatencyTracer& GetLatencyTracer() { return latency_tracer_; }
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -113,34 +250,94 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
-    std::unique_ptr<OpusEncoderWrapper> opus_encoder_;
-    std::unique_ptr<OpusDecoderWrapper> opus_decoder_;
-    OpusResampler input_resampler_;
-    OpusResampler reference_resampler_;
-    OpusResampler output_resampler_;
+    std::unique_ptr<OpusStreamEncoder> opus_encoder_;
+    OpusDecoderCache opus_decoders_{OPUS_DECODER_CACHE_SIZE};
+    OpusDecoderCache effect_decoders_{OPUS_DECODER_CACHE_SIZE};
+    InterleavedResampler input_resampler_;
     DebugStatistics debug_statistics_;
+    CodecWorkerStats encoder_stats_;
+    // Only the opus encoder task changes the settings
+    UplinkRateController rate_controller_{{
+        .min_bitrate = CONFIG_AUDIO_UPLINK_BITRATE_MIN,
+        .max_bitrate = CONFIG_AUDIO_UPLINK_BITRATE_MAX,
+        .max_complexity = CONFIG_AUDIO_UPLINK_COMPLEXITY_MAX,
+    }};
+    CodecWorkerStats decoder_stats_;
+    // Silence suppression, enabled when the server accepted it
+    UplinkDtx uplink_dtx_;
+    std::atomic<bool> uplink_dtx_enabled_ = false;
 
     EventGroupHandle_t event_group_;
+    EventGroupHandle_t queue_event_group_;
 
-    // Audio encode / decode
+    // Audio encode / decode, the pool must outlive the queues holding its frames
+    FramePool<AudioTask> audio_task_pool_;
+    std::vector<int16_t> output_resample_buffer_;
+    // Raw codec samples read by the input task before resampling
+    std::vector<int16_t> input_buffer_;
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
-    TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
-    // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    TaskHandle_t opus_encoder_task_handle_ = nullptr;
+    TaskHandle_t opus_decoder_task_handle_ = nullptr;
+    SpscQueue<AudioStreamPacketPtr, AUDIO_DECODE_QUEUE_CAPACITY> audio_decode_queue_;
+    SpscQueue<AudioStreamPacketPtr, AUDIO_SEND_QUEUE_CAPACITY> audio_send_queue_;
+    SpscQueue<AudioStreamPacketPtr, AUDIO_TESTING_QUEUE_CAPACITY> audio_testing_queue_;
+    SpscQueue<AudioTaskPtr, AUDIO_ENCODE_QUEUE_CAPACITY> audio_encode_queue_;
+    SpscQueue<AudioTaskPtr, AUDIO_PLAYBACK_QUEUE_CAPACITY> audio_playback_queue_;
+    // PushPacketToDecodeQueue() and PlaySound() may be called from any task, so producers take turns
+    std::mutex audio_decode_producer_mutex_;
+    std::mutex audio_effect_producer_mutex_;
+    // Sounds are decoded apart from the speech and mixed over it by the audio output task
+    SpscQueue<AudioStreamPacketPtr, AUDIO_EFFECT_QUEUE_CAPACITY> audio_effect_queue_;
+    SpscQueue<AudioTaskPtr, AUDIO_EFFECT_PLAYBACK_QUEUE_CAPACITY> audio_effect_playback_queue_;
+    // Only touched by the audio output task
+    AudioMixer mixer_;
+    std::vector<int16_t> mixer_buffer_;
+    // Set when the recorded testing audio should be played back
+    std::atomic<bool> audio_testing_playback_ = false;
+    // Reorders the downlink and fills lost frames, only touched by the opus decoder task
+    JitterBuffer jitter_buffer_;
+    std::atomic<bool> decoder_reset_pending_ = false;
+    // Embedded sounds indexed once, with the decoded PCM of the short ones
+    SoundBank sound_bank_{SOUND_PCM_CACHE_SIZE};
+    // When the first pending PlaySound was called, to log the time to its first sample
+    std::atomic<int64_t> sound_requested_time_us_ = 0;
+    // To log how long the wake word audio takes to be ready after the detection
+    std::atomic<int64_t> wake_word_detected_time_us_ = 0;
+    std::atomic<int> wake_word_packets_ = 0;
+    std::vector<uint8_t> wake_word_opus_;
+    LatencyTracer latency_tracer_;
+    // Written by the input task, read by the audio processor output
+    SpscQueue<CaptureMark, AUDIO_CAPTURE_MARK_QUEUE_CAPACITY> capture_marks_;
+    uint64_t captured_samples_ = 0;
+    uint64_t processed_samples_ = 0;
+    CaptureMark capture_mark_;
+    // Only the input task touches the ring, the pre-roll is handed over to the processor output
+    PcmRing pre_roll_ring_{AUDIO_PRE_ROLL_SAMPLES};
+    int64_t pre_roll_write_time_us_ = 0;
+    uint64_t pre_roll_mark_ = 0;                    // end of the audio sent with the wake word
+    std::atomic<bool> pre_roll_mark_pending_ = false;
+    std::atomic<bool> pre_roll_pending_ = false;    // listening started, the input task takes the pre-roll
+    std::atomic<bool> pre_roll_ready_ = false;      // pre_roll_pcm_ goes out before the first processed frame
+    std::vector<int16_t> pre_roll_pcm_;
+    std::vector<int16_t> pre_roll_frame_;           // owned by the encoder task
+    std::deque<AudioTaskPtr> parked_tasks_;         // frames captured while the encoder task sends the pre-roll
+    // For server AEC, the downlink audio written to the speaker, to tag the uplink frames with
+    PlaybackTimeline playback_timeline_;
+#if CONFIG_USE_LOCAL_ENDPOINTER
+    // Only the audio processor output uses it, reset when voice processing starts
+    Endpointer endpointer_{{
+        .hangover_ms = CONFIG_AUDIO_ENDPOINT_HANGOVER_MS,
+        .min_speech_ms = CONFIG_AUDIO_ENDPOINT_MIN_SPEECH_MS,
+        .energy_floor_db = CONFIG_AUDIO_ENDPOINT_ENERGY_FLOOR,
+    }};
+#endif
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
     bool voice_detected_ = false;
-    bool service_stopped_ = true;
-    bool audio_input_need_warmup_ = false;
+    std::atomic<bool> service_stopped_ = true;
+    std::atomic<int> frame_duration_ms_ = OPUS_FRAME_DURATION_MS;
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
     std::chrono::steady_clock::time_point last_input_time_;
@@ -148,9 +345,19 @@ private:
 
     void AudioInputTask();
     void AudioOutputTask();
-    void OpusCodecTask();
-    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
-    void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void OpusEncoderTask();
+    void OpusDecoderTask();
+    void ApplyUplinkRateSettings();
+    void EncodeFrame(const AudioTask& task, const std::vector<int16_t>& pcm);
+    void EncodePreRoll(AudioTask& task);
+    void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm, int64_t origin_time_us = 0, uint32_t timestamp = 0, bool silence = false, size_t split_samples = 0);
+    int64_t TraceProcessedSamples(size_t samples, int64_t& first_sample_time_us);
+    void FeedPreRoll(const std::vector<int16_t>& data);
+    void TakePreRoll();
+    void PushPreRollToEncodeQueue();
+    bool PopPacketToDecode(AudioStreamPacketPtr& packet);
+    void DecodeFrame(JitterBufferFrame& frame);
+    void DecodeEffect(AudioStreamPacketPtr& packet);
     void CheckAndUpdateAudioPowerState();
 };
 
@@ -0,0 +1,214 @@
+#include "file_audio_codec.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <cstring>
+
+#define TAG "FileAudioCodec"
+
+#define WAV_HEADER_SIZE 44
+
+static uint32_t ReadLe32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t ReadLe16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static void WriteLe32(uint8_t* p, uint32_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static void WriteLe16(uint8_t* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+FileAudioCodec::FileAudioCodec(const char* input_path, const char* output_path, int output_sample_rate, int speed)
+    : speed_(speed) {
+    duplex_ = true;
+    input_reference_ = false;
+    input_channels_ = 1;
+    input_sample_rate_ = 16000;
+    output_sample_rate_ = output_sample_rate;
+
+    if (input_path != nullptr && !OpenInput(input_path)) {
+        input_finished_ = true;
+    }
+    if (output_path != nullptr) {
+        OpenOutput(output_path);
+    }
+}
+
+FileAudioCodec::~FileAudioCodec() {
+    if (input_file_ != nullptr) {
+        fclose(input_file_);
+    }
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    FinishOutput();
+    if (output_file_ != nullptr) {
+        fclose(output_file_);
+    }
+}
+
+bool FileAudioCodec::OpenInput(const char* path) {
+    input_file_ = fopen(path, "rb");
+    if (input_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return false;
+    }
+
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), input_file_) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
+        ESP_LOGE(TAG, "%s is not a WAV file", path);
+        return false;
+    }
+
+    bool format_found = false;
+    uint8_t chunk[8];
+    while (fread(chunk, 1, sizeof(chunk), input_file_) == sizeof(chunk)) {
+        uint32_t chunk_size = ReadLe32(chunk + 4);
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            uint8_t format[16];
+            if (chunk_size < sizeof(format) || fread(format, 1, sizeof(format), input_file_) != sizeof(format)) {
+                break;
+            }
+            int channels = ReadLe16(format + 2);
+            if (ReadLe16(format) != 1 || ReadLe16(format + 14) != 16 || channels < 1 || channels > 2) {
+                ESP_LOGE(TAG, "%s must be 16 bit PCM with 1 or 2 channels", path);
+                return false;
+            }
+            input_channels_ = channels;
+            input_reference_ = channels == 2;
+            input_sample_rate_ = ReadLe32(format + 4);
+            format_found = true;
+            chunk_size -= sizeof(format);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!format_found) {
+                break;
+            }
+            input_data_left_ = chunk_size;
+            ESP_LOGI(TAG, "Input %s: %d Hz, %d channels, %lu ms", path, input_sample_rate_, input_channels_,
+                (unsigned long)(chunk_size / (2 * input_channels_) * 1000ULL / input_sample_rate_));
+            return true;
+        }
+        // Chunks are padded to an even size
+        fseek(input_file_, chunk_size + (chunk_size & 1), SEEK_CUR);
+    }
+    ESP_LOGE(TAG, "%s has no PCM data", path);
+    return false;
+}
+
+bool FileAudioCodec::OpenOutput(const char* path) {
+    output_file_ = fopen(path, "wb");
+    if (output_file_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create %s", path);
+        return false;
+    }
+    // Sizes are filled in by FinishOutput()
+    uint8_t header[WAV_HEADER_SIZE] = {};
+    fwrite(header, 1, sizeof(header), output_file_);
+    return true;
+}
+
+void FileAudioCodec::FinishOutput() {
+    if (output_file_ == nullptr) {
+        return;
+    }
+    uint8_t header[WAV_HEADER_SIZE];
+    memcpy(header, "RIFF", 4);
+    WriteLe32(header + 4, WAV_HEADER_SIZE - 8 + output_data_size_);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    WriteLe32(header + 16, 16);
+    WriteLe16(header + 20, 1);
+    WriteLe16(header + 22, output_channels_);
+    WriteLe32(header + 24, output_sample_rate_);
+    WriteLe32(header + 28, output_sample_rate_ * output_channels_ * 2);
+    WriteLe16(header + 32, output_channels_ * 2);
+    WriteLe16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    WriteLe32(header + 40, output_data_size_);
+
+    long position = ftell(output_file_);
+    fseek(output_file_, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), output_file_);
+    fseek(output_file_, position, SEEK_SET);
+    fflush(output_file_);
+}
+
+// Blocks until the frames would have passed through the I2S DMA, the clock starts at the first call
+void FileAudioCodec::Pace(int64_t& start_time_us, uint64_t frames, int sample_rate) {
+    int64_t now = esp_timer_get_time();
+    if (start_time_us == 0) {
+        start_time_us = now;
+    }
+    if (speed_ <= 0) {
+        return;
+    }
+    int64_t deadline = start_time_us + frames * 1000000 / (sample_rate * speed_);
+    if (deadline - now >= portTICK_PERIOD_MS * 1000) {
+        vTaskDelay(pdMS_TO_TICKS((deadline - now) / 1000));
+    }
+}
+
+int FileAudioCodec::Read(int16_t* dest, int samples) {
+    std::lock_guard<std::mutex> lock(input_mutex_);
+    size_t bytes = 0;
+    if (!input_finished_) {
+        size_t wanted = samples * sizeof(int16_t);
+        bytes = fread(dest, 1, wanted < input_data_left_ ? wanted : input_data_left_, input_file_);
+        input_data_left_ -= bytes;
+        if (bytes < wanted) {
+            input_finished_ = true;
+            int64_t elapsed_ms = (esp_timer_get_time() - input_start_time_us_) / 1000;
+            uint64_t frames = input_frames_ + bytes / (sizeof(int16_t) * input_channels_);
+            ESP_LOGI(TAG, "Input finished: %llu ms of audio in %lld ms", frames * 1000 / input_sample_rate_, elapsed_ms);
+        }
+    }
+    // Silence after the end of the file, the service keeps reading as long as it runs
+    memset(reinterpret_cast<uint8_t*>(dest) + bytes, 0, samples * sizeof(int16_t) - bytes);
+
+    input_frames_ += samples / input_channels_;
+    Pace(input_start_time_us_, input_frames_, input_sample_rate_);
+    return samples;
+}
+
+int FileAudioCodec::Write(const int16_t* data, int samples) {
+    std::lock_guard<std::mutex> lock(output_mutex_);
+    if (output_file_ != nullptr) {
+        output_data_size_ += fwrite(data, 1, samples * sizeof(int16_t), output_file_);
+    }
+    output_frames_ += samples / output_channels_;
+    Pace(output_start_time_us_, output_frames_, output_sample_rate_);
+    return samples;
+}
+
+void FileAudioCodec::EnableInput(bool enable) {
+    if (enable && !input_enabled_) {
+        // Like the DMA, the clock only runs while the direction is enabled
+        std::lock_guard<std::mutex> lock(input_mutex_);
+        input_start_time_us_ = 0;
+        input_frames_ = 0;
+    }
+    AudioCodec::EnableInput(enable);
+}
+
+void FileAudioCodec::EnableOutput(bool enable) {
+    if (enable != output_enabled_) {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        if (enable) {
+            output_start_time_us_ = 0;
+            output_frames_ = 0;
+        } else {
+            // Leave a playable file behind whenever the service powers the output down
+            FinishOutput();
+        }
+    }
+    AudioCodec::EnableOutput(enable);
+}
@@ -0,0 +1,52 @@
+#ifndef _FILE_AUDIO_CODEC_H
+#define _FILE_AUDIO_CODEC_H
+
+#include "audio_codec.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <mutex>
+
+/*
+ * Codec backed by WAV files instead of I2S, to replay the same recording through AudioService
+ * and capture what it plays. The paths go through stdio, so any mounted VFS (SD card, SPIFFS)
+ * works on the device.
+ *
+ * The input must be 16 bit PCM, with one channel or two (microphone + AEC reference). Reads and
+ * writes are paced like the I2S DMA at `speed` times real time; 0 runs as fast as the pipeline
+ * allows. After the end of the input file Read() returns silence, so a session always sees the
+ * same samples and the output can be compared between runs.
+ */
+class FileAudioCodec : public AudioCodec {
+private:
+    // The service toggles the directions from its power timer while the audio tasks read / write
+    std::mutex input_mutex_;
+    std::mutex output_mutex_;
+    FILE* input_file_ = nullptr;
+    FILE* output_file_ = nullptr;
+    int speed_;
+    bool input_finished_ = false;
+    uint32_t input_data_left_ = 0;      // bytes of the data chunk not read yet
+    uint32_t output_data_size_ = 0;
+    uint64_t input_frames_ = 0;
+    uint64_t output_frames_ = 0;
+    int64_t input_start_time_us_ = 0;
+    int64_t output_start_time_us_ = 0;
+
+    bool OpenInput(const char* path);
+    bool OpenOutput(const char* path);
+    void FinishOutput();
+    void Pace(int64_t& start_time_us, uint64_t frames, int sample_rate);
+
+    virtual int Read(int16_t* dest, int samples) override;
+    virtual int Write(const int16_t* data, int samples) override;
+
+public:
+    FileAudioCodec(const char* input_path, const char* output_path, int output_sample_rate, int speed = 1);
+    virtual ~FileAudioCodec();
+
+    virtual void EnableInput(bool enable) override;
+    virtual void EnableOutput(bool enable) override;
+};
+
+#endif // _FILE_AUDIO_CODEC_H
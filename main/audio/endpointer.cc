@@ -0,0 +1,55 @@
+#include "endpointer.h"
+
+#include <esp_log.h>
+#include <cmath>
+
+#define TAG "Endpointer"
+
+Endpointer::Endpointer(const EndpointerConfig& config) : config_(config) {
+    energy_floor_ = (int64_t)(32768.0 * 32768.0 * std::pow(10.0, config_.energy_floor_db / 10.0));
+}
+
+void Endpointer::Reset() {
+    speech_ms_ = 0;
+    silence_ms_ = 0;
+    last_speech_time_us_ = 0;
+}
+
+bool Endpointer::Process(bool vad_speech, const int16_t* pcm, size_t samples, int64_t capture_time_us) {
+    if (samples == 0 || (!vad_speech && speech_ms_ == 0)) {
+        return false;
+    }
+    int frame_ms = samples / 16;
+
+    bool speech = false;
+    if (vad_speech) {
+        int64_t sum = 0;
+        for (size_t i = 0; i < samples; i++) {
+            sum += (int32_t)pcm[i] * pcm[i];
+        }
+        speech = sum / (int64_t)samples >= energy_floor_;
+    }
+    if (speech) {
+        speech_ms_ += frame_ms;
+        silence_ms_ = 0;
+        last_speech_time_us_ = capture_time_us;
+        return false;
+    }
+    if (speech_ms_ == 0) {
+        return false;
+    }
+
+    silence_ms_ += frame_ms;
+    if (silence_ms_ < config_.hangover_ms) {
+        return false;
+    }
+    bool ended = speech_ms_ >= config_.min_speech_ms;
+    if (ended) {
+        ESP_LOGI(TAG, "End of utterance after %d ms of speech and %d ms of silence", speech_ms_, silence_ms_);
+        speech_end_time_us_ = last_speech_time_us_;
+    } else {
+        ESP_LOGD(TAG, "Dropped %d ms of speech, too short for an utterance", speech_ms_);
+    }
+    Reset();
+    return ended;
+}
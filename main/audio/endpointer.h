@@ -0,0 +1,44 @@
+#ifndef ENDPOINTER_H
+#define ENDPOINTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct EndpointerConfig {
+    int hangover_ms = 700;          // silence after the speech that ends the utterance
+    int min_speech_ms = 300;        // shorter bursts (clicks, coughs) are not an utterance
+    int energy_floor_db = -50;      // dBFS, quieter frames are silence whatever the VAD says
+};
+
+/*
+ * Finds the end of an utterance in the processed 16 kHz uplink audio.
+ *
+ * A frame counts as speech when the AFE VAD reports speech and its level is above the energy
+ * floor, which rejects VAD triggers on residual noise. Once at least min_speech_ms of speech was
+ * heard, hangover_ms of silence in a row ends the utterance. Shorter speech followed by the same
+ * silence is dropped and the endpointer waits for the next utterance.
+ *
+ * Process() is called by the audio processor output, one frame at a time.
+ */
+class Endpointer {
+public:
+    explicit Endpointer(const EndpointerConfig& config);
+
+    void Reset();
+    // Returns true on the frame that ends the utterance
+    bool Process(bool vad_speech, const int16_t* pcm, size_t samples, int64_t capture_time_us);
+
+    // Capture time of the last speech frame of the utterance that ended
+    inline int64_t speech_end_time_us() const { return speech_end_time_us_; }
+
+private:
+    EndpointerConfig config_;
+    int64_t energy_floor_ = 0;      // mean square of a frame at the floor
+
+    int speech_ms_ = 0;
+    int silence_ms_ = 0;
+    int64_t last_speech_time_us_ = 0;
+    int64_t speech_end_time_us_ = 0;
+};
+
+#endif // ENDPOINTER_H
@@ -0,0 +1,179 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+
+struct FramePoolStats {
+    size_t allocated = 0;   // objects currently owned by the pool (free + in use)
+    size_t in_use = 0;
+    size_t high_water = 0;  // max objects in use at the same time
+    size_t misses = 0;      // acquisitions that had to go beyond max_size
+};
+
+// Slots are 16 bit indexes in the free list head, the other 16 bits count its changes
+#define FRAME_POOL_MAX_SIZE 0xFFFE
+
+/*
+ * Recycling object pool for per-frame audio objects.
+ *
+ * Objects are created on demand up to max_size and are never freed afterwards: when a handle
+ * is destroyed the object is reset (keeping the capacity of its buffers) and put back on the
+ * free list, so once the pool has warmed up a steady stream of frames does no heap allocation.
+ * Acquisitions beyond max_size still succeed but are counted as misses and freed on release.
+ *
+ * Packets are acquired and released by the network, codec and main tasks on both cores, once
+ * per frame each. The free list is a lock-free stack of slot indexes so none of them can block
+ * on a task holding a lock: the head packs the top slot with a change counter, which keeps a
+ * compare-exchange from succeeding on a head that was popped and pushed back in between.
+ */
+template <typename T>
+class FramePool {
+public:
+    class Recycler {
+    public:
+        Recycler() = default;
+        Recycler(FramePool* pool, size_t slot) : pool_(pool), slot_(slot) {}
+        void operator()(T* item) const {
+            if (pool_ != nullptr) {
+                pool_->Release(item, slot_);
+            } else {
+                delete item;
+            }
+        }
+
+    private:
+        FramePool* pool_ = nullptr;
+        size_t slot_ = 0;
+    };
+
+    using Handle = std::unique_ptr<T, Recycler>;
+
+    // init is called once for every new object, reset every time an object is recycled
+    FramePool(size_t max_size, std::function<void(T&)> init, std::function<void(T&)> reset)
+        : max_size_(std::min<size_t>(max_size, FRAME_POOL_MAX_SIZE)), init_(init), reset_(reset),
+          items_(new T*[max_size_]()), next_(new std::atomic<uint16_t>[max_size_]) {
+    }
+
+    // Handles must not outlive the pool
+    ~FramePool() {
+        for (size_t slot = 0; slot < created_; slot++) {
+            delete items_[slot];
+        }
+    }
+
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+
+    // Pre-create objects so that the first frames do not allocate either
+    void Reserve(size_t count) {
+        size_t slot;
+        while (created_ < count && ClaimSlot(slot)) {
+            PushFree(slot);
+        }
+    }
+
+    Handle Acquire() {
+        size_t slot;
+        T* item;
+        if (PopFree(slot) || ClaimSlot(slot)) {
+            item = items_[slot];
+        } else {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            allocated_.fetch_add(1, std::memory_order_relaxed);
+            slot = max_size_;
+            item = CreateItem();
+        }
+        size_t in_use = in_use_.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t high_water = high_water_.load(std::memory_order_relaxed);
+        while (in_use > high_water && !high_water_.compare_exchange_weak(high_water, in_use, std::memory_order_relaxed)) {
+        }
+        return Handle(item, Recycler(this, slot));
+    }
+
+    // The counters are read one by one, a snapshot may be off by the frames moving meanwhile
+    FramePoolStats GetStats() const {
+        FramePoolStats stats;
+        stats.allocated = allocated_.load(std::memory_order_relaxed);
+        stats.in_use = in_use_.load(std::memory_order_relaxed);
+        stats.high_water = high_water_.load(std::memory_order_relaxed);
+        stats.misses = misses_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    const size_t max_size_;
+    std::function<void(T&)> init_;
+    std::function<void(T&)> reset_;
+    std::unique_ptr<T*[]> items_;                       // by slot, created on first use
+    std::unique_ptr<std::atomic<uint16_t>[]> next_;     // free list link of each slot, slot + 1, 0 ends
+    std::atomic<uint32_t> free_head_ = 0;               // change counter << 16 | top slot + 1
+    std::atomic<size_t> created_ = 0;
+    std::atomic<size_t> allocated_ = 0;
+    std::atomic<size_t> in_use_ = 0;
+    std::atomic<size_t> high_water_ = 0;
+    std::atomic<size_t> misses_ = 0;
+
+    T* CreateItem() {
+        T* item = new T();
+        if (init_) {
+            init_(*item);
+        }
+        return item;
+    }
+
+    // Creates the object of the next unused slot, false once all max_size slots exist
+    bool ClaimSlot(size_t& slot) {
+        size_t created = created_.load(std::memory_order_relaxed);
+        do {
+            if (created >= max_size_) {
+                return false;
+            }
+        } while (!created_.compare_exchange_weak(created, created + 1, std::memory_order_relaxed));
+        slot = created;
+        items_[slot] = CreateItem();
+        allocated_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void PushFree(size_t slot) {
+        uint32_t head = free_head_.load(std::memory_order_relaxed);
+        uint32_t new_head;
+        do {
+            next_[slot].store(head & 0xFFFF, std::memory_order_relaxed);
+            new_head = ((head + 0x10000) & 0xFFFF0000) | (slot + 1);
+        } while (!free_head_.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    bool PopFree(size_t& slot) {
+        uint32_t head = free_head_.load(std::memory_order_acquire);
+        while ((head & 0xFFFF) != 0) {
+            size_t top = (head & 0xFFFF) - 1;
+            uint32_t new_head = ((head + 0x10000) & 0xFFFF0000) | next_[top].load(std::memory_order_relaxed);
+            if (free_head_.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+                slot = top;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Release(T* item, size_t slot) {
+        if (reset_) {
+            reset_(*item);
+        }
+        in_use_.fetch_sub(1, std::memory_order_relaxed);
+        if (slot < max_size_) {
+            PushFree(slot);
+            return;
+        }
+        allocated_.fetch_sub(1, std::memory_order_relaxed);
+        delete item;
+    }
+};
+
+#endif // FRAME_POOL_H
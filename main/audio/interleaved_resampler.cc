@@ -0,0 +1,167 @@
+#include "interleaved_resampler.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "InterleavedResampler"
+
+static inline int16_t Saturate(int32_t value) {
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return value;
+}
+
+// One output frame from taps frames of interleaved input starting at x
+template <int Channels>
+static inline void FilterFrame(const int16_t* x, const int16_t* coefs, int taps, int shift, int16_t* y) {
+    int32_t acc[Channels];
+    for (int c = 0; c < Channels; c++) {
+        acc[c] = 1 << (shift - 1);
+    }
+    for (int i = 0; i < taps; i++) {
+        int32_t coef = coefs[i];
+        for (int c = 0; c < Channels; c++) {
+            acc[c] += coef * x[c];
+        }
+        x += Channels;
+    }
+    for (int c = 0; c < Channels; c++) {
+        y[c] = Saturate(acc[c] >> shift);
+    }
+}
+
+void InterleavedResampler::Configure(int input_sample_rate, int output_sample_rate, int channels) {
+    if (channels > INTERLEAVED_RESAMPLER_MAX_CHANNELS) {
+        ESP_LOGE(TAG, "Unsupported channel count: %d", channels);
+        channels = INTERLEAVED_RESAMPLER_MAX_CHANNELS;
+    }
+    if (input_sample_rate == input_sample_rate_ && output_sample_rate == output_sample_rate_ && channels == channels_) {
+        // The same stream, keep its state
+        return;
+    }
+
+    auto filter = FindPolyphaseFilter(input_sample_rate, output_sample_rate);
+    if (filter != nullptr) {
+        CarryHistory(filter, input_sample_rate, channels);
+        position_ = 0;
+    } else {
+        for (int c = 0; c < channels; c++) {
+            resamplers_[c].Configure(input_sample_rate, output_sample_rate);
+        }
+    }
+    filter_ = filter;
+    input_sample_rate_ = input_sample_rate;
+    output_sample_rate_ = output_sample_rate;
+    channels_ = channels;
+    ESP_LOGI(TAG, "Resampling %d channel(s) from %d to %d Hz (%s)", channels_, input_sample_rate, output_sample_rate,
+        filter_ != nullptr ? "polyphase" : "opus");
+}
+
+void InterleavedResampler::Reset() {
+    if (filter_ != nullptr) {
+        work_.assign((filter_->taps_per_phase - 1) * channels_, 0);
+        position_ = 0;
+    } else if (input_sample_rate_ != 0) {
+        // Configuring the opus resampler initializes its state
+        for (int c = 0; c < channels_; c++) {
+            resamplers_[c].Configure(input_sample_rate_, output_sample_rate_);
+        }
+    }
+}
+
+void InterleavedResampler::CarryHistory(const PolyphaseFilter* filter, int input_sample_rate, int channels) {
+    // The newest input frames held by the previous configuration
+    size_t held = filter_ != nullptr && channels == channels_ ? work_.size() / channels : 0;
+    size_t history = filter->taps_per_phase - 1;
+    std::vector<int16_t> work(history * channels, 0);
+    if (held > 0) {
+        const int16_t* src;
+        size_t keep;
+        if (input_sample_rate == input_sample_rate_) {
+            // Same input rate, the newest frames go on as they are
+            keep = std::min(held, history);
+            src = work_.data() + (held - keep) * channels;
+            memcpy(work.data() + (history - keep) * channels, src, keep * channels * sizeof(int16_t));
+        } else {
+            // The old frames do not fit the new rate, hold the newest one instead of starting from silence
+            keep = 0;
+            src = work_.data() + (held - 1) * channels;
+        }
+        for (size_t i = 0; i < history - keep; i++) {
+            memcpy(work.data() + i * channels, src, channels * sizeof(int16_t));
+        }
+    }
+    work_.swap(work);
+}
+
+void InterleavedResampler::Process(const int16_t* input, size_t frames, std::vector<int16_t>& output) {
+    if (filter_ != nullptr) {
+        ProcessFused(input, frames, output);
+    } else {
+        ProcessFallback(input, frames, output);
+    }
+}
+
+void InterleavedResampler::ProcessFused(const int16_t* input, size_t frames, std::vector<int16_t>& output) {
+    const int interpolation = filter_->interpolation;
+    const int decimation = filter_->decimation;
+    const int taps = filter_->taps_per_phase;
+    const int history = taps - 1;
+    work_.resize((history + frames) * channels_);
+    memcpy(work_.data() + history * channels_, input, frames * channels_ * sizeof(int16_t));
+
+    // Output n of this block sits at upsampled position position_ + n * decimation
+    const int end = frames * interpolation;
+    int output_frames = position_ < end ? (end - position_ + decimation - 1) / decimation : 0;
+    output.resize(output_frames * channels_);
+
+    // Every phase has a DC gain of 1 in Q15
+    const int shift = 15;
+    int16_t* y = output.data();
+    int position = position_;
+    for (int n = 0; n < output_frames; n++) {
+        int phase = position % interpolation;
+        // The last input frame under the filter is position / interpolation of the new input
+        const int16_t* x = work_.data() + (position / interpolation) * channels_;
+        const int16_t* coefs = filter_->coefs + phase * taps;
+        if (channels_ == 2) {
+            FilterFrame<2>(x, coefs, taps, shift, y);
+        } else {
+            FilterFrame<1>(x, coefs, taps, shift, y);
+        }
+        y += channels_;
+        position += decimation;
+    }
+    position_ = position - end;
+
+    // Keep the tail as history for the next block
+    memmove(work_.data(), work_.data() + frames * channels_, history * channels_ * sizeof(int16_t));
+    work_.resize(history * channels_);
+}
+
+void InterleavedResampler::ProcessFallback(const int16_t* input, size_t frames, std::vector<int16_t>& output) {
+    if (channels_ == 1) {
+        output.resize(resamplers_[0].GetOutputSamples(frames));
+        resamplers_[0].Process(input, frames, output.data());
+        return;
+    }
+
+    size_t output_frames = resamplers_[0].GetOutputSamples(frames);
+    channel_input_.resize(frames);
+    channel_output_.resize(output_frames);
+    output.resize(output_frames * channels_);
+    for (int c = 0; c < channels_; c++) {
+        for (size_t i = 0, j = c; i < frames; ++i, j += channels_) {
+            channel_input_[i] = input[j];
+        }
+        resamplers_[c].Process(channel_input_.data(), frames, channel_output_.data());
+        for (size_t i = 0, j = c; i < output_frames; ++i, j += channels_) {
+            output[j] = channel_output_[i];
+        }
+    }
+}
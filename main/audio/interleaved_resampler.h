@@ -0,0 +1,62 @@
+#ifndef INTERLEAVED_RESAMPLER_H
+#define INTERLEAVED_RESAMPLER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <opus_resampler.h>
+
+#include "polyphase_filters.h"
+
+#define INTERLEAVED_RESAMPLER_MAX_CHANNELS 2
+
+/*
+ * Streaming resampler for interleaved (or mono) 16 bit audio: the microphone (+ reference) input,
+ * and the decoded downlink and sounds on their way to the codec.
+ *
+ * The ratios with a bank in polyphase_filters.h go through a fused polyphase FIR that reads the
+ * interleaved input and writes the interleaved output directly, filtering all channels in the
+ * same pass. Other ratios fall back to one OpusResampler per channel. Both paths work on buffers
+ * owned by the resampler, so once the first frame has sized them no frame allocates. The filter
+ * loop is portable C, there is no ESP32-S3 PIE version of it.
+ *
+ * Configure() with the current rates keeps the stream as it is. A new ratio carries the filter
+ * history over, so a rate change in the middle of a stream does not click. Reset() drops the
+ * history for a new stream.
+ */
+class InterleavedResampler {
+public:
+    InterleavedResampler() = default;
+
+    void Configure(int input_sample_rate, int output_sample_rate, int channels);
+    // Keeps the rates, the next block starts from silence as after the first Configure()
+    void Reset();
+    // Resizes output to the resampled frames, keeping its capacity
+    void Process(const int16_t* input, size_t frames, std::vector<int16_t>& output);
+
+    inline int input_sample_rate() const { return input_sample_rate_; }
+    inline int output_sample_rate() const { return output_sample_rate_; }
+    inline int channels() const { return channels_; }
+
+private:
+    int input_sample_rate_ = 0;
+    int output_sample_rate_ = 0;
+    int channels_ = 1;
+
+    // Fused path: upsample by the interpolation, filter, keep one sample out of the decimation
+    const PolyphaseFilter* filter_ = nullptr;
+    int position_ = 0;                  // next output, in upsampled samples from the start of the new input
+    std::vector<int16_t> work_;         // interleaved, taps_per_phase - 1 frames of history then the new input
+
+    // Fallback path
+    OpusResampler resamplers_[INTERLEAVED_RESAMPLER_MAX_CHANNELS];
+    std::vector<int16_t> channel_input_;
+    std::vector<int16_t> channel_output_;
+
+    void CarryHistory(const PolyphaseFilter* filter, int input_sample_rate, int channels);
+    void ProcessFused(const int16_t* input, size_t frames, std::vector<int16_t>& output);
+    void ProcessFallback(const int16_t* input, size_t frames, std::vector<int16_t>& output);
+};
+
+#endif // INTERLEAVED_RESAMPLER_H
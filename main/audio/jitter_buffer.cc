@@ -0,0 +1,260 @@
+#include "jitter_buffer.h"
+
+#include <esp_log.h>
+#include <opus.h>
+
+#define TAG "JitterBuffer"
+
+// Whether the packet carries LBRR (in-band FEC) data for the frame before it. The same check as
+// opus_packet_has_lbrr() of libopus 1.5, which older libopus releases do not export
+static bool OpusPacketHasLbrr(const uint8_t* data, size_t size) {
+    if (size < 1 || (data[0] >> 3) >= 16) {
+        // Empty or CELT only, which has no LBRR
+        return false;
+    }
+    const unsigned char* frames[48];
+    opus_int16 sizes[48];
+    if (opus_packet_parse(data, size, nullptr, frames, sizes, nullptr) <= 0 || sizes[0] == 0) {
+        return false;
+    }
+    // The first SILK frame starts with a VAD flag per 20 ms, followed by the LBRR flag, per channel
+    int silk_frames = opus_packet_get_samples_per_frame(data, 48000) / 960;
+    if (silk_frames < 1) {
+        silk_frames = 1;
+    }
+    bool lbrr = (frames[0][0] >> (7 - silk_frames)) & 1;
+    if (opus_packet_get_nb_channels(data) == 2) {
+        lbrr = lbrr || ((frames[0][0] >> (6 - 2 * silk_frames)) & 1);
+    }
+    return lbrr;
+}
+
+void JitterBuffer::Reset() {
+    while (count_ > 0) {
+        PopFront();
+    }
+    head_ = 0;
+    synced_ = false;
+    playing_ = false;
+    drained_ = false;
+    started_ = false;
+    grow_pending_ = false;
+    starving_since_us_ = -1;
+    sequence_offset_ = 0;
+    has_last_arrival_ = false;
+    // The jitter estimate describes the link, so it is kept for the next stream
+}
+
+AudioStreamPacketPtr JitterBuffer::PopFront() {
+    auto packet = std::move(slots_[head_]);
+    head_ = (head_ + 1) % JITTER_BUFFER_CAPACITY;
+    count_--;
+    return packet;
+}
+
+void JitterBuffer::UpdateJitter(uint32_t sequence, int64_t now_us) {
+    if (has_last_arrival_) {
+        int32_t delta = static_cast<int32_t>(sequence - last_arrival_sequence_);
+        if (delta <= 0) {
+            // Reordered packet, the next in-order arrival is measured instead
+            return;
+        }
+        // Only arrivals later than their spacing count, bursts ahead of time are harmless
+        int64_t excess = (now_us - last_arrival_us_) - delta * frame_duration_us_;
+        int64_t max_excess = JITTER_BUFFER_MAX_DEPTH * frame_duration_us_;
+        if (excess > max_excess) {
+            excess = max_excess;
+        }
+        // Peak hold with a slow decay, so a single late burst keeps the buffer deeper for a while
+        jitter_us_ -= jitter_us_ / 32;
+        if (excess > jitter_us_) {
+            jitter_us_ = excess;
+        }
+    }
+    has_last_arrival_ = true;
+    last_arrival_sequence_ = sequence;
+    last_arrival_us_ = now_us;
+}
+
+void JitterBuffer::UpdateTargetDepth() {
+    target_depth_ = 1 + (jitter_us_ + frame_duration_us_ / 2) / frame_duration_us_;
+    if (loss_hold_ > 0) {
+        target_depth_++;
+    }
+    if (target_depth_ > JITTER_BUFFER_MAX_DEPTH) {
+        target_depth_ = JITTER_BUFFER_MAX_DEPTH;
+    }
+}
+
+void JitterBuffer::Put(AudioStreamPacketPtr&& packet, int64_t now_us) {
+    stats_.received++;
+    if (packet->frame_duration > 0) {
+        frame_duration_us_ = packet->frame_duration * 1000;
+    }
+
+    uint32_t sequence;
+    if (packet->sequence == 0) {
+        sequence = synced_ ? last_sequence_ + 1 : 1;
+    } else {
+        sequence = packet->sequence + sequence_offset_;
+        int32_t distance = static_cast<int32_t>(sequence - next_sequence_);
+        if (synced_ && (distance > JITTER_BUFFER_RESYNC_DISTANCE || distance < -JITTER_BUFFER_RESYNC_DISTANCE)) {
+            // A new stream (the server restarted its numbering), continue after the last packet
+            ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, resyncing", next_sequence_, sequence);
+            sequence_offset_ = last_sequence_ + 1 - packet->sequence;
+            sequence = last_sequence_ + 1;
+        }
+    }
+    packet->sequence = sequence;
+
+    if (!synced_) {
+        synced_ = true;
+        next_sequence_ = sequence;
+        last_sequence_ = sequence - 1;
+    }
+
+    int32_t distance = static_cast<int32_t>(sequence - next_sequence_);
+    if (distance < 0) {
+        if (started_) {
+            // Too late, the buffer is shallower than the jitter
+            stats_.late++;
+            grow_pending_ = true;
+            return;
+        }
+        // Reordered before the playout started
+        next_sequence_ = sequence;
+    }
+    if (full()) {
+        ESP_LOGW(TAG, "Jitter buffer is full, dropping packet %lu", sequence);
+        return;
+    }
+
+    size_t count = count_;
+    for (size_t i = 0; i < count; i++) {
+        if (SlotAt(i)->sequence == sequence) {
+            stats_.late++;
+            return;
+        }
+    }
+
+    if (drained_) {
+        // The stream went on after the buffer ran dry: an audible gap
+        drained_ = false;
+        if (sequence == next_sequence_) {
+            stats_.underruns++;
+            loss_hold_ = JITTER_BUFFER_LOSS_HOLD_PACKETS;
+        }
+        has_last_arrival_ = false;
+    }
+    UpdateJitter(sequence, now_us);
+    if (loss_hold_ > 0) {
+        loss_hold_--;
+    }
+    UpdateTargetDepth();
+
+    if (count == 0 && !playing_) {
+        buffering_since_us_ = now_us;
+    }
+    if (static_cast<int32_t>(sequence - last_sequence_) > 0) {
+        last_sequence_ = sequence;
+    }
+
+    // Insert sorted, packets usually arrive in order so this rarely shifts anything
+    size_t index = count;
+    while (index > 0 && static_cast<int32_t>(SlotAt(index - 1)->sequence - sequence) > 0) {
+        SlotAt(index) = std::move(SlotAt(index - 1));
+        index--;
+    }
+    SlotAt(index) = std::move(packet);
+    count_++;
+}
+
+JitterBufferFrame JitterBuffer::Pull(int64_t now_us, bool output_starving) {
+    JitterBufferFrame frame;
+    if (!output_starving) {
+        starving_since_us_ = -1;
+    }
+    if (count_ == 0) {
+        if (playing_ && output_starving) {
+            // The last frame taken from the playback queue is still being played, wait for it
+            if (starving_since_us_ < 0) {
+                starving_since_us_ = now_us;
+            }
+            int64_t starved_us = now_us - starving_since_us_;
+            if (starved_us < frame_duration_us_) {
+                frame.wait_ms = (frame_duration_us_ - starved_us) / 1000 + 1;
+                return frame;
+            }
+            playing_ = false;
+            drained_ = true;
+        }
+        return frame;
+    }
+    starving_since_us_ = -1;
+
+    if (!playing_) {
+        int64_t prebuffer_us = target_depth_ * frame_duration_us_;
+        int64_t waited_us = now_us - buffering_since_us_;
+        if (static_cast<int>(count_) < target_depth_ && waited_us < prebuffer_us) {
+            frame.wait_ms = (prebuffer_us - waited_us) / 1000 + 1;
+            return frame;
+        }
+        playing_ = true;
+        drained_ = false;
+        // Anything older than the first buffered packet did not make it in time
+        int32_t skipped = static_cast<int32_t>(SlotAt(0)->sequence - next_sequence_);
+        if (started_ && skipped > 0) {
+            stats_.lost += skipped;
+            loss_hold_ = JITTER_BUFFER_LOSS_HOLD_PACKETS;
+        }
+        next_sequence_ = SlotAt(0)->sequence;
+        started_ = true;
+    }
+
+    if (grow_pending_) {
+        grow_pending_ = false;
+        if (static_cast<int>(count_) < target_depth_) {
+            // Play one concealed frame, so the packets queued behind it wait one frame longer
+            stats_.stretched++;
+            frame.action = kJitterBufferConceal;
+            return frame;
+        }
+    }
+
+    int32_t distance = static_cast<int32_t>(SlotAt(0)->sequence - next_sequence_);
+    if (distance > 0) {
+        if (!output_starving) {
+            // Give the missing packet time to arrive while the output still has audio
+            return frame;
+        }
+        loss_hold_ = JITTER_BUFFER_LOSS_HOLD_PACKETS;
+        if (distance <= JITTER_BUFFER_MAX_CONCEAL_FRAMES) {
+            stats_.lost++;
+            next_sequence_++;
+            auto& next = SlotAt(0);
+            if (distance == 1 && OpusPacketHasLbrr(next->payload_data(), next->payload_size())) {
+                stats_.fec_recovered++;
+                frame.action = kJitterBufferDecodeFec;
+                frame.next_packet = next.get();
+            } else {
+                stats_.concealed++;
+                frame.action = kJitterBufferConceal;
+            }
+            return frame;
+        }
+        // Concealment would only fade to silence over such a gap, skip to the next packet
+        stats_.lost += distance;
+    }
+
+    next_sequence_ = SlotAt(0)->sequence + 1;
+    frame.action = kJitterBufferDecode;
+    frame.packet = PopFront();
+    return frame;
+}
+
+JitterBufferStats JitterBuffer::GetStats() const {
+    JitterBufferStats stats = stats_;
+    stats.jitter_ms = jitter_us_ / 1000;
+    stats.target_depth = target_depth_;
+    return stats;
+}
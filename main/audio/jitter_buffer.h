@@ -0,0 +1,103 @@
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include "protocol.h"
+
+#define JITTER_BUFFER_CAPACITY 16
+#define JITTER_BUFFER_MAX_DEPTH 5
+#define JITTER_BUFFER_MAX_CONCEAL_FRAMES 3
+#define JITTER_BUFFER_RESYNC_DISTANCE 64
+// Packets to keep one extra frame of depth for after a loss or an underrun
+#define JITTER_BUFFER_LOSS_HOLD_PACKETS 100
+
+struct JitterBufferStats {
+    uint32_t received = 0;
+    uint32_t late = 0;          // arrived after their slot was played or concealed, or duplicated
+    uint32_t lost = 0;          // missing when they were due
+    uint32_t fec_recovered = 0; // lost frames rebuilt from the FEC data of the next packet
+    uint32_t concealed = 0;     // lost frames filled by packet loss concealment
+    uint32_t stretched = 0;     // concealed frames inserted to deepen the buffer
+    uint32_t underruns = 0;     // the buffer ran dry while the stream was still going
+    uint32_t jitter_ms = 0;
+    uint32_t target_depth = 0;
+};
+
+enum JitterBufferAction {
+    kJitterBufferWait,      // nothing to play yet
+    kJitterBufferDecode,    // decode the returned packet
+    kJitterBufferDecodeFec, // the due packet is lost, decode the FEC data of the next packet
+    kJitterBufferConceal,   // the due packet is lost, run packet loss concealment
+};
+
+struct JitterBufferFrame {
+    JitterBufferAction action = kJitterBufferWait;
+    AudioStreamPacketPtr packet;                    // kJitterBufferDecode
+    const AudioStreamPacket* next_packet = nullptr; // kJitterBufferDecodeFec, still owned by the buffer
+    int wait_ms = -1;                               // kJitterBufferWait, -1 until the next arrival
+};
+
+/*
+ * Sequence ordered jitter buffer in front of the Opus decoder.
+ *
+ * Packets are kept sorted by sequence number. Packets without a sequence number (websocket,
+ * local sounds) are numbered in arrival order. Playout (re)starts once the buffer holds the
+ * target depth, or once the first packet has waited that long. The target depth follows the
+ * measured arrival jitter, plus one frame for a while after a loss or an underrun so that the
+ * next gap is noticed before the output starves. When packets keep arriving after their slot
+ * was concealed, one concealed frame is inserted to deepen the buffer while it is playing. A missing packet is only given up when the output is about to starve; it is then
+ * rebuilt from the in-band FEC of the next packet if possible, or concealed.
+ *
+ * Only the Opus decoder task may call Put / Pull / Reset.
+ */
+class JitterBuffer {
+public:
+    JitterBuffer() = default;
+
+    void Reset();
+    // Takes the packet in any case, late and duplicated packets are dropped
+    void Put(AudioStreamPacketPtr&& packet, int64_t now_us);
+    // output_starving tells that the playback queue has run empty
+    JitterBufferFrame Pull(int64_t now_us, bool output_starving);
+
+    JitterBufferStats GetStats() const;
+    inline size_t size() const { return count_; }
+    inline bool empty() const { return count_ == 0; }
+    inline bool full() const { return count_ >= JITTER_BUFFER_CAPACITY; }
+
+private:
+    std::array<AudioStreamPacketPtr, JITTER_BUFFER_CAPACITY> slots_;
+    size_t head_ = 0;
+    std::atomic<size_t> count_ = 0;
+
+    bool synced_ = false;
+    bool playing_ = false;
+    bool drained_ = false;
+    bool started_ = false;
+    bool grow_pending_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t last_sequence_ = 0;
+    uint32_t sequence_offset_ = 0;
+    int64_t buffering_since_us_ = 0;
+    int64_t starving_since_us_ = -1;
+    int64_t frame_duration_us_ = 60000;
+
+    bool has_last_arrival_ = false;
+    uint32_t last_arrival_sequence_ = 0;
+    int64_t last_arrival_us_ = 0;
+    int64_t jitter_us_ = 0;
+    int loss_hold_ = 0;
+    int target_depth_ = 1;
+
+    JitterBufferStats stats_;
+
+    inline AudioStreamPacketPtr& SlotAt(size_t index) { return slots_[(head_ + index) % JITTER_BUFFER_CAPACITY]; }
+    AudioStreamPacketPtr PopFront();
+    void UpdateJitter(uint32_t sequence, int64_t now_us);
+    void UpdateTargetDepth();
+};
+
+#endif // JITTER_BUFFER_H
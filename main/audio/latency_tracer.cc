@@ -0,0 +1,141 @@
+#include "latency_tracer.h"
+
+#include <esp_log.h>
+#include <esp_console.h>
+#include <cJSON.h>
+#include <cstring>
+
+#define TAG "LatencyTracer"
+
+static const char* const kStageNames[kLatencyStageCount] = {
+    "process",
+    "encode",
+    "send",
+    "uplink",
+    "decode",
+    "playback",
+    "downlink",
+};
+
+static int GetBucket(uint32_t ms) {
+    if (ms < LATENCY_LINEAR_BUCKETS) {
+        return ms;
+    }
+    int msb = 31 - __builtin_clz(ms);
+    int bucket = LATENCY_LINEAR_BUCKETS + (msb - 4) * LATENCY_BUCKETS_PER_OCTAVE + ((ms >> (msb - 3)) & 7);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Largest value that falls into the bucket
+static uint32_t GetBucketLimit(int bucket) {
+    if (bucket < LATENCY_LINEAR_BUCKETS) {
+        return bucket;
+    }
+    int octave = (bucket - LATENCY_LINEAR_BUCKETS) / LATENCY_BUCKETS_PER_OCTAVE;
+    int sub = (bucket - LATENCY_LINEAR_BUCKETS) % LATENCY_BUCKETS_PER_OCTAVE;
+    uint32_t width = 1u << (octave + 1);
+    return (LATENCY_BUCKETS_PER_OCTAVE + sub) * width + width - 1;
+}
+
+const char* LatencyTracer::GetStageName(LatencyStage stage) {
+    return kStageNames[stage];
+}
+
+void LatencyTracer::Record(LatencyStage stage, int64_t elapsed_us) {
+    if (elapsed_us < 0) {
+        return;
+    }
+    uint32_t ms = elapsed_us / 1000;
+    auto& histogram = histograms_[stage];
+    histogram.buckets[GetBucket(ms)]++;
+    if (ms > histogram.max_ms) {
+        histogram.max_ms = ms;
+    }
+}
+
+void LatencyTracer::Reset() {
+    for (auto& histogram : histograms_) {
+        histogram = Histogram();
+    }
+}
+
+LatencySummary LatencyTracer::GetSummary(LatencyStage stage) const {
+    // Work on a copy so that the percentiles are consistent with each other
+    Histogram histogram = histograms_[stage];
+    LatencySummary summary;
+    summary.max_ms = histogram.max_ms;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        summary.count += histogram.buckets[i];
+    }
+    if (summary.count == 0) {
+        return summary;
+    }
+
+    uint32_t* targets[] = { &summary.p50_ms, &summary.p95_ms, &summary.p99_ms };
+    const uint32_t percents[] = { 50, 95, 99 };
+    uint32_t seen = 0;
+    int next = 0;
+    for (int i = 0; i < LATENCY_BUCKETS && next < 3; i++) {
+        seen += histogram.buckets[i];
+        while (next < 3 && seen * 100 >= summary.count * percents[next]) {
+            // The last bucket is open ended
+            uint32_t limit = i == LATENCY_BUCKETS - 1 ? summary.max_ms : GetBucketLimit(i);
+            *targets[next++] = limit < summary.max_ms ? limit : summary.max_ms;
+        }
+    }
+    return summary;
+}
+
+std::string LatencyTracer::GetJson() const {
+    cJSON* root = cJSON_CreateObject();
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto summary = GetSummary(static_cast<LatencyStage>(i));
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "count", summary.count);
+        cJSON_AddNumberToObject(stage, "p50", summary.p50_ms);
+        cJSON_AddNumberToObject(stage, "p95", summary.p95_ms);
+        cJSON_AddNumberToObject(stage, "p99", summary.p99_ms);
+        cJSON_AddNumberToObject(stage, "max", summary.max_ms);
+        cJSON_AddItemToObject(root, kStageNames[i], stage);
+    }
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+void LatencyTracer::Print() const {
+    for (int i = 0; i < kLatencyStageCount; i++) {
+        auto summary = GetSummary(static_cast<LatencyStage>(i));
+        if (summary.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-8s %6lu frames, p50 %4lu ms, p95 %4lu ms, p99 %4lu ms, max %4lu ms", kStageNames[i],
+            summary.count, summary.p50_ms, summary.p95_ms, summary.p99_ms, summary.max_ms);
+    }
+}
+
+void LatencyTracer::RegisterConsoleCommand() {
+    const esp_console_cmd_t cmd = {
+        .command = "audio_latency",
+        .help = "Print the audio latency percentiles per stage, 'audio_latency reset' clears them",
+        .hint = NULL,
+        .func = NULL,
+        .argtable = NULL,
+        .func_w_context = [](void* context, int argc, char** argv) -> int {
+            auto self = static_cast<LatencyTracer*>(context);
+            if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+                self->Reset();
+                return 0;
+            }
+            printf("%s\n", self->GetJson().c_str());
+            return 0;
+        },
+        .context = this
+    };
+    esp_err_t err = esp_console_cmd_register(&cmd);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to register console command: %s", esp_err_to_name(err));
+    }
+}
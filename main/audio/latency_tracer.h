@@ -0,0 +1,61 @@
+#ifndef LATENCY_TRACER_H
+#define LATENCY_TRACER_H
+
+#include <string>
+#include <cstdint>
+
+enum LatencyStage {
+    kLatencyStageProcess,   // microphone read -> audio processor output
+    kLatencyStageEncode,    // audio processor output -> encoded (encode queue included)
+    kLatencyStageSend,      // encoded -> handed to the protocol (send queue included)
+    kLatencyStageUplink,    // microphone read -> handed to the protocol
+    kLatencyStageDecode,    // network receive -> decoded (jitter buffer included)
+    kLatencyStagePlayback,  // decoded -> written to I2S (playback queue included)
+    kLatencyStageDownlink,  // network receive -> written to I2S
+    kLatencyStageCount,
+};
+
+// Below 16 ms every millisecond has its own bucket, above that 8 buckets per power of two (12.5%)
+#define LATENCY_LINEAR_BUCKETS 16
+#define LATENCY_BUCKETS_PER_OCTAVE 8
+#define LATENCY_BUCKETS (LATENCY_LINEAR_BUCKETS + 12 * LATENCY_BUCKETS_PER_OCTAVE)
+
+struct LatencySummary {
+    uint32_t count = 0;
+    uint32_t p50_ms = 0;
+    uint32_t p95_ms = 0;
+    uint32_t p99_ms = 0;
+    uint32_t max_ms = 0;
+};
+
+/*
+ * Per-stage latency histograms of the audio frames.
+ *
+ * Frames carry esp_timer timestamps through the pipeline and each stage boundary records the
+ * elapsed time here. Recording is one bucket lookup and an increment into fixed memory, cheap
+ * enough to stay enabled. Each stage is recorded by a single task, readers may see a frame
+ * being recorded, which only skews a snapshot by one count.
+ */
+class LatencyTracer {
+public:
+    void Record(LatencyStage stage, int64_t elapsed_us);
+    void Reset();
+
+    LatencySummary GetSummary(LatencyStage stage) const;
+    // {"process":{"count":..,"p50":..,"p95":..,"p99":..,"max":..},...}, times in ms
+    std::string GetJson() const;
+    void Print() const;
+    // Adds the audio_latency command, for boards that start a serial console
+    void RegisterConsoleCommand();
+
+    static const char* GetStageName(LatencyStage stage);
+
+private:
+    struct Histogram {
+        uint32_t buckets[LATENCY_BUCKETS] = {};
+        uint32_t max_ms = 0;
+    };
+    Histogram histograms_[kLatencyStageCount];
+};
+
+#endif // LATENCY_TRACER_H
@@ -0,0 +1,75 @@
+#include "opus_decoder_cache.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusDecoderCache"
+
+OpusDecoderCache::OpusDecoderCache(size_t capacity) : entries_(capacity > 0 ? capacity : 1) {
+}
+
+void OpusDecoderCache::SetOutputSampleRate(int output_sample_rate) {
+    output_sample_rate_ = output_sample_rate;
+    for (auto& entry : entries_) {
+        if (entry.decoder && entry.decoder->sample_rate() != output_sample_rate_) {
+            entry.resampler.Configure(entry.decoder->sample_rate(), output_sample_rate_, 1);
+        }
+    }
+}
+
+OpusStreamDecoder* OpusDecoderCache::Select(int sample_rate, int frame_duration) {
+    if (current_ != nullptr && current_->decoder->sample_rate() == sample_rate && current_->decoder->duration_ms() == frame_duration) {
+        return current_->decoder.get();
+    }
+
+    // An unused entry first, the least recently used one otherwise
+    Entry* found = nullptr;
+    Entry* victim = nullptr;
+    for (auto& entry : entries_) {
+        if (entry.decoder && entry.decoder->sample_rate() == sample_rate && entry.decoder->duration_ms() == frame_duration) {
+            found = &entry;
+            break;
+        }
+        if (victim == nullptr || (victim->decoder && (!entry.decoder || entry.last_used < victim->last_used))) {
+            victim = &entry;
+        }
+    }
+
+    if (current_ != nullptr) {
+        stats_.switches++;
+    }
+    if (found == nullptr) {
+        found = victim;
+        if (found->decoder) {
+            ESP_LOGI(TAG, "Replacing the %d Hz %d ms decoder", found->decoder->sample_rate(), found->decoder->duration_ms());
+            found->decoder.reset();
+            stats_.evicted++;
+        }
+        found->decoder = std::make_unique<OpusStreamDecoder>(sample_rate, 1, frame_duration);
+        stats_.created++;
+        if (sample_rate != output_sample_rate_) {
+            ESP_LOGI(TAG, "Resampling audio from %d to %d", sample_rate, output_sample_rate_);
+            found->resampler.Configure(sample_rate, output_sample_rate_, 1);
+        }
+    }
+    found->last_used = ++use_count_;
+    current_ = found;
+    return current_->decoder.get();
+}
+
+void OpusDecoderCache::Resample(std::vector<int16_t>& pcm, std::vector<int16_t>& buffer) {
+    if (current_ == nullptr || current_->decoder->sample_rate() == output_sample_rate_) {
+        return;
+    }
+    current_->resampler.Process(pcm.data(), pcm.size(), buffer);
+    pcm.swap(buffer);
+}
+
+void OpusDecoderCache::ResetState() {
+    for (auto& entry : entries_) {
+        if (entry.decoder) {
+            entry.decoder->ResetState();
+            // Otherwise the first frame is filtered with the end of the previous stream
+            entry.resampler.Reset();
+        }
+    }
+}
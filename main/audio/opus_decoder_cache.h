@@ -0,0 +1,58 @@
+#ifndef OPUS_DECODER_CACHE_H
+#define OPUS_DECODER_CACHE_H
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "opus_stream_decoder.h"
+#include "interleaved_resampler.h"
+
+struct OpusDecoderCacheStats {
+    uint32_t switches = 0;      // the stream format changed
+    uint32_t created = 0;       // a decoder had to be created for it
+    uint32_t evicted = 0;       // the least recently used decoder made room
+};
+
+/*
+ * The decoders of one playback path, each with its resampler to the output rate, keyed by sample
+ * rate and frame duration.
+ *
+ * Switching back to a format that was used recently picks its decoder and resampler again with
+ * their state intact, so sounds at 16 kHz alternating with 24 kHz speech cost neither a decoder
+ * construction nor a click. The decoders are created on first use, the least recently used one
+ * is replaced when the cache is full.
+ *
+ * Only the opus decoder task uses it.
+ */
+class OpusDecoderCache {
+public:
+    explicit OpusDecoderCache(size_t capacity);
+
+    void SetOutputSampleRate(int output_sample_rate);
+    // Makes the decoder for this format the current one
+    OpusStreamDecoder* Select(int sample_rate, int frame_duration);
+    // Resamples the output of the current decoder to the output rate, buffer is swapped into pcm
+    void Resample(std::vector<int16_t>& pcm, std::vector<int16_t>& buffer);
+    // A new stream starts, the state of every decoder and resampler is stale
+    void ResetState();
+
+    inline OpusStreamDecoder* decoder() const { return current_ != nullptr ? current_->decoder.get() : nullptr; }
+    inline const OpusDecoderCacheStats& stats() const { return stats_; }
+
+private:
+    struct Entry {
+        std::unique_ptr<OpusStreamDecoder> decoder;
+        InterleavedResampler resampler;
+        uint32_t last_used = 0;
+    };
+
+    std::vector<Entry> entries_;
+    Entry* current_ = nullptr;
+    int output_sample_rate_ = 0;
+    uint32_t use_count_ = 0;
+    OpusDecoderCacheStats stats_;
+};
+
+#endif // OPUS_DECODER_CACHE_H
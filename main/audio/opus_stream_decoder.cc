@@ -0,0 +1,55 @@
+#include "opus_stream_decoder.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusStreamDecoder"
+
+OpusStreamDecoder::OpusStreamDecoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {
+    int error;
+    audio_dec_ = opus_decoder_create(sample_rate, channels, &error);
+    if (audio_dec_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio decoder, error code: %d", error);
+    }
+    frame_size_ = sample_rate / 1000 * duration_ms;
+}
+
+OpusStreamDecoder::~OpusStreamDecoder() {
+    if (audio_dec_ != nullptr) {
+        opus_decoder_destroy(audio_dec_);
+    }
+}
+
+bool OpusStreamDecoder::DecodeInternal(const uint8_t* data, size_t size, std::vector<int16_t>& pcm, int decode_fec) {
+    if (audio_dec_ == nullptr) {
+        return false;
+    }
+    pcm.resize(frame_size_ * channels_);
+    // A null packet makes opus run packet loss concealment for frame_size samples
+    int ret = opus_decode(audio_dec_, data, size, pcm.data(), frame_size_, decode_fec);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to decode audio, error code: %d", ret);
+        pcm.clear();
+        return false;
+    }
+    pcm.resize(ret * channels_);
+    return true;
+}
+
+bool OpusStreamDecoder::Decode(const uint8_t* opus, size_t size, std::vector<int16_t>& pcm) {
+    return DecodeInternal(opus, size, pcm, 0);
+}
+
+bool OpusStreamDecoder::DecodeFec(const uint8_t* next_opus, size_t size, std::vector<int16_t>& pcm) {
+    return DecodeInternal(next_opus, size, pcm, 1);
+}
+
+bool OpusStreamDecoder::Conceal(std::vector<int16_t>& pcm) {
+    return DecodeInternal(nullptr, 0, pcm, 0);
+}
+
+void OpusStreamDecoder::ResetState() {
+    if (audio_dec_ != nullptr) {
+        opus_decoder_ctl(audio_dec_, OPUS_RESET_STATE);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef OPUS_STREAM_DECODER_H
+#define OPUS_STREAM_DECODER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <opus.h>
+
+/*
+ * Opus decoder for the downlink stream. Unlike OpusDecoderWrapper it can also fill a lost
+ * frame, either from the in-band FEC data carried by the next packet or by packet loss
+ * concealment, which is what the jitter buffer asks for.
+ */
+class OpusStreamDecoder {
+public:
+    OpusStreamDecoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamDecoder();
+
+    bool Decode(const uint8_t* opus, size_t size, std::vector<int16_t>& pcm);
+    // Rebuild the frame before next_opus from its FEC data
+    bool DecodeFec(const uint8_t* next_opus, size_t size, std::vector<int16_t>& pcm);
+    bool Conceal(std::vector<int16_t>& pcm);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    OpusDecoder* audio_dec_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    int frame_size_;
+
+    bool DecodeInternal(const uint8_t* data, size_t size, std::vector<int16_t>& pcm, int decode_fec);
+};
+
+#endif // OPUS_STREAM_DECODER_H
@@ -0,0 +1,61 @@
+#include "opus_stream_encoder.h"
+
+#include <esp_log.h>
+
+#define TAG "OpusStreamEncoder"
+
+OpusStreamEncoder::OpusStreamEncoder(int sample_rate, int channels, int duration_ms)
+    : sample_rate_(sample_rate), channels_(channels), duration_ms_(duration_ms) {
+    int error;
+    audio_enc_ = opus_encoder_create(sample_rate, channels, OPUS_APPLICATION_VOIP, &error);
+    if (audio_enc_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", error);
+    }
+    frame_size_ = sample_rate / 1000 * duration_ms;
+}
+
+OpusStreamEncoder::~OpusStreamEncoder() {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_destroy(audio_enc_);
+    }
+}
+
+int OpusStreamEncoder::Encode(const std::vector<int16_t>& pcm, uint8_t* opus, size_t max_size) {
+    if (audio_enc_ == nullptr) {
+        return -1;
+    }
+    if (pcm.size() != (size_t)(frame_size_ * channels_)) {
+        ESP_LOGE(TAG, "Invalid frame size: %u, expected %d", (unsigned)pcm.size(), frame_size_ * channels_);
+        return -1;
+    }
+    int ret = opus_encode(audio_enc_, pcm.data(), frame_size_, opus, max_size);
+    if (ret < 0) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        return -1;
+    }
+    return ret;
+}
+
+void OpusStreamEncoder::SetBitrate(int bitrate) {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_BITRATE(bitrate));
+    }
+}
+
+void OpusStreamEncoder::SetComplexity(int complexity) {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_COMPLEXITY(complexity));
+    }
+}
+
+void OpusStreamEncoder::SetDtx(bool enable) {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_SET_DTX(enable ? 1 : 0));
+    }
+}
+
+void OpusStreamEncoder::ResetState() {
+    if (audio_enc_ != nullptr) {
+        opus_encoder_ctl(audio_enc_, OPUS_RESET_STATE);
+    }
+}
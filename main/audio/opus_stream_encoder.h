@@ -0,0 +1,39 @@
+#ifndef OPUS_STREAM_ENCODER_H
+#define OPUS_STREAM_ENCODER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <opus.h>
+
+/*
+ * Opus encoder for the uplink stream and the wake word history. Unlike OpusEncoderWrapper it
+ * encodes exactly one frame per call from a buffer it only reads, and lets the bitrate be changed
+ * while the stream is running, which is what the uplink rate controller needs.
+ */
+class OpusStreamEncoder {
+public:
+    OpusStreamEncoder(int sample_rate, int channels, int duration_ms = 60);
+    ~OpusStreamEncoder();
+
+    // pcm must hold one frame of duration_ms. Returns the packet size written to opus, or -1
+    int Encode(const std::vector<int16_t>& pcm, uint8_t* opus, size_t max_size);
+    // Bits per second, or OPUS_AUTO
+    void SetBitrate(int bitrate);
+    void SetComplexity(int complexity);
+    void SetDtx(bool enable);
+    void ResetState();
+
+    inline int sample_rate() const { return sample_rate_; }
+    inline int duration_ms() const { return duration_ms_; }
+
+private:
+    OpusEncoder* audio_enc_ = nullptr;
+    int sample_rate_;
+    int channels_;
+    int duration_ms_;
+    int frame_size_;
+};
+
+#endif // OPUS_STREAM_ENCODER_H
@@ -0,0 +1,94 @@
+#include "pcm_kernels.h"
+
+static inline int16_t SaturateInt16(int32_t value) {
+    if (value > INT16_MAX) {
+        return INT16_MAX;
+    }
+    if (value < INT16_MIN) {
+        return INT16_MIN;
+    }
+    return value;
+}
+
+static inline int ClampVolume(int volume) {
+    return volume < 0 ? 0 : volume > 100 ? 100 : volume;
+}
+
+int32_t PcmVolumeCurveQ16(int volume) {
+    volume = ClampVolume(volume);
+    return volume * volume * 65536 / 10000;
+}
+
+int32_t PcmVolumeLinearQ16(int volume) {
+    return ClampVolume(volume) * 65536 / 100;
+}
+
+void PcmScaleInt16(const int16_t* src, int16_t* dst, size_t samples, int32_t gain_q16) {
+    if (gain_q16 <= 65536) {
+        // Both factors fit in 17 bits, so the product stays within 32 bits
+        for (size_t i = 0; i < samples; i++) {
+            dst[i] = SaturateInt16((src[i] * gain_q16) >> 16);
+        }
+        return;
+    }
+    // Amplification, split the gain so that the product still stays within 32 bits
+    int32_t gain_int = gain_q16 >> 16;
+    int32_t gain_frac = gain_q16 & 0xFFFF;
+    for (size_t i = 0; i < samples; i++) {
+        int32_t value = src[i] * gain_int + ((src[i] * gain_frac) >> 16);
+        dst[i] = SaturateInt16(value);
+    }
+}
+
+void PcmInt16ToInt32(const int16_t* src, int32_t* dst, size_t samples, int32_t gain_q16) {
+    // Walk backwards so that dst may overlay src
+    for (size_t i = samples; i > 0; i--) {
+        dst[i - 1] = src[i - 1] * gain_q16;
+    }
+}
+
+void PcmInt16ToInt32Stereo(const int16_t* src, int32_t* dst, size_t samples, int32_t gain_q16) {
+    for (size_t i = 0, j = 0; i < samples; ++i, j += 2) {
+        int32_t value = src[i] * gain_q16;
+        dst[j] = value;
+        dst[j + 1] = value;
+    }
+}
+
+void PcmAccumulateInt16(const int16_t* src, int32_t* acc, size_t samples, int32_t gain_q16, int32_t end_gain_q16) {
+    if (samples == 0) {
+        return;
+    }
+    if (gain_q16 == end_gain_q16) {
+        for (size_t i = 0; i < samples; i++) {
+            acc[i] += (src[i] * gain_q16) >> 16;
+        }
+        return;
+    }
+    // The gain is stepped in Q24 so that short blocks still ramp smoothly
+    int32_t gain = gain_q16 << 8;
+    int32_t step = ((end_gain_q16 - gain_q16) << 8) / (int32_t)samples;
+    for (size_t i = 0; i < samples; i++) {
+        acc[i] += (src[i] * (gain >> 8)) >> 16;
+        gain += step;
+    }
+}
+
+void PcmInt32ToInt16(const int32_t* src, int16_t* dst, size_t samples, int shift) {
+    for (size_t i = 0; i < samples; i++) {
+        dst[i] = SaturateInt16(src[i] >> shift);
+    }
+}
+
+void PcmExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel) {
+    for (size_t i = 0, j = channel; i < frames; ++i, j += channels) {
+        dst[i] = src[j];
+    }
+}
+
+void PcmMonoToStereo(const int16_t* src, int16_t* dst, size_t samples) {
+    for (size_t i = 0, j = 0; i < samples; ++i, j += 2) {
+        dst[j] = src[i];
+        dst[j + 1] = src[i];
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef PCM_KERNELS_H
+#define PCM_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sample format and volume kernels shared by the I2S codecs.
+ *
+ * All kernels work on caller owned buffers and never allocate. Gains are Q16 (65536 is unity)
+ * and results saturate instead of wrapping. Unless noted, src and dst may be the same buffer.
+ *
+ * They are plain C loops without an ESP32-S3 PIE path, which could not be built and checked bit
+ * for bit against them. test/host/pcm_kernels_test.cc keeps the replaced per-codec loops as the
+ * reference any such path has to match.
+ */
+
+// (volume / 100)^2 in Q16, the volume curve of the I2S codecs, volume is 0-100
+int32_t PcmVolumeCurveQ16(int volume);
+// volume / 100 in Q16, volume is 0-100
+int32_t PcmVolumeLinearQ16(int volume);
+
+// dst = saturate(src * gain_q16 >> 16)
+void PcmScaleInt16(const int16_t* src, int16_t* dst, size_t samples, int32_t gain_q16);
+// dst = src * gain_q16, the left aligned 32 bit samples written to I2S, gain_q16 is 0-65536 so it never overflows
+void PcmInt16ToInt32(const int16_t* src, int32_t* dst, size_t samples, int32_t gain_q16);
+// Same, writing each mono sample to both slots of a stereo frame; dst holds samples * 2 values and must not alias src
+void PcmInt16ToInt32Stereo(const int16_t* src, int32_t* dst, size_t samples, int32_t gain_q16);
+// acc += src * gain >> 16, the gain ramps linearly from gain_q16 towards end_gain_q16 (both 0-65536)
+void PcmAccumulateInt16(const int16_t* src, int32_t* acc, size_t samples, int32_t gain_q16, int32_t end_gain_q16);
+// dst = saturate(src >> shift), to the full int16 range (NoAudioCodec::Read used to stop at -32767)
+void PcmInt32ToInt16(const int32_t* src, int16_t* dst, size_t samples, int shift);
+// Copy one channel out of interleaved frames, dst may be src
+void PcmExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel);
+// Duplicate mono samples into stereo frames; dst holds samples * 2 values and must not alias src
+void PcmMonoToStereo(const int16_t* src, int16_t* dst, size_t samples);
+
+#endif // PCM_KERNELS_H
@@ -0,0 +1,73 @@
+#include "pcm_ring.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "PcmRing"
+
+PcmRing::PcmRing(size_t capacity) {
+    if (capacity == 0) {
+        return;
+    }
+#if CONFIG_SPIRAM
+    buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_SPIRAM);
+#else
+    buffer_ = (int16_t*)heap_caps_malloc(capacity * sizeof(int16_t), MALLOC_CAP_8BIT);
+#endif
+    if (buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate %u samples", (unsigned)capacity);
+        return;
+    }
+    capacity_ = capacity;
+}
+
+PcmRing::~PcmRing() {
+    if (buffer_ != nullptr) {
+        heap_caps_free(buffer_);
+    }
+}
+
+void PcmRing::Write(const int16_t* data, size_t frames, int channels) {
+    if (capacity_ == 0) {
+        return;
+    }
+    // Only the newest samples survive a write longer than the ring
+    if (frames > capacity_) {
+        data += (frames - capacity_) * channels;
+        written_ += frames - capacity_;
+        frames = capacity_;
+    }
+    size_t index = written_ % capacity_;
+    if (channels == 1) {
+        size_t first = frames < capacity_ - index ? frames : capacity_ - index;
+        memcpy(buffer_ + index, data, first * sizeof(int16_t));
+        memcpy(buffer_, data + first, (frames - first) * sizeof(int16_t));
+    } else {
+        for (size_t i = 0; i < frames; i++) {
+            buffer_[index] = data[i * channels];
+            if (++index == capacity_) {
+                index = 0;
+            }
+        }
+    }
+    written_ += frames;
+}
+
+bool PcmRing::Read(uint64_t start, size_t count, int16_t* dest) const {
+    if (count == 0) {
+        return true;
+    }
+    if (start < oldest() || start + count > written_) {
+        return false;
+    }
+    size_t index = start % capacity_;
+    size_t first = count < capacity_ - index ? count : capacity_ - index;
+    memcpy(dest, buffer_ + index, first * sizeof(int16_t));
+    memcpy(dest + first, buffer_, (count - first) * sizeof(int16_t));
+    return true;
+}
+
+void PcmRing::Reset() {
+    written_ = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Fixed-size history of the 16kHz microphone signal.
+ *
+ * Samples are addressed by their absolute position since the last Reset(), so a reader can
+ * remember a position (e.g. where the wake word ended) and later copy everything after it, as
+ * long as it has not been overwritten yet. Only the first channel of the input is kept.
+ *
+ * Not thread safe, the audio input task owns it.
+ */
+class PcmRing {
+public:
+    explicit PcmRing(size_t capacity);
+    ~PcmRing();
+    PcmRing(const PcmRing&) = delete;
+    PcmRing& operator=(const PcmRing&) = delete;
+
+    void Write(const int16_t* data, size_t frames, int channels);
+    // Copies the samples [start, start + count), fails if any of them is no longer (or not yet) held
+    bool Read(uint64_t start, size_t count, int16_t* dest) const;
+    void Reset();
+
+    inline size_t capacity() const { return capacity_; }
+    // Position after the newest sample
+    inline uint64_t written() const { return written_; }
+    // Position of the oldest sample still held
+    inline uint64_t oldest() const { return written_ > capacity_ ? written_ - capacity_ : 0; }
+
+private:
+    int16_t* buffer_ = nullptr;
+    size_t capacity_ = 0;
+    uint64_t written_ = 0;
+};
+
+#endif // PCM_RING_H
@@ -0,0 +1,145 @@
+#include "playback_timeline.h"
+
+#include <esp_log.h>
+#include <cfloat>
+
+#define TAG "PlaybackTimeline"
+
+void PlaybackTimeline::SetSampleRate(int sample_rate) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    sample_rate_ = sample_rate;
+    us_per_sample_ = 0;
+    synced_ = false;
+}
+
+void PlaybackTimeline::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry_head_ = 0;
+    entry_count_ = 0;
+    synced_ = false;
+}
+
+void PlaybackTimeline::StartLine(uint64_t sample, int64_t time_us) {
+    synced_ = true;
+    anchor_sample_ = sample;
+    anchor_time_us_ = time_us;
+    // The fitted clock rate belongs to the hardware, it is kept across lines
+    if (us_per_sample_ == 0) {
+        us_per_sample_ = 1000000.0 / sample_rate_;
+    }
+    point_count_ = 0;
+    interval_start_ = sample;
+    interval_min_ = {sample, time_us};
+    interval_min_residual_ = 0;
+}
+
+void PlaybackTimeline::FitLine() {
+    if (point_count_ < 2) {
+        return;
+    }
+    // Least squares over the lowest write of each second, relative to the oldest one
+    const Point& origin = points_[0];
+    double mean_x = 0, mean_y = 0;
+    for (size_t i = 0; i < point_count_; i++) {
+        mean_x += (double)(points_[i].sample - origin.sample);
+        mean_y += (double)(points_[i].time_us - origin.time_us);
+    }
+    mean_x /= point_count_;
+    mean_y /= point_count_;
+    double sxx = 0, sxy = 0;
+    for (size_t i = 0; i < point_count_; i++) {
+        double dx = (double)(points_[i].sample - origin.sample) - mean_x;
+        double dy = (double)(points_[i].time_us - origin.time_us) - mean_y;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    if (sxx <= 0) {
+        return;
+    }
+    double nominal = 1000000.0 / sample_rate_;
+    double slope = sxy / sxx;
+    double max_slope = nominal * (1 + PLAYBACK_TIMELINE_MAX_DRIFT_PPM / 1000000.0);
+    double min_slope = nominal * (1 - PLAYBACK_TIMELINE_MAX_DRIFT_PPM / 1000000.0);
+    us_per_sample_ = slope > max_slope ? max_slope : (slope < min_slope ? min_slope : slope);
+
+    uint64_t sample = origin.sample + (uint64_t)mean_x;
+    anchor_time_us_ = origin.time_us + mean_y + ((double)(sample - origin.sample) - mean_x) * us_per_sample_;
+    anchor_sample_ = sample;
+}
+
+void PlaybackTimeline::Record(uint32_t timestamp, size_t samples, int64_t write_time_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t start = written_samples_;
+    written_samples_ += samples;
+
+    // Local audio in a row shares one entry
+    Entry* last = entry_count_ > 0 ? &entries_[(entry_head_ + PLAYBACK_TIMELINE_CAPACITY - 1) % PLAYBACK_TIMELINE_CAPACITY] : nullptr;
+    if (timestamp == 0 && last != nullptr && last->timestamp == 0 && last->start_sample + last->samples == start &&
+        last->samples + samples <= UINT32_MAX) {
+        last->samples += samples;
+    } else {
+        entries_[entry_head_] = {timestamp, start, (uint32_t)samples};
+        entry_head_ = (entry_head_ + 1) % PLAYBACK_TIMELINE_CAPACITY;
+        if (entry_count_ < PLAYBACK_TIMELINE_CAPACITY) {
+            entry_count_++;
+        }
+    }
+
+    // The write returns once the end of the frame fits in the DMA buffers
+    uint64_t sample = written_samples_;
+    if (!synced_) {
+        StartLine(sample, write_time_us);
+        return;
+    }
+    double residual = write_time_us - (anchor_time_us_ + (double)(int64_t)(sample - anchor_sample_) * us_per_sample_);
+    if (residual > PLAYBACK_TIMELINE_GAP_MS * 1000) {
+        ESP_LOGD(TAG, "Output resumed %lld ms behind the line", (int64_t)residual / 1000);
+        StartLine(sample, write_time_us);
+        return;
+    }
+    if (residual < 0) {
+        // Earlier than any write so far, the line moves down to it
+        anchor_time_us_ += residual;
+        residual = 0;
+    }
+    if (residual <= interval_min_residual_) {
+        interval_min_ = {sample, write_time_us};
+        interval_min_residual_ = residual;
+    }
+    if (sample - interval_start_ >= (uint64_t)sample_rate_) {
+        if (point_count_ == PLAYBACK_TIMELINE_FIT_POINTS) {
+            for (size_t i = 1; i < point_count_; i++) {
+                points_[i - 1] = points_[i];
+            }
+            point_count_--;
+        }
+        points_[point_count_++] = interval_min_;
+        FitLine();
+        interval_start_ = sample;
+        interval_min_residual_ = DBL_MAX;
+    }
+}
+
+uint32_t PlaybackTimeline::GetTimestamp(int64_t time_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!synced_ || entry_count_ == 0) {
+        return 0;
+    }
+    double offset = (time_us - anchor_time_us_) / us_per_sample_;
+    double position = (double)anchor_sample_ + offset;
+    if (position < 0 || position >= (double)written_samples_) {
+        // Nothing had been written for that time, the output was idle
+        return 0;
+    }
+    uint64_t sample = (uint64_t)position;
+    for (size_t i = 0; i < entry_count_; i++) {
+        const Entry& entry = entries_[(entry_head_ + PLAYBACK_TIMELINE_CAPACITY - 1 - i) % PLAYBACK_TIMELINE_CAPACITY];
+        if (sample >= entry.start_sample) {
+            if (sample >= entry.start_sample + entry.samples || entry.timestamp == 0) {
+                return 0;
+            }
+            return entry.timestamp + (uint32_t)((sample - entry.start_sample) * 1000 / sample_rate_);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef PLAYBACK_TIMELINE_H
+#define PLAYBACK_TIMELINE_H
+
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+#define PLAYBACK_TIMELINE_CAPACITY 64
+// Minimum points of the output clock fit, one per second of playback
+#define PLAYBACK_TIMELINE_FIT_POINTS 8
+// A write returning this much later than the clock predicts means the output ran dry
+#define PLAYBACK_TIMELINE_GAP_MS 40
+// Bound of the fitted output clock against esp_timer
+#define PLAYBACK_TIMELINE_MAX_DRIFT_PPM 500
+
+/*
+ * Which downlink audio was playing at a given time, for server side AEC.
+ *
+ * The output task records every frame it writes: the server timestamp of the frame (0 for local
+ * audio), its length and the time the blocking write returned. The samples written are counted
+ * continuously, and a line fitted over the write times maps a sample index to an esp_timer time.
+ * Writes are only ever delayed by scheduling, so the line follows the earliest writes, and its
+ * slope is fitted to the lowest write of each second, which corrects the drift between the I2S
+ * clock and esp_timer. A write far behind the line means the output ran dry and starts a new
+ * line.
+ *
+ * GetTimestamp() maps a capture time back to the server timestamp of the sample that was being
+ * written at that time, in milliseconds. The fixed delay of the I2S DMA buffers is not included,
+ * it is constant and left to the delay search of the server AEC.
+ */
+class PlaybackTimeline {
+public:
+    void SetSampleRate(int sample_rate);
+    void Reset();
+
+    // Output task, after the write returned
+    void Record(uint32_t timestamp, size_t samples, int64_t write_time_us);
+    // Returns 0 if no downlink audio was playing at that time
+    uint32_t GetTimestamp(int64_t time_us);
+
+private:
+    struct Entry {
+        uint32_t timestamp = 0;
+        uint64_t start_sample = 0;
+        uint32_t samples = 0;
+    };
+    struct Point {
+        uint64_t sample = 0;
+        int64_t time_us = 0;
+    };
+
+    std::mutex mutex_;
+    int sample_rate_ = 16000;
+    uint64_t written_samples_ = 0;
+    Entry entries_[PLAYBACK_TIMELINE_CAPACITY];
+    size_t entry_head_ = 0;     // next entry to write
+    size_t entry_count_ = 0;
+
+    // time_us = anchor_time_us_ + (sample - anchor_sample_) * us_per_sample_
+    bool synced_ = false;
+    uint64_t anchor_sample_ = 0;
+    double anchor_time_us_ = 0;
+    double us_per_sample_ = 0;
+    // The lowest write of the current second, then the fit points of the last seconds
+    Point interval_min_;
+    double interval_min_residual_ = 0;
+    uint64_t interval_start_ = 0;
+    Point points_[PLAYBACK_TIMELINE_FIT_POINTS];
+    size_t point_count_ = 0;
+
+    void StartLine(uint64_t sample, int64_t time_us);
+    void FitLine();
+};
+
+#endif // PLAYBACK_TIMELINE_H
@@ -0,0 +1,126 @@
+#include "polyphase_filters.h"
+
+#define POLYPHASE_KAISER_BETA 7.0
+
+namespace {
+
+/* Just enough math for the compiler to design the filters */
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr double Sin(double x) {
+    x -= (long long)(x / (2 * kPi)) * 2 * kPi;
+    if (x > kPi) {
+        x -= 2 * kPi;
+    } else if (x < -kPi) {
+        x += 2 * kPi;
+    }
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 14; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double Sqrt(double x) {
+    if (x <= 0) {
+        return 0;
+    }
+    double root = x > 1 ? x : 1;
+    for (int i = 0; i < 64; i++) {
+        root = (root + x / root) / 2;
+    }
+    return root;
+}
+
+// Modified Bessel function of the first kind, order 0
+constexpr double BesselI0(double x) {
+    double term = 1;
+    double sum = 1;
+    for (int k = 1; k < 64 && term > sum * 1e-15; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+template <int Phases, int TapsPerPhase>
+struct FilterBank {
+    int16_t coefs[Phases * TapsPerPhase] = {};
+};
+
+// Kaiser windowed sinc of Phases * TapsPerPhase taps at the upsampled rate, split into phases
+template <int Phases, int TapsPerPhase>
+constexpr FilterBank<Phases, TapsPerPhase> MakeFilterBank(double upsampled_rate, double cutoff) {
+    FilterBank<Phases, TapsPerPhase> bank;
+    constexpr int taps = Phases * TapsPerPhase;
+    const double fc = cutoff / upsampled_rate;
+    const double center = (taps - 1) / 2.0;
+    const double window_gain = BesselI0(POLYPHASE_KAISER_BETA);
+
+    for (int p = 0; p < Phases; p++) {
+        double h[TapsPerPhase] = {};
+        double sum = 0;
+        for (int j = 0; j < TapsPerPhase; j++) {
+            // Reversed, the last tap of the phase meets the newest input
+            int n = p + (TapsPerPhase - 1 - j) * Phases;
+            double t = n - center;
+            double sinc = t == 0 ? 1 : Sin(kPi * 2 * fc * t) / (kPi * 2 * fc * t);
+            double r = 2 * n / (taps - 1.0) - 1;
+            h[j] = sinc * BesselI0(POLYPHASE_KAISER_BETA * Sqrt(1 - r * r)) / window_gain;
+            sum += h[j];
+        }
+
+        // Q15 with a DC gain of exactly 1, the rounding error goes to the largest tap
+        int16_t* coefs = bank.coefs + p * TapsPerPhase;
+        int total = 0;
+        int peak = 0;
+        for (int j = 0; j < TapsPerPhase; j++) {
+            double scaled = h[j] / sum * 32768;
+            int value = (int)(scaled + (scaled >= 0 ? 0.5 : -0.5));
+            value = value > 32767 ? 32767 : (value < -32768 ? -32768 : value);
+            coefs[j] = value;
+            total += value;
+            if ((coefs[j] < 0 ? -coefs[j] : coefs[j]) > (coefs[peak] < 0 ? -coefs[peak] : coefs[peak])) {
+                peak = j;
+            }
+        }
+        coefs[peak] += 32768 - total;
+    }
+    return bank;
+}
+
+// 16 <-> 24 / 48 kHz share one 72 tap low pass at 48 kHz, flat to 6 kHz and below -70 dB from 9 kHz
+constexpr auto k16To48 = MakeFilterBank<3, 24>(48000, 7200);
+constexpr auto k24To16 = MakeFilterBank<2, 36>(48000, 7200);
+constexpr auto k48To16 = MakeFilterBank<1, 72>(48000, 7200);
+// 24 <-> 48 kHz, flat to 9 kHz and below -66 dB from 12.3 kHz
+constexpr auto k24To48 = MakeFilterBank<2, 36>(48000, 10800);
+constexpr auto k48To24 = MakeFilterBank<1, 72>(48000, 10800);
+// 24 <-> 44.1 kHz through 3.528 MHz, flat to 9 kHz and below -66 dB from 12.8 kHz
+constexpr auto k24To44 = MakeFilterBank<147, 24>(3528000, 10500);
+constexpr auto k44To24 = MakeFilterBank<80, 42>(3528000, 10500);
+
+const PolyphaseFilter kFilters[] = {
+    {16000, 24000, 3, 2, 24, k16To48.coefs},
+    {24000, 16000, 2, 3, 36, k24To16.coefs},
+    {16000, 48000, 3, 1, 24, k16To48.coefs},
+    {48000, 16000, 1, 3, 72, k48To16.coefs},
+    {24000, 48000, 2, 1, 36, k24To48.coefs},
+    {48000, 24000, 1, 2, 72, k48To24.coefs},
+    {24000, 44100, 147, 80, 24, k24To44.coefs},
+    {44100, 24000, 80, 147, 42, k44To24.coefs},
+};
+
+} // namespace
+
+const PolyphaseFilter* FindPolyphaseFilter(int input_sample_rate, int output_sample_rate) {
+    for (auto& filter : kFilters) {
+        if (filter.input_sample_rate == input_sample_rate && filter.output_sample_rate == output_sample_rate) {
+            return &filter;
+        }
+    }
+    return nullptr;
+}
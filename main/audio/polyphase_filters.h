@@ -0,0 +1,27 @@
+#ifndef POLYPHASE_FILTERS_H
+#define POLYPHASE_FILTERS_H
+
+#include <cstdint>
+
+/*
+ * Polyphase filter banks for the rational sample rate ratios the boards and servers use:
+ * 16 <-> 24 kHz, 16 <-> 48 kHz, 24 <-> 48 kHz and 24 <-> 44.1 kHz.
+ *
+ * The input is upsampled by interpolation, low pass filtered and decimated. Each bank holds
+ * the interpolation phases of a Kaiser windowed sinc in Q15, every phase reversed so that the
+ * inner loop walks the input forward, and scaled to a DC gain of exactly 1. The tables are
+ * computed by the compiler and live in flash.
+ */
+struct PolyphaseFilter {
+    int input_sample_rate;
+    int output_sample_rate;
+    int interpolation;
+    int decimation;
+    int taps_per_phase;
+    const int16_t* coefs;   // interpolation * taps_per_phase
+};
+
+// Returns nullptr if the ratio has no bank
+const PolyphaseFilter* FindPolyphaseFilter(int input_sample_rate, int output_sample_rate);
+
+#endif // POLYPHASE_FILTERS_H
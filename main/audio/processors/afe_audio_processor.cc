@@ -15,7 +15,8 @@ void AfeAudioProcessor::Initialize(AudioCodec* codec, int frame_duration_ms) {
     frame_samples_ = frame_duration_ms * 16000 / 1000;
 
     // Pre-allocate output buffer capacity
-    output_buffer_.reserve(frame_samples_);
+    output_buffer_.reserve(frame_samples_ * 2);
+    frame_buffer_.reserve(frame_samples_);
 
     int ref_num = codec_->input_reference() ? 1 : 0;
 
@@ -84,6 +85,18 @@ size_t AfeAudioProcessor::GetFeedSize() {
     return afe_iface_->get_feed_chunksize(afe_data_);
 }
 
+void AfeAudioProcessor::SetFrameDuration(int frame_duration_ms) {
+    frame_samples_ = frame_duration_ms * 16000 / 1000;
+    if (IsRunning()) {
+        // The buffer belongs to the task, which cuts the samples it holds at the new size from the next frame
+        return;
+    }
+    // Samples left from the last session would shift every frame after them
+    output_buffer_.clear();
+    output_buffer_.reserve(frame_samples_ * 2);
+    frame_buffer_.reserve(frame_samples_);
+}
+
 void AfeAudioProcessor::Feed(std::vector<int16_t>&& data) {
     if (afe_data_ == nullptr) {
         return;
@@ -151,18 +164,13 @@ void AfeAudioProcessor::AudioProcessorTask() {
             // Add data to buffer
             output_buffer_.insert(output_buffer_.end(), res->data, res->data + samples);
             
-            // Output complete frames when buffer has enough data
-            while (output_buffer_.size() >= frame_samples_) {
-                if (output_buffer_.size() == frame_samples_) {
-                    // If buffer size equals frame size, move the entire buffer
-                    output_callback_(std::move(output_buffer_));
-                    output_buffer_.clear();
-                    output_buffer_.reserve(frame_samples_);
-                } else {
-                    // If buffer size exceeds frame size, copy one frame and remove it
-                    output_callback_(std::vector<int16_t>(output_buffer_.begin(), output_buffer_.begin() + frame_samples_));
-                    output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples_);
-                }
+            // Output complete frames when buffer has enough data. The frame buffer is handed over
+            // by move and the receiver returns a recycled buffer in its place, so no allocation here
+            size_t frame_samples = frame_samples_;
+            while (output_buffer_.size() >= frame_samples) {
+                frame_buffer_.assign(output_buffer_.begin(), output_buffer_.begin() + frame_samples);
+                output_buffer_.erase(output_buffer_.begin(), output_buffer_.begin() + frame_samples);
+                output_callback_(std::move(frame_buffer_));
             }
         }
     }
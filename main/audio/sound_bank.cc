@@ -0,0 +1,210 @@
+#include "sound_bank.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <opus.h>
+#include <algorithm>
+#include <cstring>
+
+#define TAG "SoundBank"
+
+SoundBank::SoundBank(size_t pcm_cache_size) : pcm_cache_size_(pcm_cache_size) {
+}
+
+SoundBank::~SoundBank() {
+    for (auto& sound : sounds_) {
+        if (sound->pcm != nullptr) {
+            heap_caps_free(sound->pcm);
+        }
+    }
+}
+
+const Sound* SoundBank::Get(const std::string_view& ogg) {
+    auto data = reinterpret_cast<const uint8_t*>(ogg.data());
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& sound : sounds_) {
+        if (sound->data == data && sound->size == ogg.size()) {
+            return sound.get();
+        }
+    }
+
+    auto sound = std::make_unique<Sound>();
+    sound->data = data;
+    sound->size = ogg.size();
+    if (!Parse(*sound)) {
+        ESP_LOGE(TAG, "Invalid Ogg/Opus sound (%u bytes)", (unsigned)ogg.size());
+        return nullptr;
+    }
+    ESP_LOGI(TAG, "Indexed sound: %u packets, %d ms, %d Hz", (unsigned)sound->packets.size(),
+        sound->duration_ms, sound->sample_rate);
+    sounds_.push_back(std::move(sound));
+    return sounds_.back().get();
+}
+
+bool SoundBank::Parse(Sound& sound) {
+    const uint8_t* buf = sound.data;
+    size_t size = sound.size;
+    size_t offset = 0;
+
+    auto find_page = [&](size_t start)->size_t {
+        for (size_t i = start; i + 4 <= size; ++i) {
+            if (buf[i] == 'O' && buf[i+1] == 'g' && buf[i+2] == 'g' && buf[i+3] == 'S') return i;
+        }
+        return static_cast<size_t>(-1);
+    };
+
+    bool seen_head = false;
+    bool seen_tags = false;
+
+    while (true) {
+        size_t pos = find_page(offset);
+        if (pos == static_cast<size_t>(-1)) break;
+        offset = pos;
+        if (offset + 27 > size) break;
+
+        const uint8_t* page = buf + offset;
+        uint8_t page_segments = page[26];
+        size_t seg_table_off = offset + 27;
+        if (seg_table_off + page_segments > size) break;
+
+        size_t body_size = 0;
+        for (size_t i = 0; i < page_segments; ++i) body_size += page[27 + i];
+
+        size_t body_off = seg_table_off + page_segments;
+        if (body_off + body_size > size) break;
+
+        // Parse packets using lacing
+        size_t cur = body_off;
+        size_t seg_idx = 0;
+        while (seg_idx < page_segments) {
+            size_t pkt_len = 0;
+            size_t pkt_start = cur;
+            bool continued = false;
+            do {
+                uint8_t l = page[27 + seg_idx++];
+                pkt_len += l;
+                cur += l;
+                continued = (l == 255);
+            } while (continued && seg_idx < page_segments);
+
+            if (pkt_len == 0) continue;
+            const uint8_t* pkt_ptr = buf + pkt_start;
+
+            if (!seen_head) {
+                // OpusHead结构：[0-7] "OpusHead", [8] version, [9] channel_count, [10-11] pre_skip
+                // [12-15] input_sample_rate, [16-17] output_gain, [18] mapping_family
+                if (pkt_len >= 19 && std::memcmp(pkt_ptr, "OpusHead", 8) == 0) {
+                    seen_head = true;
+                    // 读取输入采样率 (little-endian)
+                    sound.sample_rate = pkt_ptr[12] | (pkt_ptr[13] << 8) | (pkt_ptr[14] << 16) | (pkt_ptr[15] << 24);
+                }
+                continue;
+            }
+            if (!seen_tags) {
+                // Expect OpusTags in second packet
+                if (pkt_len >= 8 && std::memcmp(pkt_ptr, "OpusTags", 8) == 0) {
+                    seen_tags = true;
+                }
+                continue;
+            }
+
+            // Audio packet (Opus)
+            if (pkt_len > UINT16_MAX) {
+                return false;
+            }
+            int samples = opus_packet_get_nb_samples(pkt_ptr, pkt_len, sound.sample_rate);
+            SoundPacket packet;
+            packet.offset = pkt_start;
+            packet.size = pkt_len;
+            packet.frame_duration = samples > 0 ? samples * 1000 / sound.sample_rate : 60;
+            sound.packets.push_back(packet);
+            sound.duration_ms += packet.frame_duration;
+        }
+
+        offset = body_off + body_size;
+    }
+    return seen_head && !sound.packets.empty();
+}
+
+Sound* SoundBank::Find(const uint8_t* packet, size_t& index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& sound : sounds_) {
+        if (packet < sound->data || packet >= sound->data + sound->size) {
+            continue;
+        }
+        uint32_t offset = packet - sound->data;
+        auto it = std::lower_bound(sound->packets.begin(), sound->packets.end(), offset,
+            [](const SoundPacket& p, uint32_t value) { return p.offset < value; });
+        if (it == sound->packets.end() || it->offset != offset) {
+            return nullptr;
+        }
+        index = it - sound->packets.begin();
+        return sound.get();
+    }
+    return nullptr;
+}
+
+bool SoundBank::LoadPcm(const uint8_t* packet, std::vector<int16_t>& pcm) {
+    if (pcm_cache_used_ == 0) {
+        return false;
+    }
+    size_t index;
+    Sound* sound = Find(packet, index);
+    if (sound == nullptr || !sound->pcm_complete) {
+        return false;
+    }
+    const int16_t* begin = sound->pcm + sound->pcm_offsets[index];
+    const int16_t* end = sound->pcm + sound->pcm_offsets[index + 1];
+    pcm.assign(begin, end);
+    return true;
+}
+
+void SoundBank::StorePcm(const uint8_t* packet, const std::vector<int16_t>& pcm, int sample_rate) {
+    if (pcm_cache_size_ == 0) {
+        return;
+    }
+    size_t index;
+    Sound* sound = Find(packet, index);
+    if (sound == nullptr || sound->pcm_complete || sound->duration_ms > SOUND_PCM_CACHE_MAX_DURATION_MS) {
+        return;
+    }
+
+    if (index == 0) {
+        // Start over from the first frame, a previous playback may have been cut short
+        if (sound->pcm == nullptr) {
+            // One spare frame, the resampler may round up
+            size_t capacity = (sound->duration_ms + 60) * sample_rate / 1000;
+            size_t bytes = capacity * sizeof(int16_t);
+            if (pcm_cache_used_ + bytes > pcm_cache_size_) {
+                return;
+            }
+#if CONFIG_SPIRAM
+            sound->pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM);
+#else
+            sound->pcm = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+#endif
+            if (sound->pcm == nullptr) {
+                return;
+            }
+            sound->pcm_capacity = capacity;
+            pcm_cache_used_ += bytes;
+        }
+        sound->pcm_offsets.assign(1, 0);
+    }
+    // Frames are only kept in playback order, so that a sound is either fully cached or not used
+    if (sound->pcm == nullptr || index + 1 != sound->pcm_offsets.size()) {
+        return;
+    }
+    size_t start = sound->pcm_offsets.back();
+    if (start + pcm.size() > sound->pcm_capacity) {
+        sound->pcm_offsets.clear();
+        return;
+    }
+    memcpy(sound->pcm + start, pcm.data(), pcm.size() * sizeof(int16_t));
+    sound->pcm_offsets.push_back(start + pcm.size());
+    if (sound->pcm_offsets.size() == sound->packets.size() + 1) {
+        sound->pcm_complete = true;
+        ESP_LOGI(TAG, "Cached %d ms sound, %u KB of %u KB used", sound->duration_ms,
+            (unsigned)(pcm_cache_used_ / 1024), (unsigned)(pcm_cache_size_ / 1024));
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef SOUND_BANK_H
+#define SOUND_BANK_H
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+
+// Only sounds up to this long are kept pre-decoded, the UI sounds and the digits are about 1s
+#define SOUND_PCM_CACHE_MAX_DURATION_MS 1500
+
+struct SoundPacket {
+    uint32_t offset;        // from the start of the Ogg data
+    uint16_t size;
+    uint16_t frame_duration;
+};
+
+struct Sound {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    int sample_rate = 16000;
+    int duration_ms = 0;
+    std::vector<SoundPacket> packets;
+
+    // Decoded PCM at the codec output rate, owned by the Opus decoder task
+    int16_t* pcm = nullptr;
+    size_t pcm_capacity = 0;
+    std::vector<uint32_t> pcm_offsets;  // start of each packet's PCM, the last entry is the end
+    bool pcm_complete = false;
+};
+
+/*
+ * Index of the embedded Ogg/Opus sounds played by AudioService::PlaySound.
+ *
+ * Each sound is parsed once, on its first use, into the offsets of its Opus packets, so playing
+ * it again only hands out views into the embedded data. The Ogg data must therefore outlive the
+ * bank, which holds for the sounds linked into the firmware.
+ *
+ * Optionally the decoded PCM of short sounds is kept as well (CONFIG_SOUND_PCM_CACHE_SIZE).
+ * The decoder task stores every frame it decodes from a sound, and once a sound has been
+ * decoded completely later playbacks copy its frames instead of running the Opus decoder.
+ */
+class SoundBank {
+public:
+    explicit SoundBank(size_t pcm_cache_size);
+    ~SoundBank();
+
+    // Returns nullptr if the data is not a valid Ogg/Opus stream
+    const Sound* Get(const std::string_view& ogg);
+
+    // Only the Opus decoder task may call these, packet is the payload view of a sound packet
+    bool LoadPcm(const uint8_t* packet, std::vector<int16_t>& pcm);
+    void StorePcm(const uint8_t* packet, const std::vector<int16_t>& pcm, int sample_rate);
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Sound>> sounds_;
+    size_t pcm_cache_size_;
+    size_t pcm_cache_used_ = 0;
+
+    bool Parse(Sound& sound);
+    Sound* Find(const uint8_t* packet, size_t& index);
+};
+
+#endif // SOUND_BANK_H
@@ -0,0 +1,141 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+#define SPSC_QUEUE_CACHE_LINE_SIZE 64
+
+/*
+ * Bounded lock-free single-producer / single-consumer ring.
+ *
+ * Head is only written by the producer and tail only by the consumer, so Push / Pop never
+ * take a lock. Each queue can be bound to two bits of an event group: the readable bit is set
+ * after every push and the writable bit after every pop, so a blocked consumer or producer is
+ * woken only by its own queue instead of a shared condition variable.
+ *
+ * Capacity is the physical slot count (power of two). The limit is the backpressure threshold
+ * used by full() and may be changed at runtime up to Capacity.
+ */
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    void Bind(EventGroupHandle_t event_group, EventBits_t readable_bit, EventBits_t writable_bit) {
+        event_group_ = event_group;
+        readable_bit_ = readable_bit;
+        writable_bit_ = writable_bit;
+    }
+
+    void SetLimit(size_t limit) {
+        limit_ = limit > Capacity ? Capacity : limit;
+    }
+
+    inline size_t limit() const { return limit_; }
+
+    // Producer side
+    bool Push(T&& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= limit_) {
+            return false;
+        }
+        slots_[head & (Capacity - 1)] = std::move(item);
+        head_.store(head + 1, std::memory_order_release);
+        size_t depth = head + 1 - tail_.load(std::memory_order_relaxed);
+        if (depth > high_water_.load(std::memory_order_relaxed)) {
+            high_water_.store(depth, std::memory_order_relaxed);
+        }
+        Signal(readable_bit_);
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T& item) {
+        DiscardCleared();
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = std::move(slots_[tail & (Capacity - 1)]);
+        slots_[tail & (Capacity - 1)] = T();
+        tail_.store(tail + 1, std::memory_order_release);
+        Signal(writable_bit_);
+        return true;
+    }
+
+    // Consumer side: drop the items that were queued before the last Clear()
+    void DiscardCleared() {
+        uint32_t until = clear_until_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (static_cast<int32_t>(until - tail) <= 0) {
+            return;
+        }
+        while (tail != until) {
+            slots_[tail & (Capacity - 1)] = T();
+            tail++;
+        }
+        tail_.store(tail, std::memory_order_release);
+        Signal(writable_bit_);
+    }
+
+    /*
+     * May be called from any task. Everything pushed so far is dropped by the consumer on its
+     * next Pop() / DiscardCleared(); items pushed after this call are kept. The consumer is woken
+     * so that the slots are released promptly.
+     */
+    void Clear() {
+        clear_until_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+        Signal(readable_bit_);
+    }
+
+    // Number of items that will still be delivered to the consumer
+    size_t size() const {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t until = clear_until_.load(std::memory_order_acquire);
+        if (static_cast<int32_t>(until - tail) > 0) {
+            tail = until;
+        }
+        return head - tail;
+    }
+
+    inline bool empty() const { return size() == 0; }
+
+    // Most items queued at the same time since the last ResetHighWater(), cleared ones included
+    inline size_t high_water() const { return high_water_.load(std::memory_order_relaxed); }
+    void ResetHighWater() { high_water_.store(0, std::memory_order_relaxed); }
+
+    // Producer side view, cleared items keep their slots until the consumer discards them
+    inline bool full() const {
+        return head_.load(std::memory_order_relaxed) - tail_.load(std::memory_order_acquire) >= limit_;
+    }
+
+private:
+    alignas(SPSC_QUEUE_CACHE_LINE_SIZE) std::atomic<uint32_t> head_ = 0;
+    alignas(SPSC_QUEUE_CACHE_LINE_SIZE) std::atomic<uint32_t> tail_ = 0;
+    alignas(SPSC_QUEUE_CACHE_LINE_SIZE) std::atomic<uint32_t> clear_until_ = 0;
+    std::atomic<size_t> high_water_ = 0;
+    size_t limit_ = Capacity;
+    EventGroupHandle_t event_group_ = nullptr;
+    EventBits_t readable_bit_ = 0;
+    EventBits_t writable_bit_ = 0;
+    T slots_[Capacity];
+
+    inline void Signal(EventBits_t bit) {
+        if (event_group_ != nullptr && bit != 0) {
+            xEventGroupSetBits(event_group_, bit);
+        }
+    }
+};
+
+#endif // SPSC_QUEUE_H
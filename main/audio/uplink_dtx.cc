@@ -0,0 +1,37 @@
+#include "uplink_dtx.h"
+
+void UplinkDtx::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    silence_ms_ = 0;
+    unsent_ms_ = 0;
+    stats_ = UplinkDtxStats();
+}
+
+bool UplinkDtx::OnFrame(bool silence, int frame_duration_ms, size_t payload_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool opus_dtx = payload_size <= UPLINK_DTX_OPUS_MAX_DTX_BYTES;
+    bool send;
+    if (!silence && !opus_dtx) {
+        silence_ms_ = 0;
+        send = true;
+    } else {
+        silence_ms_ += frame_duration_ms;
+        unsent_ms_ += frame_duration_ms;
+        send = (!opus_dtx && silence_ms_ <= UPLINK_DTX_HANGOVER_MS) || unsent_ms_ >= UPLINK_DTX_KEEPALIVE_MS;
+    }
+
+    if (send) {
+        unsent_ms_ = 0;
+        stats_.sent_frames++;
+        stats_.sent_bytes += payload_size;
+    } else {
+        stats_.suppressed_frames++;
+        stats_.saved_bytes += payload_size;
+    }
+    return send;
+}
+
+UplinkDtxStats UplinkDtx::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
@@ -0,0 +1,47 @@
+#ifndef UPLINK_DTX_H
+#define UPLINK_DTX_H
+
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Silence still sent after speech, so the end of a word is never cut
+#define UPLINK_DTX_HANGOVER_MS 200
+// During silence one frame is sent this often, it keeps the server's comfort noise and the link alive
+#define UPLINK_DTX_KEEPALIVE_MS 400
+// Opus returns packets this short when its own DTX asks for the frame not to be transmitted
+#define UPLINK_DTX_OPUS_MAX_DTX_BYTES 2
+
+struct UplinkDtxStats {
+    uint32_t sent_frames = 0;
+    uint32_t suppressed_frames = 0;
+    uint32_t sent_bytes = 0;
+    uint32_t saved_bytes = 0;       // Opus payload of the suppressed frames
+};
+
+/*
+ * Silence suppression of the uplink, only used when the server accepted the "dtx" feature.
+ *
+ * Frames the AFE VAD marked as silence are sent for a short hangover after speech, then only one
+ * every UPLINK_DTX_KEEPALIVE_MS, which the server uses as a comfort noise update. The rest are
+ * dropped before they reach the send queue. Frames the Opus encoder itself marked as DTX are
+ * treated the same way.
+ *
+ * OnFrame() is called by the opus encoder task, the stats are read and reset by the main task.
+ */
+class UplinkDtx {
+public:
+    void Reset();
+    // Returns false if the frame is not to be sent
+    bool OnFrame(bool silence, int frame_duration_ms, size_t payload_size);
+
+    UplinkDtxStats GetStats();
+
+private:
+    std::mutex mutex_;
+    int silence_ms_ = 0;
+    int unsent_ms_ = 0;             // audio since the last frame that was sent
+    UplinkDtxStats stats_;
+};
+
+#endif // UPLINK_DTX_H
@@ -0,0 +1,107 @@
+#include "uplink_rate_controller.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "UplinkRateController"
+
+UplinkRateController::UplinkRateController(const UplinkRateLimits& limits) : limits_(limits) {
+    limits_.max_bitrate = std::max(limits_.max_bitrate, limits_.min_bitrate);
+    // Start in the middle, the first windows tell which way to go
+    settings_.bitrate = (limits_.min_bitrate + limits_.max_bitrate) / 2 / 1000 * 1000;
+    settings_.bitrate = std::max(settings_.bitrate, limits_.min_bitrate);
+    settings_.complexity = 0;
+    settings_.dtx = false;
+}
+
+void UplinkRateController::StartWindow() {
+    window_ms_ = 0;
+    encode_us_ = 0;
+    max_queue_percent_ = 0;
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    sent_ = 0;
+    failed_ = 0;
+    max_send_us_ = 0;
+}
+
+void UplinkRateController::OnSend(bool sent, int64_t send_us) {
+    std::lock_guard<std::mutex> lock(send_mutex_);
+    if (sent) {
+        sent_++;
+    } else {
+        failed_++;
+    }
+    max_send_us_ = std::max(max_send_us_, send_us);
+}
+
+bool UplinkRateController::OnFrame(int64_t now_us, int frame_duration_ms, int64_t encode_us,
+    size_t send_queue_depth, size_t send_queue_limit) {
+    // After a pause the old numbers say nothing about the link any more
+    if (now_us - last_frame_us_ > UPLINK_RATE_WINDOW_MS * 1000) {
+        StartWindow();
+    }
+    last_frame_us_ = now_us;
+
+    window_ms_ += frame_duration_ms;
+    encode_us_ += encode_us;
+    if (send_queue_limit > 0) {
+        max_queue_percent_ = std::max(max_queue_percent_, send_queue_depth * 100 / send_queue_limit);
+    }
+    if (window_ms_ < UPLINK_RATE_WINDOW_MS) {
+        return false;
+    }
+    bool changed = Decide();
+    StartWindow();
+    return changed;
+}
+
+bool UplinkRateController::Decide() {
+    uint32_t sent, failed;
+    int64_t max_send_us;
+    {
+        std::lock_guard<std::mutex> lock(send_mutex_);
+        sent = sent_;
+        failed = failed_;
+        max_send_us = max_send_us_;
+    }
+    int cpu_percent = encode_us_ / (window_ms_ * 10);
+    bool severe = failed > 0 || max_queue_percent_ >= UPLINK_RATE_SEVERE_QUEUE_PERCENT;
+    bool congested = severe || max_queue_percent_ >= UPLINK_RATE_CONGESTED_QUEUE_PERCENT ||
+        max_send_us >= UPLINK_RATE_CONGESTED_SEND_MS * 1000;
+
+    UplinkRateSettings next = settings_;
+    if (congested) {
+        // Back off before the send queue overflows
+        next.bitrate = severe ? next.bitrate / 2 : next.bitrate * 3 / 4;
+        next.bitrate = std::max(next.bitrate, limits_.min_bitrate);
+        next.dtx = true;
+        clear_windows_ = 0;
+    } else if (++clear_windows_ >= UPLINK_RATE_PROBE_WINDOWS) {
+        next.bitrate = std::min(next.bitrate + UPLINK_RATE_PROBE_STEP, limits_.max_bitrate);
+        if (next.bitrate == limits_.max_bitrate) {
+            next.dtx = false;
+        }
+        clear_windows_ = 0;
+    }
+
+    if (cpu_percent >= UPLINK_RATE_CPU_HIGH_PERCENT && next.complexity > 0) {
+        next.complexity--;
+        idle_cpu_windows_ = 0;
+    } else if (cpu_percent < UPLINK_RATE_CPU_LOW_PERCENT && next.complexity < limits_.max_complexity) {
+        if (++idle_cpu_windows_ >= UPLINK_RATE_PROBE_WINDOWS) {
+            next.complexity++;
+            idle_cpu_windows_ = 0;
+        }
+    } else {
+        idle_cpu_windows_ = 0;
+    }
+
+    if (next.bitrate == settings_.bitrate && next.complexity == settings_.complexity && next.dtx == settings_.dtx) {
+        return false;
+    }
+    ESP_LOGI(TAG, "Bitrate %d -> %d bps, complexity %d -> %d, DTX %s (queue %u%%, sent %lu, failed %lu, send max %lld ms, encode %d%% CPU)",
+        settings_.bitrate, next.bitrate, settings_.complexity, next.complexity, next.dtx ? "on" : "off",
+        (unsigned)max_queue_percent_, (unsigned long)sent, (unsigned long)failed, max_send_us / 1000, cpu_percent);
+    settings_ = next;
+    return true;
+}
@@ -0,0 +1,78 @@
+#ifndef UPLINK_RATE_CONTROLLER_H
+#define UPLINK_RATE_CONTROLLER_H
+
+#include <mutex>
+#include <cstddef>
+#include <cstdint>
+
+// Audio covered by one decision
+#define UPLINK_RATE_WINDOW_MS 1000
+// A window is congested if the send queue held this much of its limit, a send failed or took this long
+#define UPLINK_RATE_CONGESTED_QUEUE_PERCENT 25
+#define UPLINK_RATE_SEVERE_QUEUE_PERCENT 50
+#define UPLINK_RATE_CONGESTED_SEND_MS 100
+// Clear windows needed before the bitrate goes up again
+#define UPLINK_RATE_PROBE_WINDOWS 3
+#define UPLINK_RATE_PROBE_STEP 2000
+// Share of one core spent encoding, the complexity goes down above the first and up below the second
+#define UPLINK_RATE_CPU_HIGH_PERCENT 30
+#define UPLINK_RATE_CPU_LOW_PERCENT 12
+
+struct UplinkRateLimits {
+    int min_bitrate = 12000;
+    int max_bitrate = 32000;
+    int max_complexity = 0;
+};
+
+struct UplinkRateSettings {
+    int bitrate = 0;
+    int complexity = 0;
+    bool dtx = false;
+};
+
+/*
+ * Picks the Opus bitrate, complexity and DTX of the uplink from what the last window of audio
+ * looked like:
+ * - the send queue depth, the send failures and the longest time a send took. A congested window
+ *   cuts the bitrate by a quarter (by half when it is severe) and turns DTX on, several clear
+ *   windows in a row raise it by one step. DTX goes off again once the bitrate is back at its
+ *   maximum. The protocols do not report a round trip time, the longest send stands in for it:
+ *   a send blocks once the socket buffer is full, which is where a growing RTT shows first.
+ * - the encode time per frame. The complexity goes down at once when the encoder uses too much
+ *   of the core and goes up one step at a time while it has room to spare.
+ *
+ * OnFrame() is called by the opus encoder task, OnSend() by the task sending the audio.
+ */
+class UplinkRateController {
+public:
+    explicit UplinkRateController(const UplinkRateLimits& limits);
+
+    // Returns true when the settings changed
+    bool OnFrame(int64_t now_us, int frame_duration_ms, int64_t encode_us, size_t send_queue_depth, size_t send_queue_limit);
+    void OnSend(bool sent, int64_t send_us);
+
+    inline const UplinkRateSettings& settings() const { return settings_; }
+    inline const UplinkRateLimits& limits() const { return limits_; }
+
+private:
+    UplinkRateLimits limits_;
+    UplinkRateSettings settings_;
+
+    int64_t last_frame_us_ = 0;
+    int window_ms_ = 0;
+    int64_t encode_us_ = 0;
+    size_t max_queue_percent_ = 0;
+    int clear_windows_ = 0;
+    int idle_cpu_windows_ = 0;
+
+    // Written by the sending task
+    std::mutex send_mutex_;
+    uint32_t sent_ = 0;
+    uint32_t failed_ = 0;
+    int64_t max_send_us_ = 0;
+
+    void StartWindow();
+    bool Decide();
+};
+
+#endif // UPLINK_RATE_CONTROLLER_H
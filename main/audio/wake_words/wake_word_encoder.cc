@@ -0,0 +1,204 @@
+#include "wake_word_encoder.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#define TAG "WakeWordEncoder"
+
+WakeWordEncoder::WakeWordEncoder() : pcm_ring_(WAKE_WORD_HISTORY_MS * 16000 / 1000) {
+}
+
+WakeWordEncoder::~WakeWordEncoder() {
+    if (task_ != nullptr) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        cv_.notify_all();
+        cv_.wait(lock, [this]() { return parked_; });
+        lock.unlock();
+        vTaskDelete(task_);
+    }
+    if (task_stack_ != nullptr) {
+        heap_caps_free(task_stack_);
+    }
+    if (task_buffer_ != nullptr) {
+        heap_caps_free(task_buffer_);
+    }
+}
+
+bool WakeWordEncoder::Initialize(int frame_duration_ms) {
+    if (task_ != nullptr) {
+        return true;
+    }
+    frame_duration_ms_ = frame_duration_ms;
+
+    // The Opus encoder needs a large stack, keep it out of the internal RAM
+    task_stack_ = (StackType_t*)heap_caps_malloc(WAKE_WORD_ENCODER_TASK_STACK_SIZE, MALLOC_CAP_SPIRAM);
+    task_buffer_ = (StaticTask_t*)heap_caps_malloc(sizeof(StaticTask_t), MALLOC_CAP_INTERNAL);
+    if (task_stack_ == nullptr || task_buffer_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the encoder task");
+        return false;
+    }
+    task_ = xTaskCreateStatic([](void* arg) {
+        auto this_ = (WakeWordEncoder*)arg;
+        this_->EncoderTask();
+    }, "encode_wake_word", WAKE_WORD_ENCODER_TASK_STACK_SIZE, this, WAKE_WORD_ENCODER_TASK_PRIORITY,
+        task_stack_, task_buffer_);
+    return true;
+}
+
+void WakeWordEncoder::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pcm_ring_.Reset();
+    encode_position_ = 0;
+    generation_++;
+    packet_head_ = 0;
+    packet_count_ = 0;
+    encoding_ = false;
+    finishing_ = false;
+    finished_ = false;
+    if (task_ != nullptr) {
+        vTaskPrioritySet(task_, WAKE_WORD_ENCODER_TASK_PRIORITY);
+    }
+}
+
+void WakeWordEncoder::Store(const int16_t* data, size_t samples) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // The history is frozen from the detection until Reset()
+        if (finishing_ || task_ == nullptr) {
+            return;
+        }
+        pcm_ring_.Write(data, samples, 1);
+    }
+    cv_.notify_all();
+}
+
+void WakeWordEncoder::Finish(int frame_duration_ms) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_ == nullptr) {
+        return;
+    }
+    if (frame_duration_ms != frame_duration_ms_) {
+        // Encoded at another duration, start over from the oldest sample still held
+        ESP_LOGI(TAG, "Frame duration changed from %d to %d ms, encoding the history again", frame_duration_ms_, frame_duration_ms);
+        frame_duration_ms_ = frame_duration_ms;
+        generation_++;
+        packet_head_ = 0;
+        packet_count_ = 0;
+        encode_position_ = pcm_ring_.oldest();
+        encoding_ = false;
+    }
+    finishing_ = true;
+    finish_position_ = pcm_ring_.written();
+    // The packet ring is only full once the encoder caught up, drop the packets that the frames
+    // still pending would push out of the history, Pop() could otherwise make room for them
+    size_t frame_samples = frame_duration_ms_ * 16000 / 1000;
+    uint64_t encode_from = encode_position_ < pcm_ring_.oldest() ? pcm_ring_.oldest() : encode_position_;
+    int pending = (finish_position_ - encode_from) / frame_samples;
+    if (encoding_ && encoding_position_ >= pcm_ring_.oldest()) {
+        pending++;
+    }
+    while (packet_count_ > 0 && packet_count_ + pending > max_packets()) {
+        packet_head_ = (packet_head_ + 1) % WAKE_WORD_MAX_PACKETS;
+        packet_count_--;
+    }
+    finished_ = false;
+    packets_ready_at_finish_ = packet_count_;
+    packets_after_finish_ = 0;
+    vTaskPrioritySet(task_, WAKE_WORD_ENCODER_FLUSH_PRIORITY);
+    cv_.notify_all();
+}
+
+bool WakeWordEncoder::Pop(std::vector<uint8_t>& opus) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() {
+        return packet_count_ > 0 || finished_ || !finishing_;
+    });
+    if (packet_count_ == 0) {
+        return false;
+    }
+    // Swap, so the slot gets the caller's buffer to encode into next time
+    opus.swap(packets_[packet_head_]);
+    packet_head_ = (packet_head_ + 1) % WAKE_WORD_MAX_PACKETS;
+    packet_count_--;
+    return true;
+}
+
+void WakeWordEncoder::EncoderTask() {
+    std::unique_ptr<OpusStreamEncoder> encoder;
+    uint32_t encoder_generation = 0;
+    // Both keep their capacity, the encoder only reads the PCM
+    std::vector<int16_t> pcm;
+    std::vector<uint8_t> opus;
+    uint8_t encoded[WAKE_WORD_MAX_PACKET_BYTES];
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        size_t frame_samples = frame_duration_ms_ * 16000 / 1000;
+        // Fell behind the ring, continue with the oldest sample still held
+        if (encode_position_ < pcm_ring_.oldest()) {
+            encode_position_ = pcm_ring_.oldest();
+        }
+        uint64_t end = finishing_ ? finish_position_ : pcm_ring_.written();
+        if (encode_position_ + frame_samples > end) {
+            // The partial frame at the end of the history is dropped
+            if (finishing_ && !finished_) {
+                finished_ = true;
+                ESP_LOGI(TAG, "Encoded wake word: %d packets were ready at detection, %d encoded after it",
+                    packets_ready_at_finish_, packets_after_finish_);
+                cv_.notify_all();
+            }
+            cv_.wait(lock);
+            continue;
+        }
+
+        pcm.resize(frame_samples);
+        pcm_ring_.Read(encode_position_, frame_samples, pcm.data());
+        uint64_t frame_position = encode_position_;
+        encode_position_ += frame_samples;
+        uint32_t generation = generation_;
+        int frame_duration_ms = frame_duration_ms_;
+        encoding_ = true;
+        encoding_position_ = frame_position;
+        lock.unlock();
+
+        if (!encoder || encoder->duration_ms() != frame_duration_ms) {
+            encoder = std::make_unique<OpusStreamEncoder>(16000, 1, frame_duration_ms);
+            encoder->SetComplexity(0); // 0 is the fastest
+        } else if (encoder_generation != generation) {
+            // New history, do not predict from the previous one
+            encoder->ResetState();
+        }
+        encoder_generation = generation;
+        int size = encoder->Encode(pcm, encoded, sizeof(encoded));
+        if (size > 0) {
+            opus.assign(encoded, encoded + size);
+        }
+
+        lock.lock();
+        encoding_ = false;
+        if (size <= 0 || generation != generation_) {
+            continue;
+        }
+        // Overwritten in the ring while it was encoded, older than the frozen history
+        if (finishing_ && frame_position < pcm_ring_.oldest()) {
+            continue;
+        }
+        if (packet_count_ == max_packets()) {
+            packet_head_ = (packet_head_ + 1) % WAKE_WORD_MAX_PACKETS;
+            packet_count_--;
+        }
+        packets_[(packet_head_ + packet_count_) % WAKE_WORD_MAX_PACKETS].swap(opus);
+        packet_count_++;
+        if (finishing_) {
+            packets_after_finish_++;
+        }
+        cv_.notify_all();
+    }
+
+    parked_ = true;
+    cv_.notify_all();
+    lock.unlock();
+    // Deleted by the destructor, which owns the stack
+    vTaskSuspend(NULL);
+}
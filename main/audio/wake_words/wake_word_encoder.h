@@ -0,0 +1,79 @@
+#ifndef WAKE_WORD_ENCODER_H
+#define WAKE_WORD_ENCODER_H
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <cstdint>
+
+#include "pcm_ring.h"
+#include "opus_stream_encoder.h"
+
+// The audio sent to the server along with a detected wake word
+#define WAKE_WORD_HISTORY_MS 2000
+#define WAKE_WORD_MAX_PACKETS (WAKE_WORD_HISTORY_MS / 20)
+// Encode buffer on the encoder task stack, the packets are copied out at their real size
+#define WAKE_WORD_MAX_PACKET_BYTES 1500
+#define WAKE_WORD_ENCODER_TASK_STACK_SIZE (4096 * 7)
+// Below the detection tasks while listening for the wake word, raised to flush after a detection
+#define WAKE_WORD_ENCODER_TASK_PRIORITY 1
+#define WAKE_WORD_ENCODER_FLUSH_PRIORITY 2
+
+/*
+ * Keeps the last WAKE_WORD_HISTORY_MS of the wake word input as Opus packets.
+ *
+ * The detection path stores its 16kHz mono input in a PCM ring and a background task encodes
+ * it frame by frame, so most of the history is already encoded when the wake word is detected.
+ * Finish() only has to encode the frames that are still pending, and Pop() hands out the
+ * packets from the oldest one.
+ */
+class WakeWordEncoder {
+public:
+    WakeWordEncoder();
+    ~WakeWordEncoder();
+
+    // Starts the background task
+    bool Initialize(int frame_duration_ms);
+    // Drops the history, call when detection starts again
+    void Reset();
+    void Store(const int16_t* data, size_t samples);
+    // The wake word was detected, encode the history up to now at this frame duration
+    void Finish(int frame_duration_ms);
+    // Blocks until the next packet is ready, returns false after the last one
+    bool Pop(std::vector<uint8_t>& opus);
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    PcmRing pcm_ring_;
+    uint64_t encode_position_ = 0;      // next sample of the ring to encode
+    int frame_duration_ms_ = 0;
+    uint32_t generation_ = 0;           // changed by Reset() and duration changes, stale packets are dropped
+    bool finishing_ = false;
+    uint64_t finish_position_ = 0;
+    bool finished_ = false;
+    int packets_ready_at_finish_ = 0;
+    int packets_after_finish_ = 0;
+
+    // Packet ring, the slots keep their capacity so that steady state encoding does not allocate
+    std::vector<uint8_t> packets_[WAKE_WORD_MAX_PACKETS];
+    int packet_head_ = 0;
+    int packet_count_ = 0;
+
+    TaskHandle_t task_ = nullptr;
+    StaticTask_t* task_buffer_ = nullptr;
+    StackType_t* task_stack_ = nullptr;
+    bool encoding_ = false;             // a frame of the current history is being encoded outside the lock
+    uint64_t encoding_position_ = 0;
+    bool stopping_ = false;
+    bool parked_ = false;
+
+    void EncoderTask();
+    int max_packets() const { return WAKE_WORD_HISTORY_MS / frame_duration_ms_; }
+};
+
+#endif // WAKE_WORD_ENCODER_H
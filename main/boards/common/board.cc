@@ -7,6 +7,7 @@
 #include "protocols/websocket_protocol.h"
 
 #include <esp_log.h>
+#include <cJSON.h>
 #include <esp_ota_ops.h>
 #include <esp_chip_info.h>
 #include <esp_random.h>
@@ -163,6 +164,22 @@ std::string Board::GetJson() {
     return json;
 }
 
+void Board::AddAudioLinkStatus(cJSON* root) {
+    AudioLinkStats stats;
+    if (!Application::GetInstance().GetAudioLinkStats(stats)) {
+        return;
+    }
+    auto audio_link = cJSON_CreateObject();
+    cJSON_AddNumberToObject(audio_link, "received", stats.received);
+    cJSON_AddNumberToObject(audio_link, "lost", stats.lost);
+    cJSON_AddNumberToObject(audio_link, "reordered", stats.reordered);
+    cJSON_AddNumberToObject(audio_link, "duplicate", stats.duplicate);
+    cJSON_AddNumberToObject(audio_link, "late", stats.late);
+    uint32_t expected = stats.received + stats.lost;
+    cJSON_AddNumberToObject(audio_link, "loss_percent", expected > 0 ? stats.lost * 1000 / expected / 10.0 : 0);
+    cJSON_AddItemToObject(root, "audio_link", audio_link);
+}
+
 WebsocketProtocol* Board::GetWebsocketProtocol() {
     // 通过Application获取websocket协议实例
     return Application::GetInstance().GetWebsocketProtocol();
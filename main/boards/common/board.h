@@ -15,6 +15,7 @@
 
 // 前向声明
 class WebsocketProtocol;
+struct cJSON;
 
 void* create_board();
 class AudioCodec;
@@ -27,6 +28,8 @@ private:
 protected:
     Board();
     std::string GenerateUuid();
+    // Adds the downlink packet counters of the audio session, if the transport numbers its packets
+    void AddAudioLinkStatus(cJSON* root);
 
     // 软件生成的设备唯一标识
     std::string uuid_;
@@ -131,6 +131,14 @@ std::string Ml307Board::GetDeviceStatusJson() {
      *         "type": "cellular",
      *         "carrier": "CHINA MOBILE",
      *         "csq": 10
+     *     },
+     *     "audio_link": {
+     *         "received": 980,
+     *         "lost": 20,
+     *         "reordered": 3,
+     *         "duplicate": 0,
+     *         "late": 1,
+     *         "loss_percent": 2
      *     }
      * }
      */
@@ -186,6 +194,8 @@ std::string Ml307Board::GetDeviceStatusJson() {
     }
     cJSON_AddItemToObject(root, "network", network);
 
+    AddAudioLinkStatus(root);
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
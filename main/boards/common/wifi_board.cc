@@ -194,6 +194,14 @@ std::string WifiBoard::GetDeviceStatusJson() {
      *     },
      *     "chip": {
      *         "temperature": 25
+     *     },
+     *     "audio_link": {
+     *         "received": 980,
+     *         "lost": 20,
+     *         "reordered": 3,
+     *         "duplicate": 0,
+     *         "late": 1,
+     *         "loss_percent": 2
      *     }
      * }
      */
@@ -254,6 +262,8 @@ std::string WifiBoard::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "chip", chip);
     }
 
+    AddAudioLinkStatus(root);
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
@@ -1,4 +1,5 @@
 #include "tdisplays3promvsrlora_audio_codec.h"
+#include "pcm_kernels.h"
 
 #include <esp_log.h>
 #include <driver/i2c_master.h>
@@ -139,12 +140,9 @@ int Tdisplays3promvsrloraAudioCodec::Read(int16_t *dest, int samples){
 int Tdisplays3promvsrloraAudioCodec::Write(const int16_t *data, int samples){
     if (output_enabled_){
         size_t bytes_read;
-        auto output_data = (int16_t *)malloc(samples * sizeof(int16_t));
-        for (size_t i = 0; i < samples; i++){
-            output_data[i] = (float)data[i] * (float)(volume_ / 100.0);
-        }
-        i2s_channel_write(tx_handle_, output_data, samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
-        free(output_data);
+        write_buffer_.resize(samples);
+        PcmScaleInt16(data, write_buffer_.data(), samples, PcmVolumeLinearQ16(volume_));
+        i2s_channel_write(tx_handle_, write_buffer_.data(), samples * sizeof(int16_t), &bytes_read, portMAX_DELAY);
     }
     return samples;
 }
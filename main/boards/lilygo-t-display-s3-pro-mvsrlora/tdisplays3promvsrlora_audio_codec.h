@@ -5,6 +5,7 @@
 
 #include <esp_codec_dev.h>
 #include <esp_codec_dev_defaults.h>
+#include <vector>
 
 class Tdisplays3promvsrloraAudioCodec : public AudioCodec {
 private:
@@ -16,6 +17,7 @@ private:
     const audio_codec_gpio_if_t *gpio_if_ = nullptr;
 
     uint32_t volume_ = 70;
+    std::vector<int16_t> write_buffer_;
 
     void CreateVoiceHardware(gpio_num_t mic_bclk, gpio_num_t mic_ws, gpio_num_t mic_data,gpio_num_t spkr_bclk, gpio_num_t spkr_lrclk, gpio_num_t spkr_data);
 
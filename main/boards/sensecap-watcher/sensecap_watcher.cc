@@ -496,6 +496,8 @@ private:
         };
         ESP_ERROR_CHECK(esp_console_cmd_register(&cmd5));
 
+        Application::GetInstance().GetAudioService().GetLatencyTracer().RegisterConsoleCommand();
+
         esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
         ESP_ERROR_CHECK(esp_console_new_repl_uart(&hw_config, &repl_config, &repl));
         ESP_ERROR_CHECK(esp_console_start_repl(repl));
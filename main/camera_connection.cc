@@ -206,6 +206,7 @@ bool CameraConnection::Connect() {
         
         // 尝试打开音频通道（这里复用现有的连接逻辑）
         ESP_LOGI(TAG, "Opening camera audio channel...");
+        websocket_protocol_->PrepareOpenAudioChannel();
         if (!websocket_protocol_->OpenAudioChannel()) {
             ESP_LOGE(TAG, "Failed to open camera connection");
             websocket_protocol_.reset();
@@ -72,6 +72,29 @@ void McpServer::AddCommonTools() {
             return true;
         });
     
+    AddTool("self.audio.get_latency",
+        "Provides the audio latency statistics of the device in milliseconds (p50 / p95 / p99 / max per stage).\n"
+        "Uplink stages: `process` (microphone to audio processor output), `encode`, `send` (to the network), `uplink` (total).\n"
+        "Downlink stages: `decode` (network to decoded, jitter buffer included), `playback` (to the speaker), `downlink` (total).\n"
+        "Use this tool when the user asks about audio delay or lag.",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return Application::GetInstance().GetAudioService().GetLatencyTracer().GetJson();
+        });
+
+    AddTool("self.audio.set_frame_duration",
+        "Set the duration of each uplink audio frame in milliseconds: 20, 40 or 60. Shorter frames lower the delay "
+        "before the server hears the user, longer frames use less data and CPU. Takes effect from the next conversation.",
+        PropertyList({
+            Property("frame_duration", kPropertyTypeInteger, 20, 60)
+        }),
+        [](const PropertyList& properties) -> ReturnValue {
+            if (!Protocol::SetPreferredFrameDuration(properties["frame_duration"].value<int>())) {
+                throw std::runtime_error("Frame duration must be 20, 40 or 60");
+            }
+            return true;
+        });
+
     auto backlight = board.GetBacklight();
     if (backlight) {
         AddTool("self.screen.set_brightness",
@@ -0,0 +1,112 @@
+#include "audio_batcher.h"
+
+#include <algorithm>
+#include <esp_timer.h>
+
+// The length table of a full batch, a smaller one ends right where the frames start
+#define AUDIO_BATCH_TABLE_ROOM (1 + AUDIO_BATCH_MAX_FRAMES * 2)
+
+// Client frames carry a 4 byte mask, payloads over 125 bytes a 16 bit extended length
+static size_t WebsocketHeaderSize(size_t payload_size) {
+    size_t size = 2 + 4;
+    if (payload_size > 65535) {
+        size += 8;
+    } else if (payload_size > 125) {
+        size += 2;
+    }
+    return size;
+}
+
+void AudioBatcher::SetSend(SendFunction send) {
+    send_ = std::move(send);
+}
+
+void AudioBatcher::Configure(int max_frames, int rtt_ms, int frame_duration_ms) {
+    max_frames_ = std::clamp(max_frames, 1, AUDIO_BATCH_MAX_FRAMES);
+    frame_duration_ms_ = std::max(frame_duration_ms, 1);
+    int budget_ms = std::max(rtt_ms, 0) * AUDIO_BATCH_RTT_BUDGET_PERCENT / 100;
+    min_frames_ = std::clamp(1 + budget_ms / frame_duration_ms_, 1, max_frames_);
+    batch_frames_ = min_frames_;
+    Reset();
+}
+
+void AudioBatcher::Reset() {
+    message_.clear();
+    lengths_.clear();
+    stats_ = AudioBatchStats();
+}
+
+bool AudioBatcher::Add(const uint8_t* frame, size_t size) {
+    // The frames go straight into the message, it keeps its capacity from batch to batch
+    if (lengths_.empty()) {
+        message_.resize(AUDIO_BATCH_TABLE_ROOM);
+    }
+    message_.insert(message_.end(), frame, frame + size);
+    lengths_.push_back(size);
+    return (int)lengths_.size() >= batch_frames_;
+}
+
+void AudioBatcher::OnSent(size_t size, int64_t send_us) {
+    int count = lengths_.size();
+    CountMessage(size, count);
+    message_.clear();
+    lengths_.clear();
+
+    int64_t audio_us = (int64_t)count * frame_duration_ms_ * 1000;
+    if (send_us * 100 > audio_us * AUDIO_BATCH_BUSY_PERCENT) {
+        batch_frames_ = std::min(batch_frames_ + 1, max_frames_);
+    } else if (send_us * 100 < audio_us * AUDIO_BATCH_IDLE_PERCENT) {
+        batch_frames_ = std::max(batch_frames_ - 1, min_frames_);
+    }
+}
+
+bool AudioBatcher::Flush() {
+    if (empty()) {
+        return true;
+    }
+    // Fill in the length table in front of the frames
+    size_t count = lengths_.size();
+    size_t offset = AUDIO_BATCH_TABLE_ROOM - (1 + count * 2);
+    uint8_t* p = message_.data() + offset;
+    *p++ = count;
+    for (auto length : lengths_) {
+        *p++ = length >> 8;
+        *p++ = length & 0xFF;
+    }
+    size_t size = message_.size() - offset;
+    auto start_time = esp_timer_get_time();
+    bool sent = send_ && send_(message_.data() + offset, size);
+    OnSent(size, esp_timer_get_time() - start_time);
+    return sent;
+}
+
+void AudioBatcher::CountMessage(size_t size, int frames) {
+    stats_.frames += frames;
+    stats_.messages++;
+    stats_.bytes += size + WebsocketHeaderSize(size);
+}
+
+bool AudioBatcher::Parse(const uint8_t* data, size_t size, std::function<void(const uint8_t* frame, size_t size)> on_frame) {
+    if (size < 1) {
+        return false;
+    }
+    size_t count = data[0];
+    size_t offset = 1 + count * 2;
+    if (count == 0 || offset > size) {
+        return false;
+    }
+    // Check the whole table first so a malformed message delivers no frame at all
+    size_t total = offset;
+    for (size_t i = 0; i < count; i++) {
+        total += (data[1 + i * 2] << 8) | data[2 + i * 2];
+    }
+    if (total != size) {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t length = (data[1 + i * 2] << 8) | data[2 + i * 2];
+        on_frame(data + offset, length);
+        offset += length;
+    }
+    return true;
+}
@@ -0,0 +1,81 @@
+#ifndef AUDIO_BATCHER_H
+#define AUDIO_BATCHER_H
+
+#include <functional>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Most frames one batch message may carry, offered in the hello features
+#define AUDIO_BATCH_MAX_FRAMES 4
+// Frames are held for at most this share of the round trip time, in percent
+#define AUDIO_BATCH_RTT_BUDGET_PERCENT 50
+// A message send blocking longer than this share of the audio it carries asks for larger batches
+#define AUDIO_BATCH_BUSY_PERCENT 50
+#define AUDIO_BATCH_IDLE_PERCENT 10
+
+struct AudioBatchStats {
+    uint32_t frames = 0;
+    uint32_t messages = 0;
+    uint32_t bytes = 0;         // including the estimated websocket frame headers
+};
+
+/*
+ * Packs several framed audio packets into one websocket binary message:
+ *
+ *   |count 1u|length 2u (big endian) x count|frame 1|...|frame count|
+ *
+ * Each frame is a complete frame of the negotiated binary protocol version. Fewer messages mean
+ * fewer websocket headers, TLS records and TCP segments, which matters most on links where every
+ * send is a slow AT command.
+ *
+ * The number of frames per message starts from the round trip time measured with the hello
+ * exchange: the frames are held for up to half of it. It grows while sending a message blocks
+ * for a large share of the audio it carries and shrinks back when the link is idle.
+ */
+class AudioBatcher {
+public:
+    // Sends one binary websocket message, returns false if it failed
+    using SendFunction = std::function<bool(const uint8_t* data, size_t size)>;
+
+    void SetSend(SendFunction send);
+    // max_frames 1 sends every frame on its own, as without batching
+    void Configure(int max_frames, int rtt_ms, int frame_duration_ms);
+    void Reset();
+
+    // Returns true once the batch is full, it must be flushed before the next frame is added
+    bool Add(const uint8_t* frame, size_t size);
+    // Sends the pending frames as one message, if there are any. The frames are dropped when
+    // the send fails, returns false then
+    bool Flush();
+    // How long the first frame of a batch may wait before the batch is flushed anyway
+    inline int64_t flush_delay_us() const { return (int64_t)batch_frames_ * frame_duration_ms_ * 1000; }
+
+    inline bool empty() const { return lengths_.empty(); }
+    inline int batch_frames() const { return batch_frames_; }
+    inline int max_frames() const { return max_frames_; }
+
+    // Accounts a message that was sent without going through the batch
+    void CountMessage(size_t size, int frames);
+
+    inline const AudioBatchStats& stats() const { return stats_; }
+
+    // Calls on_frame for each frame of a received message, returns false if it is malformed
+    static bool Parse(const uint8_t* data, size_t size, std::function<void(const uint8_t* frame, size_t size)> on_frame);
+
+private:
+    SendFunction send_;
+    int max_frames_ = 1;
+    int min_frames_ = 1;        // from the round trip time
+    int batch_frames_ = 1;
+    int frame_duration_ms_ = 60;
+    std::vector<uint16_t> lengths_;
+    // Room for the largest length table, then the frames as they were added
+    std::vector<uint8_t> message_;
+    AudioBatchStats stats_;
+
+    // Releases the frames of the message and adapts the batch size to how long the send blocked
+    void OnSent(size_t size, int64_t send_us);
+};
+
+#endif // AUDIO_BATCHER_H
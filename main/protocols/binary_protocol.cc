@@ -0,0 +1,80 @@
+#include "binary_protocol.h"
+
+#include <cstring>
+#include <arpa/inet.h>
+
+const uint8_t* FrameBinaryAudio(int version, AudioStreamPacket& packet, size_t& frame_size) {
+    size_t payload_size = packet.payload_size();
+    size_t header_size = 0;
+    if (version == 2) {
+        header_size = sizeof(BinaryProtocol2);
+    } else if (version == 3) {
+        header_size = sizeof(BinaryProtocol3);
+    }
+    if (header_size == 0) {
+        frame_size = payload_size;
+        return packet.payload_data();
+    }
+    if (packet.payload_view != nullptr) {
+        // A read-only view has no headroom, copy it into the owned buffer once
+        const uint8_t* view = packet.payload_view;
+        packet.payload_view = nullptr;
+        packet.payload_view_size = 0;
+        packet.buffer.resize(AUDIO_STREAM_PACKET_HEADROOM);
+        packet.payload_offset = AUDIO_STREAM_PACKET_HEADROOM;
+        packet.AssignPayload(view, payload_size);
+    } else if (packet.payload_offset < header_size) {
+        // Not built by CreateAudioStreamPacket(), make room by moving the payload
+        packet.buffer.insert(packet.buffer.begin(), header_size - packet.payload_offset, 0);
+        packet.payload_offset = header_size;
+    }
+
+    uint8_t* frame = packet.buffer.data() + packet.payload_offset - header_size;
+    if (version == 2) {
+        BinaryProtocol2 header;
+        header.version = htons(version);
+        header.type = 0;
+        header.reserved = 0;
+        header.timestamp = htonl(packet.timestamp);
+        header.payload_size = htonl(payload_size);
+        memcpy(frame, &header, sizeof(header));
+    } else {
+        BinaryProtocol3 header;
+        header.type = 0;
+        header.reserved = 0;
+        header.payload_size = htons(payload_size);
+        memcpy(frame, &header, sizeof(header));
+    }
+    frame_size = header_size + payload_size;
+    return frame;
+}
+
+bool ParseBinaryAudio(int version, const uint8_t* data, size_t size, AudioStreamPacket& packet) {
+    if (version == 2) {
+        BinaryProtocol2 header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        size_t payload_size = ntohl(header.payload_size);
+        if (payload_size > size - sizeof(header)) {
+            return false;
+        }
+        packet.timestamp = ntohl(header.timestamp);
+        packet.AssignPayload(data + sizeof(header), payload_size);
+    } else if (version == 3) {
+        BinaryProtocol3 header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+        memcpy(&header, data, sizeof(header));
+        size_t payload_size = ntohs(header.payload_size);
+        if (payload_size > size - sizeof(header)) {
+            return false;
+        }
+        packet.AssignPayload(data + sizeof(header), payload_size);
+    } else {
+        packet.AssignPayload(data, size);
+    }
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "protocol.h"
+
+/*
+ * Audio framing of the websocket binary messages.
+ *
+ * Version 1 sends the bare Opus packet, versions 2 and 3 put a BinaryProtocol2 / BinaryProtocol3
+ * header in front of it. On send the header is written into the headroom of the pooled packet,
+ * so the frame is the packet buffer itself and goes out in one write without a copy. A packet
+ * without the headroom, or with a read-only payload view, is copied once into shape. On receive
+ * the header is read in place without modifying the websocket buffer, and the payload is copied
+ * once into the pooled packet after checking its size against the frame.
+ */
+
+// Returns the frame to send, which points into the packet
+const uint8_t* FrameBinaryAudio(int version, AudioStreamPacket& packet, size_t& frame_size);
+// Fills the timestamp and payload of packet, returns false if the frame is malformed
+bool ParseBinaryAudio(int version, const uint8_t* data, size_t size, AudioStreamPacket& packet);
+
+#endif // BINARY_PROTOCOL_H
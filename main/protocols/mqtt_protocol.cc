@@ -18,9 +18,16 @@ MqttProtocol::MqttProtocol() {
         .callback = [](void* arg) {
             MqttProtocol* protocol = (MqttProtocol*)arg;
             auto& app = Application::GetInstance();
-            if (app.GetDeviceState() == kDeviceStateIdle) {
-                ESP_LOGI(TAG, "Reconnecting to MQTT server");
+            // The task opening the audio channel connects by itself
+            if (app.GetDeviceState() == kDeviceStateIdle && !protocol->opening_audio_channel_) {
                 app.Schedule([protocol]() {
+                    // Checked again on the main task, which may have started an open since the timer fired
+                    auto& app = Application::GetInstance();
+                    if (app.GetDeviceState() != kDeviceStateIdle || app.IsAudioChannelOpening() ||
+                        protocol->opening_audio_channel_) {
+                        return;
+                    }
+                    ESP_LOGI(TAG, "Reconnecting to MQTT server");
                     protocol->StartMqttClient(false);
                 });
             }
@@ -148,30 +155,17 @@ bool MqttProtocol::SendText(const std::string& text) {
     return true;
 }
 
-bool MqttProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool MqttProtocol::SendAudio(AudioStreamPacketPtr packet) {
     std::lock_guard<std::mutex> lock(channel_mutex_);
     if (udp_ == nullptr) {
         return false;
     }
 
-    std::string nonce(aes_nonce_);
-    *(uint16_t*)&nonce[2] = htons(packet->payload.size());
-    *(uint32_t*)&nonce[8] = htonl(packet->timestamp);
-    *(uint32_t*)&nonce[12] = htonl(++local_sequence_);
-
-    std::string encrypted;
-    encrypted.resize(aes_nonce_.size() + packet->payload.size());
-    memcpy(encrypted.data(), nonce.data(), nonce.size());
-
-    size_t nc_off = 0;
-    uint8_t stream_block[16] = {0};
-    if (mbedtls_aes_crypt_ctr(&aes_ctx_, packet->payload.size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
-        (uint8_t*)packet->payload.data(), (uint8_t*)&encrypted[nonce.size()]) != 0) {
-        ESP_LOGE(TAG, "Failed to encrypt audio data");
+    auto datagram = crypto_.Seal(*packet, ++local_sequence_);
+    if (datagram == nullptr) {
         return false;
     }
-
-    return udp_->Send(encrypted) > 0;
+    return udp_->Send(*datagram) > 0;
 }
 
 void MqttProtocol::CloseAudioChannel() {
@@ -191,81 +185,98 @@ void MqttProtocol::CloseAudioChannel() {
     }
 }
 
+void MqttProtocol::PrepareOpenAudioChannel() {
+    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_CANCEL_EVENT);
+}
+
+void MqttProtocol::CancelOpenAudioChannel() {
+    xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_CANCEL_EVENT);
+}
+
 bool MqttProtocol::OpenAudioChannel() {
+    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
+    opening_audio_channel_ = true;
+    bool opened = OpenAudioChannelInternal();
+    opening_audio_channel_ = false;
+    return opened;
+}
+
+bool MqttProtocol::OpenAudioChannelInternal() {
+    // DNS, TCP, TLS and the MQTT handshake all happen inside Connect, they are timed together
+    int connect_ms = 0;
     if (mqtt_ == nullptr || !mqtt_->IsConnected()) {
         ESP_LOGI(TAG, "MQTT is not connected, try to connect now");
+        auto connect_time = esp_timer_get_time();
         if (!StartMqttClient(true)) {
             return false;
         }
+        connect_ms = (esp_timer_get_time() - connect_time) / 1000;
     }
 
     error_occurred_ = false;
     session_id_ = "";
-    xEventGroupClearBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 
     auto message = GetHelloMessage();
+    auto hello_time = esp_timer_get_time();
     if (!SendText(message)) {
         return false;
     }
 
     // 等待服务器响应
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT | MQTT_PROTOCOL_CANCEL_EVENT,
+        pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    if (bits & MQTT_PROTOCOL_CANCEL_EVENT) {
+        ESP_LOGI(TAG, "Opening the audio channel was cancelled");
+        return false;
+    }
     if (!(bits & MQTT_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
 
+    int hello_ms = (esp_timer_get_time() - hello_time) / 1000;
+
     std::lock_guard<std::mutex> lock(channel_mutex_);
     auto network = Board::GetInstance().GetNetwork();
     udp_ = network->CreateUdp(2);
     udp_->OnMessage([this](const std::string& data) {
-        /*
-         * UDP Encrypted OPUS Packet Format:
-         * |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
-         * |payload payload_len|
-         */
-        if (data.size() < sizeof(aes_nonce_)) {
-            ESP_LOGE(TAG, "Invalid audio packet size: %u", data.size());
+        auto packet = CreateAudioStreamPacket();
+        if (!crypto_.Open(data, *packet)) {
             return;
         }
-        if (data[0] != 0x01) {
-            ESP_LOGE(TAG, "Invalid audio packet type: %x", data[0]);
-            return;
-        }
-        uint32_t timestamp = ntohl(*(uint32_t*)&data[8]);
-        uint32_t sequence = ntohl(*(uint32_t*)&data[12]);
-        if (sequence < remote_sequence_) {
-            ESP_LOGW(TAG, "Received audio packet with old sequence: %lu, expected: %lu", sequence, remote_sequence_);
-            return;
-        }
-        if (sequence != remote_sequence_ + 1) {
-            ESP_LOGW(TAG, "Received audio packet with wrong sequence: %lu, expected: %lu", sequence, remote_sequence_ + 1);
-        }
-
-        size_t decrypted_size = data.size() - aes_nonce_.size();
-        size_t nc_off = 0;
-        uint8_t stream_block[16] = {0};
-        auto nonce = (uint8_t*)data.data();
-        auto encrypted = (uint8_t*)data.data() + aes_nonce_.size();
-        auto packet = std::make_unique<AudioStreamPacket>();
         packet->sample_rate = server_sample_rate_;
         packet->frame_duration = server_frame_duration_;
-        packet->timestamp = timestamp;
-        packet->payload.resize(decrypted_size);
-        int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, decrypted_size, &nc_off, nonce, stream_block, encrypted, (uint8_t*)packet->payload.data());
-        if (ret != 0) {
-            ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+        packet->origin_time_us = esp_timer_get_time();
+        uint32_t sequence = packet->sequence;
+        switch (sequence_tracker_.Add(sequence)) {
+        case kSequenceGap:
+            ESP_LOGW(TAG, "Received audio packet with sequence %lu after a gap", sequence);
+            break;
+        case kSequenceReordered:
+            ESP_LOGW(TAG, "Received reordered audio packet with sequence %lu", sequence);
+            break;
+        case kSequenceDuplicate:
+            ESP_LOGW(TAG, "Dropped duplicated audio packet with sequence %lu", sequence);
             return;
+        case kSequenceLate:
+            // Still forwarded, the jitter buffer decides whether a late packet can be played
+            ESP_LOGW(TAG, "Received late audio packet with sequence %lu", sequence);
+            break;
+        default:
+            break;
         }
+
         if (on_incoming_audio_ != nullptr) {
             on_incoming_audio_(std::move(packet));
         }
-        remote_sequence_ = sequence;
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
+    auto udp_time = esp_timer_get_time();
     udp_->Connect(udp_server_, udp_port_);
+    int udp_ms = (esp_timer_get_time() - udp_time) / 1000;
+    ESP_LOGI(TAG, "Audio channel opened: connect %d ms, hello %d ms, udp %d ms", connect_ms, hello_ms, udp_ms);
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -284,12 +295,16 @@ std::string MqttProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_USE_UPLINK_DTX
+    cJSON_AddBoolToObject(features, "dtx", true);
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    frame_duration_ = GetPreferredFrameDuration();
+    cJSON_AddNumberToObject(audio_params, "frame_duration", frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -310,6 +325,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         session_id_ = session_id->valuestring;
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
+    NegotiateFeatures(root);
 
     // Get sample rate from hello message
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
@@ -318,10 +334,7 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(sample_rate)) {
             server_sample_rate_ = sample_rate->valueint;
         }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
-        }
+        NegotiateFrameDuration(audio_params);
     }
 
     auto udp = cJSON_GetObjectItem(root, "udp");
@@ -336,11 +349,12 @@ void MqttProtocol::ParseServerHello(const cJSON* root) {
 
     // auto encryption = cJSON_GetObjectItem(udp, "encryption")->valuestring;
     // ESP_LOGI(TAG, "UDP server: %s, port: %d, encryption: %s", udp_server_.c_str(), udp_port_, encryption);
-    aes_nonce_ = DecodeHexString(nonce);
-    mbedtls_aes_init(&aes_ctx_);
-    mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)DecodeHexString(key).c_str(), 128);
+    if (!crypto_.SetKey(DecodeHexString(key), DecodeHexString(nonce))) {
+        ESP_LOGE(TAG, "Failed to set the UDP audio key");
+        return;
+    }
     local_sequence_ = 0;
-    remote_sequence_ = 0;
+    sequence_tracker_.Reset();
     xEventGroupSetBits(event_group_handle_, MQTT_PROTOCOL_SERVER_HELLO_EVENT);
 }
 
@@ -363,6 +377,10 @@ std::string MqttProtocol::DecodeHexString(const std::string& hex_string) {
     return decoded;
 }
 
+bool MqttProtocol::GetAudioLinkStats(AudioLinkStats& stats) {
+    return sequence_tracker_.GetStats(stats);
+}
+
 bool MqttProtocol::IsAudioChannelOpened() const {
     return udp_ != nullptr && !error_occurred_ && !IsTimeout();
 }
@@ -3,10 +3,11 @@
 
 
 #include "protocol.h"
+#include "udp_audio_crypto.h"
+#include "sequence_tracker.h"
 #include <mqtt.h>
 #include <udp.h>
 #include <cJSON.h>
-#include <mbedtls/aes.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <esp_timer.h>
@@ -15,11 +16,13 @@
 #include <string>
 #include <map>
 #include <mutex>
+#include <atomic>
 
 #define MQTT_PING_INTERVAL_SECONDS 90
 #define MQTT_RECONNECT_INTERVAL_MS 60000
 
 #define MQTT_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define MQTT_PROTOCOL_CANCEL_EVENT (1 << 1)
 
 class MqttProtocol : public Protocol {
 public:
@@ -27,10 +30,13 @@ public:
     ~MqttProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacketPtr packet) override;
     bool OpenAudioChannel() override;
+    void PrepareOpenAudioChannel() override;
+    void CancelOpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    bool GetAudioLinkStats(AudioLinkStats& stats) override;
 
 private:
     EventGroupHandle_t event_group_handle_;
@@ -40,15 +46,16 @@ private:
     std::mutex channel_mutex_;
     std::unique_ptr<Mqtt> mqtt_;
     std::unique_ptr<Udp> udp_;
-    mbedtls_aes_context aes_ctx_;
-    std::string aes_nonce_;
+    UdpAudioCrypto crypto_;
     std::string udp_server_;
     int udp_port_;
     uint32_t local_sequence_;
-    uint32_t remote_sequence_;
+    SequenceTracker sequence_tracker_;
     esp_timer_handle_t reconnect_timer_;
+    std::atomic<bool> opening_audio_channel_ = false;
 
     bool StartMqttClient(bool report_error=false);
+    bool OpenAudioChannelInternal();
     void ParseServerHello(const cJSON* root);
     std::string DecodeHexString(const std::string& hex_string);
 
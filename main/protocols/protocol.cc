@@ -1,14 +1,36 @@
 #include "protocol.h"
+#include "audio_service.h"
+#include "settings.h"
 
 #include <esp_log.h>
 
 #define TAG "Protocol"
 
+static FramePool<AudioStreamPacket>& GetAudioStreamPacketPool() {
+    static FramePool<AudioStreamPacket> pool(AUDIO_STREAM_PACKET_POOL_SIZE,
+        [](AudioStreamPacket& packet) {
+            packet.buffer.reserve(AUDIO_STREAM_PACKET_HEADROOM + AUDIO_STREAM_PACKET_PAYLOAD_CAPACITY);
+            packet.buffer.resize(AUDIO_STREAM_PACKET_HEADROOM);
+        },
+        [](AudioStreamPacket& packet) {
+            packet.Reset();
+        });
+    return pool;
+}
+
+AudioStreamPacketPtr CreateAudioStreamPacket() {
+    return GetAudioStreamPacketPool().Acquire();
+}
+
+FramePoolStats GetAudioStreamPacketPoolStats() {
+    return GetAudioStreamPacketPool().GetStats();
+}
+
 void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
-void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
+void Protocol::OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
@@ -32,6 +54,59 @@ void Protocol::OnDisconnected(std::function<void()> callback) {
     on_disconnected_ = callback;
 }
 
+void Protocol::OnAudioSent(std::function<void(bool sent, int64_t send_us)> callback) {
+    on_audio_sent_ = callback;
+}
+
+int Protocol::GetPreferredFrameDuration() {
+    Settings settings("audio", false);
+    int frame_duration = settings.GetInt("frame_duration", OPUS_FRAME_DURATION_MS);
+    if (!IS_VALID_OPUS_FRAME_DURATION(frame_duration)) {
+        ESP_LOGW(TAG, "Invalid frame duration in settings: %d ms", frame_duration);
+        frame_duration = OPUS_FRAME_DURATION_MS;
+    }
+    return frame_duration;
+}
+
+bool Protocol::SetPreferredFrameDuration(int frame_duration) {
+    if (!IS_VALID_OPUS_FRAME_DURATION(frame_duration)) {
+        return false;
+    }
+    Settings settings("audio", true);
+    settings.SetInt("frame_duration", frame_duration);
+    return true;
+}
+
+void Protocol::NegotiateFrameDuration(const cJSON* audio_params) {
+    // frame_duration of the server hello is the downlink. The uplink keeps the duration the device asked
+    // for, unless the server rejects it by naming another one in uplink_frame_duration
+    auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
+    if (cJSON_IsNumber(frame_duration)) {
+        server_frame_duration_ = frame_duration->valueint;
+    }
+    auto uplink_frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (cJSON_IsNumber(uplink_frame_duration)) {
+        if (IS_VALID_OPUS_FRAME_DURATION(uplink_frame_duration->valueint)) {
+            frame_duration_ = uplink_frame_duration->valueint;
+        } else {
+            ESP_LOGW(TAG, "Unsupported uplink frame duration: %d ms", uplink_frame_duration->valueint);
+        }
+    }
+    ESP_LOGI(TAG, "Frame duration: uplink %d ms, downlink %d ms", frame_duration_, server_frame_duration_);
+}
+
+void Protocol::NegotiateFeatures(const cJSON* root) {
+    // A feature offered in the device hello is only used if the server hello accepts it as well
+    uplink_dtx_ = false;
+#if CONFIG_USE_UPLINK_DTX
+    auto features = cJSON_GetObjectItem(root, "features");
+    if (cJSON_IsObject(features)) {
+        uplink_dtx_ = cJSON_IsTrue(cJSON_GetObjectItem(features, "dtx"));
+    }
+#endif
+    ESP_LOGI(TAG, "Features: uplink DTX %s", uplink_dtx_ ? "on" : "off");
+}
+
 void Protocol::SetError(const std::string& message) {
     error_occurred_ = true;
     if (on_network_error_ != nullptr) {
@@ -6,14 +6,59 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <cstring>
+
+#include "frame_pool.h"
+
+// Free bytes in front of every payload, where a transport writes its header (the largest is BinaryProtocol2)
+#define AUDIO_STREAM_PACKET_HEADROOM 16
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
-    std::vector<uint8_t> payload;
+    uint32_t sequence = 0;  // 0 if the transport does not number its packets
+    // The payload starts at payload_offset, the headroom before it lets the header be written in
+    // place so the frame goes out as one contiguous buffer. Use the accessors below
+    std::vector<uint8_t> buffer;
+    size_t payload_offset = AUDIO_STREAM_PACKET_HEADROOM;
+    // Read-only payload that outlives the packet (an embedded sound), used instead of payload when set
+    const uint8_t* payload_view = nullptr;
+    size_t payload_view_size = 0;
+    // esp_timer times for latency tracing, 0 if unknown
+    int64_t origin_time_us = 0;     // uplink: read from the microphone, downlink: received from the network
+    int64_t encode_time_us = 0;     // uplink: encoded
+
+    inline const uint8_t* payload_data() const { return payload_view != nullptr ? payload_view : buffer.data() + payload_offset; }
+    inline size_t payload_size() const { return payload_view != nullptr ? payload_view_size : buffer.size() - payload_offset; }
+    // Sizes the owned payload, keeping the headroom, and returns where it starts
+    inline uint8_t* ResizePayload(size_t size) {
+        buffer.resize(payload_offset + size);
+        return buffer.data() + payload_offset;
+    }
+    inline void AssignPayload(const uint8_t* data, size_t size) {
+        memcpy(ResizePayload(size), data, size);
+    }
+    // Back to an empty packet when it is recycled, the buffer keeps its capacity
+    void Reset() {
+        sample_rate = 0;
+        frame_duration = 0;
+        timestamp = 0;
+        sequence = 0;
+        buffer.resize(AUDIO_STREAM_PACKET_HEADROOM);
+        payload_offset = AUDIO_STREAM_PACKET_HEADROOM;
+        payload_view = nullptr;
+        payload_view_size = 0;
+        origin_time_us = 0;
+        encode_time_us = 0;
+    }
 };
 
+// Packets are recycled through a shared pool, always create them with CreateAudioStreamPacket()
+using AudioStreamPacketPtr = FramePool<AudioStreamPacket>::Handle;
+AudioStreamPacketPtr CreateAudioStreamPacket();
+FramePoolStats GetAudioStreamPacketPoolStats();
+
 struct BinaryProtocol2 {
     uint16_t version;
     uint16_t type;          // Message type (0: OPUS, 1: JSON)
@@ -30,6 +75,15 @@ struct BinaryProtocol3 {
     uint8_t payload[];
 } __attribute__((packed));
 
+// Downlink packet counters of the current audio session
+struct AudioLinkStats {
+    uint32_t received = 0;
+    uint32_t lost = 0;          // still missing, late packets included
+    uint32_t reordered = 0;     // arrived after a newer packet
+    uint32_t duplicate = 0;
+    uint32_t late = 0;          // too far behind the newest packet to be told apart
+};
+
 enum AbortReason {
     kAbortReasonNone,
     kAbortReasonWakeWordDetected
@@ -51,48 +105,75 @@ public:
     inline int server_frame_duration() const {
         return server_frame_duration_;
     }
+    // Uplink frame duration negotiated in the hello exchange
+    inline int frame_duration() const {
+        return frame_duration_;
+    }
+    // The server accepted that silent uplink frames are suppressed
+    inline bool uplink_dtx() const {
+        return uplink_dtx_;
+    }
     inline const std::string& session_id() const {
         return session_id_;
     }
 
-    void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    void OnIncomingAudio(std::function<void(AudioStreamPacketPtr packet)> callback);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
     void OnConnected(std::function<void()> callback);
     void OnDisconnected(std::function<void()> callback);
+    // Audio sent later than the SendAudio() call that queued it, e.g. a batch flushed by a timer
+    void OnAudioSent(std::function<void(bool sent, int64_t send_us)> callback);
 
     virtual bool Start() = 0;
+    // Blocks until the channel is open or failed, called by the task opening the audio channel
     virtual bool OpenAudioChannel() = 0;
+    // Called before the task running OpenAudioChannel is created, a cancel from then on is not lost
+    virtual void PrepareOpenAudioChannel() {}
+    // Makes a running OpenAudioChannel give up waiting for the server, may be called from any task
+    virtual void CancelOpenAudioChannel() {}
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    virtual bool SendAudio(AudioStreamPacketPtr packet) = 0;
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
 
+    // Returns false if the transport does not number its packets
+    virtual bool GetAudioLinkStats(AudioLinkStats& stats) { return false; }
+
+    // Stores the uplink frame duration proposed in the next hello, returns false if it is not 20, 40 or 60 ms
+    static bool SetPreferredFrameDuration(int frame_duration);
+
     // 类型检查方法
     virtual bool IsWebsocketProtocol() const { return false; }
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
-    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<void(AudioStreamPacketPtr packet)> on_incoming_audio_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
     std::function<void()> on_connected_;
     std::function<void()> on_disconnected_;
+    std::function<void(bool sent, int64_t send_us)> on_audio_sent_;
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int frame_duration_ = 60;
+    bool uplink_dtx_ = false;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
+    int GetPreferredFrameDuration();
+    void NegotiateFrameDuration(const cJSON* audio_params);
+    void NegotiateFeatures(const cJSON* root);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
@@ -0,0 +1,53 @@
+#include "sequence_tracker.h"
+
+void SequenceTracker::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    started_ = false;
+    window_ = 0;
+    stats_ = AudioLinkStats();
+}
+
+SequenceEvent SequenceTracker::Add(uint32_t sequence) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        started_ = true;
+        first_ = highest_ = sequence;
+        window_ = 1;
+        stats_.received++;
+        return kSequenceInOrder;
+    }
+
+    // Serial number arithmetic, so the order holds across the wrap of the 32 bit counter
+    int32_t distance = static_cast<int32_t>(sequence - highest_);
+    if (distance > 0) {
+        window_ = distance < SEQUENCE_TRACKER_WINDOW ? (window_ << distance) | 1 : 1;
+        highest_ = sequence;
+        stats_.received++;
+        return distance == 1 ? kSequenceInOrder : kSequenceGap;
+    }
+
+    if (distance <= -SEQUENCE_TRACKER_WINDOW || static_cast<int32_t>(sequence - first_) < 0) {
+        stats_.late++;
+        return kSequenceLate;
+    }
+    uint64_t bit = 1ULL << -distance;
+    if (window_ & bit) {
+        stats_.duplicate++;
+        return kSequenceDuplicate;
+    }
+    window_ |= bit;
+    stats_.received++;
+    stats_.reordered++;
+    return kSequenceReordered;
+}
+
+bool SequenceTracker::GetStats(AudioLinkStats& stats) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!started_) {
+        return false;
+    }
+    stats = stats_;
+    uint32_t expected = highest_ - first_ + 1;
+    stats.lost = expected > stats_.received ? expected - stats_.received : 0;
+    return true;
+}
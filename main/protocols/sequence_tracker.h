@@ -0,0 +1,47 @@
+#ifndef SEQUENCE_TRACKER_H
+#define SEQUENCE_TRACKER_H
+
+#include <mutex>
+#include <cstdint>
+
+#include "protocol.h"
+
+// Sequences this far behind the newest one are no longer told apart, they count as late
+#define SEQUENCE_TRACKER_WINDOW 64
+
+enum SequenceEvent {
+    kSequenceInOrder,
+    kSequenceGap,           // newer than expected, the packets in between are missing for now
+    kSequenceReordered,     // fills an earlier gap
+    kSequenceDuplicate,
+    kSequenceLate,          // older than the window
+};
+
+/*
+ * Classifies the sequence numbers of one downlink session as they arrive and counts loss,
+ * reordering, duplicates and late packets, in the manner of the RTP receiver reports: a packet
+ * that is missing when the stats are read counts as lost, a reordered packet that arrives later
+ * takes its loss back.
+ *
+ * Reordering itself is left to the JitterBuffer, which already plays packets in sequence order
+ * with a depth that follows the measured jitter, so holding packets here would add latency twice.
+ *
+ * Add is called by the receive task, GetStats by anyone.
+ */
+class SequenceTracker {
+public:
+    void Reset();
+    SequenceEvent Add(uint32_t sequence);
+    // Returns false until the first packet arrived
+    bool GetStats(AudioLinkStats& stats);
+
+private:
+    std::mutex mutex_;
+    bool started_ = false;
+    uint32_t first_ = 0;
+    uint32_t highest_ = 0;
+    uint64_t window_ = 0;       // bit i: highest_ - i has arrived
+    AudioLinkStats stats_;
+};
+
+#endif // SEQUENCE_TRACKER_H
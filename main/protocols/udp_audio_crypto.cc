@@ -0,0 +1,86 @@
+#include "udp_audio_crypto.h"
+
+#include <esp_log.h>
+#include <cstring>
+#include <arpa/inet.h>
+
+#define TAG "UdpAudioCrypto"
+
+UdpAudioCrypto::UdpAudioCrypto() {
+    mbedtls_aes_init(&aes_ctx_);
+}
+
+UdpAudioCrypto::~UdpAudioCrypto() {
+    mbedtls_aes_free(&aes_ctx_);
+}
+
+bool UdpAudioCrypto::SetKey(const std::string& key, const std::string& nonce) {
+    if (key.size() != 16 || nonce.size() != UDP_AUDIO_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid key size %u or nonce size %u", key.size(), nonce.size());
+        return false;
+    }
+    memcpy(nonce_, nonce.data(), UDP_AUDIO_NONCE_SIZE);
+    return mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.data(), 128) == 0;
+}
+
+const std::string* UdpAudioCrypto::Seal(const AudioStreamPacket& packet, uint32_t sequence) {
+    size_t payload_size = packet.payload_size();
+    datagram_.resize(UDP_AUDIO_NONCE_SIZE + payload_size);
+    auto header = (uint8_t*)datagram_.data();
+    memcpy(header, nonce_, UDP_AUDIO_NONCE_SIZE);
+    uint16_t payload_len = htons(payload_size);
+    uint32_t timestamp = htonl(packet.timestamp);
+    uint32_t sequence_be = htonl(sequence);
+    memcpy(header + 2, &payload_len, sizeof(payload_len));
+    memcpy(header + 8, &timestamp, sizeof(timestamp));
+    memcpy(header + 12, &sequence_be, sizeof(sequence_be));
+
+    // The counter is advanced by the cipher, so it works on a copy of the header
+    uint8_t counter[UDP_AUDIO_NONCE_SIZE];
+    memcpy(counter, header, UDP_AUDIO_NONCE_SIZE);
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    if (mbedtls_aes_crypt_ctr(&aes_ctx_, payload_size, &nc_off, counter, stream_block,
+        packet.payload_data(), header + UDP_AUDIO_NONCE_SIZE) != 0) {
+        ESP_LOGE(TAG, "Failed to encrypt audio data");
+        return nullptr;
+    }
+    return &datagram_;
+}
+
+bool UdpAudioCrypto::Open(const std::string& datagram, AudioStreamPacket& packet) {
+    if (datagram.size() < UDP_AUDIO_NONCE_SIZE) {
+        ESP_LOGE(TAG, "Invalid audio packet size: %u", datagram.size());
+        return false;
+    }
+    auto header = (const uint8_t*)datagram.data();
+    if (header[0] != UDP_AUDIO_PACKET_TYPE) {
+        ESP_LOGE(TAG, "Invalid audio packet type: %x", header[0]);
+        return false;
+    }
+    // CTR mode does not authenticate, but a datagram cut short or padded does not match its header
+    uint16_t payload_len;
+    memcpy(&payload_len, header + 2, sizeof(payload_len));
+    size_t payload_size = datagram.size() - UDP_AUDIO_NONCE_SIZE;
+    if (ntohs(payload_len) != payload_size) {
+        ESP_LOGE(TAG, "Invalid audio payload length: %u, received %u", ntohs(payload_len), payload_size);
+        return false;
+    }
+    uint32_t timestamp, sequence;
+    memcpy(&timestamp, header + 8, sizeof(timestamp));
+    memcpy(&sequence, header + 12, sizeof(sequence));
+    packet.timestamp = ntohl(timestamp);
+    packet.sequence = ntohl(sequence);
+
+    uint8_t counter[UDP_AUDIO_NONCE_SIZE];
+    memcpy(counter, header, UDP_AUDIO_NONCE_SIZE);
+    size_t nc_off = 0;
+    uint8_t stream_block[16] = {0};
+    int ret = mbedtls_aes_crypt_ctr(&aes_ctx_, payload_size, &nc_off, counter, stream_block,
+        header + UDP_AUDIO_NONCE_SIZE, packet.ResizePayload(payload_size));
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Failed to decrypt audio data, ret: %d", ret);
+        return false;
+    }
+    return true;
+}
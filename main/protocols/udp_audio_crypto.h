@@ -0,0 +1,46 @@
+#ifndef UDP_AUDIO_CRYPTO_H
+#define UDP_AUDIO_CRYPTO_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <mbedtls/aes.h>
+
+#include "protocol.h"
+
+#define UDP_AUDIO_NONCE_SIZE 16
+#define UDP_AUDIO_PACKET_TYPE 0x01
+
+/*
+ * AES-128-CTR sealing of the audio datagrams of the MQTT + UDP protocol:
+ *
+ *   |type 1u|flags 1u|payload_len 2u|ssrc 4u|timestamp 4u|sequence 4u|
+ *   |payload payload_len|
+ *
+ * The 16 byte header is the counter block, built from the nonce of the server hello. One AES
+ * context lives as long as the object and is only rekeyed by each hello, on ESP32 chips
+ * mbedtls routes it to the hardware AES accelerator. Sealing writes the header and the
+ * ciphertext straight into a datagram buffer that keeps its capacity, opening decrypts straight
+ * into the pooled packet, so neither direction allocates per packet.
+ */
+class UdpAudioCrypto {
+public:
+    UdpAudioCrypto();
+    ~UdpAudioCrypto();
+
+    // key and nonce are the decoded values of the server hello
+    bool SetKey(const std::string& key, const std::string& nonce);
+
+    // Returns the datagram to send, valid until the next call, or nullptr if encryption failed
+    const std::string* Seal(const AudioStreamPacket& packet, uint32_t sequence);
+    // Fills the timestamp, sequence and payload of packet, returns false if the datagram is invalid.
+    // Only the type and the length are checked, CTR mode cannot tell a modified payload
+    bool Open(const std::string& datagram, AudioStreamPacket& packet);
+
+private:
+    mbedtls_aes_context aes_ctx_;
+    uint8_t nonce_[UDP_AUDIO_NONCE_SIZE] = {0};
+    std::string datagram_;
+};
+
+#endif // UDP_AUDIO_CRYPTO_H
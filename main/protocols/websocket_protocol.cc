@@ -3,10 +3,13 @@
 #include "system_info.h"
 #include "application.h"
 #include "settings.h"
+#include "binary_protocol.h"
 
 #include <cstring>
+#include <algorithm>
 #include <cJSON.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <arpa/inet.h>
 #include <chrono>
 #include <thread>
@@ -16,9 +19,31 @@
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+
+    // Sends a batch that is not full after the audio stopped, e.g. at the end of speech or when
+    // DTX suppresses the following frames
+    esp_timer_create_args_t batch_timer_args = {
+        .callback = [](void* arg) {
+            auto protocol = (WebsocketProtocol*)arg;
+            Application::GetInstance().Schedule([protocol]() {
+                protocol->FlushPendingAudio();
+            });
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ws_batch",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&batch_timer_args, &batch_timer_);
+    // Only flushed with websocket_mutex_ held
+    batcher_.SetSend([this](const uint8_t* data, size_t size) {
+        return websocket_ != nullptr && websocket_->Send(data, size, true);
+    });
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    esp_timer_stop(batch_timer_);
+    esp_timer_delete(batch_timer_);
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -27,43 +52,82 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
+bool WebsocketProtocol::SendAudio(AudioStreamPacketPtr packet) {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
-    if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
-        bp2->version = htons(version_);
-        bp2->type = 0;
-        bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
-        bp3->type = 0;
-        bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+    size_t frame_size;
+    auto frame = FrameBinaryAudio(version_, *packet, frame_size);
+    if (batcher_.max_frames() <= 1) {
+        batcher_.CountMessage(frame_size, 1);
+        return websocket_->Send(frame, frame_size, true);
+    }
+
+    bool first = batcher_.empty();
+    if (batcher_.Add(frame, frame_size)) {
+        return FlushAudioBatch();
+    }
+    if (first) {
+        esp_timer_start_once(batch_timer_, batcher_.flush_delay_us());
+    }
+    return true;
+}
+
+bool WebsocketProtocol::FlushAudioBatch() {
+    esp_timer_stop(batch_timer_);
+    return batcher_.Flush();
+}
+
+void WebsocketProtocol::FlushPendingAudio() {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    FlushPendingAudioLocked();
+}
+
+void WebsocketProtocol::FlushPendingAudioLocked() {
+    if (batcher_.empty()) {
+        return;
+    }
+    // No SendAudio() call is waiting for this result, it goes to the uplink rate control instead
+    int64_t start_time = esp_timer_get_time();
+    bool sent = FlushAudioBatch();
+    if (!sent) {
+        ESP_LOGW(TAG, "Failed to send an audio batch");
+    }
+    if (on_audio_sent_ != nullptr) {
+        on_audio_sent_(sent, esp_timer_get_time() - start_time);
+    }
+}
+
+void WebsocketProtocol::OnIncomingBinary(const uint8_t* data, size_t size) {
+    auto on_frame = [this](const uint8_t* frame, size_t frame_size) {
+        auto packet = CreateAudioStreamPacket();
+        packet->sample_rate = server_sample_rate_;
+        packet->frame_duration = server_frame_duration_;
+        packet->origin_time_us = esp_timer_get_time();
+        if (!ParseBinaryAudio(version_, frame, frame_size, *packet)) {
+            ESP_LOGE(TAG, "Invalid binary protocol %d frame, size: %u", version_, (unsigned)frame_size);
+            return;
+        }
+        on_incoming_audio_(std::move(packet));
+    };
+
+    if (batcher_.max_frames() <= 1) {
+        on_frame(data, size);
+    } else if (!AudioBatcher::Parse(data, size, on_frame)) {
+        ESP_LOGE(TAG, "Invalid audio batch, size: %u", (unsigned)size);
     }
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
     if (websocket_ == nullptr || !websocket_->IsConnected()) {
         return false;
     }
 
+    // Audio captured before the message goes out first, the server relies on the order
+    FlushPendingAudioLocked();
     if (!websocket_->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
@@ -74,11 +138,32 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
     return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    std::unique_ptr<WebSocket> websocket;
+    {
+        std::lock_guard<std::mutex> lock(websocket_mutex_);
+        FlushPendingAudioLocked();
+        auto& stats = batcher_.stats();
+        if (stats.messages > 0) {
+            ESP_LOGI(TAG, "Uplink audio: %lu frames in %lu messages, %lu bytes with websocket headers",
+                (unsigned long)stats.frames, (unsigned long)stats.messages, (unsigned long)stats.bytes);
+        }
+        websocket = std::move(websocket_);
+    }
+    // Closing waits for the connection to shut down, a send from another task fails fast meanwhile
+    websocket.reset();
+}
+
+void WebsocketProtocol::PrepareOpenAudioChannel() {
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_CANCEL_EVENT);
+}
+
+void WebsocketProtocol::CancelOpenAudioChannel() {
+    xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_CANCEL_EVENT);
 }
 
 bool WebsocketProtocol::OpenAudioChannel() {
@@ -91,10 +176,20 @@ bool WebsocketProtocol::OpenAudioChannel() {
     }
 
     error_occurred_ = false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    {
+        // Sends fail fast until the new socket is published below
+        std::unique_ptr<WebSocket> previous;
+        {
+            std::lock_guard<std::mutex> lock(websocket_mutex_);
+            previous = std::move(websocket_);
+            batcher_.Configure(1, 0, frame_duration_);
+        }
+    }
 
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
-    if (websocket_ == nullptr) {
+    auto websocket = network->CreateWebSocket(1);
+    if (websocket == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
     }
@@ -104,47 +199,16 @@ bool WebsocketProtocol::OpenAudioChannel() {
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(version_).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    websocket->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
             if (on_incoming_audio_ != nullptr) {
-                if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
-                } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
-                } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
-                }
+                OnIncomingBinary((const uint8_t*)data, len);
             }
         } else {
             // Parse JSON data
@@ -166,7 +230,7 @@ bool WebsocketProtocol::OpenAudioChannel() {
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
@@ -174,25 +238,51 @@ bool WebsocketProtocol::OpenAudioChannel() {
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
+    // DNS, TCP, TLS and the upgrade all happen inside Connect, they are timed together
+    auto connect_time = esp_timer_get_time();
+    if (!websocket->Connect(url.c_str())) {
         ESP_LOGE(TAG, "Failed to connect to websocket server");
         SetError(Lang::Strings::SERVER_NOT_CONNECTED);
         return false;
     }
+    int connect_ms = (esp_timer_get_time() - connect_time) / 1000;
+    if (xEventGroupGetBits(event_group_handle_) & WEBSOCKET_PROTOCOL_CANCEL_EVENT) {
+        ESP_LOGI(TAG, "Opening the audio channel was cancelled");
+        return false;
+    }
 
     // Send hello message to describe the client
     auto message = GetHelloMessage();
-    if (!SendText(message)) {
+    auto hello_time = esp_timer_get_time();
+    if (!websocket->Send(message)) {
+        ESP_LOGE(TAG, "Failed to send text: %s", message.c_str());
+        SetError(Lang::Strings::SERVER_ERROR);
         return false;
     }
 
     // Wait for server hello
-    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT | WEBSOCKET_PROTOCOL_CANCEL_EVENT,
+        pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
+    if (bits & WEBSOCKET_PROTOCOL_CANCEL_EVENT) {
+        ESP_LOGI(TAG, "Opening the audio channel was cancelled");
+        return false;
+    }
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
         SetError(Lang::Strings::SERVER_TIMEOUT);
         return false;
     }
+    int hello_rtt_ms = (esp_timer_get_time() - hello_time) / 1000;
+    ESP_LOGI(TAG, "Audio channel opened: connect %d ms, hello %d ms", connect_ms, hello_rtt_ms);
+    {
+        std::lock_guard<std::mutex> lock(websocket_mutex_);
+        websocket_ = std::move(websocket);
+        batcher_.Configure(audio_batch_frames_, hello_rtt_ms, frame_duration_);
+        if (batcher_.max_frames() > 1) {
+            ESP_LOGI(TAG, "Audio batches of %d to %d frames, hello round trip %d ms",
+                batcher_.batch_frames(), batcher_.max_frames(), hello_rtt_ms);
+        }
+    }
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -211,13 +301,20 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddBoolToObject(features, "aec", true);
 #endif
     cJSON_AddBoolToObject(features, "mcp", true);
+#if CONFIG_USE_UPLINK_DTX
+    cJSON_AddBoolToObject(features, "dtx", true);
+#endif
+#if CONFIG_USE_WEBSOCKET_AUDIO_BATCH
+    cJSON_AddNumberToObject(features, "batch", AUDIO_BATCH_MAX_FRAMES);
+#endif
     cJSON_AddItemToObject(root, "features", features);
     cJSON_AddStringToObject(root, "transport", "websocket");
     cJSON* audio_params = cJSON_CreateObject();
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    frame_duration_ = GetPreferredFrameDuration();
+    cJSON_AddNumberToObject(audio_params, "frame_duration", frame_duration_);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -238,6 +335,15 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         session_id_ = session_id->valuestring;
         ESP_LOGI(TAG, "Session ID: %s", session_id_.c_str());
     }
+    NegotiateFeatures(root);
+    audio_batch_frames_ = 1;
+#if CONFIG_USE_WEBSOCKET_AUDIO_BATCH
+    auto features = cJSON_GetObjectItem(root, "features");
+    auto batch = cJSON_GetObjectItem(features, "batch");
+    if (cJSON_IsNumber(batch) && batch->valueint > 1) {
+        audio_batch_frames_ = std::min(batch->valueint, AUDIO_BATCH_MAX_FRAMES);
+    }
+#endif
 
     auto audio_params = cJSON_GetObjectItem(root, "audio_params");
     if (cJSON_IsObject(audio_params)) {
@@ -245,10 +351,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(sample_rate)) {
             server_sample_rate_ = sample_rate->valueint;
         }
-        auto frame_duration = cJSON_GetObjectItem(audio_params, "frame_duration");
-        if (cJSON_IsNumber(frame_duration)) {
-            server_frame_duration_ = frame_duration->valueint;
-        }
+        NegotiateFrameDuration(audio_params);
     }
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
@@ -259,7 +362,8 @@ bool WebsocketProtocol::ShouldKeepConnection() const {
 }
 
 bool WebsocketProtocol::SendKeepalive() {
-    if (!camera_streaming_ || websocket_ == nullptr || !websocket_->IsConnected()) {
+    // SendText checks the socket with websocket_mutex_ held
+    if (!camera_streaming_) {
         return false;
     }
 
@@ -3,12 +3,16 @@
 
 
 #include "protocol.h"
+#include "audio_batcher.h"
 
 #include <web_socket.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
+#include <esp_timer.h>
+#include <mutex>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+#define WEBSOCKET_PROTOCOL_CANCEL_EVENT (1 << 1)
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -16,8 +20,10 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacketPtr packet) override;
     bool OpenAudioChannel() override;
+    void PrepareOpenAudioChannel() override;
+    void CancelOpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
     
@@ -33,14 +39,25 @@ public:
 
 private:
     EventGroupHandle_t event_group_handle_;
+    // Held by every send and by replacing or closing websocket_, which is only published once the
+    // channel has opened
+    mutable std::mutex websocket_mutex_;
     std::unique_ptr<WebSocket> websocket_;
     int version_ = 1;
     bool camera_streaming_ = false;  // 摄像头推流状态
     std::chrono::steady_clock::time_point last_keepalive_time_;  // 最后保活时间
+    esp_timer_handle_t batch_timer_ = nullptr;
+    AudioBatcher batcher_;
+    int audio_batch_frames_ = 1;    // accepted by the server hello, 1 without batching
 
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
     std::string GetHelloMessage();
+    bool FlushAudioBatch();
+    // Flushes outside of SendAudio(), reports the result with on_audio_sent_
+    void FlushPendingAudio();
+    void FlushPendingAudioLocked();
+    void OnIncomingBinary(const uint8_t* data, size_t size);
 };
 
 #endif
@@ -0,0 +1,183 @@
+#include "audio_batcher.h"
+
+#include "host_test.h"
+
+#include <esp_timer.h>
+
+#include <string>
+#include <vector>
+
+class AudioBatcherTest : public HostTest {
+protected:
+    AudioBatcher batcher_;
+    // What went out, in order: "audio:<frames>" per batch message, else the text
+    std::vector<std::string> sent_;
+    std::vector<std::vector<uint8_t>> frames_;
+    int64_t send_duration_us_ = 0;
+    int64_t now_us_ = 1000000;
+
+    void SetUp() override {
+        host_set_time_us(now_us_);
+        batcher_.SetSend([this](const uint8_t* data, size_t size) {
+            size_t count = 0;
+            bool valid = AudioBatcher::Parse(data, size, [this, &count](const uint8_t* frame, size_t frame_size) {
+                frames_.emplace_back(frame, frame + frame_size);
+                count++;
+            });
+            sent_.push_back(valid ? "audio:" + std::to_string(count) : "invalid");
+            now_us_ += send_duration_us_;
+            host_set_time_us(now_us_);
+            return valid;
+        });
+    }
+
+    void TearDown() override {
+        host_set_time_us(-1);
+    }
+
+    bool AddFrame(uint8_t value, size_t size = 120) {
+        std::vector<uint8_t> frame(size, value);
+        return batcher_.Add(frame.data(), frame.size());
+    }
+};
+
+TEST_F(AudioBatcherTest, BatchSizeStartsFromTheRoundTrip) {
+    batcher_.Configure(4, 0, 60);
+    EXPECT_EQ(batcher_.batch_frames(), 1);
+    // Half of 300 ms holds two more 60 ms frames
+    batcher_.Configure(4, 300, 60);
+    EXPECT_EQ(batcher_.batch_frames(), 3);
+    EXPECT_EQ(batcher_.flush_delay_us(), 180000);
+    batcher_.Configure(4, 5000, 20);
+    EXPECT_EQ(batcher_.batch_frames(), 4) << "never beyond the frames the server accepted";
+    batcher_.Configure(9, 5000, 20);
+    EXPECT_EQ(batcher_.max_frames(), AUDIO_BATCH_MAX_FRAMES);
+}
+
+TEST_F(AudioBatcherTest, FlushesWhenTheBatchIsFull) {
+    batcher_.Configure(4, 300, 60);
+    EXPECT_FALSE(AddFrame(1));
+    EXPECT_FALSE(AddFrame(2, 300));
+    EXPECT_TRUE(AddFrame(3, 7));
+    EXPECT_TRUE(batcher_.Flush());
+    EXPECT_TRUE(batcher_.empty());
+
+    ASSERT_EQ(sent_.size(), 1u);
+    EXPECT_EQ(sent_[0], "audio:3");
+    ASSERT_EQ(frames_.size(), 3u);
+    EXPECT_EQ(frames_[0], std::vector<uint8_t>(120, 1));
+    EXPECT_EQ(frames_[1], std::vector<uint8_t>(300, 2));
+    EXPECT_EQ(frames_[2], std::vector<uint8_t>(7, 3));
+
+    auto& stats = batcher_.stats();
+    EXPECT_EQ(stats.frames, 3u);
+    EXPECT_EQ(stats.messages, 1u);
+    // 1 + 3 * 2 table bytes, the frames, and a masked header with a 16 bit length
+    EXPECT_EQ(stats.bytes, 7u + 427u + 8u);
+}
+
+TEST_F(AudioBatcherTest, DelayFlushSendsAPartialBatch) {
+    batcher_.Configure(4, 300, 60);
+    EXPECT_TRUE(batcher_.Flush()) << "nothing to send";
+    EXPECT_TRUE(sent_.empty());
+
+    // The protocol arms its timer with the delay when the first frame is queued
+    EXPECT_FALSE(AddFrame(1));
+    EXPECT_EQ(batcher_.flush_delay_us(), 3 * 60000);
+    EXPECT_TRUE(batcher_.Flush());
+    ASSERT_EQ(sent_.size(), 1u);
+    EXPECT_EQ(sent_[0], "audio:1");
+}
+
+TEST_F(AudioBatcherTest, BatchesGrowOnSlowSendsAndShrinkBack) {
+    batcher_.Configure(4, 150, 60);
+    ASSERT_EQ(batcher_.batch_frames(), 2);
+
+    // Sends blocking for more than half of the audio they carry
+    send_duration_us_ = 100000;
+    for (int i = 0; i < 5; i++) {
+        while (!AddFrame(i)) {
+        }
+        batcher_.Flush();
+    }
+    EXPECT_EQ(batcher_.batch_frames(), 4);
+    EXPECT_EQ(batcher_.flush_delay_us(), 4 * 60000);
+
+    // Fast sends shrink the batch back, but not below the round trip budget
+    send_duration_us_ = 0;
+    for (int i = 0; i < 5; i++) {
+        while (!AddFrame(i)) {
+        }
+        batcher_.Flush();
+    }
+    EXPECT_EQ(batcher_.batch_frames(), 2);
+}
+
+TEST_F(AudioBatcherTest, EveryBatchSizeHasItsLengthTable) {
+    batcher_.Configure(AUDIO_BATCH_MAX_FRAMES, 0, 60);
+    // The table of a partial batch is shorter, the frames must still follow it directly
+    for (int count = AUDIO_BATCH_MAX_FRAMES; count >= 1; count--) {
+        frames_.clear();
+        for (int i = 0; i < count; i++) {
+            AddFrame(count * 10 + i, 50 + i);
+        }
+        EXPECT_TRUE(batcher_.Flush());
+        EXPECT_EQ(sent_.back(), "audio:" + std::to_string(count));
+        ASSERT_EQ(frames_.size(), (size_t)count);
+        for (int i = 0; i < count; i++) {
+            EXPECT_EQ(frames_[i], std::vector<uint8_t>(50 + i, count * 10 + i)) << count << " frames";
+        }
+    }
+}
+
+TEST_F(AudioBatcherTest, FailedSendDropsTheBatch) {
+    batcher_.Configure(4, 300, 60);
+    bool fail = true;
+    batcher_.SetSend([this, &fail](const uint8_t* data, size_t size) {
+        sent_.push_back(fail ? "failed" : "audio");
+        return !fail;
+    });
+    AddFrame(1);
+    AddFrame(2);
+    EXPECT_FALSE(batcher_.Flush());
+    EXPECT_TRUE(batcher_.empty()) << "the frames are not sent again with the next batch";
+    EXPECT_EQ(batcher_.stats().frames, 2u);
+
+    fail = false;
+    AddFrame(3);
+    EXPECT_TRUE(batcher_.Flush());
+    EXPECT_TRUE(batcher_.Flush()) << "nothing to send";
+    std::vector<std::string> expected = {"failed", "audio"};
+    EXPECT_TRUE(sent_ == expected);
+}
+
+TEST_F(AudioBatcherTest, MalformedMessagesDeliverNoFrame) {
+    int delivered = 0;
+    auto on_frame = [&delivered](const uint8_t*, size_t) { delivered++; };
+
+    std::vector<uint8_t> message = {2, 0, 3, 0, 1, 'a', 'b', 'c', 'd'};
+    EXPECT_TRUE(AudioBatcher::Parse(message.data(), message.size(), on_frame));
+    EXPECT_EQ(delivered, 2);
+
+    delivered = 0;
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), 0, on_frame));
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), 4, on_frame)) << "length table cut short";
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), 8, on_frame)) << "last frame cut short";
+    message.push_back('e');
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), message.size(), on_frame)) << "bytes past the last frame";
+    message = {0};
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), message.size(), on_frame)) << "no frames";
+    message = {3, 0, 1, 0, 1, 0};
+    EXPECT_FALSE(AudioBatcher::Parse(message.data(), message.size(), on_frame)) << "odd table";
+    EXPECT_EQ(delivered, 0);
+}
+
+TEST_F(AudioBatcherTest, SingleFramesAreCountedWithoutBatching) {
+    batcher_.Configure(1, 1000, 60);
+    EXPECT_TRUE(AddFrame(1)) << "every frame fills the batch";
+    batcher_.Flush();
+    batcher_.CountMessage(200, 1);
+    auto& stats = batcher_.stats();
+    EXPECT_EQ(stats.messages, 2u);
+    EXPECT_EQ(stats.frames, 2u);
+}
@@ -0,0 +1,180 @@
+#include "audio_mixer.h"
+#include "pcm_kernels.h"
+
+#include "host_test.h"
+
+#include <deque>
+#include <vector>
+
+TEST(PcmAccumulateInt16, ConstantGain) {
+    std::vector<int16_t> src = {32767, -32768, 1000, -1000, 1};
+    std::vector<int32_t> acc = {0, 0, 5, 5, 5};
+    PcmAccumulateInt16(src.data(), acc.data(), src.size(), 32768, 32768);
+    std::vector<int32_t> expected = {16383, -16384, 505, -495, 5};
+    EXPECT_TRUE(acc == expected);
+
+    // Unity gain is exact at the extremes
+    acc.assign(src.size(), 0);
+    PcmAccumulateInt16(src.data(), acc.data(), src.size(), 65536, 65536);
+    EXPECT_EQ(acc[0], 32767);
+    EXPECT_EQ(acc[1], -32768);
+    PcmAccumulateInt16(src.data(), acc.data(), 0, 0, 65536);
+    EXPECT_EQ(acc[0], 32767) << "an empty block touches nothing";
+}
+
+TEST(PcmAccumulateInt16, GainRampsLinearly) {
+    const size_t samples = 64;
+    std::vector<int16_t> src(samples, 16384);
+    std::vector<int32_t> acc(samples, 0);
+    PcmAccumulateInt16(src.data(), acc.data(), samples, 65536, 0);
+    EXPECT_EQ(acc[0], 16384) << "starts at the current gain";
+    for (size_t i = 1; i < samples; i++) {
+        ASSERT_LE(acc[i], acc[i - 1]);
+        // One step of 16384 / 64 per sample
+        ASSERT_NEAR(acc[i], 16384 - int(i) * 256, 1);
+    }
+    EXPECT_LE(acc[samples - 1], 256) << "ends one step short of the target, which the next block holds";
+
+    // Ramping up, over a block shorter than the gain difference in Q16
+    acc.assign(3, 0);
+    PcmAccumulateInt16(src.data(), acc.data(), 3, 0, 65536);
+    EXPECT_EQ(acc[0], 0);
+    EXPECT_NEAR(acc[1], 16384 / 3, 1);
+    EXPECT_NEAR(acc[2], 16384 * 2 / 3, 1);
+}
+
+TEST(PcmInt32ToInt16, Saturates) {
+    std::vector<int32_t> src = {40000, -40000, 32767, -32768, 123};
+    std::vector<int16_t> dst(src.size());
+    PcmInt32ToInt16(src.data(), dst.data(), src.size(), 0);
+    std::vector<int16_t> expected = {32767, -32768, 32767, -32768, 123};
+    EXPECT_TRUE(dst == expected);
+}
+
+class AudioMixerTest : public HostTest {
+protected:
+    AudioMixer mixer_;
+    std::deque<std::vector<int16_t>> queued_[kAudioMixerSourceCount];
+
+    void SetUp() override {
+        for (int i = 0; i < kAudioMixerSourceCount; i++) {
+            mixer_.SetPull(AudioMixerSource(i), [this, i](std::vector<int16_t>& pcm) {
+                if (queued_[i].empty()) {
+                    return false;
+                }
+                pcm = std::move(queued_[i].front());
+                queued_[i].pop_front();
+                return true;
+            });
+        }
+    }
+
+    void Queue(AudioMixerSource source, size_t samples, int16_t value) {
+        queued_[source].emplace_back(samples, value);
+    }
+};
+
+TEST_F(AudioMixerTest, SpeechAloneIsUntouched) {
+    std::vector<int16_t> speech = {1, -2, 32767, -32768};
+    auto original = speech;
+    mixer_.Mix(speech);
+    EXPECT_TRUE(speech == original);
+}
+
+TEST_F(AudioMixerTest, SumSaturatesAtTheInt16Limits) {
+    std::vector<int16_t> speech = {30000, -30000, 20000, -20000};
+    queued_[kAudioMixerSourceEffect].push_back({30000, -30000, -5000, 5000});
+    mixer_.Mix(speech);
+    std::vector<int16_t> expected = {32767, -32768, 15000, -15000};
+    EXPECT_TRUE(speech == expected);
+
+    // Sources summed in 32 bits and saturated once: opposite overloads cancel out
+    queued_[kAudioMixerSourceEffect].push_back({32767, -32768});
+    queued_[kAudioMixerSourceLocal].push_back({32767, -32768});
+    speech = {-32768, 32767};
+    mixer_.Mix(speech);
+    expected = {32766, -32768};
+    EXPECT_TRUE(speech == expected);
+}
+
+TEST_F(AudioMixerTest, SpeechDucksEffectsWithARamp) {
+    AudioMixerSourceConfig speech_config;
+    speech_config.priority = 1;
+    speech_config.duck_q16 = 16384;
+    mixer_.Configure(kAudioMixerSourceSpeech, speech_config);
+
+    const size_t frame = 160;
+    Queue(kAudioMixerSourceEffect, frame * 3, 8000);
+    std::vector<int16_t> speech(frame, 0);
+    mixer_.Mix(speech);
+    // The effect fades from full level to a quarter over the first frame
+    EXPECT_EQ(speech[0], 8000);
+    for (size_t i = 1; i < frame; i++) {
+        ASSERT_LE(speech[i], speech[i - 1]);
+    }
+    EXPECT_NEAR(speech[frame - 1], 2000, 8000 / frame + 1);
+
+    speech.assign(frame, 0);
+    mixer_.Mix(speech);
+    EXPECT_EQ(speech.front(), 2000);
+    EXPECT_EQ(speech.back(), 2000);
+
+    // Without speech the effect ramps back up to full level
+    std::vector<int16_t> output;
+    ASSERT_TRUE(mixer_.Render(output, frame));
+    ASSERT_EQ(output.size(), frame);
+    EXPECT_EQ(output.front(), 2000);
+    for (size_t i = 1; i < frame; i++) {
+        ASSERT_GE(output[i], output[i - 1]);
+    }
+    EXPECT_NEAR(output.back(), 8000, 8000 / frame + 1);
+}
+
+TEST_F(AudioMixerTest, SpeechGainRampsToo) {
+    AudioMixerSourceConfig config;
+    config.gain_q16 = 32768;
+    mixer_.Configure(kAudioMixerSourceSpeech, config);
+    std::vector<int16_t> speech(100, 1000);
+    mixer_.Mix(speech);
+    EXPECT_EQ(speech.front(), 500);
+    EXPECT_EQ(speech.back(), 500);
+}
+
+TEST_F(AudioMixerTest, RenderPadsTheShorterSource) {
+    Queue(kAudioMixerSourceEffect, 100, 1000);
+    Queue(kAudioMixerSourceLocal, 40, 300);
+    std::vector<int16_t> output;
+    ASSERT_TRUE(mixer_.Render(output, 160));
+    ASSERT_EQ(output.size(), 100u) << "the block ends with the longest source";
+    for (size_t i = 0; i < 40; i++) {
+        ASSERT_EQ(output[i], 1300);
+    }
+    for (size_t i = 40; i < 100; i++) {
+        ASSERT_EQ(output[i], 1000);
+    }
+    EXPECT_FALSE(mixer_.Render(output, 160));
+}
+
+TEST_F(AudioMixerTest, RenderSplitsLongFramesAcrossBlocks) {
+    Queue(kAudioMixerSourceEffect, 100, 7);
+    Queue(kAudioMixerSourceEffect, 30, 9);
+    std::vector<int16_t> output;
+    size_t total = 0;
+    std::vector<int16_t> all;
+    while (mixer_.Render(output, 48)) {
+        EXPECT_LE(output.size(), 48u);
+        all.insert(all.end(), output.begin(), output.end());
+        total += output.size();
+    }
+    ASSERT_EQ(total, 130u);
+    EXPECT_EQ(all[99], 7);
+    EXPECT_EQ(all[100], 9);
+}
+
+TEST_F(AudioMixerTest, ClearDropsTheBufferedAudio) {
+    Queue(kAudioMixerSourceEffect, 100, 7);
+    std::vector<int16_t> output;
+    ASSERT_TRUE(mixer_.Render(output, 40));
+    mixer_.Clear(kAudioMixerSourceEffect);
+    EXPECT_FALSE(mixer_.Render(output, 40));
+}
@@ -0,0 +1,303 @@
+// Runs the whole AudioService on the host: a fixed WAV recording goes up through the audio
+// processor and the Opus encoder, and its packets come back down through the jitter buffer, the
+// decoder and the mixer into an output WAV. The figures printed are the regression benchmark of
+// audio_service.cc: throughput, queue peaks and the time of each codec call.
+#include "audio_service.h"
+#include "codecs/file_audio_codec.h"
+
+#include "host_test.h"
+#include "lcg.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#define SESSION_INPUT_PATH "audio_service_session_input.wav"
+#define SESSION_OUTPUT_PATH "audio_service_session_output.wav"
+#define SESSION_DURATION_MS 20000
+#define SESSION_OUTPUT_SAMPLE_RATE 24000
+#define SESSION_TIMEOUT_MS 60000
+#define SESSION_MAX_FRAMES 4096
+
+#if HOST_LIBOPUS
+#define SESSION_CODEC "libopus"
+#else
+#define SESSION_CODEC "stand-in codec"
+#endif
+
+// Each codec call is timed, encoding only happens on one task and decoding on another
+static std::vector<int64_t> encode_ns;
+static std::vector<int64_t> decode_ns;
+static std::atomic<uint32_t> decoded_frames = 0;
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+extern "C" {
+
+opus_int32 __real_opus_encode(OpusEncoder* st, const opus_int16* pcm, int frame_size, unsigned char* data,
+    opus_int32 max_data_bytes);
+int __real_opus_decode(OpusDecoder* st, const unsigned char* data, opus_int32 len, opus_int16* pcm, int frame_size,
+    int decode_fec);
+
+opus_int32 __wrap_opus_encode(OpusEncoder* st, const opus_int16* pcm, int frame_size, unsigned char* data,
+    opus_int32 max_data_bytes) {
+    int64_t start = NowNs();
+    opus_int32 size = __real_opus_encode(st, pcm, frame_size, data, max_data_bytes);
+    if (encode_ns.size() < encode_ns.capacity()) {
+        encode_ns.push_back(NowNs() - start);
+    }
+    return size;
+}
+
+int __wrap_opus_decode(OpusDecoder* st, const unsigned char* data, opus_int32 len, opus_int16* pcm, int frame_size,
+    int decode_fec) {
+    int64_t start = NowNs();
+    int samples = __real_opus_decode(st, data, len, pcm, frame_size, decode_fec);
+    if (decode_ns.size() < decode_ns.capacity()) {
+        decode_ns.push_back(NowNs() - start);
+    }
+    decoded_frames++;
+    return samples;
+}
+
+}
+
+static void WriteLe32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = value >> (8 * i);
+    }
+}
+
+static void WriteLe16(uint8_t* p, uint16_t value) {
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+// Syllables of a few harmonics on a wandering pitch with pauses between them, over a noise floor.
+// Only depends on the seed, so every run encodes the same samples
+static std::vector<int16_t> SpeechLikeSignal(size_t samples) {
+    std::vector<int16_t> pcm(samples);
+    Lcg lcg(20240611);
+    double phase = 0;
+    size_t i = 0;
+    while (i < samples) {
+        size_t syllable = 16 * lcg.Uniform(80, 300);
+        size_t pause = 16 * lcg.Uniform(20, 400);
+        double pitch = lcg.Uniform(90, 260);
+        for (size_t n = 0; n < syllable + pause && i < samples; n++, i++) {
+            double sample = lcg.Uniform(-200, 200);
+            if (n < syllable) {
+                double envelope = sin(M_PI * n / syllable);
+                phase += 2 * M_PI * pitch * (1.0 + 0.1 * n / syllable) / 16000;
+                sample += envelope * (6000 * sin(phase) + 3000 * sin(2 * phase) + 1500 * sin(3 * phase));
+            }
+            pcm[i] = (int16_t)sample;
+        }
+    }
+    return pcm;
+}
+
+static bool WriteWav(const char* path, const std::vector<int16_t>& pcm, int sample_rate) {
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    uint8_t header[44];
+    uint32_t data_size = pcm.size() * sizeof(int16_t);
+    memcpy(header, "RIFF", 4);
+    WriteLe32(header + 4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    WriteLe32(header + 16, 16);
+    WriteLe16(header + 20, 1);
+    WriteLe16(header + 22, 1);
+    WriteLe32(header + 24, sample_rate);
+    WriteLe32(header + 28, sample_rate * 2);
+    WriteLe16(header + 32, 2);
+    WriteLe16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    WriteLe32(header + 40, data_size);
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+        fwrite(pcm.data(), 1, data_size, file) == data_size;
+    fclose(file);
+    return written;
+}
+
+// Samples in the data chunk of a WAV written by FileAudioCodec
+static size_t ReadWavSamples(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+    uint8_t header[44];
+    size_t read = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if (read != sizeof(header)) {
+        return 0;
+    }
+    return (header[40] | (header[41] << 8) | (header[42] << 16) | ((uint32_t)header[43] << 24)) / sizeof(int16_t);
+}
+
+static void PrintCodecTimes(const char* name, std::vector<int64_t> times) {
+    if (times.empty()) {
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    size_t count = times.size();
+    printf("  %s: %zu calls, p50 %.1f us, p99 %.1f us, max %.1f us\n", name, count,
+        times[count * 50 / 100] / 1000.0, times[std::min(count - 1, count * 99 / 100)] / 1000.0,
+        times.back() / 1000.0);
+}
+
+static void PrintQueue(const char* name, const AudioQueueDepth& depth) {
+    printf("  %s queue: peak %zu of %zu\n", name, depth.high_water, depth.limit);
+}
+
+class AudioServiceSessionTest : public HostTest {
+protected:
+    std::vector<int16_t> input_;
+    int frame_samples_ = OPUS_FRAME_DURATION_MS * 16;
+    size_t frames_ = 0;
+    std::unique_ptr<FileAudioCodec> codec_;
+    std::unique_ptr<AudioService> service_;
+    bool stopped_ = false;
+    std::mutex mutex_;
+    std::condition_variable send_queue_available_;
+
+    void SetUp() override {
+        input_ = SpeechLikeSignal(SESSION_DURATION_MS * 16);
+        frames_ = input_.size() / frame_samples_;
+        ASSERT_TRUE(WriteWav(SESSION_INPUT_PATH, input_, 16000));
+
+        encode_ns.clear();
+        encode_ns.reserve(SESSION_MAX_FRAMES);
+        decode_ns.clear();
+        decode_ns.reserve(SESSION_MAX_FRAMES);
+        decoded_frames = 0;
+
+        // Unpaced, the pipeline runs as fast as its tasks allow
+        codec_ = std::make_unique<FileAudioCodec>(SESSION_INPUT_PATH, SESSION_OUTPUT_PATH, SESSION_OUTPUT_SAMPLE_RATE, 0);
+        service_ = std::make_unique<AudioService>();
+        service_->Initialize(codec_.get());
+        AudioServiceCallbacks callbacks;
+        callbacks.on_send_queue_available = [this]() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            send_queue_available_.notify_one();
+        };
+        service_->SetCallbacks(callbacks);
+        service_->Start();
+    }
+
+    void TearDown() override {
+        StopService();
+    }
+
+    // The codec calls are only read after the tasks have returned
+    void StopService() {
+        if (stopped_) {
+            return;
+        }
+        stopped_ = true;
+        service_->Stop();
+        host_join_tasks();
+        // Writes the header of the output WAV
+        codec_.reset();
+    }
+
+    static int64_t ElapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+TEST_F(AudioServiceSessionTest, Uplink) {
+    std::vector<AudioStreamPacketPtr> packets;
+    auto start = std::chrono::steady_clock::now();
+    service_->EnableVoiceProcessing(true);
+    // After the recording the codec reads silence, only the frames of the recording are counted
+    while (packets.size() < frames_ && ElapsedMs(start) < SESSION_TIMEOUT_MS) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            send_queue_available_.wait_for(lock, std::chrono::milliseconds(10));
+        }
+        while (packets.size() < frames_) {
+            auto packet = service_->PopPacketFromSendQueue();
+            if (packet == nullptr) {
+                break;
+            }
+            service_->OnAudioSent(true, 0);
+            packets.push_back(std::move(packet));
+        }
+    }
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    service_->EnableVoiceProcessing(false);
+    auto queues = service_->GetQueueStats();
+    StopService();
+
+    ASSERT_EQ(packets.size(), frames_);
+    size_t bytes = 0;
+    for (auto& packet : packets) {
+        EXPECT_EQ(packet->frame_duration, OPUS_FRAME_DURATION_MS);
+        EXPECT_EQ(packet->sample_rate, 16000);
+        EXPECT_GT(packet->payload_size(), 0u);
+        bytes += packet->payload_size();
+    }
+    EXPECT_GE(encode_ns.size(), frames_);
+
+    printf("Uplink, %s: %zu frames of %d ms (%zu bytes) in %.3f s, %.0f frames/s, %.1fx real time\n",
+        SESSION_CODEC, frames_, OPUS_FRAME_DURATION_MS, bytes, elapsed_s, frames_ / elapsed_s,
+        frames_ * OPUS_FRAME_DURATION_MS / 1000.0 / elapsed_s);
+    PrintQueue("encode", queues.encode);
+    PrintQueue("send", queues.send);
+    PrintCodecTimes("encode", encode_ns);
+}
+
+TEST_F(AudioServiceSessionTest, Downlink) {
+    // The recording is encoded here, as the server would, and arrives back to back
+    std::vector<std::vector<uint8_t>> packets(frames_);
+    {
+        OpusStreamEncoder encoder(16000, 1, OPUS_FRAME_DURATION_MS);
+        encoder.SetBitrate(CONFIG_AUDIO_UPLINK_BITRATE_MAX);
+        std::vector<int16_t> pcm(frame_samples_);
+        for (size_t i = 0; i < frames_; i++) {
+            pcm.assign(input_.begin() + i * frame_samples_, input_.begin() + (i + 1) * frame_samples_);
+            packets[i].resize(AUDIO_STREAM_PACKET_PAYLOAD_CAPACITY);
+            int size = encoder.Encode(pcm, packets[i].data(), packets[i].size());
+            ASSERT_GT(size, 0);
+            packets[i].resize(size);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto& payload : packets) {
+        auto packet = CreateAudioStreamPacket();
+        packet->sample_rate = 16000;
+        packet->frame_duration = OPUS_FRAME_DURATION_MS;
+        packet->origin_time_us = esp_timer_get_time();
+        packet->AssignPayload(payload.data(), payload.size());
+        ASSERT_TRUE(service_->PushPacketToDecodeQueue(std::move(packet), true));
+    }
+    while ((decoded_frames < frames_ || !service_->IsIdle()) && ElapsedMs(start) < SESSION_TIMEOUT_MS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    double elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto queues = service_->GetQueueStats();
+    StopService();
+
+    ASSERT_GE(decoded_frames.load(), frames_);
+    // Concealed frames may follow the last packet, nothing of the recording is missing
+    size_t output_samples = ReadWavSamples(SESSION_OUTPUT_PATH);
+    EXPECT_GE(output_samples, frames_ * OPUS_FRAME_DURATION_MS * SESSION_OUTPUT_SAMPLE_RATE / 1000);
+
+    printf("Downlink, %s: %zu frames of %d ms in %.3f s, %.0f frames/s, %.1fx real time, %zu samples at %d Hz written\n",
+        SESSION_CODEC, frames_, OPUS_FRAME_DURATION_MS, elapsed_s, frames_ / elapsed_s,
+        frames_ * OPUS_FRAME_DURATION_MS / 1000.0 / elapsed_s, output_samples, SESSION_OUTPUT_SAMPLE_RATE);
+    PrintQueue("decode", queues.decode);
+    PrintQueue("playback", queues.playback);
+    PrintCodecTimes("decode", decode_ns);
+}
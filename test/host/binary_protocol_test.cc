@@ -0,0 +1,121 @@
+#include "binary_protocol.h"
+
+#include "host_test.h"
+
+#include <algorithm>
+#include <vector>
+
+static std::vector<uint8_t> Payload(size_t size) {
+    std::vector<uint8_t> payload(size);
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = uint8_t(i * 37 + 11);
+    }
+    return payload;
+}
+
+static AudioStreamPacketPtr MakePacket(const std::vector<uint8_t>& payload, uint32_t timestamp) {
+    auto packet = CreateAudioStreamPacket();
+    packet->timestamp = timestamp;
+    packet->AssignPayload(payload.data(), payload.size());
+    return packet;
+}
+
+// Frames the payload with the version, parses it back and checks that nothing was lost
+static void RoundTrip(int version, size_t header_size, bool keeps_timestamp) {
+    auto payload = Payload(321);
+    auto packet = MakePacket(payload, 0x12345678);
+    size_t frame_size = 0;
+    const uint8_t* frame = FrameBinaryAudio(version, *packet, frame_size);
+    ASSERT_TRUE(frame != nullptr);
+    ASSERT_EQ(frame_size, header_size + payload.size());
+    EXPECT_TRUE(frame == packet->payload_data() - header_size) << "the header goes into the headroom";
+
+    auto received = CreateAudioStreamPacket();
+    ASSERT_TRUE(ParseBinaryAudio(version, frame, frame_size, *received));
+    EXPECT_EQ(received->payload_size(), payload.size());
+    EXPECT_TRUE(std::equal(payload.begin(), payload.end(), received->payload_data()));
+    EXPECT_EQ(received->timestamp, keeps_timestamp ? 0x12345678u : 0u);
+}
+
+TEST(BinaryProtocol, Version1IsTheBarePayload) {
+    RoundTrip(1, 0, false);
+}
+
+TEST(BinaryProtocol, Version2RoundTrip) {
+    RoundTrip(2, sizeof(BinaryProtocol2), true);
+}
+
+TEST(BinaryProtocol, Version3RoundTrip) {
+    RoundTrip(3, sizeof(BinaryProtocol3), false);
+}
+
+TEST(BinaryProtocol, HeadersAreBigEndian) {
+    auto packet = MakePacket(Payload(0x0102), 0x0A0B0C0D);
+    size_t frame_size;
+    const uint8_t* frame = FrameBinaryAudio(2, *packet, frame_size);
+    std::vector<uint8_t> header(frame, frame + sizeof(BinaryProtocol2));
+    std::vector<uint8_t> expected = {0, 2, 0, 0, 0, 0, 0, 0, 0x0A, 0x0B, 0x0C, 0x0D, 0, 0, 0x01, 0x02};
+    EXPECT_TRUE(header == expected);
+
+    packet = MakePacket(Payload(0x0102), 0);
+    frame = FrameBinaryAudio(3, *packet, frame_size);
+    header.assign(frame, frame + sizeof(BinaryProtocol3));
+    expected = {0, 0, 0x01, 0x02};
+    EXPECT_TRUE(header == expected);
+}
+
+TEST(BinaryProtocol, MalformedFramesAreRejected) {
+    auto packet = CreateAudioStreamPacket();
+    std::vector<uint8_t> frame = {0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 1, 2, 3};
+    EXPECT_FALSE(ParseBinaryAudio(2, frame.data(), frame.size(), *packet)) << "payload cut short";
+    EXPECT_FALSE(ParseBinaryAudio(2, frame.data(), sizeof(BinaryProtocol2) - 1, *packet)) << "header cut short";
+    frame.push_back(4);
+    EXPECT_TRUE(ParseBinaryAudio(2, frame.data(), frame.size(), *packet));
+    EXPECT_EQ(packet->payload_size(), 4u);
+
+    frame = {0, 0, 0, 3, 1, 2};
+    EXPECT_FALSE(ParseBinaryAudio(3, frame.data(), frame.size(), *packet));
+    EXPECT_FALSE(ParseBinaryAudio(3, frame.data(), 3, *packet));
+    frame = {0, 0, 0, 2, 1, 2, 9};
+    EXPECT_TRUE(ParseBinaryAudio(3, frame.data(), frame.size(), *packet)) << "trailing bytes are ignored";
+    EXPECT_EQ(packet->payload_size(), 2u);
+}
+
+TEST(BinaryProtocol, PayloadViewIsCopiedBehindAHeadroom) {
+    auto payload = Payload(100);
+    for (int version : {2, 3}) {
+        auto packet = CreateAudioStreamPacket();
+        packet->payload_view = payload.data();
+        packet->payload_view_size = payload.size();
+        size_t frame_size;
+        const uint8_t* frame = FrameBinaryAudio(version, *packet, frame_size);
+        ASSERT_TRUE(frame != nullptr);
+        EXPECT_TRUE(packet->payload_view == nullptr);
+        EXPECT_TRUE(frame >= packet->buffer.data() && frame < packet->buffer.data() + packet->buffer.size());
+
+        auto received = CreateAudioStreamPacket();
+        ASSERT_TRUE(ParseBinaryAudio(version, frame, frame_size, *received));
+        EXPECT_EQ(received->payload_size(), payload.size());
+        EXPECT_TRUE(std::equal(payload.begin(), payload.end(), received->payload_data()));
+    }
+}
+
+TEST(BinaryProtocol, ShortHeadroomIsMadeRoomFor) {
+    auto payload = Payload(50);
+    for (int version : {2, 3}) {
+        // A packet filled without the headroom
+        AudioStreamPacket packet;
+        packet.buffer = payload;
+        packet.payload_offset = 0;
+        packet.timestamp = 77;
+        size_t frame_size;
+        const uint8_t* frame = FrameBinaryAudio(version, packet, frame_size);
+        ASSERT_TRUE(frame != nullptr);
+
+        AudioStreamPacket received;
+        ASSERT_TRUE(ParseBinaryAudio(version, frame, frame_size, received));
+        EXPECT_EQ(received.payload_size(), payload.size());
+        EXPECT_TRUE(std::equal(payload.begin(), payload.end(), received.payload_data()));
+        EXPECT_EQ(received.timestamp, version == 2 ? 77u : 0u);
+    }
+}
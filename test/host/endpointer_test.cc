@@ -0,0 +1,189 @@
+#include "endpointer.h"
+
+#include "host_test.h"
+#include "lcg.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// 30 ms frames of 16 kHz audio
+#define FRAME_SAMPLES 480
+#define FRAME_US 30000
+// About -21 dBFS speech and -61 dBFS background noise
+#define SPEECH_AMPLITUDE 3000
+#define NOISE_AMPLITUDE 30
+
+class EndpointerTest : public HostTest {
+protected:
+    Endpointer endpointer_{EndpointerConfig()};
+    std::vector<int16_t> speech_ = Square(SPEECH_AMPLITUDE);
+    std::vector<int16_t> noise_ = Square(NOISE_AMPLITUDE);
+    int64_t now_us_ = 0;
+
+    static std::vector<int16_t> Square(int16_t amplitude) {
+        std::vector<int16_t> pcm(FRAME_SAMPLES);
+        for (size_t i = 0; i < pcm.size(); i++) {
+            pcm[i] = (i / 8) % 2 ? amplitude : -amplitude;
+        }
+        return pcm;
+    }
+
+    // Returns true if the frame ended the utterance
+    bool Frame(bool vad_speech, bool loud) {
+        auto& pcm = loud ? speech_ : noise_;
+        bool ended = endpointer_.Process(vad_speech, pcm.data(), pcm.size(), now_us_);
+        now_us_ += FRAME_US;
+        return ended;
+    }
+
+    // Frames until the utterance ends, -1 if it does not within max_frames
+    int FramesToEnd(int max_frames) {
+        for (int i = 1; i <= max_frames; i++) {
+            if (Frame(false, false)) {
+                return i;
+            }
+        }
+        return -1;
+    }
+};
+
+TEST_F(EndpointerTest, EndsAfterTheHangover) {
+    for (int i = 0; i < 20; i++) {
+        EXPECT_FALSE(Frame(true, true));
+    }
+    int64_t last_speech_us = now_us_ - FRAME_US;
+    // 700 ms of silence at 30 ms frames is reached on the 24th frame
+    EXPECT_EQ(FramesToEnd(100), 24);
+    EXPECT_EQ(endpointer_.speech_end_time_us(), last_speech_us);
+    EXPECT_EQ(FramesToEnd(100), -1) << "waits for the next utterance";
+}
+
+TEST_F(EndpointerTest, SpeechWithinTheHangoverContinuesTheUtterance) {
+    for (int i = 0; i < 20; i++) {
+        Frame(true, true);
+    }
+    for (int i = 0; i < 20; i++) {
+        EXPECT_FALSE(Frame(false, false));
+    }
+    Frame(true, true);
+    int64_t last_speech_us = now_us_ - FRAME_US;
+    EXPECT_EQ(FramesToEnd(100), 24);
+    EXPECT_EQ(endpointer_.speech_end_time_us(), last_speech_us);
+}
+
+TEST_F(EndpointerTest, ShortBurstsAreNotAnUtterance) {
+    // 270 ms, just under min_speech_ms
+    for (int i = 0; i < 9; i++) {
+        Frame(true, true);
+    }
+    EXPECT_EQ(FramesToEnd(100), -1);
+
+    // The next utterance starts from scratch
+    for (int i = 0; i < 10; i++) {
+        Frame(true, true);
+    }
+    EXPECT_EQ(FramesToEnd(100), 24);
+}
+
+TEST_F(EndpointerTest, QuietVadTriggersAreSilence) {
+    for (int i = 0; i < 100; i++) {
+        EXPECT_FALSE(Frame(true, false)) << "below the energy floor";
+    }
+    for (int i = 0; i < 20; i++) {
+        Frame(true, true);
+    }
+    // Noise the VAD still calls speech does not hold the utterance open
+    for (int i = 1; i < 24; i++) {
+        ASSERT_FALSE(Frame(true, false));
+    }
+    EXPECT_TRUE(Frame(true, false));
+}
+
+TEST_F(EndpointerTest, ResetForgetsTheUtterance) {
+    for (int i = 0; i < 20; i++) {
+        Frame(true, true);
+    }
+    endpointer_.Reset();
+    EXPECT_EQ(FramesToEnd(100), -1);
+}
+
+// Turns with hesitations, coughs and VAD triggers on noise: the figures quoted with the defaults
+TEST_F(EndpointerTest, SyntheticConversation) {
+    Lcg random(20240612);
+    const int turns = 500;
+    int false_cuts = 0;             // ended before the speaker finished
+    int missed_ends = 0;            // the speaker finished and nothing ended
+    int short_turns = 0;            // a single word under min_speech_ms, dropped by design
+    int spurious_ends = 0;          // ended on a cough or noise between turns
+    int end_time_errors = 0;
+    std::vector<int> latency_ms;
+
+    for (int turn = 0; turn < turns; turn++) {
+        // Between turns: noise with VAD triggers, and a cough now and then
+        int pause = random.Uniform(1000, 3000) / 30;
+        for (int i = 0; i < pause; i++) {
+            bool cough = random.Uniform(0, 199) == 0;
+            int length = cough ? random.Uniform(3, 8) : 1;
+            for (int j = 0; j < length && i < pause; j++, i++) {
+                spurious_ends += Frame(cough || random.Uniform(0, 19) == 0, cough);
+            }
+        }
+
+        // A turn: words with pauses, hesitations up to 600 ms, VAD misses of 1-2 frames
+        int words = random.Uniform(1, 12);
+        int64_t last_speech_us = 0;
+        int speech_ms = 0;
+        bool cut = false;
+        for (int word = 0; word < words && !cut; word++) {
+            int length = random.Uniform(5, 20);
+            for (int i = 0; i < length && !cut; i++) {
+                bool missed = random.Uniform(0, 24) == 0;
+                if (!missed) {
+                    last_speech_us = now_us_;
+                    speech_ms += FRAME_US / 1000;
+                }
+                cut = Frame(!missed, true);
+            }
+            if (word + 1 < words) {
+                bool hesitation = random.Uniform(0, 9) == 0;
+                int gap = hesitation ? random.Uniform(10, 20) : random.Uniform(1, 8);
+                for (int i = 0; i < gap && !cut; i++) {
+                    cut = Frame(false, false);
+                }
+            }
+        }
+        if (cut) {
+            false_cuts++;
+            continue;
+        }
+
+        int frames = FramesToEnd(200);
+        if (frames < 0) {
+            if (speech_ms < EndpointerConfig().min_speech_ms) {
+                short_turns++;
+            } else {
+                missed_ends++;
+            }
+            continue;
+        }
+        // From the end of the last speech frame to the end of the frame that ended the utterance
+        latency_ms.push_back((now_us_ - last_speech_us - FRAME_US) / 1000);
+        end_time_errors += endpointer_.speech_end_time_us() != last_speech_us;
+    }
+
+    std::sort(latency_ms.begin(), latency_ms.end());
+    int median = latency_ms.empty() ? 0 : latency_ms[latency_ms.size() / 2];
+    int worst = latency_ms.empty() ? 0 : latency_ms.back();
+    printf("Endpointer: %d turns, %d false cuts, %d missed ends, %d short turns dropped, %d ends on coughs or noise\n",
+        turns, false_cuts, missed_ends, short_turns, spurious_ends);
+    printf("Endpointer: end of speech to endpoint %d ms median, %d ms worst, %d wrong end times\n",
+        median, worst, end_time_errors);
+
+    // Hesitations up to 600 ms stay within the 700 ms hangover
+    EXPECT_EQ(false_cuts, 0);
+    EXPECT_EQ(missed_ends, 0);
+    EXPECT_EQ(spurious_ends, 0);
+    EXPECT_EQ(end_time_errors, 0);
+    EXPECT_LE(worst, 700 + 30);
+}
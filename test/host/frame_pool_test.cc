@@ -0,0 +1,160 @@
+#include "frame_pool.h"
+
+#include "host_test.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Every heap allocation of the test binary goes through here
+static std::atomic<size_t> allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+struct Frame {
+    std::vector<int16_t> pcm;
+    std::atomic<int> owner = 0;
+};
+
+static FramePool<Frame> CreatePool(size_t max_size) {
+    return FramePool<Frame>(max_size,
+        [](Frame& frame) { frame.pcm.reserve(960); },
+        [](Frame& frame) { frame.pcm.clear(); });
+}
+
+TEST(FramePool, NoHeapAllocationOnceWarm) {
+    auto pool = CreatePool(8);
+    {
+        // Warm up with as many frames in flight as the steady state below
+        std::vector<FramePool<Frame>::Handle> frames;
+        for (int i = 0; i < 4; i++) {
+            frames.push_back(pool.Acquire());
+        }
+    }
+
+    size_t before = allocations;
+    for (int i = 0; i < 10000; i++) {
+        auto a = pool.Acquire();
+        auto b = pool.Acquire();
+        a->pcm.resize(960);
+        b->pcm.resize(320);
+        auto c = std::move(a);
+        auto d = pool.Acquire();
+        auto e = pool.Acquire();
+    }
+    EXPECT_EQ(allocations - before, 0u);
+
+    auto stats = pool.GetStats();
+    EXPECT_EQ(stats.allocated, 4u);
+    EXPECT_EQ(stats.in_use, 0u);
+    EXPECT_EQ(stats.high_water, 4u);
+    EXPECT_EQ(stats.misses, 0u);
+}
+
+TEST(FramePool, ReserveCreatesAheadOfTime) {
+    auto pool = CreatePool(8);
+    pool.Reserve(6);
+    EXPECT_EQ(pool.GetStats().allocated, 6u);
+
+    size_t before = allocations;
+    {
+        std::vector<FramePool<Frame>::Handle> frames;
+        frames.reserve(6);
+        before = allocations;
+        for (int i = 0; i < 6; i++) {
+            frames.push_back(pool.Acquire());
+        }
+    }
+    EXPECT_EQ(allocations - before, 0u);
+    // Never beyond the pool size
+    pool.Reserve(100);
+    EXPECT_EQ(pool.GetStats().allocated, 8u);
+}
+
+TEST(FramePool, RecyclesResetObjects) {
+    auto pool = CreatePool(1);
+    Frame* first;
+    {
+        auto frame = pool.Acquire();
+        frame->pcm.assign(480, 7);
+        first = frame.get();
+    }
+    auto frame = pool.Acquire();
+    EXPECT_EQ(frame.get(), first);
+    EXPECT_TRUE(frame->pcm.empty());
+    EXPECT_GE(frame->pcm.capacity(), 960u) << "the buffer keeps its capacity";
+}
+
+TEST(FramePool, MissesBeyondMaxSizeAreFreed) {
+    auto pool = CreatePool(2);
+    {
+        auto a = pool.Acquire();
+        auto b = pool.Acquire();
+        auto c = pool.Acquire();
+        auto stats = pool.GetStats();
+        EXPECT_EQ(stats.allocated, 3u);
+        EXPECT_EQ(stats.in_use, 3u);
+        EXPECT_EQ(stats.misses, 1u);
+    }
+    auto stats = pool.GetStats();
+    EXPECT_EQ(stats.allocated, 2u);
+    EXPECT_EQ(stats.in_use, 0u);
+    EXPECT_EQ(stats.high_water, 3u);
+}
+
+TEST(FramePool, NeverHandsOutAnObjectTwice) {
+    auto pool = CreatePool(16);
+    const int threads = 4;
+    const int rounds = 100000;
+    std::atomic<int> conflicts = 0;
+
+    std::vector<std::thread> workers;
+    for (int id = 1; id <= threads; id++) {
+        workers.emplace_back([&, id]() {
+            std::vector<FramePool<Frame>::Handle> held;
+            for (int i = 0; i < rounds; i++) {
+                auto frame = pool.Acquire();
+                int expected = 0;
+                if (!frame->owner.compare_exchange_strong(expected, id)) {
+                    conflicts++;
+                }
+                held.push_back(std::move(frame));
+                // Hold up to three frames, released in a different order than acquired
+                if (held.size() > (size_t)(i % 3)) {
+                    size_t index = i % held.size();
+                    held[index]->owner = 0;
+                    held.erase(held.begin() + index);
+                }
+            }
+            for (auto& frame : held) {
+                frame->owner = 0;
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    EXPECT_EQ(conflicts.load(), 0);
+    auto stats = pool.GetStats();
+    EXPECT_EQ(stats.in_use, 0u);
+    EXPECT_LE(stats.allocated, 16u);
+    EXPECT_LE(stats.high_water, (size_t)threads * 3);
+}
@@ -0,0 +1,314 @@
+#include "interleaved_resampler.h"
+
+#include "host_test.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+struct Ratio {
+    int input_sample_rate;
+    int output_sample_rate;
+};
+
+static const Ratio kPolyphaseRatios[] = {
+    {16000, 24000}, {24000, 16000}, {16000, 48000}, {48000, 16000},
+    {24000, 48000}, {48000, 24000}, {24000, 44100}, {44100, 24000},
+};
+
+static std::vector<int16_t> Sine(double frequency, int sample_rate, size_t frames, double amplitude = 16384) {
+    std::vector<int16_t> pcm(frames);
+    for (size_t i = 0; i < frames; i++) {
+        pcm[i] = (int16_t)std::lround(amplitude * std::sin(2 * M_PI * frequency * i / sample_rate));
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> Resample(InterleavedResampler& resampler, const std::vector<int16_t>& input, size_t block_frames) {
+    std::vector<int16_t> output;
+    std::vector<int16_t> block;
+    int channels = resampler.channels();
+    size_t frames = input.size() / channels;
+    for (size_t start = 0; start < frames; start += block_frames) {
+        size_t count = std::min(block_frames, frames - start);
+        resampler.Process(input.data() + start * channels, count, block);
+        output.insert(output.end(), block.begin(), block.end());
+    }
+    return output;
+}
+
+// Fits a sine of the frequency to the output, whatever its delay, and returns the power of the
+// fit over the power of what is left, in dB. The first 20 ms are the filter settling
+static double SineSnrDb(const std::vector<int16_t>& pcm, double frequency, int sample_rate) {
+    size_t start = sample_rate / 50;
+    double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0;
+    for (size_t i = start; i < pcm.size(); i++) {
+        double s = std::sin(2 * M_PI * frequency * i / sample_rate);
+        double c = std::cos(2 * M_PI * frequency * i / sample_rate);
+        ss += s * s;
+        cc += c * c;
+        sc += s * c;
+        ys += pcm[i] * s;
+        yc += pcm[i] * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    double signal = 0, noise = 0;
+    for (size_t i = start; i < pcm.size(); i++) {
+        double fit = a * std::sin(2 * M_PI * frequency * i / sample_rate) + b * std::cos(2 * M_PI * frequency * i / sample_rate);
+        signal += fit * fit;
+        noise += (pcm[i] - fit) * (pcm[i] - fit);
+    }
+    return 10 * std::log10(signal / noise);
+}
+
+TEST(InterleavedResampler, PolyphaseBanksForTheBoardRatios) {
+    for (auto& ratio : kPolyphaseRatios) {
+        auto filter = FindPolyphaseFilter(ratio.input_sample_rate, ratio.output_sample_rate);
+        ASSERT_TRUE(filter != nullptr) << ratio.input_sample_rate << " -> " << ratio.output_sample_rate;
+        EXPECT_EQ((int64_t)ratio.input_sample_rate * filter->interpolation,
+            (int64_t)ratio.output_sample_rate * filter->decimation);
+        // Every phase has a DC gain of exactly 1 in Q15
+        for (int phase = 0; phase < filter->interpolation; phase++) {
+            int32_t sum = 0;
+            for (int i = 0; i < filter->taps_per_phase; i++) {
+                sum += filter->coefs[phase * filter->taps_per_phase + i];
+            }
+            ASSERT_EQ(sum, 32768) << "phase " << phase;
+        }
+    }
+    EXPECT_TRUE(FindPolyphaseFilter(16000, 22050) == nullptr);
+}
+
+TEST(InterleavedResampler, SineSnrOfEveryRatio) {
+    for (auto& ratio : kPolyphaseRatios) {
+        double min_snr = 1000;
+        int low = std::min(ratio.input_sample_rate, ratio.output_sample_rate);
+        for (double frequency : {440.0, 1000.0, 3000.0, 5500.0}) {
+            if (frequency > low * 0.4) {
+                continue;
+            }
+            InterleavedResampler resampler;
+            resampler.Configure(ratio.input_sample_rate, ratio.output_sample_rate, 1);
+            auto output = Resample(resampler, Sine(frequency, ratio.input_sample_rate, ratio.input_sample_rate), 480);
+            EXPECT_NEAR(double(output.size()), double(ratio.output_sample_rate), 1);
+            min_snr = std::min(min_snr, SineSnrDb(output, frequency, ratio.output_sample_rate));
+        }
+        printf("InterleavedResampler: %5d -> %5d Hz, SNR %.1f dB at worst\n",
+            ratio.input_sample_rate, ratio.output_sample_rate, min_snr);
+        EXPECT_GT(min_snr, 70.0) << ratio.input_sample_rate << " -> " << ratio.output_sample_rate;
+    }
+}
+
+TEST(InterleavedResampler, StopbandIsAttenuated) {
+    // A tone above the output Nyquist frequency must not alias back into the band
+    InterleavedResampler resampler;
+    resampler.Configure(48000, 16000, 1);
+    auto output = Resample(resampler, Sine(11000, 48000, 48000), 480);
+    double power = 0;
+    for (size_t i = 320; i < output.size(); i++) {
+        power += double(output[i]) * output[i];
+    }
+    double rms = std::sqrt(power / (output.size() - 320));
+    double attenuation = 20 * std::log10(rms / (16384 / std::sqrt(2.0)));
+    printf("InterleavedResampler: 11 kHz at 48 -> 16 kHz attenuated by %.1f dB\n", -attenuation);
+    EXPECT_LT(attenuation, -60.0);
+}
+
+TEST(InterleavedResampler, RateChangeKeepsTheHistory) {
+    // A constant level must go on through a rate change, without a dip to silence
+    InterleavedResampler resampler;
+    resampler.Configure(24000, 48000, 1);
+    std::vector<int16_t> output;
+    std::vector<int16_t> level(480, 10000);
+    for (int i = 0; i < 4; i++) {
+        resampler.Process(level.data(), level.size(), output);
+    }
+    for (int rate : {16000, 24000, 44100}) {
+        resampler.Configure(rate, 48000, 1);
+        level.assign(rate / 50, 10000);
+        resampler.Process(level.data(), level.size(), output);
+        ASSERT_FALSE(output.empty());
+        for (auto sample : output) {
+            ASSERT_NEAR(sample, 10000, 2) << "after switching to " << rate << " Hz";
+        }
+    }
+    // The same rates again keep the stream as it is
+    resampler.Configure(44100, 48000, 1);
+    resampler.Process(level.data(), level.size(), output);
+    EXPECT_NEAR(output.front(), 10000, 2);
+}
+
+TEST(InterleavedResampler, ResetStartsFromSilence) {
+    std::vector<int16_t> level(480, 10000);
+    for (auto& ratio : {Ratio{24000, 16000}, Ratio{16000, 22050}}) {
+        InterleavedResampler fresh;
+        fresh.Configure(ratio.input_sample_rate, ratio.output_sample_rate, 1);
+        auto expected = Resample(fresh, level, level.size());
+
+        InterleavedResampler resampler;
+        resampler.Configure(ratio.input_sample_rate, ratio.output_sample_rate, 1);
+        Resample(resampler, Sine(1000, ratio.input_sample_rate, 1000), 333);
+        resampler.Reset();
+        EXPECT_EQ(resampler.output_sample_rate(), ratio.output_sample_rate);
+        EXPECT_TRUE(Resample(resampler, level, level.size()) == expected) << ratio.output_sample_rate << " Hz";
+    }
+}
+
+// There is no SIMD path: the inner loop is a plain int16 multiply-accumulate into 32 bit sums.
+// Host timings, they only compare the ratios with each other
+TEST(InterleavedResampler, Benchmark) {
+    for (auto& ratio : kPolyphaseRatios) {
+        InterleavedResampler resampler;
+        resampler.Configure(ratio.input_sample_rate, ratio.output_sample_rate, 1);
+        size_t frames = ratio.input_sample_rate * 60 / 1000;
+        auto input = Sine(1000, ratio.input_sample_rate, frames);
+        std::vector<int16_t> output;
+        const int rounds = 2000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            resampler.Process(input.data(), frames, output);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        printf("InterleavedResampler: %5d -> %5d Hz, %.1f ns per output sample\n",
+            ratio.input_sample_rate, ratio.output_sample_rate, ns / (rounds * output.size()));
+    }
+}
+
+static std::vector<int16_t> Interleave(const std::vector<int16_t>& left, const std::vector<int16_t>& right) {
+    std::vector<int16_t> pcm(left.size() * 2);
+    for (size_t i = 0; i < left.size(); i++) {
+        pcm[i * 2] = left[i];
+        pcm[i * 2 + 1] = right[i];
+    }
+    return pcm;
+}
+
+static std::vector<int16_t> Channel(const std::vector<int16_t>& pcm, int channel) {
+    std::vector<int16_t> samples(pcm.size() / 2);
+    for (size_t i = 0; i < samples.size(); i++) {
+        samples[i] = pcm[i * 2 + channel];
+    }
+    return samples;
+}
+
+TEST(InterleavedResampler, StereoChannelsStaySeparate) {
+    // Microphone and reference as the codecs deliver them: a 1 kHz tone, and a 3 kHz tone plus DC
+    for (int rate : {24000, 48000}) {
+        auto mic = Sine(1000, rate, rate);
+        auto reference = Sine(3000, rate, rate, 12000);
+        for (auto& sample : reference) {
+            sample += 4000;
+        }
+        InterleavedResampler resampler;
+        resampler.Configure(rate, 16000, 2);
+        auto output = Resample(resampler, Interleave(mic, reference), 480);
+        ASSERT_EQ(output.size(), 2u * 16000);
+
+        auto mic_out = Channel(output, 0);
+        auto reference_out = Channel(output, 1);
+        double mic_snr = SineSnrDb(mic_out, 1000, 16000);
+        double mean = 0;
+        for (size_t i = 320; i < reference_out.size(); i++) {
+            mean += reference_out[i];
+        }
+        mean /= reference_out.size() - 320;
+        for (auto& sample : reference_out) {
+            sample -= 4000;
+        }
+        double reference_snr = SineSnrDb(reference_out, 3000, 16000);
+        printf("InterleavedResampler: stereo %d -> 16000 Hz, SNR %.1f dB (1 kHz) and %.1f dB (3 kHz + DC)\n",
+            rate, mic_snr, reference_snr);
+        EXPECT_GT(mic_snr, 70.0);
+        EXPECT_GT(reference_snr, 70.0);
+        EXPECT_NEAR(mean, 4000, 1) << "no crosstalk from the other channel";
+
+        // The same as resampling each channel on its own
+        InterleavedResampler mono;
+        mono.Configure(rate, 16000, 1);
+        EXPECT_TRUE(Resample(mono, mic, 480) == mic_out);
+    }
+}
+
+TEST(InterleavedResampler, OutputDoesNotDependOnTheBlockSize) {
+    for (int rate : {24000, 48000, 44100}) {
+        auto input = Interleave(Sine(1000, rate, rate), Sine(3000, rate, rate));
+        InterleavedResampler reference_resampler;
+        reference_resampler.Configure(rate, 16000 + (rate == 44100) * 8000, 2);
+        auto reference = Resample(reference_resampler, input, 480);
+        for (size_t block : {1, 333, 720, 1024}) {
+            InterleavedResampler resampler;
+            resampler.Configure(rate, reference_resampler.output_sample_rate(), 2);
+            ASSERT_TRUE(Resample(resampler, input, block) == reference) << rate << " Hz in blocks of " << block;
+        }
+    }
+}
+
+TEST(InterleavedResampler, FallbackKeepsTheChannelsApart) {
+    // No bank for 16 -> 22.05 kHz: one OpusResampler per channel
+    InterleavedResampler resampler;
+    resampler.Configure(16000, 22050, 2);
+    std::vector<int16_t> left(320, 1111);
+    std::vector<int16_t> right(320, -2222);
+    std::vector<int16_t> output;
+    resampler.Process(Interleave(left, right).data(), 320, output);
+    ASSERT_EQ(output.size(), 2u * 441);
+    for (size_t i = 0; i < output.size(); i += 2) {
+        ASSERT_EQ(output[i], 1111);
+        ASSERT_EQ(output[i + 1], -2222);
+    }
+}
+
+// The read path before the fused resampler: split the channels, resample each, interleave again,
+// through temporaries allocated per call. Same filter, so only the structure is compared
+static void SplitResample(InterleavedResampler& left, InterleavedResampler& right, const std::vector<int16_t>& input,
+    std::vector<int16_t>& output) {
+    std::vector<int16_t> mic_channel(input.size() / 2);
+    std::vector<int16_t> reference_channel(input.size() / 2);
+    for (size_t i = 0, j = 0; i < mic_channel.size(); ++i, j += 2) {
+        mic_channel[i] = input[j];
+        reference_channel[i] = input[j + 1];
+    }
+    std::vector<int16_t> resampled_mic;
+    std::vector<int16_t> resampled_reference;
+    left.Process(mic_channel.data(), mic_channel.size(), resampled_mic);
+    right.Process(reference_channel.data(), reference_channel.size(), resampled_reference);
+    output.resize(resampled_mic.size() + resampled_reference.size());
+    for (size_t i = 0, j = 0; i < resampled_mic.size(); ++i, j += 2) {
+        output[j] = resampled_mic[i];
+        output[j + 1] = resampled_reference[i];
+    }
+}
+
+TEST(InterleavedResampler, StereoInputBenchmark) {
+    for (int rate : {24000, 48000}) {
+        size_t frames = rate * 30 / 1000;
+        auto input = Interleave(Sine(1000, rate, frames), Sine(3000, rate, frames));
+        InterleavedResampler fused;
+        fused.Configure(rate, 16000, 2);
+        InterleavedResampler left, right;
+        left.Configure(rate, 16000, 1);
+        right.Configure(rate, 16000, 1);
+
+        std::vector<int16_t> output;
+        std::vector<int16_t> split_output;
+        const int rounds = 4000;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            fused.Process(input.data(), frames, output);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            SplitResample(left, right, input, split_output);
+        }
+        auto end = std::chrono::steady_clock::now();
+        EXPECT_TRUE(output == split_output);
+
+        double fused_us = std::chrono::duration<double, std::micro>(middle - start).count() / rounds;
+        double split_us = std::chrono::duration<double, std::micro>(end - middle).count() / rounds;
+        printf("InterleavedResampler: stereo %d -> 16000 Hz, 30 ms frame in %.2f us fused, %.2f us split\n",
+            rate, fused_us, split_us);
+    }
+}
@@ -0,0 +1,413 @@
+#include "jitter_buffer.h"
+
+#include "host_test.h"
+#include "lcg.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <vector>
+
+#define FRAME_US 60000
+// MAX_PLAYBACK_TASKS_IN_QUEUE of AudioService
+#define MAX_PLAYBACK_FRAMES 2
+
+// SILK wideband 60 ms and 20 ms, CELT fullband 20 ms; one frame per packet
+#define TOC_SILK_WB_60MS 0x58
+#define TOC_SILK_WB_20MS 0x48
+#define TOC_CELT_FB_20MS 0xF8
+
+// The LBRR flag follows the VAD flags of the 20 ms SILK frames: bit 4 for 60 ms packets
+static AudioStreamPacketPtr MakePacket(uint32_t sequence, bool lbrr = false, uint8_t toc = TOC_SILK_WB_60MS) {
+    auto packet = CreateAudioStreamPacket();
+    packet->sequence = sequence;
+    packet->frame_duration = 60;
+    packet->sample_rate = 16000;
+    uint8_t flags = 0;
+    if (lbrr) {
+        flags = toc == TOC_SILK_WB_20MS ? 0x40 : 0x10;
+    }
+    std::vector<uint8_t> payload = {toc, flags, 0x5A, 0xA5, 0x33};
+    packet->AssignPayload(payload.data(), payload.size());
+    return packet;
+}
+
+class JitterBufferTest : public HostTest {
+protected:
+    JitterBuffer buffer_;
+    int64_t now_us_ = 1000000;
+
+    void Put(uint32_t sequence, bool lbrr = false, uint8_t toc = TOC_SILK_WB_60MS) {
+        buffer_.Put(MakePacket(sequence, lbrr, toc), now_us_);
+    }
+
+    // The sequence of the decoded packet, -1 for any other action
+    int PullDecode(bool output_starving = false) {
+        auto frame = buffer_.Pull(now_us_, output_starving);
+        if (frame.action != kJitterBufferDecode) {
+            return -1;
+        }
+        return frame.packet->sequence;
+    }
+
+    void Tick(int frames = 1) {
+        now_us_ += frames * FRAME_US;
+    }
+};
+
+TEST_F(JitterBufferTest, InOrderPacketsPlayWithoutLoss) {
+    for (uint32_t sequence = 1; sequence <= 50; sequence++) {
+        Put(sequence);
+        ASSERT_EQ(PullDecode(), int(sequence));
+        Tick();
+    }
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.received, 50u);
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.late, 0u);
+    EXPECT_EQ(stats.jitter_ms, 0u);
+    EXPECT_EQ(stats.target_depth, 1u);
+}
+
+TEST_F(JitterBufferTest, ReorderedPacketsAreSorted) {
+    Put(1);
+    Put(3);
+    Put(2);
+    EXPECT_EQ(PullDecode(), 1);
+    EXPECT_EQ(PullDecode(), 2);
+    EXPECT_EQ(PullDecode(), 3);
+
+    // Once playing, a gap is held open while the output still has audio
+    Put(5);
+    auto frame = buffer_.Pull(now_us_, false);
+    EXPECT_EQ(frame.action, kJitterBufferWait);
+    Put(4);
+    EXPECT_EQ(PullDecode(), 4);
+    EXPECT_EQ(PullDecode(), 5);
+
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.late, 0u);
+}
+
+TEST_F(JitterBufferTest, ReorderedBeforePlayoutStarts) {
+    Put(2);
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    EXPECT_EQ(PullDecode(), 2);
+    EXPECT_EQ(buffer_.GetStats().late, 0u);
+}
+
+TEST_F(JitterBufferTest, DuplicatesAreDropped) {
+    Put(1);
+    Put(2);
+    Put(2);
+    EXPECT_EQ(buffer_.size(), 2u);
+    EXPECT_EQ(PullDecode(), 1);
+    // Played already
+    Put(1);
+    EXPECT_EQ(PullDecode(), 2);
+    EXPECT_TRUE(buffer_.empty());
+
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.received, 4u);
+    EXPECT_EQ(stats.late, 2u);
+}
+
+TEST_F(JitterBufferTest, LostPacketIsConcealedWhenTheOutputStarves) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(3);
+    EXPECT_EQ(buffer_.Pull(now_us_, false).action, kJitterBufferWait);
+    auto frame = buffer_.Pull(now_us_, true);
+    EXPECT_EQ(frame.action, kJitterBufferConceal);
+    EXPECT_EQ(PullDecode(true), 3);
+
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.concealed, 1u);
+    EXPECT_EQ(stats.fec_recovered, 0u);
+    // One frame deeper after a loss, from the next arrival on
+    Put(4);
+    EXPECT_EQ(buffer_.GetStats().target_depth, 2u);
+}
+
+TEST_F(JitterBufferTest, LostPacketIsRebuiltFromFec) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(3, true);
+    auto frame = buffer_.Pull(now_us_, true);
+    ASSERT_EQ(frame.action, kJitterBufferDecodeFec);
+    ASSERT_TRUE(frame.next_packet != nullptr);
+    EXPECT_EQ(frame.next_packet->sequence, 3u);
+    EXPECT_EQ(buffer_.size(), 1u) << "the next packet stays queued for its own turn";
+    EXPECT_EQ(PullDecode(true), 3);
+
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.fec_recovered, 1u);
+    EXPECT_EQ(stats.concealed, 0u);
+}
+
+TEST_F(JitterBufferTest, FecOnlyCoversTheFrameRightBefore) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(4, true);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferConceal);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferDecodeFec);
+    EXPECT_EQ(PullDecode(true), 4);
+
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.lost, 2u);
+    EXPECT_EQ(stats.concealed, 1u);
+    EXPECT_EQ(stats.fec_recovered, 1u);
+}
+
+TEST_F(JitterBufferTest, LbrrFlagFollowsTheFrameDuration) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(3, true, TOC_SILK_WB_20MS);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferDecodeFec);
+    EXPECT_EQ(PullDecode(true), 3);
+
+    // The 20 ms flag bit is a VAD flag of a 60 ms packet
+    auto packet = MakePacket(5);
+    packet->buffer[packet->payload_offset + 1] = 0x40;
+    buffer_.Put(std::move(packet), now_us_);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferConceal);
+
+    // CELT has no LBRR, whatever the bits
+    auto celt = MakePacket(7, false, TOC_CELT_FB_20MS);
+    celt->buffer[celt->payload_offset + 1] = 0xFF;
+    EXPECT_EQ(PullDecode(true), 5);
+    buffer_.Put(std::move(celt), now_us_);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferConceal);
+    EXPECT_EQ(PullDecode(true), 7);
+}
+
+TEST_F(JitterBufferTest, PacketAfterItsConcealedSlotIsLateAndDeepensTheBuffer) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(3);
+    EXPECT_EQ(buffer_.Pull(now_us_, true).action, kJitterBufferConceal);
+    EXPECT_EQ(PullDecode(true), 3);
+    Tick();
+    Put(2);
+    EXPECT_EQ(buffer_.GetStats().late, 1u);
+
+    // The next pull plays a stretch frame, so what follows waits one frame longer
+    Put(4);
+    EXPECT_EQ(buffer_.Pull(now_us_, false).action, kJitterBufferConceal);
+    EXPECT_EQ(PullDecode(), 4);
+    EXPECT_EQ(buffer_.GetStats().stretched, 1u);
+}
+
+TEST_F(JitterBufferTest, LongGapIsSkipped) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    Put(10);
+    EXPECT_EQ(PullDecode(true), 10) << "no concealment beyond a few frames";
+    EXPECT_EQ(buffer_.GetStats().lost, 8u);
+    EXPECT_EQ(buffer_.GetStats().concealed, 0u);
+}
+
+TEST_F(JitterBufferTest, RestartedNumberingResyncs) {
+    for (uint32_t sequence = 1000; sequence < 1003; sequence++) {
+        Put(sequence);
+        EXPECT_EQ(PullDecode(), int(sequence));
+    }
+    Put(1);
+    Put(2);
+    EXPECT_EQ(PullDecode(), 1003);
+    EXPECT_EQ(PullDecode(), 1004);
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.lost, 0u);
+    EXPECT_EQ(stats.late, 0u);
+}
+
+TEST_F(JitterBufferTest, UnnumberedPacketsPlayInArrivalOrder) {
+    for (int i = 0; i < 3; i++) {
+        Put(0);
+    }
+    EXPECT_EQ(PullDecode(), 1);
+    EXPECT_EQ(PullDecode(), 2);
+    EXPECT_EQ(PullDecode(), 3);
+}
+
+TEST_F(JitterBufferTest, UnderrunWaitsForTheLastFrameThenCounts) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    auto frame = buffer_.Pull(now_us_, true);
+    EXPECT_EQ(frame.action, kJitterBufferWait);
+    EXPECT_EQ(frame.wait_ms, FRAME_US / 1000 + 1);
+    Tick();
+    buffer_.Pull(now_us_, true);
+
+    // The stream goes on after the gap, with a deeper buffer
+    Put(2);
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.underruns, 1u);
+    EXPECT_EQ(stats.target_depth, 2u);
+    frame = buffer_.Pull(now_us_, false);
+    EXPECT_EQ(frame.action, kJitterBufferWait) << "prebuffers the target depth again";
+    EXPECT_GT(frame.wait_ms, 0);
+    Put(3);
+    EXPECT_EQ(PullDecode(), 2);
+}
+
+TEST_F(JitterBufferTest, LateArrivalsRaiseTheTargetDepth) {
+    Put(1);
+    EXPECT_EQ(PullDecode(), 1);
+    // Packet 2 is two frames late
+    Tick(3);
+    Put(2);
+    auto stats = buffer_.GetStats();
+    EXPECT_EQ(stats.jitter_ms, 2u * FRAME_US / 1000);
+    EXPECT_EQ(stats.target_depth, 3u);
+}
+
+struct LinkProfile {
+    const char* name;
+    int loss_per_mille;     // chance that a loss burst starts at a packet
+    int max_burst;          // packets lost in a row, 1 to max_burst
+    int jitter_ms;          // uniform delay on top of the base delay
+    int spike_per_mille;    // chance of a delay spike, Wi-Fi retries or a cell handover
+    int spike_ms;
+};
+
+struct ReplayResult {
+    JitterBufferStats stats;
+    int output_gaps = 0;        // the output ran dry while the stream was going on
+    int gap_ms = 0;
+    double mean_added_ms = 0;   // from the arrival of a packet to the start of its playout
+    int p95_added_ms = 0;
+};
+
+/*
+ * Replays 3000 packets of 60 ms (3 minutes) over a link with the given loss and delay profile, in
+ * 1 ms steps. The decoder task keeps a playback queue of two frames filled as AudioService does,
+ * and the output takes a frame from it every 60 ms. Every packet carries LBRR, as with FEC on.
+ */
+static ReplayResult ReplayLink(const LinkProfile& profile, uint32_t seed) {
+    const int packets = 3000;
+    const int base_delay_ms = 40;
+    Lcg random(seed);
+
+    struct Arrival {
+        int time_ms;
+        uint32_t sequence;
+    };
+    std::vector<Arrival> arrivals;
+    for (int i = 0; i < packets; i++) {
+        if (random.Uniform(0, 999) < profile.loss_per_mille) {
+            i += random.Uniform(1, profile.max_burst) - 1;
+            continue;
+        }
+        int delay = base_delay_ms + random.Uniform(0, profile.jitter_ms);
+        if (random.Uniform(0, 999) < profile.spike_per_mille) {
+            delay += profile.spike_ms;
+        }
+        arrivals.push_back({i * 60 + delay, uint32_t(i + 1)});
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+        [](const Arrival& a, const Arrival& b) { return a.time_ms < b.time_ms; });
+
+    JitterBuffer buffer;
+    std::vector<int> arrival_ms(packets + 1, -1);
+    std::deque<int> playback_queue;     // arrival time of the decoded packet, -1 for a concealed frame
+    std::vector<int> added_ms;
+    ReplayResult result;
+    size_t next_arrival = 0;
+    int output_end_ms = -1;
+    bool output_dry = false;
+    uint32_t played_packets = 0;
+    const int end_ms = arrivals.back().time_ms + 1000;
+
+    for (int now = 0; now < end_ms; now++) {
+        int64_t now_us = 1000000 + now * 1000LL;
+        while (next_arrival < arrivals.size() && arrivals[next_arrival].time_ms <= now) {
+            auto packet = MakePacket(arrivals[next_arrival].sequence, true);
+            arrival_ms[arrivals[next_arrival].sequence] = now;
+            buffer.Put(std::move(packet), now_us);
+            next_arrival++;
+        }
+
+        if (output_end_ms >= 0 && now >= output_end_ms) {
+            if (!playback_queue.empty()) {
+                if (playback_queue.front() >= 0) {
+                    added_ms.push_back(now - playback_queue.front());
+                }
+                playback_queue.pop_front();
+                output_end_ms = now + 60;
+                output_dry = false;
+            } else if (next_arrival < arrivals.size() || !buffer.empty()) {
+                // Silence in the middle of the stream
+                result.gap_ms++;
+                if (!output_dry) {
+                    result.output_gaps++;
+                    output_dry = true;
+                }
+            }
+        }
+
+        while (playback_queue.size() < MAX_PLAYBACK_FRAMES) {
+            auto frame = buffer.Pull(now_us, playback_queue.empty());
+            if (frame.action == kJitterBufferWait) {
+                break;
+            }
+            if (frame.action == kJitterBufferDecode) {
+                playback_queue.push_back(arrival_ms[frame.packet->sequence]);
+                played_packets++;
+            } else {
+                playback_queue.push_back(-1);
+            }
+            if (output_end_ms < 0) {
+                output_end_ms = now;
+            }
+        }
+    }
+
+    result.stats = buffer.GetStats();
+    double total = 0;
+    for (int ms : added_ms) {
+        total += ms;
+    }
+    result.mean_added_ms = added_ms.empty() ? 0 : total / added_ms.size();
+    std::sort(added_ms.begin(), added_ms.end());
+    result.p95_added_ms = added_ms.empty() ? 0 : added_ms[added_ms.size() * 95 / 100];
+    return result;
+}
+
+TEST(JitterBufferReplay, LossAndJitterProfiles) {
+    // Bounds per profile on the output gaps and the p95 added latency, a little above the figures of this seed.
+    // A loss burst that empties the buffer is played as a gap: the buffer cannot tell it from the end of the stream
+    struct Case {
+        LinkProfile profile;
+        int max_gaps;
+        int max_p95_added_ms;
+    };
+    const Case cases[] = {
+        {{"clean", 0, 1, 5, 0, 0}, 0, 30},
+        {{"wifi", 20, 1, 30, 0, 0}, 8, 160},
+        {{"bursty loss", 30, 3, 30, 0, 0}, 90, 180},
+        {{"delay spikes", 5, 1, 20, 10, 200}, 4, 350},
+        {{"cellular", 30, 2, 100, 5, 300}, 4, 500},
+    };
+    for (auto& test : cases) {
+        auto result = ReplayLink(test.profile, 20240614);
+        auto& stats = result.stats;
+        printf("  %-12s lost %3lu (fec %3lu, plc %3lu), late %3lu, stretched %2lu, underruns %2lu, output gaps %2d (%5d ms), "
+            "added latency %3.0f ms mean, %3d ms p95, depth %lu\n",
+            test.profile.name, (unsigned long)stats.lost, (unsigned long)stats.fec_recovered,
+            (unsigned long)stats.concealed, (unsigned long)stats.late, (unsigned long)stats.stretched,
+            (unsigned long)stats.underruns, result.output_gaps, result.gap_ms, result.mean_added_ms,
+            result.p95_added_ms, (unsigned long)stats.target_depth);
+
+        EXPECT_LE(result.output_gaps, test.max_gaps) << test.profile.name;
+        EXPECT_LE(result.p95_added_ms, test.max_p95_added_ms) << test.profile.name;
+        // Single losses with the next packet in time are rebuilt from its FEC data
+        if (test.profile.max_burst == 1 && test.profile.loss_per_mille > 0) {
+            EXPECT_GT(stats.fec_recovered, stats.concealed) << test.profile.name;
+        }
+    }
+}
@@ -0,0 +1,49 @@
+// Host build: the packet inspection part of the libopus API, enough for the sources under test, and a
+// stand-in codec (opus_codec.cc) whose packets tell which samples they were encoded from
+#pragma once
+
+#include <cstdint>
+
+typedef int16_t opus_int16;
+typedef int32_t opus_int32;
+
+#define OPUS_OK 0
+#define OPUS_BAD_ARG -1
+#define OPUS_INVALID_PACKET -4
+#define OPUS_AUTO -1000
+#define OPUS_APPLICATION_VOIP 2048
+
+#define OPUS_SET_BITRATE(x) 4002, (opus_int32)(x)
+#define OPUS_SET_COMPLEXITY(x) 4010, (opus_int32)(x)
+#define OPUS_SET_DTX(x) 4016, (opus_int32)(x)
+#define OPUS_RESET_STATE 4028
+
+// C linkage as in libopus, the session test wraps the codec calls with the linker
+extern "C" {
+
+int opus_packet_get_samples_per_frame(const unsigned char* data, opus_int32 Fs);
+int opus_packet_get_nb_channels(const unsigned char* data);
+int opus_packet_get_nb_frames(const unsigned char packet[], opus_int32 len);
+int opus_packet_get_nb_samples(const unsigned char packet[], opus_int32 len, opus_int32 Fs);
+int opus_packet_parse(const unsigned char* data, opus_int32 len, unsigned char* out_toc,
+    const unsigned char* frames[48], opus_int16 size[48], int* payload_offset);
+
+typedef struct OpusEncoder OpusEncoder;
+
+OpusEncoder* opus_encoder_create(opus_int32 Fs, int channels, int application, int* error);
+void opus_encoder_destroy(OpusEncoder* st);
+// A SILK wideband TOC for the frame duration, then the first and the last sample of the frame
+opus_int32 opus_encode(OpusEncoder* st, const opus_int16* pcm, int frame_size, unsigned char* data,
+    opus_int32 max_data_bytes);
+int opus_encoder_ctl(OpusEncoder* st, int request, ...);
+
+typedef struct OpusDecoder OpusDecoder;
+
+OpusDecoder* opus_decoder_create(opus_int32 Fs, int channels, int* error);
+void opus_decoder_destroy(OpusDecoder* st);
+// A ramp from the first to the last sample of a stand-in packet, silence for a lost frame
+int opus_decode(OpusDecoder* st, const unsigned char* data, opus_int32 len, opus_int16* pcm, int frame_size,
+    int decode_fec);
+int opus_decoder_ctl(OpusDecoder* st, int request, ...);
+
+}
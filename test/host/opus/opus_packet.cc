@@ -0,0 +1,184 @@
+// Opus packet framing as specified by RFC 6716 section 3, written after libopus
+#include "opus.h"
+
+int opus_packet_get_samples_per_frame(const unsigned char* data, opus_int32 Fs) {
+    int config = data[0] >> 3;
+    if (config >= 16) {
+        // CELT: 2.5, 5, 10, 20 ms
+        return (Fs << (config & 3)) / 400;
+    }
+    if (config >= 12) {
+        // Hybrid: 10, 20 ms
+        return (config & 1) ? Fs / 50 : Fs / 100;
+    }
+    // SILK: 10, 20, 40, 60 ms
+    int size = config & 3;
+    return size == 3 ? Fs * 60 / 1000 : (Fs << size) / 100;
+}
+
+int opus_packet_get_nb_channels(const unsigned char* data) {
+    return (data[0] & 0x4) ? 2 : 1;
+}
+
+int opus_packet_get_nb_frames(const unsigned char packet[], opus_int32 len) {
+    if (len < 1) {
+        return OPUS_BAD_ARG;
+    }
+    int code = packet[0] & 0x3;
+    if (code == 0) {
+        return 1;
+    }
+    if (code != 3) {
+        return 2;
+    }
+    if (len < 2) {
+        return OPUS_INVALID_PACKET;
+    }
+    return packet[1] & 0x3F;
+}
+
+int opus_packet_get_nb_samples(const unsigned char packet[], opus_int32 len, opus_int32 Fs) {
+    int count = opus_packet_get_nb_frames(packet, len);
+    if (count < 0) {
+        return count;
+    }
+    int samples = count * opus_packet_get_samples_per_frame(packet, Fs);
+    // Packets longer than 120 ms are invalid
+    if (samples * 25 > Fs * 3) {
+        return OPUS_INVALID_PACKET;
+    }
+    return samples;
+}
+
+// Frame length coded in one or two bytes, returns the bytes used or -1
+static int ParseSize(const unsigned char* data, opus_int32 len, opus_int16* size) {
+    if (len < 1) {
+        *size = -1;
+        return -1;
+    }
+    if (data[0] < 252) {
+        *size = data[0];
+        return 1;
+    }
+    if (len < 2) {
+        *size = -1;
+        return -1;
+    }
+    *size = 4 * data[1] + data[0];
+    return 2;
+}
+
+int opus_packet_parse(const unsigned char* data, opus_int32 len, unsigned char* out_toc,
+    const unsigned char* frames[48], opus_int16 size[48], int* payload_offset) {
+    if (size == nullptr || len < 0) {
+        return OPUS_BAD_ARG;
+    }
+    if (len == 0) {
+        return OPUS_INVALID_PACKET;
+    }
+    const unsigned char* start = data;
+    int framesize = opus_packet_get_samples_per_frame(data, 48000);
+    unsigned char toc = *data++;
+    len--;
+    opus_int32 last_size = len;
+    int count;
+    bool cbr = false;
+    int pad = 0;
+
+    switch (toc & 0x3) {
+    case 0:
+        count = 1;
+        break;
+    case 1:
+        count = 2;
+        cbr = true;
+        if (len & 1) {
+            return OPUS_INVALID_PACKET;
+        }
+        last_size = len / 2;
+        size[0] = last_size;
+        break;
+    case 2: {
+        count = 2;
+        int bytes = ParseSize(data, len, size);
+        len -= bytes;
+        if (size[0] < 0 || size[0] > len) {
+            return OPUS_INVALID_PACKET;
+        }
+        data += bytes;
+        last_size = len - size[0];
+        break;
+    }
+    default: {
+        if (len < 1) {
+            return OPUS_INVALID_PACKET;
+        }
+        int ch = *data++;
+        count = ch & 0x3F;
+        if (count <= 0 || framesize * count > 5760) {
+            return OPUS_INVALID_PACKET;
+        }
+        len--;
+        if (ch & 0x40) {
+            int p;
+            do {
+                if (len <= 0) {
+                    return OPUS_INVALID_PACKET;
+                }
+                p = *data++;
+                len--;
+                int tmp = p == 255 ? 254 : p;
+                len -= tmp;
+                pad += tmp;
+            } while (p == 255);
+        }
+        if (len < 0) {
+            return OPUS_INVALID_PACKET;
+        }
+        cbr = !(ch & 0x80);
+        if (!cbr) {
+            last_size = len;
+            for (int i = 0; i < count - 1; i++) {
+                int bytes = ParseSize(data, len, size + i);
+                len -= bytes;
+                if (size[i] < 0 || size[i] > len) {
+                    return OPUS_INVALID_PACKET;
+                }
+                data += bytes;
+                last_size -= bytes + size[i];
+            }
+            if (last_size < 0) {
+                return OPUS_INVALID_PACKET;
+            }
+        } else {
+            last_size = len / count;
+            if (last_size * count != len) {
+                return OPUS_INVALID_PACKET;
+            }
+            for (int i = 0; i < count - 1; i++) {
+                size[i] = last_size;
+            }
+        }
+        break;
+    }
+    }
+
+    if (last_size > 1275) {
+        return OPUS_INVALID_PACKET;
+    }
+    size[count - 1] = last_size;
+    if (payload_offset != nullptr) {
+        *payload_offset = data - start;
+    }
+    for (int i = 0; i < count; i++) {
+        if (frames != nullptr) {
+            frames[i] = data;
+        }
+        data += size[i];
+    }
+    if (out_toc != nullptr) {
+        *out_toc = toc;
+    }
+    (void)pad;
+    return count;
+}
@@ -0,0 +1,31 @@
+// Host build: the OpusResampler interface of esp-opus-encoder, with a nearest sample resampler
+// behind it. Only good enough to test what InterleavedResampler does around it
+#pragma once
+
+#include <cstdint>
+
+class OpusResampler {
+public:
+    void Configure(int input_sample_rate, int output_sample_rate) {
+        input_sample_rate_ = input_sample_rate;
+        output_sample_rate_ = output_sample_rate;
+    }
+
+    int GetOutputSamples(int input_samples) const {
+        return (int64_t)input_samples * output_sample_rate_ / input_sample_rate_;
+    }
+
+    void Process(const int16_t* input, int input_samples, int16_t* output) {
+        int output_samples = GetOutputSamples(input_samples);
+        for (int i = 0; i < output_samples; i++) {
+            output[i] = input[(int64_t)i * input_sample_rate_ / output_sample_rate_];
+        }
+    }
+
+    int input_sample_rate() const { return input_sample_rate_; }
+    int output_sample_rate() const { return output_sample_rate_; }
+
+private:
+    int input_sample_rate_ = 16000;
+    int output_sample_rate_ = 16000;
+};
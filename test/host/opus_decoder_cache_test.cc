@@ -0,0 +1,143 @@
+#include "opus_decoder_cache.h"
+
+#include "host_test.h"
+
+#include <vector>
+
+#define OUTPUT_SAMPLE_RATE 24000
+
+// A stand-in packet of the frame duration, decoded as a ramp from first to last
+static std::vector<uint8_t> Packet(int frame_duration, int16_t first, int16_t last) {
+    // SILK wideband configs 4 to 7 are 10, 20, 40 and 60 ms
+    int config = frame_duration == 10 ? 4 : frame_duration == 20 ? 5 : frame_duration == 40 ? 6 : 7;
+    return {(uint8_t)(config << 3), (uint8_t)(first & 0xFF), (uint8_t)(first >> 8),
+        (uint8_t)(last & 0xFF), (uint8_t)(last >> 8)};
+}
+
+// Decodes a frame of a constant level with the current decoder and resamples it
+static std::vector<int16_t> Play(OpusDecoderCache& cache, int16_t level) {
+    std::vector<int16_t> pcm;
+    std::vector<int16_t> buffer;
+    auto packet = Packet(cache.decoder()->duration_ms(), level, level);
+    if (!cache.decoder()->Decode(packet.data(), packet.size(), pcm)) {
+        return {};
+    }
+    cache.Resample(pcm, buffer);
+    return pcm;
+}
+
+class OpusDecoderCacheTest : public HostTest {
+protected:
+    OpusDecoderCache cache_{3};
+
+    void SetUp() override {
+        cache_.SetOutputSampleRate(OUTPUT_SAMPLE_RATE);
+    }
+
+    // True when the format was still cached
+    bool Reused(int sample_rate, int frame_duration) {
+        uint32_t created = cache_.stats().created;
+        auto decoder = cache_.Select(sample_rate, frame_duration);
+        EXPECT_EQ(decoder->sample_rate(), sample_rate);
+        EXPECT_EQ(decoder->duration_ms(), frame_duration);
+        return cache_.stats().created == created;
+    }
+};
+
+TEST_F(OpusDecoderCacheTest, ReusesTheDecoderOfAFormat) {
+    EXPECT_TRUE(cache_.decoder() == nullptr);
+    auto speech = cache_.Select(24000, 60);
+    auto sound = cache_.Select(16000, 60);
+    EXPECT_NE(speech, sound);
+    EXPECT_EQ(cache_.Select(24000, 60), speech);
+    EXPECT_EQ(cache_.Select(16000, 60), sound);
+    // The same rate at another frame duration is another decoder
+    auto short_frames = cache_.Select(16000, 20);
+    EXPECT_NE(short_frames, sound);
+    EXPECT_EQ(cache_.decoder(), short_frames);
+
+    EXPECT_EQ(cache_.stats().created, 3u);
+    EXPECT_EQ(cache_.stats().switches, 4u);
+    EXPECT_EQ(cache_.stats().evicted, 0u);
+
+    // Selecting the current format again is not a switch
+    cache_.Select(16000, 20);
+    EXPECT_EQ(cache_.stats().switches, 4u);
+}
+
+TEST_F(OpusDecoderCacheTest, EvictsTheLeastRecentlyUsed) {
+    EXPECT_FALSE(Reused(24000, 60));
+    EXPECT_FALSE(Reused(16000, 60));
+    EXPECT_FALSE(Reused(16000, 20));
+    // Using the oldest one again makes 16 kHz 60 ms the least recently used
+    EXPECT_TRUE(Reused(24000, 60));
+    EXPECT_FALSE(Reused(48000, 60));
+    EXPECT_EQ(cache_.stats().evicted, 1u);
+    EXPECT_TRUE(Reused(24000, 60));
+    EXPECT_TRUE(Reused(16000, 20));
+    EXPECT_TRUE(Reused(48000, 60));
+    EXPECT_FALSE(Reused(16000, 60)) << "evicted";
+    // Which pushed out 24 kHz, now the least recently used
+    EXPECT_EQ(cache_.stats().evicted, 2u);
+    EXPECT_TRUE(Reused(16000, 20));
+    EXPECT_FALSE(Reused(24000, 60));
+    EXPECT_EQ(cache_.stats().created, 6u);
+}
+
+TEST_F(OpusDecoderCacheTest, SingleEntry) {
+    OpusDecoderCache cache(0);
+    cache.SetOutputSampleRate(OUTPUT_SAMPLE_RATE);
+    cache.Select(24000, 60);
+    cache.Select(16000, 60);
+    cache.Select(24000, 60);
+    EXPECT_EQ(cache.stats().created, 3u);
+    EXPECT_EQ(cache.stats().evicted, 2u);
+}
+
+TEST_F(OpusDecoderCacheTest, ResamplesToTheOutputRate) {
+    cache_.Select(16000, 60);
+    EXPECT_EQ(Play(cache_, 1000).size(), 1440u);
+    cache_.Select(OUTPUT_SAMPLE_RATE, 60);
+    EXPECT_EQ(Play(cache_, 1000).size(), 1440u) << "no resampling at the output rate";
+    cache_.Select(16000, 20);
+    EXPECT_EQ(Play(cache_, 1000).size(), 480u);
+
+    // A new output rate reconfigures the cached resamplers, the 24 kHz one included
+    cache_.SetOutputSampleRate(48000);
+    EXPECT_EQ(Play(cache_, 1000).size(), 960u);
+    EXPECT_TRUE(Reused(OUTPUT_SAMPLE_RATE, 60));
+    EXPECT_EQ(Play(cache_, 1000).size(), 2880u);
+}
+
+TEST_F(OpusDecoderCacheTest, SwitchingBackKeepsTheResamplerState) {
+    OpusDecoderCache fresh(1);
+    fresh.SetOutputSampleRate(OUTPUT_SAMPLE_RATE);
+    fresh.Select(16000, 60);
+    auto from_silence = Play(fresh, 10000);
+
+    cache_.Select(16000, 60);
+    Play(cache_, 10000);
+    cache_.Select(OUTPUT_SAMPLE_RATE, 60);
+    Play(cache_, -10000);
+    EXPECT_TRUE(Reused(16000, 60));
+    // Goes on from the previous 16 kHz frame, not from silence
+    auto resumed = Play(cache_, 10000);
+    ASSERT_EQ(resumed.size(), from_silence.size());
+    EXPECT_NE(resumed.front(), from_silence.front());
+    EXPECT_NEAR(resumed.front(), 10000, 2);
+}
+
+TEST_F(OpusDecoderCacheTest, ResetStateResetsTheResamplers) {
+    OpusDecoderCache fresh(1);
+    fresh.SetOutputSampleRate(OUTPUT_SAMPLE_RATE);
+    fresh.Select(16000, 60);
+    auto from_silence = Play(fresh, 10000);
+
+    cache_.Select(16000, 60);
+    Play(cache_, -10000);
+    cache_.Select(OUTPUT_SAMPLE_RATE, 60);
+    cache_.ResetState();
+    // The next stream starts from silence, the end of the previous one is not filtered into it
+    EXPECT_TRUE(Reused(16000, 60));
+    EXPECT_TRUE(Play(cache_, 10000) == from_silence);
+}
@@ -0,0 +1,162 @@
+#include "pcm_kernels.h"
+
+#include "host_test.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// The per-codec loops the kernels replaced, kept as the reference for bit exactness
+
+static void ReferenceNoAudioCodecWrite(const int16_t* data, int32_t* buffer, int samples, int volume) {
+    int32_t volume_factor = pow(double(volume) / 100.0, 2) * 65536;
+    for (int i = 0; i < samples; i++) {
+        int64_t temp = int64_t(data[i]) * volume_factor;
+        if (temp > INT32_MAX) {
+            buffer[i] = INT32_MAX;
+        } else if (temp < INT32_MIN) {
+            buffer[i] = INT32_MIN;
+        } else {
+            buffer[i] = static_cast<int32_t>(temp);
+        }
+    }
+}
+
+static void ReferenceNoAudioCodecRead(const int32_t* bit32_buffer, int16_t* dest, int samples) {
+    for (int i = 0; i < samples; i++) {
+        int32_t value = bit32_buffer[i] >> 12;
+        dest[i] = (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+    }
+}
+
+static void ReferenceLilygoWrite(const int16_t* data, int16_t* output_data, size_t samples, int volume) {
+    for (size_t i = 0; i < samples; i++) {
+        output_data[i] = (float)data[i] * (float)(volume / 100.0);
+    }
+}
+
+static void ReferenceCameraPlusGain(int16_t* ptr, int samples) {
+    for (int i = 0; i < samples; i++) {
+        int32_t amplified = *ptr * 20;
+        *ptr++ = (amplified > 32767) ? 32767 : (amplified < -32768) ? -32768 : amplified;
+    }
+}
+
+static std::vector<int16_t> AllInt16() {
+    std::vector<int16_t> samples;
+    for (int value = INT16_MIN; value <= INT16_MAX; value++) {
+        samples.push_back(value);
+    }
+    return samples;
+}
+
+TEST(PcmKernels, VolumeCurveMatchesPow) {
+    for (int volume = 0; volume <= 100; volume++) {
+        int32_t expected = pow(double(volume) / 100.0, 2) * 65536;
+        ASSERT_EQ(PcmVolumeCurveQ16(volume), expected) << "volume " << volume;
+    }
+    EXPECT_EQ(PcmVolumeCurveQ16(-5), 0);
+    EXPECT_EQ(PcmVolumeCurveQ16(120), 65536);
+}
+
+TEST(PcmKernels, Int16ToInt32MatchesNoAudioCodecWrite) {
+    auto src = AllInt16();
+    std::vector<int32_t> expected(src.size());
+    std::vector<int32_t> actual(src.size());
+    std::vector<int32_t> stereo(src.size() * 2);
+    for (int volume = 0; volume <= 100; volume++) {
+        ReferenceNoAudioCodecWrite(src.data(), expected.data(), src.size(), volume);
+        PcmInt16ToInt32(src.data(), actual.data(), src.size(), PcmVolumeCurveQ16(volume));
+        ASSERT_TRUE(actual == expected) << "volume " << volume;
+
+        // The K10 codec wrote the same values to both slots
+        PcmInt16ToInt32Stereo(src.data(), stereo.data(), src.size(), PcmVolumeCurveQ16(volume));
+        for (size_t i = 0; i < src.size(); i++) {
+            ASSERT_EQ(stereo[i * 2], expected[i]);
+            ASSERT_EQ(stereo[i * 2 + 1], expected[i]);
+        }
+    }
+}
+
+TEST(PcmKernels, Int16ToInt32InPlace) {
+    std::vector<int32_t> buffer(64);
+    auto samples = reinterpret_cast<int16_t*>(buffer.data());
+    for (int i = 0; i < 64; i++) {
+        samples[i] = i * 1000 - 32000;
+    }
+    PcmInt16ToInt32(samples, buffer.data(), 64, 65536);
+    for (int i = 0; i < 64; i++) {
+        ASSERT_EQ(buffer[i], (i * 1000 - 32000) * 65536);
+    }
+}
+
+TEST(PcmKernels, Int32ToInt16MatchesNoAudioCodecReadButSaturatesToMinimum) {
+    std::vector<int32_t> src;
+    for (int64_t value = INT32_MIN; value <= INT32_MAX; value += 4093) {
+        src.push_back(value);
+    }
+    src.push_back(INT32_MAX);
+    std::vector<int16_t> expected(src.size());
+    std::vector<int16_t> actual(src.size());
+    ReferenceNoAudioCodecRead(src.data(), expected.data(), src.size());
+    PcmInt32ToInt16(src.data(), actual.data(), src.size(), 12);
+    int differences = 0;
+    for (size_t i = 0; i < src.size(); i++) {
+        if (actual[i] != expected[i]) {
+            // The old clamp stopped at -32767, the kernel uses the full int16 range
+            ASSERT_EQ(expected[i], -32767);
+            ASSERT_EQ(actual[i], -32768);
+            ASSERT_LT(src[i] >> 12, -32767);
+            differences++;
+        }
+    }
+    EXPECT_GT(differences, 0);
+}
+
+TEST(PcmKernels, ScaleMatchesCameraPlusGain) {
+    auto expected = AllInt16();
+    auto actual = expected;
+    ReferenceCameraPlusGain(expected.data(), expected.size());
+    PcmScaleInt16(actual.data(), actual.data(), actual.size(), 20 << 16);
+    EXPECT_TRUE(actual == expected);
+}
+
+TEST(PcmKernels, ScaleIsWithinOneStepOfTheLilygoFloatLoop) {
+    auto src = AllInt16();
+    std::vector<int16_t> expected(src.size());
+    std::vector<int16_t> actual(src.size());
+    int differing_volumes = 0;
+    for (int volume = 0; volume <= 100; volume++) {
+        ReferenceLilygoWrite(src.data(), expected.data(), src.size(), volume);
+        PcmScaleInt16(src.data(), actual.data(), src.size(), PcmVolumeLinearQ16(volume));
+        int max_difference = 0;
+        for (size_t i = 0; i < src.size(); i++) {
+            max_difference = std::max(max_difference, std::abs(actual[i] - expected[i]));
+        }
+        // The float loop truncates towards zero, the kernel rounds down
+        ASSERT_LE(max_difference, 1) << "volume " << volume;
+        differing_volumes += max_difference > 0;
+    }
+    printf("PcmScaleInt16: 1 LSB away from the float loop at %d of 101 volumes\n", differing_volumes);
+}
+
+TEST(PcmKernels, ChannelKernelsMatchTheLoops) {
+    std::vector<int16_t> interleaved(960 * 2);
+    for (size_t i = 0; i < interleaved.size(); i++) {
+        interleaved[i] = int16_t(i * 7919);
+    }
+    auto expected = interleaved;
+    for (size_t i = 0, j = 0; j < expected.size(); ++i, j += 2) {
+        expected[i] = expected[j];
+    }
+    auto actual = interleaved;
+    PcmExtractChannel(actual.data(), actual.data(), 960, 2, 0);
+    EXPECT_TRUE(std::equal(actual.begin(), actual.begin() + 960, expected.begin()));
+
+    std::vector<int16_t> stereo(960 * 2);
+    PcmMonoToStereo(actual.data(), stereo.data(), 960);
+    for (size_t i = 0; i < 960; i++) {
+        ASSERT_EQ(stereo[i * 2], actual[i]);
+        ASSERT_EQ(stereo[i * 2 + 1], actual[i]);
+    }
+}
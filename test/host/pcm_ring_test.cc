@@ -0,0 +1,123 @@
+#include "pcm_ring.h"
+
+#include "host_test.h"
+
+#include <vector>
+
+// Samples numbered by their position, so a read shows where every sample came from
+static std::vector<int16_t> Ramp(uint64_t start, size_t count, int channels = 1) {
+    std::vector<int16_t> pcm(count * channels);
+    for (size_t i = 0; i < count; i++) {
+        for (int c = 0; c < channels; c++) {
+            // The other channels carry the reference and must never show up in the ring
+            pcm[i * channels + c] = c == 0 ? (int16_t)(start + i) : (int16_t)-1000 - c;
+        }
+    }
+    return pcm;
+}
+
+static bool IsRamp(const std::vector<int16_t>& pcm, uint64_t start) {
+    for (size_t i = 0; i < pcm.size(); i++) {
+        if (pcm[i] != (int16_t)(start + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(PcmRing, EmptyRing) {
+    PcmRing ring(100);
+    EXPECT_EQ(ring.capacity(), 100u);
+    EXPECT_EQ(ring.written(), 0u);
+    EXPECT_EQ(ring.oldest(), 0u);
+    int16_t sample;
+    EXPECT_TRUE(ring.Read(0, 0, &sample));
+    EXPECT_FALSE(ring.Read(0, 1, &sample)) << "not written yet";
+
+    PcmRing disabled(0);
+    auto pcm = Ramp(0, 10);
+    disabled.Write(pcm.data(), 10, 1);
+    EXPECT_EQ(disabled.written(), 0u);
+    EXPECT_FALSE(disabled.Read(0, 1, &sample));
+}
+
+TEST(PcmRing, WrapsAroundManyTimes) {
+    PcmRing ring(100);
+    uint64_t position = 0;
+    // Chunk sizes that are prime to the capacity, so the wrap lands everywhere
+    for (int round = 0; round < 200; round++) {
+        size_t chunk = 7 + (round * 13) % 61;
+        auto pcm = Ramp(position, chunk);
+        ring.Write(pcm.data(), chunk, 1);
+        position += chunk;
+        ASSERT_EQ(ring.written(), position);
+        ASSERT_EQ(ring.oldest(), position > 100 ? position - 100 : 0);
+
+        std::vector<int16_t> held(position - ring.oldest());
+        ASSERT_TRUE(ring.Read(ring.oldest(), held.size(), held.data()));
+        ASSERT_TRUE(IsRamp(held, ring.oldest())) << "round " << round;
+    }
+}
+
+TEST(PcmRing, ReadBounds) {
+    PcmRing ring(100);
+    auto pcm = Ramp(0, 250);
+    ring.Write(pcm.data(), 150, 1);
+    ring.Write(pcm.data() + 150, 100, 1);
+    EXPECT_EQ(ring.oldest(), 150u);
+
+    std::vector<int16_t> out(100);
+    EXPECT_TRUE(ring.Read(150, 100, out.data()));
+    EXPECT_TRUE(IsRamp(out, 150));
+    EXPECT_FALSE(ring.Read(149, 10, out.data())) << "overwritten";
+    EXPECT_FALSE(ring.Read(245, 10, out.data())) << "not written yet";
+    EXPECT_FALSE(ring.Read(150, 101, out.data()));
+    out.assign(1, 0);
+    EXPECT_TRUE(ring.Read(249, 1, out.data()));
+    EXPECT_EQ(out[0], 249);
+}
+
+TEST(PcmRing, WriteLongerThanTheRingKeepsTheNewest) {
+    PcmRing ring(100);
+    auto pcm = Ramp(0, 30);
+    ring.Write(pcm.data(), 30, 1);
+    pcm = Ramp(30, 270);
+    ring.Write(pcm.data(), 270, 1);
+    EXPECT_EQ(ring.written(), 300u);
+    EXPECT_EQ(ring.oldest(), 200u);
+    std::vector<int16_t> out(100);
+    EXPECT_TRUE(ring.Read(200, 100, out.data()));
+    EXPECT_TRUE(IsRamp(out, 200));
+}
+
+TEST(PcmRing, KeepsTheFirstChannel) {
+    for (int channels : {2, 3, 4}) {
+        PcmRing ring(100);
+        uint64_t position = 0;
+        for (size_t chunk : {40, 75, 33, 160}) {
+            auto pcm = Ramp(position, chunk, channels);
+            ring.Write(pcm.data(), chunk, channels);
+            position += chunk;
+        }
+        EXPECT_EQ(ring.written(), position);
+        std::vector<int16_t> out(100);
+        ASSERT_TRUE(ring.Read(ring.oldest(), out.size(), out.data()));
+        EXPECT_TRUE(IsRamp(out, ring.oldest())) << channels << " channels";
+    }
+}
+
+TEST(PcmRing, ResetStartsOver) {
+    PcmRing ring(100);
+    auto pcm = Ramp(0, 80);
+    ring.Write(pcm.data(), 80, 1);
+    ring.Reset();
+    EXPECT_EQ(ring.written(), 0u);
+    EXPECT_EQ(ring.oldest(), 0u);
+    int16_t sample;
+    EXPECT_FALSE(ring.Read(0, 1, &sample)) << "the old samples are gone";
+    pcm = Ramp(0, 10);
+    ring.Write(pcm.data(), 10, 1);
+    std::vector<int16_t> out(10);
+    EXPECT_TRUE(ring.Read(0, 10, out.data()));
+    EXPECT_TRUE(IsRamp(out, 0));
+}
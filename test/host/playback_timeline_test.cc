@@ -0,0 +1,127 @@
+#include "playback_timeline.h"
+
+#include "host_test.h"
+#include "lcg.h"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#define SAMPLE_RATE 24000
+#define FRAME_MS 60
+#define FRAME_SAMPLES (SAMPLE_RATE * FRAME_MS / 1000)
+
+TEST(PlaybackTimeline, NothingPlayingIsZero) {
+    PlaybackTimeline timeline;
+    timeline.SetSampleRate(SAMPLE_RATE);
+    EXPECT_EQ(timeline.GetTimestamp(1000000), 0u);
+
+    timeline.Record(5000, FRAME_SAMPLES, 1000000);
+    EXPECT_EQ(timeline.GetTimestamp(999000 - FRAME_MS * 1000), 0u) << "before the first write";
+    EXPECT_EQ(timeline.GetTimestamp(1001000), 0u) << "after the last written sample";
+    timeline.Reset();
+    EXPECT_EQ(timeline.GetTimestamp(990000), 0u);
+}
+
+TEST(PlaybackTimeline, MapsTimeToTheServerTimestamp) {
+    PlaybackTimeline timeline;
+    timeline.SetSampleRate(SAMPLE_RATE);
+    // Each write returns once the frame after it fits, one frame ahead of what is playing
+    int64_t time_us = 1000000;
+    for (int i = 0; i < 5; i++) {
+        timeline.Record(5000 + i * FRAME_MS, FRAME_SAMPLES, time_us);
+        time_us += FRAME_MS * 1000;
+    }
+    // The first write returned at 1 s with 60 ms written, so 1.1 s is 160 ms into the stream
+    EXPECT_EQ(timeline.GetTimestamp(1100000), 5160u);
+    EXPECT_EQ(timeline.GetTimestamp(1125000), 5185u);
+
+    // Local audio plays without a server timestamp
+    timeline.Record(0, FRAME_SAMPLES, time_us);
+    timeline.Record(0, FRAME_SAMPLES, time_us + FRAME_MS * 1000);
+    EXPECT_EQ(timeline.GetTimestamp(time_us + 10000), 0u);
+    EXPECT_EQ(timeline.GetTimestamp(time_us - 100000), 5260u);
+}
+
+struct AlignmentResult {
+    double mean_error_ms = 0;
+    int max_error_ms = 0;
+    int settled_max_error_ms = 0;   // once the output has played for a second
+    int queries = 0;
+};
+
+// Plays 180 s of 60 ms frames in bursts, with write jitter and the I2S clock off by drift_ppm,
+// and compares GetTimestamp() with the sample that was really being written
+static AlignmentResult SimulateAlignment(double drift_ppm, uint32_t seed) {
+    Lcg random(seed);
+    PlaybackTimeline timeline;
+    timeline.SetSampleRate(SAMPLE_RATE);
+    const double us_per_sample = 1000000.0 / SAMPLE_RATE * (1 + drift_ppm / 1000000.0);
+
+    AlignmentResult result;
+    double total_error = 0;
+    int64_t now_us = 1000000;
+    uint32_t timestamp = 1;
+    uint64_t written = 0;
+    while (now_us < 181000000) {
+        // A burst of speech, 2-20 s, then a pause that lets the output run dry
+        int frames = random.Uniform(2000, 20000) / FRAME_MS;
+        int64_t start_us = now_us;
+        uint64_t start_sample = written + FRAME_SAMPLES;
+        struct Frame {
+            uint32_t timestamp;
+            uint64_t start;
+        };
+        std::vector<Frame> played;
+        for (int i = 0; i < frames; i++) {
+            played.push_back({timestamp, written});
+            written += FRAME_SAMPLES;
+            // The write returns when the end of the frame fits, late by scheduling only
+            int64_t ideal_us = start_us + (int64_t)((written - start_sample) * us_per_sample);
+            int delay_us = random.Uniform(0, 8000);
+            if (random.Uniform(0, 99) == 0) {
+                delay_us = 30000;
+            }
+            timeline.Record(timestamp, FRAME_SAMPLES, ideal_us + delay_us);
+            timestamp += FRAME_MS;
+
+            // Query the frame that was just written over, as the uplink does a frame later
+            if (i < 2) {
+                continue;
+            }
+            for (int q = 0; q < FRAME_MS; q += 7) {
+                int64_t query_us = ideal_us - FRAME_MS * 1000 + q * 1000;
+                double position = start_sample + (query_us - start_us) / us_per_sample;
+                uint64_t sample = (uint64_t)position;
+                size_t index = 0;
+                while (index + 1 < played.size() && played[index + 1].start <= sample) {
+                    index++;
+                }
+                uint32_t expected = played[index].timestamp + (uint32_t)((sample - played[index].start) * 1000 / SAMPLE_RATE);
+                uint32_t actual = timeline.GetTimestamp(query_us);
+                int error = std::abs((int)(actual - expected));
+                total_error += error;
+                result.max_error_ms = std::max(result.max_error_ms, error);
+                if (i * FRAME_MS >= 1000) {
+                    result.settled_max_error_ms = std::max(result.settled_max_error_ms, error);
+                }
+                result.queries++;
+            }
+        }
+        now_us = start_us + (int64_t)(frames * FRAME_SAMPLES * us_per_sample) + random.Uniform(500, 3000) * 1000;
+    }
+    result.mean_error_ms = total_error / result.queries;
+    return result;
+}
+
+TEST(PlaybackTimeline, AlignmentUnderJitterAndDrift) {
+    for (double drift_ppm : {0.0, 100.0, -300.0, 500.0}) {
+        auto result = SimulateAlignment(drift_ppm, 20240613);
+        printf("PlaybackTimeline: drift %+4.0f ppm, %d queries, mean error %.2f ms, max %d ms, %d ms after the first second\n",
+            drift_ppm, result.queries, result.mean_error_ms, result.max_error_ms, result.settled_max_error_ms);
+        EXPECT_LT(result.mean_error_ms, 1.0) << "drift " << drift_ppm;
+        // The line starts from the first write, late by its scheduling delay, until earlier writes pull it down
+        EXPECT_LE(result.max_error_ms, 8) << "drift " << drift_ppm;
+        EXPECT_LE(result.settled_max_error_ms, 2) << "drift " << drift_ppm;
+    }
+}
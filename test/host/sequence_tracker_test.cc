@@ -0,0 +1,124 @@
+#include "sequence_tracker.h"
+
+#include "host_test.h"
+
+#include <initializer_list>
+
+class SequenceTrackerTest : public HostTest {
+protected:
+    SequenceTracker tracker_;
+
+    AudioLinkStats Stats() {
+        AudioLinkStats stats;
+        EXPECT_TRUE(tracker_.GetStats(stats));
+        return stats;
+    }
+
+    void AddAll(uint32_t first, std::initializer_list<int> offsets) {
+        for (int offset : offsets) {
+            tracker_.Add(first + offset);
+        }
+    }
+};
+
+TEST_F(SequenceTrackerTest, NoStatsBeforeTheFirstPacket) {
+    AudioLinkStats stats;
+    EXPECT_FALSE(tracker_.GetStats(stats));
+    tracker_.Add(7);
+    EXPECT_TRUE(tracker_.GetStats(stats));
+    tracker_.Reset();
+    EXPECT_FALSE(tracker_.GetStats(stats));
+}
+
+TEST_F(SequenceTrackerTest, LossIsTakenBackByReorderedPackets) {
+    EXPECT_EQ(tracker_.Add(1), kSequenceInOrder);
+    EXPECT_EQ(tracker_.Add(2), kSequenceInOrder);
+    EXPECT_EQ(tracker_.Add(5), kSequenceGap);
+    auto stats = Stats();
+    EXPECT_EQ(stats.received, 3u);
+    EXPECT_EQ(stats.lost, 2u);
+
+    EXPECT_EQ(tracker_.Add(4), kSequenceReordered);
+    stats = Stats();
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_EQ(tracker_.Add(6), kSequenceInOrder);
+    EXPECT_EQ(Stats().lost, 1u);
+}
+
+TEST_F(SequenceTrackerTest, DuplicatesAreCountedOnce) {
+    AddAll(100, {0, 1, 2});
+    EXPECT_EQ(tracker_.Add(102), kSequenceDuplicate);
+    EXPECT_EQ(tracker_.Add(100), kSequenceDuplicate);
+    auto stats = Stats();
+    EXPECT_EQ(stats.received, 3u);
+    EXPECT_EQ(stats.duplicate, 2u);
+    EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST_F(SequenceTrackerTest, OlderThanTheWindowOrTheSessionIsLate) {
+    tracker_.Add(1000);
+    tracker_.Add(1000 + SEQUENCE_TRACKER_WINDOW);
+    EXPECT_EQ(tracker_.Add(1000), kSequenceLate) << "out of the window even though it did arrive";
+    EXPECT_EQ(tracker_.Add(1001), kSequenceReordered) << "the oldest one still in the window";
+
+    tracker_.Reset();
+    tracker_.Add(50);
+    EXPECT_EQ(tracker_.Add(49), kSequenceLate) << "before the session started";
+    auto stats = Stats();
+    EXPECT_EQ(stats.late, 1u);
+    EXPECT_EQ(stats.lost, 0u);
+}
+
+TEST_F(SequenceTrackerTest, WrapsAroundThe32BitCounter) {
+    const uint32_t first = 0xFFFFFFFD;
+    EXPECT_EQ(tracker_.Add(first), kSequenceInOrder);
+    EXPECT_EQ(tracker_.Add(first + 1), kSequenceInOrder);
+    EXPECT_EQ(tracker_.Add(first + 3), kSequenceGap) << "0xFFFFFFFF is missing";
+    EXPECT_EQ(tracker_.Add(first + 4), kSequenceInOrder) << "1 follows 0";
+    EXPECT_EQ(tracker_.Add(first + 2), kSequenceReordered);
+    EXPECT_EQ(tracker_.Add(first + 3), kSequenceDuplicate);
+    EXPECT_EQ(tracker_.Add(first + 6), kSequenceGap);
+    EXPECT_EQ(tracker_.Add(first - 1), kSequenceLate);
+
+    auto stats = Stats();
+    EXPECT_EQ(stats.received, 6u);
+    EXPECT_EQ(stats.lost, 1u);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_EQ(stats.duplicate, 1u);
+    EXPECT_EQ(stats.late, 1u);
+}
+
+TEST_F(SequenceTrackerTest, LongRunWithMixedImpairments) {
+    // Every 10th packet dropped, every 7th swapped with its successor, every 13th sent twice
+    const uint32_t first = 0xFFFFFF00;
+    const int count = 1000;
+    uint32_t order[count];
+    for (int i = 0; i < count; i++) {
+        order[i] = first + i;
+    }
+    for (int i = 0; i + 1 < count; i += 7) {
+        std::swap(order[i], order[i + 1]);
+    }
+    int dropped = 0;
+    int duplicated = 0;
+    for (int i = 0; i < count; i++) {
+        if (order[i] % 10 == 0 && i > 0) {
+            dropped++;
+            continue;
+        }
+        tracker_.Add(order[i]);
+        if (i % 13 == 0) {
+            tracker_.Add(order[i]);
+            duplicated++;
+        }
+    }
+
+    auto stats = Stats();
+    EXPECT_EQ(stats.received, uint32_t(count - dropped));
+    EXPECT_EQ(stats.duplicate, uint32_t(duplicated));
+    EXPECT_EQ(stats.late, 0u);
+    // The last packet may be a dropped one that lies past the highest sequence
+    EXPECT_LE(stats.lost, uint32_t(dropped));
+    EXPECT_GE(stats.lost + 1, uint32_t(dropped));
+}
@@ -0,0 +1,250 @@
+#include "sound_bank.h"
+
+#include "host_test.h"
+
+#include <opus.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Set by CMakeLists.txt, the sounds are the ones linked into the firmware
+#ifndef ASSETS_DIR
+#error "ASSETS_DIR must point at main/assets"
+#endif
+
+#define OUTPUT_SAMPLE_RATE 24000
+
+static std::string ReadAsset(const char* path) {
+    std::ifstream file(std::string(ASSETS_DIR) + "/" + path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// Granule position of the last Ogg page, the stream length in 48 kHz samples including the pre-skip
+static uint64_t LastGranulePosition(const std::string& ogg) {
+    size_t pos = ogg.rfind("OggS");
+    uint64_t granule = 0;
+    for (int i = 7; i >= 0; i--) {
+        granule = (granule << 8) | (uint8_t)ogg[pos + 6 + i];
+    }
+    return granule;
+}
+
+// What the decoder task would produce for a packet, a ramp so that every frame is distinct
+static std::vector<int16_t> FakeDecode(const Sound& sound, size_t index) {
+    std::vector<int16_t> pcm(sound.packets[index].frame_duration * OUTPUT_SAMPLE_RATE / 1000);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        pcm[i] = (int16_t)(index * 1000 + i);
+    }
+    return pcm;
+}
+
+static const uint8_t* PacketData(const Sound& sound, size_t index) {
+    return sound.data + sound.packets[index].offset;
+}
+
+static void StoreAll(SoundBank& bank, const Sound& sound) {
+    for (size_t i = 0; i < sound.packets.size(); i++) {
+        bank.StorePcm(PacketData(sound, i), FakeDecode(sound, i), OUTPUT_SAMPLE_RATE);
+    }
+}
+
+class SoundBankTest : public HostTest {
+protected:
+    std::string popup_ = ReadAsset("common/popup.ogg");
+    std::string digit_ = ReadAsset("locales/zh-CN/0.ogg");
+    std::string activation_ = ReadAsset("locales/zh-CN/activation.ogg");
+
+    void SetUp() override {
+        ASSERT_FALSE(popup_.empty()) << "assets not found in " << ASSETS_DIR;
+        ASSERT_FALSE(digit_.empty());
+        ASSERT_FALSE(activation_.empty());
+    }
+};
+
+TEST_F(SoundBankTest, IndexesTheOpusPackets) {
+    SoundBank bank(0);
+    for (const std::string* ogg : {&popup_, &digit_, &activation_}) {
+        const Sound* sound = bank.Get(*ogg);
+        ASSERT_TRUE(sound != nullptr);
+        EXPECT_EQ(sound->sample_rate, 16000);
+        ASSERT_GT(sound->packets.size(), 0u);
+
+        int duration_ms = 0;
+        uint32_t previous_end = 0;
+        for (auto& packet : sound->packets) {
+            // Views into the embedded data, in stream order and without overlap
+            EXPECT_GE(packet.offset, previous_end);
+            EXPECT_LE(packet.offset + packet.size, sound->size);
+            previous_end = packet.offset + packet.size;
+            int samples = opus_packet_get_nb_samples(sound->data + packet.offset, packet.size, 48000);
+            EXPECT_GT(samples, 0) << "packet at " << packet.offset;
+            EXPECT_EQ(packet.frame_duration, samples / 48);
+            duration_ms += packet.frame_duration;
+        }
+        EXPECT_EQ(sound->duration_ms, duration_ms);
+        // The last packet may be padded past the end of the stream
+        int stream_ms = LastGranulePosition(*ogg) / 48;
+        EXPECT_GE(sound->duration_ms, stream_ms - 80);
+        EXPECT_LE(sound->duration_ms, stream_ms + sound->packets.back().frame_duration);
+    }
+}
+
+TEST_F(SoundBankTest, ParsesEachSoundOnce) {
+    SoundBank bank(0);
+    const Sound* first = bank.Get(activation_);
+    ASSERT_TRUE(first != nullptr);
+    EXPECT_EQ(bank.Get(activation_), first);
+    // Same bytes at another address are a different sound, the index is keyed by the embedded data
+    std::string copy = activation_;
+    const Sound* other = bank.Get(copy);
+    ASSERT_TRUE(other != nullptr);
+    EXPECT_NE(other, first);
+    EXPECT_EQ(other->packets.size(), first->packets.size());
+    // A prefix of the same data is not the same sound either
+    EXPECT_NE(bank.Get(std::string_view(activation_.data(), activation_.size() / 2)), first);
+}
+
+TEST_F(SoundBankTest, RejectsInvalidData) {
+    SoundBank bank(0);
+    std::string garbage(4096, 'x');
+    EXPECT_TRUE(bank.Get(garbage) == nullptr);
+    EXPECT_TRUE(bank.Get(std::string_view()) == nullptr);
+    // Headers only, no audio packet
+    std::string headers = popup_.substr(0, popup_.find("OggS", popup_.find("OpusTags")));
+    EXPECT_TRUE(bank.Get(headers) == nullptr);
+    // A failed parse is not cached, the next call tries again
+    EXPECT_TRUE(bank.Get(garbage) == nullptr);
+}
+
+TEST_F(SoundBankTest, LookupCostAgainstParsing) {
+    // ShowActivationCode plays a digit after another, before the bank every call re-parsed the Ogg file
+    std::vector<std::string> digits;
+    for (int i = 0; i < 10; i++) {
+        digits.push_back(ReadAsset(("locales/zh-CN/" + std::to_string(i) + ".ogg").c_str()));
+    }
+    SoundBank bank(0);
+    const int rounds = 2000;
+    size_t packets = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        SoundBank fresh(0);
+        for (auto& digit : digits) {
+            packets += fresh.Get(digit)->packets.size();
+        }
+    }
+    double parse_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    for (auto& digit : digits) {
+        bank.Get(digit);
+    }
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) {
+        for (auto& digit : digits) {
+            packets += bank.Get(digit)->packets.size();
+        }
+    }
+    double lookup_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    size_t bytes = 0;
+    for (auto& digit : digits) {
+        bytes += digit.size();
+    }
+    printf("  10 digits, %u bytes: parse %.2f us, indexed lookup %.2f us per digit\n", (unsigned)bytes,
+        parse_us / rounds / 10, lookup_us / rounds / 10);
+    EXPECT_GT(packets, 0u);
+    EXPECT_LT(lookup_us, parse_us);
+}
+
+TEST_F(SoundBankTest, CachesPcmPlayedInOrder) {
+    SoundBank bank(256 * 1024);
+    const Sound* sound = bank.Get(digit_);
+    ASSERT_TRUE(sound != nullptr);
+    ASSERT_LE(sound->duration_ms, SOUND_PCM_CACHE_MAX_DURATION_MS);
+
+    std::vector<int16_t> pcm;
+    EXPECT_FALSE(bank.LoadPcm(PacketData(*sound, 0), pcm)) << "nothing cached yet";
+    StoreAll(bank, *sound);
+    EXPECT_TRUE(sound->pcm_complete);
+
+    for (size_t i = 0; i < sound->packets.size(); i++) {
+        ASSERT_TRUE(bank.LoadPcm(PacketData(*sound, i), pcm));
+        EXPECT_TRUE(pcm == FakeDecode(*sound, i)) << "frame " << i;
+    }
+    // Only packet starts of known sounds are looked up
+    EXPECT_FALSE(bank.LoadPcm(PacketData(*sound, 0) + 1, pcm));
+    std::string other = digit_;
+    EXPECT_FALSE(bank.LoadPcm((const uint8_t*)other.data() + sound->packets[0].offset, pcm));
+}
+
+TEST_F(SoundBankTest, IncompletePlaybackIsNotUsed) {
+    SoundBank bank(256 * 1024);
+    const Sound* sound = bank.Get(popup_);
+    ASSERT_TRUE(sound != nullptr);
+    ASSERT_GT(sound->packets.size(), 2u);
+
+    // Cut short after the first frames
+    bank.StorePcm(PacketData(*sound, 0), FakeDecode(*sound, 0), OUTPUT_SAMPLE_RATE);
+    bank.StorePcm(PacketData(*sound, 1), FakeDecode(*sound, 1), OUTPUT_SAMPLE_RATE);
+    std::vector<int16_t> pcm;
+    EXPECT_FALSE(sound->pcm_complete);
+    EXPECT_FALSE(bank.LoadPcm(PacketData(*sound, 0), pcm));
+
+    // A frame out of order stops the caching for this playback
+    bank.StorePcm(PacketData(*sound, 0), FakeDecode(*sound, 0), OUTPUT_SAMPLE_RATE);
+    for (size_t i = 2; i < sound->packets.size(); i++) {
+        bank.StorePcm(PacketData(*sound, i), FakeDecode(*sound, i), OUTPUT_SAMPLE_RATE);
+    }
+    EXPECT_FALSE(sound->pcm_complete);
+
+    // The next full playback starts over at the first frame
+    StoreAll(bank, *sound);
+    EXPECT_TRUE(sound->pcm_complete);
+    ASSERT_TRUE(bank.LoadPcm(PacketData(*sound, 1), pcm));
+    EXPECT_TRUE(pcm == FakeDecode(*sound, 1));
+}
+
+TEST_F(SoundBankTest, RespectsTheCacheSize) {
+    SoundBank disabled(0);
+    const Sound* sound = disabled.Get(digit_);
+    StoreAll(disabled, *sound);
+    EXPECT_TRUE(sound->pcm == nullptr);
+    EXPECT_FALSE(sound->pcm_complete);
+
+    // Room for one digit but not for two
+    size_t bytes = (sound->duration_ms + 60) * OUTPUT_SAMPLE_RATE / 1000 * sizeof(int16_t);
+    SoundBank bank(bytes + bytes / 2);
+    std::string second_digit = ReadAsset("locales/zh-CN/1.ogg");
+    const Sound* first = bank.Get(digit_);
+    const Sound* second = bank.Get(second_digit);
+    StoreAll(bank, *first);
+    StoreAll(bank, *second);
+    EXPECT_TRUE(first->pcm_complete);
+    EXPECT_TRUE(second->pcm == nullptr);
+    EXPECT_FALSE(second->pcm_complete);
+
+    // Sounds longer than the limit are never cached
+    SoundBank large(4 * 1024 * 1024);
+    const Sound* activation = large.Get(activation_);
+    ASSERT_GT(activation->duration_ms, SOUND_PCM_CACHE_MAX_DURATION_MS);
+    StoreAll(large, *activation);
+    EXPECT_TRUE(activation->pcm == nullptr);
+}
+
+TEST_F(SoundBankTest, FrameLargerThanReservedDropsTheCache) {
+    SoundBank bank(256 * 1024);
+    const Sound* sound = bank.Get(digit_);
+    ASSERT_TRUE(sound != nullptr);
+    bank.StorePcm(PacketData(*sound, 0), FakeDecode(*sound, 0), OUTPUT_SAMPLE_RATE);
+    // The capacity was sized for the output rate of the first frame
+    std::vector<int16_t> oversized(sound->pcm_capacity, 1);
+    bank.StorePcm(PacketData(*sound, 1), oversized, OUTPUT_SAMPLE_RATE);
+    for (size_t i = 2; i < sound->packets.size(); i++) {
+        bank.StorePcm(PacketData(*sound, i), FakeDecode(*sound, i), OUTPUT_SAMPLE_RATE);
+    }
+    EXPECT_FALSE(sound->pcm_complete);
+}
@@ -0,0 +1,351 @@
+#include "spsc_queue.h"
+
+#include "host_test.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define READABLE_BIT (1 << 0)
+#define WRITABLE_BIT (1 << 1)
+
+class SpscQueueTest : public HostTest {
+protected:
+    EventGroupHandle_t event_group_ = xEventGroupCreate();
+
+    ~SpscQueueTest() override {
+        vEventGroupDelete(event_group_);
+    }
+
+    EventBits_t TakeBits() {
+        EventBits_t bits = xEventGroupGetBits(event_group_);
+        xEventGroupClearBits(event_group_, READABLE_BIT | WRITABLE_BIT);
+        return bits;
+    }
+};
+
+TEST_F(SpscQueueTest, KeepsOrderAcrossManyWraparounds) {
+    SpscQueue<int, 4> queue;
+    int next_push = 0;
+    int next_pop = 0;
+    // Push 3 and pop 2 at a time, so the slots wrap at a different position every round
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < 3 && !queue.full(); i++) {
+            ASSERT_TRUE(queue.Push(int(next_push)));
+            next_push++;
+        }
+        for (int i = 0; i < 2; i++) {
+            int item = -1;
+            if (!queue.Pop(item)) {
+                break;
+            }
+            ASSERT_EQ(item, next_pop);
+            next_pop++;
+        }
+        ASSERT_EQ(queue.size(), size_t(next_push - next_pop));
+    }
+    int item;
+    while (queue.Pop(item)) {
+        ASSERT_EQ(item, next_pop);
+        next_pop++;
+    }
+    EXPECT_EQ(next_pop, next_push);
+    EXPECT_GT(next_push, 1000);
+}
+
+TEST_F(SpscQueueTest, SignalsReadableAndWritable) {
+    SpscQueue<int, 4> queue;
+    queue.Bind(event_group_, READABLE_BIT, WRITABLE_BIT);
+
+    int item;
+    EXPECT_FALSE(queue.Pop(item));
+    EXPECT_EQ(TakeBits(), 0u) << "a failed pop frees no slot";
+
+    EXPECT_TRUE(queue.Push(1));
+    EXPECT_EQ(TakeBits(), EventBits_t(READABLE_BIT));
+
+    EXPECT_TRUE(queue.Pop(item));
+    EXPECT_EQ(TakeBits(), EventBits_t(WRITABLE_BIT));
+}
+
+TEST_F(SpscQueueTest, LimitIsTheBackpressureThreshold) {
+    SpscQueue<int, 8> queue;
+    queue.Bind(event_group_, READABLE_BIT, WRITABLE_BIT);
+    queue.SetLimit(3);
+    EXPECT_TRUE(queue.empty());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FALSE(queue.full());
+        EXPECT_TRUE(queue.Push(int(i)));
+    }
+    EXPECT_TRUE(queue.full());
+    TakeBits();
+    EXPECT_FALSE(queue.Push(3));
+    EXPECT_EQ(TakeBits(), 0u) << "a rejected push must not wake the consumer";
+    EXPECT_EQ(queue.high_water(), 3u);
+
+    int item;
+    EXPECT_TRUE(queue.Pop(item));
+    EXPECT_FALSE(queue.full());
+
+    // Raising the limit above the capacity stops at the capacity
+    queue.SetLimit(100);
+    EXPECT_EQ(queue.limit(), 8u);
+    while (queue.Push(0)) {
+    }
+    EXPECT_EQ(queue.size(), 8u);
+    EXPECT_EQ(queue.high_water(), 8u);
+    queue.ResetHighWater();
+    EXPECT_EQ(queue.high_water(), 0u);
+}
+
+TEST_F(SpscQueueTest, ClearDropsOnlyWhatWasQueuedBefore) {
+    SpscQueue<int, 8> queue;
+    queue.Bind(event_group_, READABLE_BIT, WRITABLE_BIT);
+    for (int i = 0; i < 5; i++) {
+        queue.Push(int(i));
+    }
+    TakeBits();
+    queue.Clear();
+    EXPECT_EQ(TakeBits(), EventBits_t(READABLE_BIT)) << "the consumer is woken to release the slots";
+    EXPECT_TRUE(queue.empty());
+    // The producer still sees the slots taken until the consumer discards them
+    queue.SetLimit(6);
+    EXPECT_TRUE(queue.Push(5));
+    EXPECT_TRUE(queue.full());
+    EXPECT_EQ(queue.size(), 1u);
+
+    int item = -1;
+    EXPECT_TRUE(queue.Pop(item));
+    EXPECT_EQ(item, 5);
+    EXPECT_FALSE(queue.Pop(item));
+    EXPECT_FALSE(queue.full());
+}
+
+TEST_F(SpscQueueTest, DiscardReleasesTheItems) {
+    auto tracked = std::make_shared<int>(0);
+    SpscQueue<std::shared_ptr<int>, 4> queue;
+    queue.Push(std::shared_ptr<int>(tracked));
+    queue.Push(std::shared_ptr<int>(tracked));
+    EXPECT_EQ(tracked.use_count(), 3);
+    queue.Clear();
+    queue.DiscardCleared();
+    EXPECT_EQ(tracked.use_count(), 1);
+
+    // Popped slots do not keep a reference either
+    queue.Push(std::shared_ptr<int>(tracked));
+    std::shared_ptr<int> item;
+    EXPECT_TRUE(queue.Pop(item));
+    item.reset();
+    EXPECT_EQ(tracked.use_count(), 1);
+}
+
+TEST_F(SpscQueueTest, ProducerAndConsumerThreads) {
+    SpscQueue<uint32_t, 16> queue;
+    queue.Bind(event_group_, READABLE_BIT, WRITABLE_BIT);
+    const uint32_t count = 200000;
+
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count; i++) {
+            while (!queue.Push(uint32_t(i))) {
+                xEventGroupWaitBits(event_group_, WRITABLE_BIT, pdTRUE, pdFALSE, 1);
+            }
+        }
+    });
+    uint32_t expected = 0;
+    while (expected < count) {
+        uint32_t item;
+        if (!queue.Pop(item)) {
+            xEventGroupWaitBits(event_group_, READABLE_BIT, pdTRUE, pdFALSE, 1);
+            continue;
+        }
+        ASSERT_EQ(item, expected);
+        expected++;
+    }
+    producer.join();
+    EXPECT_TRUE(queue.empty());
+}
+
+/*
+ * Encode hop benchmark: input task -> encode queue -> codec task -> send queue -> main loop, with the
+ * firmware limits of 2 and 40 frames. LockedPipeline is the design the rings replaced, two deques
+ * behind one mutex and a condition variable notified on every push and pop.
+ */
+#define BENCH_ENCODE_LIMIT 2
+#define BENCH_SEND_LIMIT 40
+
+struct BenchFrame {
+    uint32_t sequence = 0;
+    int64_t push_ns = 0;
+};
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class LockedPipeline {
+public:
+    void PushEncode(BenchFrame&& frame) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return encode_.size() < BENCH_ENCODE_LIMIT; });
+        encode_.push_back(std::move(frame));
+        cv_.notify_all();
+    }
+
+    BenchFrame PopEncode() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !encode_.empty() && send_.size() < BENCH_SEND_LIMIT; });
+        BenchFrame frame = encode_.front();
+        encode_.pop_front();
+        cv_.notify_all();
+        return frame;
+    }
+
+    void PushSend(BenchFrame&& frame) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        send_.push_back(std::move(frame));
+        cv_.notify_all();
+    }
+
+    BenchFrame PopSend() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return !send_.empty(); });
+        BenchFrame frame = send_.front();
+        send_.pop_front();
+        cv_.notify_all();
+        return frame;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<BenchFrame> encode_;
+    std::deque<BenchFrame> send_;
+};
+
+class SpscPipeline {
+public:
+    SpscPipeline() {
+        encode_.Bind(event_group_, ENCODE_READABLE_BIT, ENCODE_WRITABLE_BIT);
+        encode_.SetLimit(BENCH_ENCODE_LIMIT);
+        send_.Bind(event_group_, SEND_READABLE_BIT, SEND_WRITABLE_BIT);
+        send_.SetLimit(BENCH_SEND_LIMIT);
+    }
+
+    ~SpscPipeline() {
+        vEventGroupDelete(event_group_);
+    }
+
+    void PushEncode(BenchFrame&& frame) {
+        while (!encode_.Push(std::move(frame))) {
+            xEventGroupWaitBits(event_group_, ENCODE_WRITABLE_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+    }
+
+    BenchFrame PopEncode() {
+        BenchFrame frame;
+        while (send_.full() || !encode_.Pop(frame)) {
+            xEventGroupWaitBits(event_group_, ENCODE_READABLE_BIT | SEND_WRITABLE_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+        return frame;
+    }
+
+    void PushSend(BenchFrame&& frame) {
+        send_.Push(std::move(frame));
+    }
+
+    BenchFrame PopSend() {
+        BenchFrame frame;
+        while (!send_.Pop(frame)) {
+            xEventGroupWaitBits(event_group_, SEND_READABLE_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        }
+        return frame;
+    }
+
+private:
+    static constexpr EventBits_t ENCODE_READABLE_BIT = 1 << 0;
+    static constexpr EventBits_t ENCODE_WRITABLE_BIT = 1 << 1;
+    static constexpr EventBits_t SEND_READABLE_BIT = 1 << 2;
+    static constexpr EventBits_t SEND_WRITABLE_BIT = 1 << 3;
+    EventGroupHandle_t event_group_ = xEventGroupCreate();
+    SpscQueue<BenchFrame, 4> encode_;
+    SpscQueue<BenchFrame, 64> send_;
+};
+
+struct BenchResult {
+    double frames_per_second;
+    double p99_hop_us;
+    uint32_t out_of_order;
+};
+
+// Unpaced when period_ns is 0, otherwise the input task pushes a frame every period_ns
+template <typename Pipeline>
+static BenchResult RunPipeline(uint32_t frames, int64_t period_ns) {
+    Pipeline pipeline;
+    std::vector<int64_t> encode_hops(frames);
+    std::vector<int64_t> send_hops(frames);
+    uint32_t out_of_order = 0;
+
+    int64_t start = NowNs();
+    std::thread codec([&]() {
+        for (uint32_t i = 0; i < frames; i++) {
+            BenchFrame frame = pipeline.PopEncode();
+            int64_t now = NowNs();
+            encode_hops[i] = now - frame.push_ns;
+            frame.push_ns = now;
+            pipeline.PushSend(std::move(frame));
+        }
+    });
+    std::thread sender([&]() {
+        for (uint32_t i = 0; i < frames; i++) {
+            BenchFrame frame = pipeline.PopSend();
+            send_hops[i] = NowNs() - frame.push_ns;
+            if (frame.sequence != i) {
+                out_of_order++;
+            }
+        }
+    });
+    for (uint32_t i = 0; i < frames; i++) {
+        if (period_ns > 0) {
+            while (NowNs() < start + (int64_t)i * period_ns) {
+            }
+        }
+        pipeline.PushEncode(BenchFrame{i, NowNs()});
+    }
+    codec.join();
+    sender.join();
+    double seconds = (NowNs() - start) / 1e9;
+
+    std::vector<int64_t> hops = encode_hops;
+    hops.insert(hops.end(), send_hops.begin(), send_hops.end());
+    auto p99 = hops.begin() + hops.size() * 99 / 100;
+    std::nth_element(hops.begin(), p99, hops.end());
+    return BenchResult{frames / seconds, *p99 / 1000.0, out_of_order};
+}
+
+TEST(SpscQueueBenchmark, AgainstDequeAndConditionVariable) {
+    const uint32_t frames = 200000;
+    // A frame every 50 us, much faster than the device but slow enough that the queues stay short
+    const uint32_t paced_frames = 20000;
+    const int64_t period_ns = 50000;
+
+    auto locked = RunPipeline<LockedPipeline>(frames, 0);
+    auto spsc = RunPipeline<SpscPipeline>(frames, 0);
+    auto locked_paced = RunPipeline<LockedPipeline>(paced_frames, period_ns);
+    auto spsc_paced = RunPipeline<SpscPipeline>(paced_frames, period_ns);
+
+    printf("  deque + condvar: %8.0f frames/s, p99 hop %6.1f us (paced)\n", locked.frames_per_second,
+        locked_paced.p99_hop_us);
+    printf("  SPSC rings:      %8.0f frames/s, p99 hop %6.1f us (paced)\n", spsc.frames_per_second,
+        spsc_paced.p99_hop_us);
+    printf("  (host event groups run on a mutex and a condition variable, FreeRTOS ones do not)\n");
+
+    EXPECT_EQ(locked.out_of_order + locked_paced.out_of_order, 0u);
+    EXPECT_EQ(spsc.out_of_order + spsc_paced.out_of_order, 0u);
+}
@@ -0,0 +1,2 @@
+// Host build: the audio sources include the board header but use nothing from it
+#pragma once
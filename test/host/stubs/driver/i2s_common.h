@@ -0,0 +1,7 @@
+// Host build: no I2S peripheral, AudioCodec only enables the channels it has
+#pragma once
+
+#include "i2s_std.h"
+
+inline esp_err_t i2s_channel_enable(i2s_chan_handle_t handle) { return ESP_OK; }
+inline esp_err_t i2s_channel_disable(i2s_chan_handle_t handle) { return ESP_OK; }
@@ -0,0 +1,6 @@
+// Host build: no I2S peripheral, codecs that read and write files leave the channels null
+#pragma once
+
+#include <esp_err.h>
+
+typedef struct i2s_channel_obj_t* i2s_chan_handle_t;
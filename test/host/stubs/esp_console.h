@@ -0,0 +1,19 @@
+// Host build: there is no console, registering a command does nothing
+#pragma once
+
+#include <esp_err.h>
+
+typedef int (*esp_console_cmd_func_t)(int argc, char** argv);
+typedef int (*esp_console_cmd_func_with_context_t)(void* context, int argc, char** argv);
+
+typedef struct {
+    const char* command;
+    const char* help;
+    const char* hint;
+    esp_console_cmd_func_t func;
+    void* argtable;
+    esp_console_cmd_func_with_context_t func_w_context;
+    void* context;
+} esp_console_cmd_t;
+
+inline esp_err_t esp_console_cmd_register(const esp_console_cmd_t* cmd) { return ESP_OK; }
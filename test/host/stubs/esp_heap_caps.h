@@ -0,0 +1,12 @@
+// Host build: every capability is plain heap
+#pragma once
+
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t size, int caps) { return malloc(size); }
+inline void* heap_caps_realloc(void* ptr, size_t size, int caps) { return realloc(ptr, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
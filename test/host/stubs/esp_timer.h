@@ -0,0 +1,33 @@
+// Host build: esp_timer_get_time() follows the steady clock unless a test sets the time. Timers
+// can be created and started but never fire, the tests drive the code they would call
+#pragma once
+
+#include <cstdint>
+#include <esp_err.h>
+
+int64_t esp_timer_get_time();
+
+// Freezes esp_timer_get_time() at time_us, a negative value returns to the steady clock
+void host_set_time_us(int64_t time_us);
+
+typedef void (*esp_timer_cb_t)(void* arg);
+typedef struct HostTimer* esp_timer_handle_t;
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
@@ -0,0 +1,32 @@
+// Host build: tasks are threads, a tick is a millisecond
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct HostTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef uint8_t StackType_t;
+typedef struct {
+    uint8_t unused;
+} StaticTask_t;
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+void vTaskDelay(TickType_t ticks);
+// The stack, the priority and the core are ignored, the task runs on a thread of its own
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id);
+// The stack and the priority are ignored, the task runs on a thread of its own
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buffer);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+// Only a task suspending itself is supported, it sleeps until it is deleted
+void vTaskSuspend(TaskHandle_t task);
+// Deleting another task waits for its thread to return. A task deleting itself returns from
+// vTaskDelete and its thread ends with the task function
+void vTaskDelete(TaskHandle_t task);
+
+// Waits for the threads of the tasks that deleted themselves, or will, e.g. after a service stopped
+void host_join_tasks();
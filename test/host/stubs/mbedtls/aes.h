@@ -0,0 +1,17 @@
+// Host build: the AES-128 encryption and CTR mode part of the mbedtls API, implemented by
+// support/host_aes.cc when the system has no mbedtls to link against
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+typedef struct mbedtls_aes_context {
+    uint32_t round_keys[44];
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+// Only 128 bit keys
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+    unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
@@ -0,0 +1,14 @@
+// Host build: only the options read by the sources under test
+#pragma once
+
+// Kconfig defaults of a target without PSRAM
+#define CONFIG_OPUS_FRAME_DURATION_60 1
+#define CONFIG_OPUS_ENCODER_TASK_CORE -1
+#define CONFIG_OPUS_ENCODER_TASK_PRIORITY 2
+#define CONFIG_OPUS_DECODER_TASK_CORE -1
+#define CONFIG_OPUS_DECODER_TASK_PRIORITY 2
+#define CONFIG_SOUND_PCM_CACHE_SIZE 0
+#define CONFIG_AUDIO_PRE_ROLL_DURATION 500
+#define CONFIG_AUDIO_UPLINK_BITRATE_MIN 12000
+#define CONFIG_AUDIO_UPLINK_BITRATE_MAX 32000
+#define CONFIG_AUDIO_UPLINK_COMPLEXITY_MAX 1
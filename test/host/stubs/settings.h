@@ -0,0 +1,17 @@
+// Host build: nothing is stored, every read returns the default
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+class Settings {
+public:
+    Settings(const std::string& ns, bool read_write = false) {}
+
+    std::string GetString(const std::string& key, const std::string& default_value = "") { return default_value; }
+    void SetString(const std::string& key, const std::string& value) {}
+    int32_t GetInt(const std::string& key, int32_t default_value = 0) { return default_value; }
+    void SetInt(const std::string& key, int32_t value) {}
+    bool GetBool(const std::string& key, bool default_value = false) { return default_value; }
+    void SetBool(const std::string& key, bool value) {}
+};
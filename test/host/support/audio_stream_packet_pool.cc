@@ -0,0 +1,25 @@
+// The firmware pool lives in protocol.cc, which needs the whole application; this one recycles the same way
+#include "protocol.h"
+
+#define HOST_PACKET_POOL_SIZE 64
+#define HOST_PACKET_PAYLOAD_CAPACITY 1500
+
+static FramePool<AudioStreamPacket>& GetAudioStreamPacketPool() {
+    static FramePool<AudioStreamPacket> pool(HOST_PACKET_POOL_SIZE,
+        [](AudioStreamPacket& packet) {
+            packet.buffer.reserve(AUDIO_STREAM_PACKET_HEADROOM + HOST_PACKET_PAYLOAD_CAPACITY);
+            packet.buffer.resize(AUDIO_STREAM_PACKET_HEADROOM);
+        },
+        [](AudioStreamPacket& packet) {
+            packet.Reset();
+        });
+    return pool;
+}
+
+AudioStreamPacketPtr CreateAudioStreamPacket() {
+    return GetAudioStreamPacketPool().Acquire();
+}
+
+FramePoolStats GetAudioStreamPacketPoolStats() {
+    return GetAudioStreamPacketPool().GetStats();
+}
@@ -0,0 +1,45 @@
+#include <esp_timer.h>
+
+#include <atomic>
+#include <chrono>
+
+static std::atomic<int64_t> fixed_time_us = -1;
+
+int64_t esp_timer_get_time() {
+    int64_t time_us = fixed_time_us;
+    if (time_us >= 0) {
+        return time_us;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void host_set_time_us(int64_t time_us) {
+    fixed_time_us = time_us;
+}
+
+struct HostTimer {
+    esp_timer_create_args_t args;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+    *out_handle = new HostTimer{*args};
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    delete timer;
+    return ESP_OK;
+}
@@ -0,0 +1,151 @@
+#include <freertos/event_groups.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct HostEventGroup {
+    std::mutex mutex;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+EventGroupHandle_t xEventGroupCreate() {
+    return new HostEventGroup();
+}
+
+void vEventGroupDelete(EventGroupHandle_t event_group) {
+    delete event_group;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t event_group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(event_group->mutex);
+    event_group->bits |= bits;
+    event_group->changed.notify_all();
+    return event_group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t event_group, EventBits_t bits) {
+    std::lock_guard<std::mutex> lock(event_group->mutex);
+    EventBits_t previous = event_group->bits;
+    event_group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t event_group) {
+    std::lock_guard<std::mutex> lock(event_group->mutex);
+    return event_group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t event_group, EventBits_t bits, BaseType_t clear_on_exit,
+    BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    std::unique_lock<std::mutex> lock(event_group->mutex);
+    auto satisfied = [&]() {
+        EventBits_t set = event_group->bits & bits;
+        return wait_for_all ? set == bits : set != 0;
+    };
+    if (ticks_to_wait == portMAX_DELAY) {
+        event_group->changed.wait(lock, satisfied);
+    } else {
+        event_group->changed.wait_for(lock, std::chrono::milliseconds(ticks_to_wait), satisfied);
+    }
+    EventBits_t result = event_group->bits;
+    if (clear_on_exit && satisfied()) {
+        event_group->bits &= ~bits;
+    }
+    return result;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+struct HostTask {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable changed;
+    bool deleted = false;
+};
+
+static thread_local HostTask* current_task = nullptr;
+
+// Tasks not deleted by another task yet, host_join_tasks() waits for them
+static std::mutex tasks_mutex;
+static std::vector<HostTask*> tasks;
+
+static HostTask* StartTask(TaskFunction_t function, void* arg) {
+    auto task = new HostTask();
+    std::lock_guard<std::mutex> lock(tasks_mutex);
+    task->thread = std::thread([task, function, arg]() {
+        current_task = task;
+        function(arg);
+    });
+    tasks.push_back(task);
+    return task;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buffer) {
+    return StartTask(function, arg);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* created_task) {
+    auto task = StartTask(function, arg);
+    if (created_task != nullptr) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_size, void* arg,
+    UBaseType_t priority, TaskHandle_t* created_task, BaseType_t core_id) {
+    return xTaskCreate(function, name, stack_size, arg, priority, created_task);
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    if (task == nullptr) {
+        task = current_task;
+    }
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->changed.wait(lock, [task]() { return task->deleted; });
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task == nullptr || task == current_task) {
+        // The thread ends when the task function returns, host_join_tasks() joins it
+        std::lock_guard<std::mutex> lock(current_task->mutex);
+        current_task->deleted = true;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        tasks.erase(std::find(tasks.begin(), tasks.end(), task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->deleted = true;
+        task->changed.notify_all();
+    }
+    task->thread.join();
+    delete task;
+}
+
+void host_join_tasks() {
+    std::vector<HostTask*> joined;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex);
+        joined.swap(tasks);
+    }
+    for (auto task : joined) {
+        task->thread.join();
+        delete task;
+    }
+}
@@ -0,0 +1,54 @@
+#include "host_test.h"
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+struct HostTestEntry {
+    std::string name;
+    std::function<HostTest*()> factory;
+};
+
+static std::vector<HostTestEntry>& GetTests() {
+    static std::vector<HostTestEntry> tests;
+    return tests;
+}
+
+static int failures = 0;
+
+HostTestRegistration::HostTestRegistration(const char* suite, const char* name, std::function<HostTest*()> factory) {
+    GetTests().push_back({std::string(suite) + "." + name, factory});
+}
+
+void HostTestFailure::operator=(const HostTestMessage& message) const {
+    failures++;
+    std::string text = message.str();
+    fprintf(stderr, "%s:%d: Failure: %s%s%s\n", file, line, condition.c_str(), text.empty() ? "" : ": ", text.c_str());
+}
+
+int main(int argc, char** argv) {
+    const char* filter = argc > 1 ? argv[1] : "";
+    int run = 0;
+    int failed = 0;
+    for (auto& test : GetTests()) {
+        if (test.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        printf("[ RUN      ] %s\n", test.name.c_str());
+        fflush(stdout);
+        int before = failures;
+        std::unique_ptr<HostTest> instance(test.factory());
+        instance->SetUp();
+        instance->Body();
+        instance->TearDown();
+        run++;
+        if (failures != before) {
+            failed++;
+            printf("[  FAILED  ] %s\n", test.name.c_str());
+        } else {
+            printf("[       OK ] %s\n", test.name.c_str());
+        }
+    }
+    printf("%d tests, %d failed\n", run, failed);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
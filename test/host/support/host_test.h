@@ -0,0 +1,133 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+/*
+ * Minimal test harness for the host tests, so that they build with nothing but a C++ compiler.
+ *
+ *   TEST(Suite, Name) { EXPECT_EQ(a, b) << "context"; }
+ *   TEST_F(Fixture, Name) { ... }   // Fixture derives from HostTest, SetUp() / TearDown() optional
+ *
+ * EXPECT_* records a failure and goes on, ASSERT_* also returns from the test. The test binary
+ * runs every test whose "Suite.Name" contains the first argument, and fails if any check failed.
+ */
+
+#include <cmath>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+class HostTest {
+public:
+    virtual ~HostTest() = default;
+    virtual void SetUp() {}
+    virtual void TearDown() {}
+    virtual void Body() = 0;
+};
+
+struct HostTestRegistration {
+    HostTestRegistration(const char* suite, const char* name, std::function<HostTest*()> factory);
+};
+
+class HostTestMessage {
+public:
+    template <typename T>
+    HostTestMessage& operator<<(const T& value) {
+        stream_ << value;
+        return *this;
+    }
+    std::string str() const { return stream_.str(); }
+
+private:
+    std::ostringstream stream_;
+};
+
+struct HostTestFailure {
+    const char* file;
+    int line;
+    std::string condition;
+    // Reports the failure, with the streamed message appended
+    void operator=(const HostTestMessage& message) const;
+};
+
+template <typename T>
+std::string HostTestFormat(const T& value) {
+    if constexpr (requires(std::ostream& stream) { stream << value; }) {
+        std::ostringstream stream;
+        if constexpr (sizeof(T) == 1 && std::is_integral_v<T>) {
+            stream << int(value);
+        } else {
+            stream << value;
+        }
+        return stream.str();
+    } else {
+        return "(value)";
+    }
+}
+
+// Empty if the check passed, else the description of the failure
+template <typename A, typename B, typename Compare>
+std::string HostTestCompare(const A& a, const B& b, Compare compare, const char* a_text, const char* b_text, const char* op) {
+    if (compare(a, b)) {
+        return std::string();
+    }
+    return std::string(a_text) + " " + op + " " + b_text + " (" + HostTestFormat(a) + " vs " + HostTestFormat(b) + ")";
+}
+
+#define HOST_TEST_CLASS(suite, name) suite##_##name##_Test
+
+#define HOST_TEST_DEFINE(suite, name, base) \
+    class HOST_TEST_CLASS(suite, name) : public base { \
+    public: \
+        void Body() override; \
+    }; \
+    static HostTestRegistration suite##_##name##_registration(#suite, #name, \
+        []() -> HostTest* { return new HOST_TEST_CLASS(suite, name)(); }); \
+    void HOST_TEST_CLASS(suite, name)::Body()
+
+#define TEST(suite, name) HOST_TEST_DEFINE(suite, name, HostTest)
+#define TEST_F(fixture, name) HOST_TEST_DEFINE(fixture, name, fixture)
+
+#define HOST_TEST_FAIL(text) HostTestFailure{__FILE__, __LINE__, text} = HostTestMessage()
+
+#define HOST_TEST_CHECK(condition, text, on_failure) \
+    if (std::string host_test_failure_ = (condition) ? std::string() : std::string(text); host_test_failure_.empty()) \
+        ; \
+    else on_failure HOST_TEST_FAIL(host_test_failure_)
+
+#define HOST_TEST_BINARY(a, b, op, on_failure) \
+    if (std::string host_test_failure_ = HostTestCompare((a), (b), \
+            [](const auto& x, const auto& y) { return x op y; }, #a, #b, #op); \
+        host_test_failure_.empty()) \
+        ; \
+    else on_failure HOST_TEST_FAIL(host_test_failure_)
+
+#define HOST_TEST_NEAR(a, b, tolerance, on_failure) \
+    if (std::string host_test_failure_ = HostTestCompare((a), (b), \
+            [&](const auto& x, const auto& y) { return std::fabs(double(x) - double(y)) <= (tolerance); }, \
+            #a, #b, "within " #tolerance " of"); \
+        host_test_failure_.empty()) \
+        ; \
+    else on_failure HOST_TEST_FAIL(host_test_failure_)
+
+#define EXPECT_TRUE(condition) HOST_TEST_CHECK(condition, #condition, )
+#define EXPECT_FALSE(condition) HOST_TEST_CHECK(!(condition), "!(" #condition ")", )
+#define EXPECT_EQ(a, b) HOST_TEST_BINARY(a, b, ==, )
+#define EXPECT_NE(a, b) HOST_TEST_BINARY(a, b, !=, )
+#define EXPECT_LT(a, b) HOST_TEST_BINARY(a, b, <, )
+#define EXPECT_LE(a, b) HOST_TEST_BINARY(a, b, <=, )
+#define EXPECT_GT(a, b) HOST_TEST_BINARY(a, b, >, )
+#define EXPECT_GE(a, b) HOST_TEST_BINARY(a, b, >=, )
+#define EXPECT_NEAR(a, b, tolerance) HOST_TEST_NEAR(a, b, tolerance, )
+
+#define ASSERT_TRUE(condition) HOST_TEST_CHECK(condition, #condition, return)
+#define ASSERT_FALSE(condition) HOST_TEST_CHECK(!(condition), "!(" #condition ")", return)
+#define ASSERT_EQ(a, b) HOST_TEST_BINARY(a, b, ==, return)
+#define ASSERT_NE(a, b) HOST_TEST_BINARY(a, b, !=, return)
+#define ASSERT_LT(a, b) HOST_TEST_BINARY(a, b, <, return)
+#define ASSERT_LE(a, b) HOST_TEST_BINARY(a, b, <=, return)
+#define ASSERT_GT(a, b) HOST_TEST_BINARY(a, b, >, return)
+#define ASSERT_GE(a, b) HOST_TEST_BINARY(a, b, >=, return)
+#define ASSERT_NEAR(a, b, tolerance) HOST_TEST_NEAR(a, b, tolerance, return)
+
+#endif // HOST_TEST_H
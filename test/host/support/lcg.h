@@ -0,0 +1,24 @@
+#ifndef LCG_H
+#define LCG_H
+
+#include <cstdint>
+
+/*
+ * Small deterministic generator for the simulations in the host tests. The printed figures only
+ * depend on the seed, not on the standard library the tests are built with.
+ */
+class Lcg {
+public:
+    explicit Lcg(uint32_t seed) : state_(seed) {}
+
+    // Uniform in [min, max]
+    int Uniform(int min, int max) {
+        state_ = state_ * 1664525u + 1013904223u;
+        return min + int((state_ >> 8) % uint32_t(max - min + 1));
+    }
+
+private:
+    uint32_t state_;
+};
+
+#endif // LCG_H
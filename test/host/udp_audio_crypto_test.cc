@@ -0,0 +1,240 @@
+#include "udp_audio_crypto.h"
+
+#include "host_test.h"
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every heap allocation of the test binary goes through here, not inlined so that GCC does not
+// take the free() of the replaced operators for a mismatched delete
+static std::atomic<size_t> allocations = 0;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+static std::string FromHex(const char* hex) {
+    std::string bytes;
+    for (size_t i = 0; hex[i] != '\0' && hex[i + 1] != '\0'; i += 2) {
+        bytes.push_back((char)std::strtol(std::string(hex + i, 2).c_str(), nullptr, 16));
+    }
+    return bytes;
+}
+
+// The SP 800-38A key, and a hello nonce of type 1 with the ssrc 0x11223344
+static const std::string kKey = FromHex("2b7e151628aed2a6abf7158809cf4f3c");
+static const std::string kNonce = FromHex("01000000112233440000000000000000");
+
+static AudioStreamPacket MakePacket(size_t size, uint32_t timestamp) {
+    AudioStreamPacket packet;
+    packet.timestamp = timestamp;
+    auto payload = packet.ResizePayload(size);
+    for (size_t i = 0; i < size; i++) {
+        payload[i] = (uint8_t)i;
+    }
+    return packet;
+}
+
+// MqttProtocol::SendAudio before UdpAudioCrypto, kept to check that the datagrams did not change
+class LegacySealer {
+public:
+    LegacySealer(const std::string& key, const std::string& nonce) : aes_nonce_(nonce) {
+        mbedtls_aes_init(&aes_ctx_);
+        mbedtls_aes_setkey_enc(&aes_ctx_, (const unsigned char*)key.c_str(), 128);
+    }
+    ~LegacySealer() {
+        mbedtls_aes_free(&aes_ctx_);
+    }
+
+    std::string Seal(const AudioStreamPacket& packet, uint32_t sequence) {
+        std::string nonce(aes_nonce_);
+        *(uint16_t*)&nonce[2] = htons(packet.payload_size());
+        *(uint32_t*)&nonce[8] = htonl(packet.timestamp);
+        *(uint32_t*)&nonce[12] = htonl(sequence);
+
+        std::string encrypted;
+        encrypted.resize(aes_nonce_.size() + packet.payload_size());
+        memcpy(encrypted.data(), nonce.data(), nonce.size());
+
+        size_t nc_off = 0;
+        uint8_t stream_block[16] = {0};
+        mbedtls_aes_crypt_ctr(&aes_ctx_, packet.payload_size(), &nc_off, (uint8_t*)nonce.c_str(), stream_block,
+            packet.payload_data(), (uint8_t*)&encrypted[nonce.size()]);
+        return encrypted;
+    }
+
+private:
+    mbedtls_aes_context aes_ctx_;
+    std::string aes_nonce_;
+};
+
+class UdpAudioCryptoTest : public HostTest {
+protected:
+    UdpAudioCrypto crypto_;
+
+    void SetUp() override {
+        ASSERT_TRUE(crypto_.SetKey(kKey, kNonce));
+    }
+};
+
+TEST(UdpAudioCrypto, AesCtrKnownAnswer) {
+    // SP 800-38A F.5.1, the first block of CTR-AES128.Encrypt
+    mbedtls_aes_context ctx;
+    mbedtls_aes_init(&ctx);
+    ASSERT_EQ(mbedtls_aes_setkey_enc(&ctx, (const unsigned char*)kKey.data(), 128), 0);
+    auto counter = FromHex("f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff");
+    auto plaintext = FromHex("6bc1bee22e409f96e93d7e117393172a");
+    std::string ciphertext(16, '\0');
+    size_t nc_off = 0;
+    uint8_t stream_block[16];
+    ASSERT_EQ(mbedtls_aes_crypt_ctr(&ctx, 16, &nc_off, (uint8_t*)counter.data(), stream_block,
+        (const uint8_t*)plaintext.data(), (uint8_t*)ciphertext.data()), 0);
+    EXPECT_TRUE(ciphertext == FromHex("874d6191b620e3261bef6864990db6ce"));
+    mbedtls_aes_free(&ctx);
+}
+
+TEST_F(UdpAudioCryptoTest, SealsTheKnownDatagram) {
+    // Computed with openssl enc -aes-128-ctr, the header is the counter block
+    struct Vector {
+        uint32_t sequence;
+        const char* datagram;
+    } vectors[] = {
+        {7, "01000020112233440102030400000007"
+            "709c0d027db18cc02d817c6d9ef0d920848341329ff538e0fb09229646167570"},
+        // The counter of the second block carries into the timestamp
+        {0xffffffff, "010000201122334401020304ffffffff"
+            "a26a52853075f4eb6132b0839ccbdd0dab9542f3d21974426b560ebfd73c7763"},
+    };
+    auto packet = MakePacket(32, 0x01020304);
+    for (auto& vector : vectors) {
+        auto datagram = crypto_.Seal(packet, vector.sequence);
+        ASSERT_TRUE(datagram != nullptr);
+        EXPECT_TRUE(*datagram == FromHex(vector.datagram)) << "sequence " << vector.sequence;
+    }
+}
+
+TEST_F(UdpAudioCryptoTest, MatchesTheLegacyPath) {
+    LegacySealer legacy(kKey, kNonce);
+    for (size_t size : {0, 1, 15, 16, 17, 120, 333, 1400}) {
+        auto packet = MakePacket(size, 1000 + size);
+        for (uint32_t sequence : {1u, 2u, 255u, 65536u, 0xfffffffeu}) {
+            auto datagram = crypto_.Seal(packet, sequence);
+            ASSERT_TRUE(datagram != nullptr);
+            EXPECT_TRUE(*datagram == legacy.Seal(packet, sequence)) << size << " bytes, sequence " << sequence;
+        }
+    }
+}
+
+TEST_F(UdpAudioCryptoTest, SealThenOpen) {
+    // The server seals with the same key and nonce, the device opens into a recycled packet
+    AudioStreamPacket received;
+    for (size_t size : {1, 16, 17, 120, 1400, 60}) {
+        auto packet = MakePacket(size, 48000 + size);
+        auto datagram = crypto_.Seal(packet, size);
+        ASSERT_TRUE(datagram != nullptr);
+        EXPECT_EQ(datagram->size(), UDP_AUDIO_NONCE_SIZE + size);
+        EXPECT_NE(memcmp(datagram->data() + UDP_AUDIO_NONCE_SIZE, packet.payload_data(), size), 0) << size << " bytes";
+
+        std::string copy = *datagram;
+        ASSERT_TRUE(crypto_.Open(copy, received));
+        EXPECT_EQ(received.timestamp, packet.timestamp);
+        EXPECT_EQ(received.sequence, size);
+        ASSERT_EQ(received.payload_size(), size);
+        EXPECT_EQ(memcmp(received.payload_data(), packet.payload_data(), size), 0);
+        EXPECT_TRUE(copy == *datagram) << "the received datagram is left as it is";
+    }
+
+    // A new hello rekeys the same object
+    UdpAudioCrypto other;
+    ASSERT_TRUE(other.SetKey(FromHex("000102030405060708090a0b0c0d0e0f"), kNonce));
+    auto packet = MakePacket(120, 1);
+    std::string datagram = *other.Seal(packet, 1);
+    ASSERT_TRUE(crypto_.Open(datagram, received));
+    EXPECT_NE(memcmp(received.payload_data(), packet.payload_data(), 120), 0) << "wrong key";
+    ASSERT_TRUE(crypto_.SetKey(FromHex("000102030405060708090a0b0c0d0e0f"), kNonce));
+    ASSERT_TRUE(crypto_.Open(datagram, received));
+    EXPECT_EQ(memcmp(received.payload_data(), packet.payload_data(), 120), 0);
+}
+
+TEST_F(UdpAudioCryptoTest, RejectsShortAndMalformedDatagrams) {
+    EXPECT_FALSE(crypto_.SetKey(kKey.substr(0, 15), kNonce));
+    EXPECT_FALSE(crypto_.SetKey(kKey, kNonce.substr(0, 8)));
+
+    auto packet = MakePacket(120, 1);
+    const std::string datagram = *crypto_.Seal(packet, 1);
+    AudioStreamPacket received;
+
+    EXPECT_FALSE(crypto_.Open(std::string(), received));
+    EXPECT_FALSE(crypto_.Open(datagram.substr(0, UDP_AUDIO_NONCE_SIZE - 1), received)) << "header cut short";
+    EXPECT_FALSE(crypto_.Open(datagram.substr(0, datagram.size() - 1), received)) << "payload cut short";
+    EXPECT_FALSE(crypto_.Open(datagram + '\0', received)) << "bytes past the payload";
+
+    std::string tampered = datagram;
+    tampered[0] = 0x02;
+    EXPECT_FALSE(crypto_.Open(tampered, received)) << "type";
+    tampered = datagram;
+    tampered[3] ^= 0x01;
+    EXPECT_FALSE(crypto_.Open(tampered, received)) << "payload_len";
+
+    // CTR mode has no integrity check: a flipped payload bit opens, with the same bit flipped
+    tampered = datagram;
+    tampered[UDP_AUDIO_NONCE_SIZE + 5] ^= 0x80;
+    ASSERT_TRUE(crypto_.Open(tampered, received));
+    EXPECT_EQ(received.payload_data()[5], packet.payload_data()[5] ^ 0x80);
+
+    // An empty payload is well formed
+    auto empty = MakePacket(0, 1);
+    ASSERT_TRUE(crypto_.Open(*crypto_.Seal(empty, 2), received));
+    EXPECT_EQ(received.payload_size(), 0u);
+}
+
+TEST_F(UdpAudioCryptoTest, Benchmark) {
+    // A 60 ms frame of 16 kHz speech
+    auto packet = MakePacket(120, 1);
+    LegacySealer legacy(kKey, kNonce);
+    const int packets = 200000;
+
+    auto run = [&](const char* name, auto&& step) {
+        size_t before = allocations;
+        size_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < packets; i++) {
+            bytes += step(i);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        double per_packet = (double)(allocations - before) / packets;
+        printf("  %s: %.2f M packets/s, %.2f allocations/packet\n", name, packets / seconds / 1e6, per_packet);
+        EXPECT_GT(bytes, 0u);
+        return per_packet;
+    };
+
+    run("legacy seal", [&](int i) { return legacy.Seal(packet, i).size(); });
+    // The first datagram sizes the buffer
+    crypto_.Seal(packet, 0);
+    EXPECT_EQ(run("seal", [&](int i) { return crypto_.Seal(packet, i)->size(); }), 0.0);
+    std::string datagram = *crypto_.Seal(packet, 1);
+    AudioStreamPacket received;
+    crypto_.Open(datagram, received);
+    EXPECT_EQ(run("open", [&](int) { return crypto_.Open(datagram, received) ? received.payload_size() : 0; }), 0.0);
+}
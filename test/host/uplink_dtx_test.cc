@@ -0,0 +1,139 @@
+#include "uplink_dtx.h"
+
+#include "host_test.h"
+#include "lcg.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#define FRAME_MS 60
+#define SPEECH_BYTES 120
+#define SILENCE_BYTES 12
+
+TEST(UplinkDtx, SpeechIsAlwaysSent) {
+    UplinkDtx dtx;
+    for (int i = 0; i < 100; i++) {
+        ASSERT_TRUE(dtx.OnFrame(false, FRAME_MS, SPEECH_BYTES));
+    }
+    auto stats = dtx.GetStats();
+    EXPECT_EQ(stats.sent_frames, 100u);
+    EXPECT_EQ(stats.suppressed_frames, 0u);
+    EXPECT_EQ(stats.sent_bytes, 100u * SPEECH_BYTES);
+}
+
+TEST(UplinkDtx, HangoverThenKeepalive) {
+    UplinkDtx dtx;
+    dtx.OnFrame(false, FRAME_MS, SPEECH_BYTES);
+    std::vector<int> sent_at;
+    for (int ms = FRAME_MS; ms <= 2400; ms += FRAME_MS) {
+        if (dtx.OnFrame(true, FRAME_MS, SILENCE_BYTES)) {
+            sent_at.push_back(ms);
+        }
+    }
+    // 200 ms of hangover at 60 ms frames, then one frame per 400 ms of unsent audio
+    std::vector<int> expected = {60, 120, 180, 600, 1020, 1440, 1860, 2280};
+    EXPECT_TRUE(sent_at == expected);
+
+    // The first speech frame after the silence goes out at once
+    EXPECT_TRUE(dtx.OnFrame(false, FRAME_MS, SPEECH_BYTES));
+    EXPECT_TRUE(dtx.OnFrame(true, FRAME_MS, SILENCE_BYTES)) << "a new hangover";
+}
+
+TEST(UplinkDtx, OpusDtxFramesSkipTheHangover) {
+    UplinkDtx dtx;
+    dtx.OnFrame(false, FRAME_MS, SPEECH_BYTES);
+    EXPECT_FALSE(dtx.OnFrame(false, FRAME_MS, 1)) << "the encoder asked not to send it";
+    EXPECT_TRUE(dtx.OnFrame(true, FRAME_MS, SILENCE_BYTES)) << "still within the hangover";
+    int sent = 0;
+    for (int i = 0; i < 20; i++) {
+        sent += dtx.OnFrame(false, FRAME_MS, UPLINK_DTX_OPUS_MAX_DTX_BYTES);
+    }
+    EXPECT_EQ(sent, 2) << "keepalives only, one per 7 frames";
+
+    auto stats = dtx.GetStats();
+    EXPECT_EQ(stats.saved_bytes, 1u + 18u * UPLINK_DTX_OPUS_MAX_DTX_BYTES);
+    dtx.Reset();
+    EXPECT_EQ(dtx.GetStats().sent_frames, 0u);
+}
+
+// A long conversation with an imperfect VAD, the figures quoted when the defaults were chosen
+TEST(UplinkDtx, SyntheticConversation) {
+    UplinkDtx dtx;
+    Lcg random(20240611);
+    int speech_frames = 0;          // frames that carry speech
+    int gap_frames = 0;             // silence between the words of an utterance
+    int pause_frames = 0;           // silence between utterances
+    int cut_frames = 0;             // speech frames that were not sent
+    int dropped_gap_frames = 0;
+    int suppressed_pause_frames = 0;
+    int resume_delay_frames = 0;    // speech frames the VAD caught but were not sent after a suppressed run
+    int longest_unsent_ms = 0;
+    int unsent_ms = 0;
+
+    enum Truth { kSpeech, kGap, kPause };
+    auto frame = [&](bool vad_speech, Truth truth) {
+        bool sent = dtx.OnFrame(!vad_speech, FRAME_MS, vad_speech ? SPEECH_BYTES : SILENCE_BYTES);
+        if (truth == kSpeech) {
+            speech_frames++;
+            cut_frames += !sent;
+        } else if (truth == kGap) {
+            gap_frames++;
+            dropped_gap_frames += !sent;
+        } else {
+            pause_frames++;
+            suppressed_pause_frames += !sent;
+        }
+        if (vad_speech && !sent) {
+            resume_delay_frames++;
+        }
+        unsent_ms = sent ? 0 : unsent_ms + FRAME_MS;
+        longest_unsent_ms = std::max(longest_unsent_ms, unsent_ms);
+    };
+
+    for (int utterance = 0; utterance < 500; utterance++) {
+        // Pause between turns, with the odd single frame VAD trigger on noise
+        int pause = random.Uniform(300, 4000) / FRAME_MS;
+        for (int i = 0; i < pause; i++) {
+            frame(random.Uniform(0, 99) < 3, kPause);
+        }
+        // Words separated by short gaps; the VAD misses runs of 1-3 speech frames (soft onsets,
+        // unvoiced consonants) about once every 12 frames
+        int words = random.Uniform(2, 15);
+        for (int word = 0; word < words; word++) {
+            int length = random.Uniform(3, 10);
+            for (int i = 0; i < length; i++) {
+                if (random.Uniform(0, 35) == 0) {
+                    int miss = random.Uniform(1, 3);
+                    for (int j = 0; j < miss && i < length; j++, i++) {
+                        frame(false, kSpeech);
+                    }
+                    if (i >= length) {
+                        break;
+                    }
+                }
+                frame(true, kSpeech);
+            }
+            int gap = word + 1 < words ? random.Uniform(0, 4) : 0;
+            for (int i = 0; i < gap; i++) {
+                frame(false, kGap);
+            }
+        }
+    }
+
+    auto stats = dtx.GetStats();
+    double cut = 100.0 * cut_frames / speech_frames;
+    double gap_dropped = 100.0 * dropped_gap_frames / gap_frames;
+    double pause_suppressed = 100.0 * suppressed_pause_frames / pause_frames;
+    double saved = 100.0 * stats.saved_bytes / (stats.sent_bytes + stats.saved_bytes);
+    printf("UplinkDtx: %d speech, %d gap and %d pause frames of %d ms\n", speech_frames, gap_frames, pause_frames, FRAME_MS);
+    printf("UplinkDtx: false cuts %d speech frames (%.2f%%), resume delay %d frames, %.1f%% of word gaps dropped\n",
+        cut_frames, cut, resume_delay_frames, gap_dropped);
+    printf("UplinkDtx: %.1f%% of pause frames suppressed, %.1f%% of the payload saved, longest unsent run %d ms\n",
+        pause_suppressed, saved, longest_unsent_ms);
+
+    EXPECT_EQ(resume_delay_frames, 0);
+    EXPECT_LE(longest_unsent_ms, UPLINK_DTX_KEEPALIVE_MS);
+    EXPECT_LT(cut, 1.0);
+    EXPECT_GT(pause_suppressed, 70.0);
+}
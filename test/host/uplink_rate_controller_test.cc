@@ -0,0 +1,187 @@
+#include "uplink_rate_controller.h"
+
+#include "host_test.h"
+
+#include <vector>
+
+#define FRAME_MS 60
+#define QUEUE_LIMIT 40
+// Encode time per frame for a share of the core
+#define ENCODE_US(percent) (FRAME_MS * 10 * (percent))
+
+class UplinkRateControllerTest : public HostTest {
+protected:
+    int64_t now_us_ = 0;
+
+    // One decision window of frames, the sends are reported before the last frame
+    bool Window(UplinkRateController& controller, int cpu_percent = 5, size_t queue_depth = 0,
+        bool send_failed = false, int64_t send_us = 5000) {
+        controller.OnSend(!send_failed, send_us);
+        bool changed = false;
+        for (int ms = 0; ms < UPLINK_RATE_WINDOW_MS; ms += FRAME_MS) {
+            now_us_ += FRAME_MS * 1000;
+            changed = controller.OnFrame(now_us_, FRAME_MS, ENCODE_US(cpu_percent), queue_depth, QUEUE_LIMIT);
+        }
+        return changed;
+    }
+};
+
+TEST_F(UplinkRateControllerTest, StartsInTheMiddle) {
+    UplinkRateController controller({.min_bitrate = 12000, .max_bitrate = 32000, .max_complexity = 3});
+    EXPECT_EQ(controller.settings().bitrate, 22000);
+    EXPECT_EQ(controller.settings().complexity, 0);
+    EXPECT_FALSE(controller.settings().dtx);
+    // Nothing is decided before a full window
+    now_us_ += FRAME_MS * 1000;
+    EXPECT_FALSE(controller.OnFrame(now_us_, FRAME_MS, ENCODE_US(5), QUEUE_LIMIT, QUEUE_LIMIT));
+    EXPECT_EQ(controller.settings().bitrate, 22000);
+}
+
+TEST_F(UplinkRateControllerTest, BacksOffOnCongestion) {
+    UplinkRateController controller({.min_bitrate = 6000, .max_bitrate = 32000});
+    ASSERT_EQ(controller.settings().bitrate, 19000);
+
+    // A quarter of the send queue limit, down by a quarter
+    EXPECT_TRUE(Window(controller, 5, QUEUE_LIMIT / 4));
+    EXPECT_EQ(controller.settings().bitrate, 14250);
+    EXPECT_TRUE(controller.settings().dtx);
+    // Half of it is severe, down by half
+    EXPECT_TRUE(Window(controller, 5, QUEUE_LIMIT / 2));
+    EXPECT_EQ(controller.settings().bitrate, 7125);
+    // Just below the threshold is a clear window
+    EXPECT_FALSE(Window(controller, 5, QUEUE_LIMIT / 4 - 1));
+    EXPECT_EQ(controller.settings().bitrate, 7125);
+}
+
+TEST_F(UplinkRateControllerTest, BacksOffOnSendFailuresAndSlowSends) {
+    UplinkRateController controller({.min_bitrate = 6000, .max_bitrate = 32000});
+
+    // A failed send is severe whatever the queue looks like
+    EXPECT_TRUE(Window(controller, 5, 0, true));
+    EXPECT_EQ(controller.settings().bitrate, 9500);
+    EXPECT_TRUE(controller.settings().dtx);
+
+    // The longest send stands in for the round trip time
+    EXPECT_TRUE(Window(controller, 5, 0, false, UPLINK_RATE_CONGESTED_SEND_MS * 1000));
+    EXPECT_EQ(controller.settings().bitrate, 7125);
+    EXPECT_FALSE(Window(controller, 5, 0, false, UPLINK_RATE_CONGESTED_SEND_MS * 1000 - 1));
+    EXPECT_EQ(controller.settings().bitrate, 7125);
+
+    // The failures of a window are not carried into the next one
+    controller.OnSend(false, 1000);
+    Window(controller);
+    EXPECT_FALSE(Window(controller));
+    EXPECT_EQ(controller.settings().bitrate, 6000) << "halved and clamped";
+}
+
+TEST_F(UplinkRateControllerTest, ProbesUpOneStepAfterClearWindows) {
+    UplinkRateController controller({.min_bitrate = 12000, .max_bitrate = 32000});
+    ASSERT_TRUE(Window(controller, 5, QUEUE_LIMIT / 2));
+    ASSERT_EQ(controller.settings().bitrate, 12000);
+    ASSERT_TRUE(controller.settings().dtx);
+
+    std::vector<int> bitrates;
+    for (int i = 0; i < 3 * UPLINK_RATE_PROBE_WINDOWS; i++) {
+        bool changed = Window(controller);
+        EXPECT_EQ(changed, (i + 1) % UPLINK_RATE_PROBE_WINDOWS == 0) << "window " << i;
+        bitrates.push_back(controller.settings().bitrate);
+    }
+    std::vector<int> expected = {12000, 12000, 14000, 14000, 14000, 16000, 16000, 16000, 18000};
+    EXPECT_TRUE(bitrates == expected);
+    EXPECT_TRUE(controller.settings().dtx) << "DTX stays on below the maximum";
+
+    // A congested window starts the count over
+    Window(controller);
+    Window(controller);
+    Window(controller, 5, QUEUE_LIMIT / 4);
+    int backed_off = controller.settings().bitrate;
+    EXPECT_EQ(backed_off, 13500);
+    Window(controller);
+    Window(controller);
+    EXPECT_EQ(controller.settings().bitrate, backed_off);
+    Window(controller);
+    EXPECT_EQ(controller.settings().bitrate, backed_off + UPLINK_RATE_PROBE_STEP);
+}
+
+TEST_F(UplinkRateControllerTest, ComplexityFollowsTheCpuLoad) {
+    UplinkRateController controller({.min_bitrate = 12000, .max_bitrate = 32000, .max_complexity = 3});
+
+    // Up one step after each run of idle windows
+    std::vector<int> complexities;
+    for (int i = 0; i < 3 * UPLINK_RATE_PROBE_WINDOWS; i++) {
+        Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+        complexities.push_back(controller.settings().complexity);
+    }
+    std::vector<int> expected = {0, 0, 1, 1, 1, 2, 2, 2, 3};
+    EXPECT_TRUE(complexities == expected);
+
+    // Down at once when the encoder uses too much of the core
+    EXPECT_TRUE(Window(controller, UPLINK_RATE_CPU_HIGH_PERCENT));
+    EXPECT_EQ(controller.settings().complexity, 2);
+    EXPECT_TRUE(Window(controller, UPLINK_RATE_CPU_HIGH_PERCENT));
+    EXPECT_EQ(controller.settings().complexity, 1);
+
+    // A load between the thresholds holds the complexity and restarts the idle count
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT);
+    EXPECT_EQ(controller.settings().complexity, 1);
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+    EXPECT_EQ(controller.settings().complexity, 1);
+    Window(controller, UPLINK_RATE_CPU_LOW_PERCENT - 1);
+    EXPECT_EQ(controller.settings().complexity, 2);
+}
+
+TEST_F(UplinkRateControllerTest, StaysWithinTheBoardLimits) {
+    // The Kconfig defaults: ESP32-C3/C6, ESP32, ESP32-S3, ESP32-P4, and a bound set the wrong way round
+    std::vector<UplinkRateLimits> boards = {
+        {.min_bitrate = 12000, .max_bitrate = 24000, .max_complexity = 0},
+        {.min_bitrate = 12000, .max_bitrate = 24000, .max_complexity = 1},
+        {.min_bitrate = 12000, .max_bitrate = 32000, .max_complexity = 3},
+        {.min_bitrate = 12000, .max_bitrate = 32000, .max_complexity = 5},
+        {.min_bitrate = 16000, .max_bitrate = 8000, .max_complexity = 1},
+    };
+    for (auto& limits : boards) {
+        UplinkRateController controller(limits);
+        int max_bitrate = std::max(limits.max_bitrate, limits.min_bitrate);
+        EXPECT_EQ(controller.limits().max_bitrate, max_bitrate);
+
+        // A clear link and an idle core for long enough reach the upper bounds and stop there
+        for (int i = 0; i < 50; i++) {
+            Window(controller, 1);
+            EXPECT_LE(controller.settings().bitrate, max_bitrate);
+            EXPECT_LE(controller.settings().complexity, limits.max_complexity);
+        }
+        EXPECT_EQ(controller.settings().bitrate, max_bitrate) << "max " << limits.max_bitrate;
+        EXPECT_EQ(controller.settings().complexity, limits.max_complexity);
+        EXPECT_FALSE(controller.settings().dtx);
+
+        // A failing link and a busy core reach the lower bounds
+        for (int i = 0; i < 20; i++) {
+            Window(controller, 50, QUEUE_LIMIT, true);
+            EXPECT_GE(controller.settings().bitrate, limits.min_bitrate);
+            EXPECT_GE(controller.settings().complexity, 0);
+        }
+        EXPECT_EQ(controller.settings().bitrate, limits.min_bitrate);
+        EXPECT_EQ(controller.settings().complexity, 0);
+        EXPECT_TRUE(controller.settings().dtx);
+    }
+}
+
+TEST_F(UplinkRateControllerTest, APauseStartsANewWindow) {
+    UplinkRateController controller({.min_bitrate = 6000, .max_bitrate = 32000});
+    // Half a window of a full queue before the speaker stopped
+    for (int ms = 0; ms < UPLINK_RATE_WINDOW_MS / 2; ms += FRAME_MS) {
+        now_us_ += FRAME_MS * 1000;
+        controller.OnFrame(now_us_, FRAME_MS, ENCODE_US(5), QUEUE_LIMIT, QUEUE_LIMIT);
+    }
+    controller.OnSend(false, 1000);
+    now_us_ += 5 * UPLINK_RATE_WINDOW_MS * 1000;
+    for (int ms = 0; ms < UPLINK_RATE_WINDOW_MS; ms += FRAME_MS) {
+        now_us_ += FRAME_MS * 1000;
+        EXPECT_FALSE(controller.OnFrame(now_us_, FRAME_MS, ENCODE_US(5), 0, QUEUE_LIMIT));
+    }
+    EXPECT_EQ(controller.settings().bitrate, 19000);
+    EXPECT_FALSE(controller.settings().dtx);
+}
@@ -0,0 +1,172 @@
+#include "wake_words/wake_word_encoder.h"
+
+#include "host_test.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Every heap allocation of the test binary goes through here, not inlined so that GCC does not
+// take the free() of the replaced operators for a mismatched delete
+static std::atomic<size_t> allocations = 0;
+
+__attribute__((noinline)) void* operator new(size_t size) {
+    allocations++;
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+// The samples are numbered, and the stand-in encoder writes the first and the last one of every frame
+static std::vector<int16_t> Ramp(int start, size_t count) {
+    std::vector<int16_t> pcm(count);
+    for (size_t i = 0; i < count; i++) {
+        pcm[i] = (int16_t)(start + i);
+    }
+    return pcm;
+}
+
+struct EncodedFrame {
+    int duration_ms;
+    int16_t first;
+    int16_t last;
+};
+
+static EncodedFrame Parse(const std::vector<uint8_t>& opus) {
+    return EncodedFrame{opus_packet_get_samples_per_frame(opus.data(), 16000) / 16,
+        (int16_t)(opus[1] | (opus[2] << 8)), (int16_t)(opus[3] | (opus[4] << 8))};
+}
+
+class WakeWordEncoderTest : public HostTest {
+protected:
+    WakeWordEncoder encoder_;
+    int written_ = 0;
+
+    // Stores the next samples in chunks of the given size, as the detection path does
+    void Store(size_t samples, size_t chunk = 512) {
+        while (samples > 0) {
+            size_t count = samples < chunk ? samples : chunk;
+            auto pcm = Ramp(written_, count);
+            encoder_.Store(pcm.data(), count);
+            written_ += count;
+            samples -= count;
+        }
+    }
+
+    std::vector<EncodedFrame> PopAll() {
+        std::vector<EncodedFrame> frames;
+        std::vector<uint8_t> opus;
+        while (encoder_.Pop(opus)) {
+            frames.push_back(Parse(opus));
+        }
+        return frames;
+    }
+};
+
+TEST_F(WakeWordEncoderTest, SplitsTheHistoryIntoConsecutiveFrames) {
+    ASSERT_TRUE(encoder_.Initialize(60));
+    // 1.5 s and a partial frame, in chunks that do not line up with the frames
+    Store(24000 + 500, 333);
+    encoder_.Finish(60);
+    auto frames = PopAll();
+
+    ASSERT_EQ(frames.size(), 25u) << "the partial frame at the end is dropped";
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frames[i].duration_ms, 60);
+        EXPECT_EQ(frames[i].first, (int16_t)(i * 960)) << "frame " << i;
+        EXPECT_EQ(frames[i].last, (int16_t)(i * 960 + 959)) << "frame " << i;
+    }
+}
+
+TEST_F(WakeWordEncoderTest, KeepsTheLastTwoSeconds) {
+    ASSERT_TRUE(encoder_.Initialize(60));
+    Store(16000 * 5);
+    encoder_.Finish(60);
+    auto frames = PopAll();
+
+    // 2000 ms hold 33 frames of 60 ms, the newest ones
+    ASSERT_EQ(frames.size(), 33u);
+    int16_t expected = (int16_t)((16000 * 5 / 960 - 33) * 960);
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frames[i].first, (int16_t)(expected + i * 960)) << "frame " << i;
+    }
+}
+
+TEST_F(WakeWordEncoderTest, ReencodesAtANewFrameDuration) {
+    ASSERT_TRUE(encoder_.Initialize(60));
+    Store(16000);
+    encoder_.Finish(20);
+    auto frames = PopAll();
+
+    ASSERT_EQ(frames.size(), 50u);
+    for (size_t i = 0; i < frames.size(); i++) {
+        EXPECT_EQ(frames[i].duration_ms, 20);
+        EXPECT_EQ(frames[i].first, (int16_t)(i * 320)) << "frame " << i;
+        EXPECT_EQ(frames[i].last, (int16_t)(i * 320 + 319)) << "frame " << i;
+    }
+}
+
+TEST_F(WakeWordEncoderTest, ResetDropsTheHistory) {
+    ASSERT_TRUE(encoder_.Initialize(60));
+    Store(16000);
+    encoder_.Finish(60);
+    EXPECT_EQ(PopAll().size(), 16u);
+
+    // Frozen from the detection until Reset()
+    Store(9600);
+    encoder_.Finish(60);
+    EXPECT_EQ(PopAll().size(), 0u) << "the packets were handed out already";
+
+    encoder_.Reset();
+    written_ = 0;
+    Store(9600);
+    encoder_.Finish(60);
+    auto frames = PopAll();
+    ASSERT_EQ(frames.size(), 10u);
+    EXPECT_EQ(frames[0].first, 0);
+}
+
+TEST_F(WakeWordEncoderTest, SteadyStateEncodingDoesNotAllocate) {
+    ASSERT_TRUE(encoder_.Initialize(60));
+    std::vector<int16_t> pcm(512);
+    std::vector<uint8_t> opus;
+    auto session = [&](bool paced) {
+        encoder_.Reset();
+        // 5 s, paced so that the encoder keeps up and writes a packet to every slot
+        for (int i = 0; i < 160; i++) {
+            encoder_.Store(pcm.data(), pcm.size());
+            if (paced) {
+                vTaskDelay(1);
+            }
+        }
+        encoder_.Finish(60);
+        int packets = 0;
+        while (encoder_.Pop(opus)) {
+            packets++;
+        }
+        return packets;
+    };
+
+    // The packet buffers circulate between the slots, the encoder task and the caller, each of
+    // them gets its capacity the first time a packet is encoded into it
+    EXPECT_EQ(session(true), 33);
+    EXPECT_EQ(session(true), 33);
+    for (int i = 0; i < 3; i++) {
+        size_t before = allocations;
+        int packets = session(i == 0);
+        size_t allocated = allocations - before;
+        EXPECT_EQ(packets, 33);
+        EXPECT_EQ(allocated, 0u) << "session " << i;
+    }
+}